@@ -39,7 +39,7 @@
  * or modified, or when the user-mapped driver- and endpoint-descriptors
  * are modified.
  */
-#define OMX_DRIVER_ABI_VERSION		0x20f
+#define OMX_DRIVER_ABI_VERSION		0x21e
 
 /************************
  * Common parameters or IOCTL subtypes
@@ -50,41 +50,46 @@
  */
 typedef uint32_t omx_eventq_index_t;
 
+/*
+ * The number of entries of each queue is chosen when opening the endpoint
+ * (0 means the default below), and exported in the endpoint descriptor.
+ * It must be a power of 2 so that 32bits event indexes may wrap-around,
+ * and each queue must use an integral number of pages.
+ */
+#define OMX_QUEUE_ENTRY_NR_MIN	64UL
+#define OMX_QUEUE_ENTRY_NR_MAX	16384UL /* must fit in the uint16_t sendq_index */
+
 /* sendq: where outgoing packet payload is stored */
 #ifdef OMX_SHARED_RING_ENTRY_NR
-#define OMX_SENDQ_ENTRY_NR	OMX_SHARED_RING_ENTRY_NR
+#define OMX_SENDQ_ENTRY_NR_DEFAULT	OMX_SHARED_RING_ENTRY_NR
 #else
-#define OMX_SENDQ_ENTRY_NR	1024UL
+#define OMX_SENDQ_ENTRY_NR_DEFAULT	1024UL
 #endif
 #define OMX_SENDQ_ENTRY_SHIFT	OMX_MEDIUM_FRAG_LENGTH_ROUNDUPSHIFT
 #define OMX_SENDQ_ENTRY_SIZE	(1UL << OMX_SENDQ_ENTRY_SHIFT)
-#define OMX_SENDQ_SIZE		(OMX_SENDQ_ENTRY_NR << OMX_SENDQ_ENTRY_SHIFT)
+#define OMX_SENDQ_SIZE(nr)	((unsigned long) (nr) << OMX_SENDQ_ENTRY_SHIFT)
 
-/* recvq: where received packet payload is stored */
+/* recvq: where received packet payload is stored, as many entries as in the unexpected eventq */
 #ifdef OMX_SHARED_RING_ENTRY_NR
-#define OMX_RECVQ_ENTRY_NR	OMX_SHARED_RING_ENTRY_NR
+#define OMX_RECVQ_ENTRY_NR_DEFAULT	OMX_SHARED_RING_ENTRY_NR
 #else
-#define OMX_RECVQ_ENTRY_NR	1024UL
+#define OMX_RECVQ_ENTRY_NR_DEFAULT	1024UL
 #endif
 #define OMX_RECVQ_ENTRY_SHIFT	OMX_MEDIUM_FRAG_LENGTH_ROUNDUPSHIFT
 #define OMX_RECVQ_ENTRY_SIZE	(1UL << OMX_RECVQ_ENTRY_SHIFT)
-#define OMX_RECVQ_SIZE		(OMX_RECVQ_ENTRY_NR << OMX_RECVQ_ENTRY_SHIFT)
+#define OMX_RECVQ_SIZE(nr)	((unsigned long) (nr) << OMX_RECVQ_ENTRY_SHIFT)
 
 /* expected eventq: where expected events are stored, medium send done and pull done */
 /* unexpected eventq: where unexpected events are stored, incoming packets */
 #define OMX_EVENTQ_ENTRY_SHIFT	6
 #define OMX_EVENTQ_ENTRY_SIZE	(1UL << OMX_EVENTQ_ENTRY_SHIFT)
 #ifdef OMX_SHARED_RING_ENTRY_NR
-#define OMX_EXP_EVENTQ_ENTRY_NR		OMX_SHARED_RING_ENTRY_NR
-#define OMX_UNEXP_EVENTQ_ENTRY_NR	OMX_SHARED_RING_ENTRY_NR
+#define OMX_EXP_EVENTQ_ENTRY_NR_DEFAULT		OMX_SHARED_RING_ENTRY_NR
 #else
-#define OMX_EXP_EVENTQ_ENTRY_NR		1024UL
-#define OMX_UNEXP_EVENTQ_ENTRY_NR	1024UL
+#define OMX_EXP_EVENTQ_ENTRY_NR_DEFAULT		1024UL
 #endif
-#define OMX_EXP_EVENTQ_SIZE		(OMX_EVENTQ_ENTRY_SIZE * OMX_EXP_EVENTQ_ENTRY_NR)
-#define OMX_UNEXP_EVENTQ_SIZE		(OMX_EVENTQ_ENTRY_SIZE * OMX_UNEXP_EVENTQ_ENTRY_NR)
-#define OMX_EXP_RELEASE_SLOTS_BATCH_NR		(OMX_EXP_EVENTQ_ENTRY_NR/4)
-#define OMX_UNEXP_RELEASE_SLOTS_BATCH_NR	(OMX_UNEXP_EVENTQ_ENTRY_NR/4)
+#define OMX_EVENTQ_SIZE(nr)		((unsigned long) (nr) << OMX_EVENTQ_ENTRY_SHIFT)
+#define OMX_RELEASE_SLOTS_BATCH_NR(nr)	((nr)/4)
 
 /* Event ids go from 1 to a power-of-two, 0 means unused yet.
  * This ensures that the same slot of the eventq will not use the same id
@@ -159,6 +164,18 @@ struct omx_endpoint_desc {
 	uint32_t session_id;
 	uint32_t user_event_index;
 	/* 24 */
+	uint32_t exp_eventq_released_index; /* written by the lib, read lazily by the driver when the queue looks full */
+	uint32_t unexp_eventq_released_index; /* written by the lib, read lazily by the driver when the queue looks full */
+	/* 32 */
+	uint32_t sendq_entry_nr;
+	uint32_t recvq_entry_nr;
+	/* 40 */
+	uint32_t exp_eventq_entry_nr;
+	uint32_t unexp_eventq_entry_nr;
+	/* 48 */
+	uint32_t unexp_retained_nr; /* written by the driver, packets waiting for unexpected slots */
+	uint32_t pad;
+	/* 56 */
 };
 
 #define OMX_ENDPOINT_DESC_SIZE	sizeof(struct omx_endpoint_desc)
@@ -302,10 +319,19 @@ struct omx_cmd_raw_get_event {
 struct omx_cmd_open_endpoint {
 	uint8_t board_index;
 	uint8_t endpoint_index;
-	uint8_t pad[6];
+	uint8_t numa_placement; /* OMX_ENDPOINT_NUMA_PLACEMENT_* */
+	uint8_t pad;
+	uint32_t sendq_entry_nr; /* 0 for the default */
 	/* 8 */
+	uint32_t recvq_entry_nr; /* 0 for the default, also sizes the unexpected eventq */
+	uint32_t exp_eventq_entry_nr; /* 0 for the default */
+	/* 16 */
 };
 
+/* where the driver allocates the endpoint queues and pull handles */
+#define OMX_ENDPOINT_NUMA_PLACEMENT_LOCAL	0 /* node of the process opening the endpoint */
+#define OMX_ENDPOINT_NUMA_PLACEMENT_NIC		1 /* node of the board, if known */
+
 struct omx_cmd_send_tiny {
 	struct omx_cmd_send_tiny_hdr {
 		uint16_t peer_index;
@@ -366,6 +392,29 @@ struct omx_cmd_send_mediumsq_frag {
 	/* 40 */
 };
 
+struct omx_cmd_send_mediumsq {
+	uint16_t peer_index;
+	uint8_t dest_endpoint;
+	uint8_t shared;
+	uint32_t session_id;
+	/* 8 */
+	uint16_t seqnum;
+	uint16_t piggyack;
+	uint32_t msg_length;
+	/* 16 */
+	uint16_t pad0;
+	uint8_t frags_nr;
+	uint8_t frag_pipeline;
+	uint32_t pad;
+	/* 24 */
+	uint64_t match_info;
+	/* 32 */
+	uint16_t sendq_index[OMX_MEDIUM_FRAGS_MAX]; /* frag #i is stored in sendq entry #sendq_index[i] */
+	/* 32 + 2*OMX_MEDIUM_FRAGS_MAX */
+	uint16_t frag_checksum[OMX_MEDIUM_FRAGS_MAX]; /* checksum put in the header of frag #i */
+	/* 32 + 4*OMX_MEDIUM_FRAGS_MAX */
+};
+
 struct omx_cmd_send_mediumva {
 	uint16_t peer_index;
 	uint8_t dest_endpoint;
@@ -377,13 +426,16 @@ struct omx_cmd_send_mediumva {
 	uint32_t length;
 	/* 16 */
 	uint16_t checksum;
-	uint16_t pad;
+	uint8_t zerocopy; /* attach the pinned user pages to skbs instead of copying */
+	uint8_t pad;
 	uint32_t nr_segments;
 	/* 24 */
 	uint64_t segments;
 	/* 32 */
 	uint64_t match_info;
 	/* 40 */
+	uint16_t frag_checksum[OMX_MEDIUM_FRAGS_MAX]; /* checksum put in the header of frag #i */
+	/* 40 + 2*OMX_MEDIUM_FRAGS_MAX */
 };
 
 struct omx_cmd_send_rndv {
@@ -457,6 +509,26 @@ struct omx_cmd_pull {
 	/* 32 */
 	uint64_t lib_cookie;
 	/* 40 */
+	uint32_t puller_rdma_offset; /* offset of the receive buffer in the puller region */
+	uint32_t puller_nr_segments; /* shared only, copy into puller_segments instead of the puller region if non-zero */
+	/* 48 */
+	uint64_t puller_segments;
+	/* 56 */
+};
+
+struct omx_cmd_medium_direct {
+	uint16_t peer_index;
+	uint8_t src_endpoint;
+	uint8_t detach; /* stop placing fragments in the region and release it */
+	uint16_t seqnum;
+	uint16_t pad;
+	/* 8 */
+	uint32_t rdma_id;
+	uint32_t length; /* length that may be written in the region */
+	/* 16 */
+	uint32_t offset; /* offset of the receive buffer in the region */
+	uint32_t pad2;
+	/* 24 */
 };
 
 struct omx_cmd_send_notify {
@@ -486,10 +558,36 @@ struct omx_cmd_send_liback {
 	uint16_t send_seq;
 	/* 16 */
 	uint8_t resent;
-	uint8_t pad[7];
+	uint8_t pad[3];
+	uint32_t sack_mask;
 	/* 24 */
 };
 
+/* maximal number of commands that may be submitted at once */
+#define OMX_SUBMIT_CMDS_MAX	64
+
+struct omx_cmd_submit_entry {
+	uint32_t epcmd; /* OMX_EPCMD_SEND_{TINY,SMALL,MEDIUMSQ_FRAG,NOTIFY,LIBACK} */
+	uint32_t pad;
+	/* 8 */
+	union {
+		struct omx_cmd_send_tiny send_tiny;
+		struct omx_cmd_send_small send_small;
+		struct omx_cmd_send_mediumsq_frag send_mediumsq_frag;
+		struct omx_cmd_send_notify send_notify;
+		struct omx_cmd_send_liback send_liback;
+	} cmd;
+	/* 64 */
+};
+
+struct omx_cmd_submit_cmds {
+	uint64_t entries; /* array of struct omx_cmd_submit_entry */
+	/* 8 */
+	uint32_t nr;
+	uint32_t pad;
+	/* 16 */
+};
+
 struct omx_cmd_create_user_region {
 	uint32_t nr_segments;
 	uint32_t id;
@@ -546,16 +644,20 @@ struct omx_cmd_wakeup {
 #define OMX_CMD_BENCH_TYPE_RECV_ACQU	0x11
 #define OMX_CMD_BENCH_TYPE_RECV_NOTIFY	0x12
 #define OMX_CMD_BENCH_TYPE_RECV_DONE	0x13
+/* peer table testing, lookup board_addr as the receive path does */
+#define OMX_CMD_BENCH_TYPE_PEER_LOOKUP	0x21
 
 struct omx_cmd_bench {
 	struct omx_cmd_bench_hdr {
 		uint8_t type;
 		uint8_t pad[7];
 		/* 8 */
+		uint64_t board_addr; /* only for OMX_CMD_BENCH_TYPE_PEER_LOOKUP */
+		/* 16 */
 	} hdr;
-	/* 8 */
+	/* 16 */
 	char dummy_data[OMX_TINY_MSG_LENGTH_MAX];
-	/* 40 */
+	/* 48 */
 };
 
 /************************
@@ -602,6 +704,10 @@ struct omx_cmd_bench {
 #define OMX_EPCMD_WAKEUP		0xe
 #define OMX_EPCMD_RELEASE_EXP_SLOTS	0xf
 #define OMX_EPCMD_RELEASE_UNEXP_SLOTS	0x10
+#define OMX_EPCMD_SUBMIT_CMDS		0x11
+#define OMX_EPCMD_SEND_MEDIUMSQ		0x12
+#define OMX_EPCMD_MEDIUM_DIRECT		0x13
+#define OMX_EPCMD_DELIVER_UNEXP_RETAINED	0x14
 #define OMX_CMD_BENCH			_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_BENCH, struct omx_cmd_bench)
 #define OMX_CMD_SEND_TINY		_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_SEND_TINY, struct omx_cmd_send_tiny)
 #define OMX_CMD_SEND_SMALL		_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_SEND_SMALL, struct omx_cmd_send_small)
@@ -619,6 +725,10 @@ struct omx_cmd_bench {
 #define OMX_CMD_WAKEUP			_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_WAKEUP, struct omx_cmd_wakeup)
 #define OMX_CMD_RELEASE_EXP_SLOTS	_IO(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_RELEASE_EXP_SLOTS)
 #define OMX_CMD_RELEASE_UNEXP_SLOTS	_IO(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_RELEASE_UNEXP_SLOTS)
+#define OMX_CMD_SUBMIT_CMDS		_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_SUBMIT_CMDS, struct omx_cmd_submit_cmds)
+#define OMX_CMD_SEND_MEDIUMSQ		_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_SEND_MEDIUMSQ, struct omx_cmd_send_mediumsq)
+#define OMX_CMD_MEDIUM_DIRECT		_IOR(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_MEDIUM_DIRECT, struct omx_cmd_medium_direct)
+#define OMX_CMD_DELIVER_UNEXP_RETAINED	_IO(OMX_CMD_MAGIC, 0x80 + OMX_EPCMD_DELIVER_UNEXP_RETAINED)
 
 static inline __pure const char *
 omx_strcmd(unsigned cmd)
@@ -692,6 +802,14 @@ omx_strcmd(unsigned cmd)
 		return "Release Expected Event Slots";
 	case OMX_CMD_RELEASE_UNEXP_SLOTS:
 		return "Release Unexpected Event Slots";
+	case OMX_CMD_SUBMIT_CMDS:
+		return "Submit Commands";
+	case OMX_CMD_SEND_MEDIUMSQ:
+		return "Send MediumSQ";
+	case OMX_CMD_MEDIUM_DIRECT:
+		return "Medium Direct";
+	case OMX_CMD_DELIVER_UNEXP_RETAINED:
+		return "Deliver Retained Unexpected Packets";
 	default:
 		return "** Unknown **";
 	}
@@ -714,6 +832,7 @@ omx_strcmd(unsigned cmd)
 #define OMX_EVT_RECV_NACK_LIB		0x19
 #define OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE	0x20
 #define OMX_EVT_PULL_DONE		0x21
+#define OMX_EVT_SEND_MEDIUMSQ_DONE	0x22
 
 #define OMX_EVT_NACK_LIB_BAD_ENDPT	0x01
 #define OMX_EVT_NACK_LIB_ENDPT_CLOSED	0x02
@@ -760,6 +879,8 @@ omx_strevt(unsigned type)
 		return "Send MediumSQ Fragment Done";
 	case OMX_EVT_PULL_DONE:
 		return "Pull Done";
+	case OMX_EVT_SEND_MEDIUMSQ_DONE:
+		return "Send MediumSQ Done";
 	default:
 		return "** Unknown **";
 	}
@@ -787,6 +908,15 @@ union omx_evt {
 		/* 64 */
 	} send_mediumsq_frag_done;
 
+	/* send whole medium done */
+	struct omx_evt_send_mediumsq_done {
+		uint32_t sendq_offset; /* offset of the first fragment */
+		uint8_t pad[58];
+		uint8_t type;
+		uint8_t id;
+		/* 64 */
+	} send_mediumsq_done;
+
 	struct omx_evt_pull_done {
 		uint64_t lib_cookie;
 		/* 8 */
@@ -851,7 +981,10 @@ union omx_evt {
 		uint16_t send_seq;
 		/* 16 */
 		uint8_t resent;
-		uint8_t pad2[45];
+		uint8_t pad2[3];
+		uint32_t sack_mask;
+		/* 24 */
+		uint8_t pad3[38];
 		uint8_t type;
 		uint8_t id;
 		/* 64 */
@@ -906,7 +1039,9 @@ union omx_evt {
 				uint8_t frag_pipeline;
 				/* 12 */
 				uint16_t checksum;
-				uint16_t pad2[13];
+				uint8_t direct; /* data already copied in the attached region */
+				uint8_t pad1;
+				uint16_t pad2[12];
 				/* 40 */
 			} medium_frag;
 
@@ -967,6 +1102,7 @@ enum omx_counter_index {
 	OMX_COUNTER_RECV_TINY,
 	OMX_COUNTER_RECV_SMALL,
 	OMX_COUNTER_RECV_MEDIUM_FRAG,
+	OMX_COUNTER_RECV_MEDIUM_FRAG_DIRECT,
 	OMX_COUNTER_RECV_RNDV,
 	OMX_COUNTER_RECV_NOTIFY,
 	OMX_COUNTER_RECV_CONNECT_REQUEST,
@@ -989,16 +1125,39 @@ enum omx_counter_index {
 	OMX_COUNTER_RECV_NONLINEAR_HEADER,
 	OMX_COUNTER_EXP_EVENTQ_FULL,
 	OMX_COUNTER_UNEXP_EVENTQ_FULL,
+	OMX_COUNTER_EXP_EVENTQ_RELEASE_SHARED,
+	OMX_COUNTER_UNEXP_EVENTQ_RELEASE_SHARED,
+	OMX_COUNTER_UNEXP_RETAINED,
+	OMX_COUNTER_UNEXP_RETAINED_DELIVERED,
+	OMX_COUNTER_UNEXP_RETAIN_LIMIT,
+	OMX_COUNTER_EVENT_WAKEUP,
+	OMX_COUNTER_EVENT_WAKEUP_NO_SLEEPER,
+	OMX_COUNTER_EVENT_WAKEUP_COALESCED,
+	OMX_COUNTER_SUBMIT_BATCH_1,
+	OMX_COUNTER_SUBMIT_BATCH_2_3,
+	OMX_COUNTER_SUBMIT_BATCH_4_7,
+	OMX_COUNTER_SUBMIT_BATCH_8_15,
+	OMX_COUNTER_SUBMIT_BATCH_16_MORE,
+	OMX_COUNTER_SUBMIT_CMD_FAILED,
 	OMX_COUNTER_SEND_NOMEM_SKB,
 	OMX_COUNTER_SEND_NOMEM_MEDIUM_DEFEVENT,
 	OMX_COUNTER_MEDIUMSQ_FRAG_SEND_LINEAR,
+	OMX_COUNTER_MEDIUMVA_FRAG_SEND_ZEROCOPY,
+	OMX_COUNTER_MEDIUMVA_FRAG_SEND_LINEAR,
 	OMX_COUNTER_PULL_NONFIRST_BLOCK_DONE_EARLY,
 	OMX_COUNTER_PULL_REQUEST_NOTONLYFIRST_BLOCKS,
 	OMX_COUNTER_PULL_TIMEOUT_HANDLER_FIRST_BLOCK,
 	OMX_COUNTER_PULL_TIMEOUT_HANDLER_NONFIRST_BLOCK,
 	OMX_COUNTER_PULL_TIMEOUT_ABORT,
+	OMX_COUNTER_PULL_WINDOW_GROW,
+	OMX_COUNTER_PULL_WINDOW_SHRINK,
+	OMX_COUNTER_PULL_DONE_WINDOW_1_4,
+	OMX_COUNTER_PULL_DONE_WINDOW_5_8,
+	OMX_COUNTER_PULL_DONE_WINDOW_9_MORE,
 	OMX_COUNTER_PULL_REPLY_SEND_LINEAR,
 	OMX_COUNTER_PULL_REPLY_FILL_FAILED,
+	OMX_COUNTER_MEDIUM_DIRECT_MISSED,
+	OMX_COUNTER_MEDIUM_DIRECT_EVICTED,
 
 	OMX_COUNTER_DROP_BAD_HEADER_DATALEN,
 	OMX_COUNTER_DROP_BAD_DATALEN,
@@ -1034,6 +1193,7 @@ enum omx_counter_index {
 	OMX_COUNTER_SHARED_CONNECT_REPLY,
 	OMX_COUNTER_SHARED_LIBACK,
 	OMX_COUNTER_SHARED_PULL,
+	OMX_COUNTER_SHARED_PULL_DIRECT,
 
 	OMX_COUNTER_SHARED_DMA_MEDIUM_FRAG,
 	OMX_COUNTER_SHARED_DMA_LARGE,
@@ -1084,6 +1244,8 @@ omx_strcounter(enum omx_counter_index index)
 		return "Recv Small";
 	case OMX_COUNTER_RECV_MEDIUM_FRAG:
 		return "Recv Medium Frag";
+	case OMX_COUNTER_RECV_MEDIUM_FRAG_DIRECT:
+		return "Recv Medium Frag Directly in Posted Buffer";
 	case OMX_COUNTER_RECV_RNDV:
 		return "Recv Rndv";
 	case OMX_COUNTER_RECV_NOTIFY:
@@ -1124,12 +1286,44 @@ omx_strcounter(enum omx_counter_index index)
 		return "Expected Event Queue Full";
 	case OMX_COUNTER_UNEXP_EVENTQ_FULL:
 		return "Unexpected Event Queue Full";
+	case OMX_COUNTER_EXP_EVENTQ_RELEASE_SHARED:
+		return "Expected Event Slot Batches Released without Syscall";
+	case OMX_COUNTER_UNEXP_EVENTQ_RELEASE_SHARED:
+		return "Unexpected Event Slot Batches Released without Syscall";
+	case OMX_COUNTER_UNEXP_RETAINED:
+		return "Unexpected Packet Retained while Queue Full";
+	case OMX_COUNTER_UNEXP_RETAINED_DELIVERED:
+		return "Retained Unexpected Packet Delivered";
+	case OMX_COUNTER_UNEXP_RETAIN_LIMIT:
+		return "Unexpected Packet Dropped because of Retain Limit";
+	case OMX_COUNTER_EVENT_WAKEUP:
+		return "Event Wakeup";
+	case OMX_COUNTER_EVENT_WAKEUP_NO_SLEEPER:
+		return "Event Wakeup Skipped without Sleeper";
+	case OMX_COUNTER_EVENT_WAKEUP_COALESCED:
+		return "Event Wakeup Coalesced";
+	case OMX_COUNTER_SUBMIT_BATCH_1:
+		return "Submit Batch of 1 Command";
+	case OMX_COUNTER_SUBMIT_BATCH_2_3:
+		return "Submit Batch of 2-3 Commands";
+	case OMX_COUNTER_SUBMIT_BATCH_4_7:
+		return "Submit Batch of 4-7 Commands";
+	case OMX_COUNTER_SUBMIT_BATCH_8_15:
+		return "Submit Batch of 8-15 Commands";
+	case OMX_COUNTER_SUBMIT_BATCH_16_MORE:
+		return "Submit Batch of 16 or more Commands";
+	case OMX_COUNTER_SUBMIT_CMD_FAILED:
+		return "Submitted Command Failed";
 	case OMX_COUNTER_SEND_NOMEM_SKB:
 		return "Send Skbuff Alloc Failed";
 	case OMX_COUNTER_SEND_NOMEM_MEDIUM_DEFEVENT:
 		return "Send Medium Deferred Event Alloc Failed";
 	case OMX_COUNTER_MEDIUMSQ_FRAG_SEND_LINEAR:
 		return "MediumSQ Frag Sent as Linear";
+	case OMX_COUNTER_MEDIUMVA_FRAG_SEND_ZEROCOPY:
+		return "MediumVA Frag Sent from Pinned User Pages";
+	case OMX_COUNTER_MEDIUMVA_FRAG_SEND_LINEAR:
+		return "MediumVA Frag Sent as Linear with Zero-Copy Requested";
 	case OMX_COUNTER_PULL_NONFIRST_BLOCK_DONE_EARLY:
 		return "Pull Non-First Block Done before First One";
 	case OMX_COUNTER_PULL_REQUEST_NOTONLYFIRST_BLOCKS:
@@ -1140,10 +1334,24 @@ omx_strcounter(enum omx_counter_index index)
 		return "Pull Timeout Handler Requests Non-First Block";
 	case OMX_COUNTER_PULL_TIMEOUT_ABORT:
 		return "Pull Timeout Abort";
+	case OMX_COUNTER_PULL_WINDOW_GROW:
+		return "Pull Window Grown";
+	case OMX_COUNTER_PULL_WINDOW_SHRINK:
+		return "Pull Window Shrunk on Timeout";
+	case OMX_COUNTER_PULL_DONE_WINDOW_1_4:
+		return "Pull Done with 1-4 Blocks in Parallel";
+	case OMX_COUNTER_PULL_DONE_WINDOW_5_8:
+		return "Pull Done with 5-8 Blocks in Parallel";
+	case OMX_COUNTER_PULL_DONE_WINDOW_9_MORE:
+		return "Pull Done with 9+ Blocks in Parallel";
 	case OMX_COUNTER_PULL_REPLY_SEND_LINEAR:
 		return "Pull Reply Sent as Linear";
 	case OMX_COUNTER_PULL_REPLY_FILL_FAILED:
 		return "Pull Reply Recv Fill Pages Failed";
+	case OMX_COUNTER_MEDIUM_DIRECT_MISSED:
+		return "Medium Direct Attached Too Late";
+	case OMX_COUNTER_MEDIUM_DIRECT_EVICTED:
+		return "Medium Direct Tracking Evicted";
 	case OMX_COUNTER_DROP_BAD_HEADER_DATALEN:
 	       	return "Drop Bad Data Length for Headers";
 	case OMX_COUNTER_DROP_BAD_DATALEN:
@@ -1210,6 +1418,8 @@ omx_strcounter(enum omx_counter_index index)
 		return "Shared LibAck";
 	case OMX_COUNTER_SHARED_PULL:
 		return "Shared Pull";
+	case OMX_COUNTER_SHARED_PULL_DIRECT:
+		return "Shared Pull Direct";
 	case OMX_COUNTER_SHARED_DMA_MEDIUM_FRAG:
 		return "DMA Shared Medium Frag";
 	case OMX_COUNTER_SHARED_DMA_LARGE:
@@ -112,6 +112,12 @@
 
 #endif /* !OMX_MX_WIRE_COMPAT */
 
+#ifdef OMX_MX_WIRE_COMPAT
+#define OMX_MEDIUM_FRAGS_MAX 8
+#elif !defined OMX_MEDIUM_FRAGS_MAX /* if not enforced by configure */
+#define OMX_MEDIUM_FRAGS_MAX 32 /* 32 needed for 32kB if MTU=1500 */
+#endif
+
 #define OMX_ENDPOINT_INDEX_MAX 256
 #define OMX_PEER_INDEX_MAX 65536
 
@@ -286,10 +292,15 @@ struct omx_pkt_truc {
 			uint8_t resent;
 			uint8_t pad1;
 			/* 28 */
+			uint32_t sack_mask; /* not in MX, see below */
+			/* 32 */
 		} liback;
 	};
 };
-#define OMX_PKT_TRUC_LIBACK_DATA_LENGTH sizeof(struct omx_pkt_truc_liback_data)
+/* MX libacks stop before the sack mask */
+#define OMX_PKT_TRUC_LIBACK_DATA_LENGTH (sizeof(struct omx_pkt_truc_liback_data) - sizeof(uint32_t))
+/* bit i of the sack mask means that seqnum lib_seqnum+1+i was received */
+#define OMX_PKT_TRUC_LIBACK_SACK_DATA_LENGTH sizeof(struct omx_pkt_truc_liback_data)
 
 enum omx_pkt_truc_data_type {
 	OMX_PKT_TRUC_DATA_TYPE_ACK = 0x55
@@ -180,6 +180,35 @@ else
   echo no
 fi
 
+# work_on_cpu appeared in 2.6.27
+echo -n "  checking (in kernel headers) whether work_on_cpu is available ... "
+if grep "work_on_cpu *(" ${LINUX_HDR}/include/linux/workqueue.h > /dev/null ; then
+  echo "#define OMX_HAVE_WORK_ON_CPU 1" >> ${TMP_CHECKS_NAME}
+  echo yes
+else
+  echo no
+fi
+
+# packet_type.list_func appeared in 4.19
+echo -n "  checking (in kernel headers) whether packet_type has list_func ... "
+if sed -ne '/^struct packet_type {/,/^};/p' ${LINUX_HDR}/include/linux/netdevice.h \
+  | grep "list_func" > /dev/null ; then
+  echo "#define OMX_HAVE_PACKET_TYPE_LIST_FUNC 1" >> ${TMP_CHECKS_NAME}
+  echo yes
+else
+  echo no
+fi
+
+# kmem_cache_create lost its destructor argument in 2.6.23
+echo -n "  checking (in kernel headers) kmem_cache_create destructor argument ... "
+if test `sed -ne '/kmem_cache_create *(/,/;/p' ${LINUX_HDR}/include/linux/slab.h \
+  | grep -c "void (\*)"` -ge 2 ; then
+  echo "#define OMX_HAVE_KMEM_CACHE_CREATE_DTOR 1" >> ${TMP_CHECKS_NAME}
+  echo yes
+else
+  echo no
+fi
+
 # net_device.dev appeared in 2.6.21
 echo -n "  checking (in kernel headers) device type in net_device ... "
 if sed -ne '/^struct net_device/,/^};/p' ${LINUX_HDR}/include/linux/netdevice.h \
@@ -251,6 +280,15 @@ else
   echo no
 fi
 
+# vma_kernel_pagesize added in 2.6.29
+echo -n "  checking (in kernel headers) vma_kernel_pagesize availability ... "
+if grep vma_kernel_pagesize ${LINUX_HDR}/include/linux/hugetlb.h > /dev/null ; then
+  echo "#define OMX_HAVE_VMA_KERNEL_PAGESIZE 1" >> ${TMP_CHECKS_NAME}
+  echo yes
+else
+  echo no
+fi
+
 # kfree_rcu added in 2.6.40
 echo -n "  checking (in kernel headers) kfree_rcu availability ... "
 if grep kfree_rcu ${LINUX_HDR}/include/linux/rcupdate.h > /dev/null ; then
@@ -28,7 +28,8 @@ struct omx_endpoint;
 struct sk_buff;
 
 /* constants */
-#define OMX_PULL_BLOCK_DESCS_NR 4
+/* pull frame seqnums are 8 bits, so at most 256 frames may be requested at once */
+#define OMX_PULL_BLOCK_DESCS_MAX (256 / OMX_PULL_REPLY_PER_BLOCK)
 #define OMX_IFACE_RX_USECS_WARN_MIN 13
 
 /* globals */
@@ -40,16 +41,21 @@ extern int omx_endpoint_max;
 extern int omx_peer_max;
 extern int omx_skb_frags;
 extern int omx_skb_copy_max;
+extern int omx_skb_cache_nr;
 extern int omx_pin_synchronous;
 extern int omx_pin_progressive;
 extern int omx_pin_chunk_pages_min;
 extern int omx_pin_chunk_pages_max;
+extern int omx_pull_blocks_min;
+extern int omx_pull_blocks_max;
+extern int omx_unexp_retain_kb;
 extern int omx_pin_invalidate;
 extern unsigned long omx_user_rights;
 
 /* events */
 extern int omx_event_delivery_check(void);
 extern void omx_endpoint_queues_init(struct omx_endpoint *endpoint);
+extern void omx_endpoint_queues_exit(struct omx_endpoint *endpoint);
 extern int omx_notify_exp_event(struct omx_endpoint *endpoint, const void *event, int length);
 extern int omx_notify_unexp_event(struct omx_endpoint *endpoint, const void *event, int length);
 extern int omx_prepare_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint, unsigned long *recvq_offset);
@@ -60,13 +66,17 @@ extern int omx_ioctl_wait_event(struct omx_endpoint * endpoint, void __user * up
 extern int omx_ioctl_wakeup(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_release_exp_slots(struct omx_endpoint *endpoint, void __user * uparam);
 extern int omx_ioctl_release_unexp_slots(struct omx_endpoint *endpoint, void __user * uparam);
+extern int omx_ioctl_deliver_unexp_retained(struct omx_endpoint *endpoint, void __user * uparam);
 extern void omx_wakeup_endpoint_on_close(struct omx_endpoint * endpoint);
 
 /* sending */
+extern int omx_send_init(void);
+extern void omx_send_exit(void);
 extern struct sk_buff * omx_new_skb(unsigned long len);
 extern int omx_ioctl_send_tiny(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_small(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint, void __user * uparam);
+extern int omx_ioctl_send_mediumsq(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_mediumva(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_rndv(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_pull(struct omx_endpoint * endpoint, void __user * uparam);
@@ -74,6 +84,7 @@ extern int omx_ioctl_send_notify(struct omx_endpoint * endpoint, void __user * u
 extern int omx_ioctl_send_connect_request(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_connect_reply(struct omx_endpoint * endpoint, void __user * uparam);
 extern int omx_ioctl_send_liback(struct omx_endpoint * endpoint, void __user * uparam);
+extern int omx_ioctl_submit_cmds(struct omx_endpoint * endpoint, void __user * uparam);
 extern void omx_send_nack_lib(struct omx_iface * iface, uint32_t peer_index, enum omx_nack_type nack_type, uint8_t src_endpoint, uint8_t dst_endpoint, uint16_t lib_seqnum);
 extern void omx_send_nack_mcp(struct omx_iface * iface, uint32_t peer_index, enum omx_nack_type nack_type, uint8_t src_endpoint, uint32_t src_pull_handle, uint32_t src_magic);
 
@@ -82,9 +93,20 @@ extern void omx_pkt_types_init(void);
 extern struct packet_type omx_pt;
 extern int omx_recv_pull_request(struct omx_iface * iface, struct omx_hdr * mh, struct sk_buff * skb);
 extern int omx_recv_pull_reply(struct omx_iface * iface, struct omx_hdr * mh, struct sk_buff * skb);
+#ifdef OMX_HAVE_PACKET_TYPE_LIST_FUNC
+extern void omx_recv_pull_replies(struct omx_iface * iface, struct sk_buff_head * queue);
+#endif
 extern int omx_recv_nack_mcp(struct omx_iface * iface, struct omx_hdr * mh, struct sk_buff * skb);
+extern void omx_endpoint_medium_direct_init(struct omx_endpoint * endpoint);
+extern void omx_endpoint_medium_direct_exit(struct omx_endpoint * endpoint);
+extern int omx_ioctl_medium_direct(struct omx_endpoint * endpoint, void __user * uparam);
+extern void omx_endpoint_unexp_retained_init(struct omx_endpoint * endpoint);
+extern void omx_endpoint_unexp_retained_exit(struct omx_endpoint * endpoint);
+extern void omx_endpoint_deliver_unexp_retained(struct omx_endpoint * endpoint);
 
 /* pull */
+extern int omx_pull_init(void);
+extern void omx_pull_exit(void);
 extern int omx_endpoint_pull_handles_init(struct omx_endpoint * endpoint);
 extern void omx_endpoint_pull_handles_exit(struct omx_endpoint * endpoint);
 
@@ -41,19 +41,55 @@
  * Alloc/Release internal endpoint fields once everything is setup/locked
  */
 
+/* get the number of entries of a queue, or 0 if the requested one cannot be mmap'ed */
+static uint32_t
+omx_endpoint_queue_entry_nr(uint32_t requested, unsigned long default_nr, unsigned long entry_size)
+{
+	uint32_t nr = requested ? requested : default_nr;
+
+	if (nr < OMX_QUEUE_ENTRY_NR_MIN || nr > OMX_QUEUE_ENTRY_NR_MAX
+	    || (nr & (nr-1)) || ((nr * entry_size) & ~PAGE_MASK))
+		return 0;
+
+	return nr;
+}
+
 static int
-omx_endpoint_alloc_resources(struct omx_endpoint * endpoint)
+omx_endpoint_alloc_resources(struct omx_endpoint * endpoint,
+			     const struct omx_cmd_open_endpoint * param)
 {
 	struct page ** sendq_pages, ** recvq_pages;
 	struct omx_endpoint_desc *userdesc;
 	int i;
 	int ret;
 
+	/* check the queue sizes */
+	endpoint->sendq_entry_nr = omx_endpoint_queue_entry_nr(param->sendq_entry_nr,
+							       OMX_SENDQ_ENTRY_NR_DEFAULT, OMX_SENDQ_ENTRY_SIZE);
+	endpoint->recvq_entry_nr = omx_endpoint_queue_entry_nr(param->recvq_entry_nr,
+							       OMX_RECVQ_ENTRY_NR_DEFAULT, OMX_EVENTQ_ENTRY_SIZE);
+	endpoint->exp_eventq_entry_nr = omx_endpoint_queue_entry_nr(param->exp_eventq_entry_nr,
+								    OMX_EXP_EVENTQ_ENTRY_NR_DEFAULT, OMX_EVENTQ_ENTRY_SIZE);
+	if (!endpoint->sendq_entry_nr || !endpoint->recvq_entry_nr || !endpoint->exp_eventq_entry_nr) {
+		printk(KERN_ERR "Open-MX: Cannot open endpoint with %ld sendq, %ld recvq and %ld exp eventq entries\n",
+		       (unsigned long) param->sendq_entry_nr, (unsigned long) param->recvq_entry_nr,
+		       (unsigned long) param->exp_eventq_entry_nr);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* choose the node where our queues and pull handles go */
+	endpoint->numa_node = -1;
+	if (param->numa_placement == OMX_ENDPOINT_NUMA_PLACEMENT_NIC)
+		endpoint->numa_node = omx_iface_get_numa_node(param->board_index);
+	if (endpoint->numa_node < 0)
+		endpoint->numa_node = numa_node_id();
+
 	/* generate the session id */
 	get_random_bytes(&endpoint->session_id, sizeof(endpoint->session_id));
 
 	/* create the user descriptor */
-	userdesc = omx_vmalloc_user(sizeof(struct omx_endpoint_desc));
+	userdesc = omx_vmalloc_user_node(sizeof(struct omx_endpoint_desc), endpoint->numa_node);
 	if (!userdesc) {
 		printk(KERN_ERR "Open-MX: failed to allocate endpoint user descriptor\n");
 		ret = -ENOMEM;
@@ -61,37 +97,44 @@ omx_endpoint_alloc_resources(struct omx_endpoint * endpoint)
 	}
 	userdesc->status = 0;
 	userdesc->session_id = endpoint->session_id;
+	userdesc->exp_eventq_released_index = 0;
+	userdesc->unexp_eventq_released_index = 0;
+	userdesc->sendq_entry_nr = endpoint->sendq_entry_nr;
+	userdesc->recvq_entry_nr = endpoint->recvq_entry_nr;
+	userdesc->exp_eventq_entry_nr = endpoint->exp_eventq_entry_nr;
+	userdesc->unexp_eventq_entry_nr = endpoint->recvq_entry_nr;
 	endpoint->userdesc = userdesc;
 
 	/* alloc and init user queues */
 	ret = -ENOMEM;
-	endpoint->sendq = omx_vmalloc_user(OMX_SENDQ_SIZE);
+	endpoint->sendq = omx_vmalloc_user_node(OMX_SENDQ_SIZE(endpoint->sendq_entry_nr), endpoint->numa_node);
 	if (!endpoint->sendq) {
 		printk(KERN_ERR "Open-MX: failed to allocate sendq\n");
 		goto out_with_desc;
 	}
-	endpoint->recvq = omx_vmalloc_user(OMX_RECVQ_SIZE);
+	endpoint->recvq = omx_vmalloc_user_node(OMX_RECVQ_SIZE(endpoint->recvq_entry_nr), endpoint->numa_node);
 	if (!endpoint->recvq) {
 		printk(KERN_ERR "Open-MX: failed to allocate recvq\n");
 		goto out_with_sendq;
 	}
-	endpoint->exp_eventq = omx_vmalloc_user(OMX_EXP_EVENTQ_SIZE);
+	endpoint->exp_eventq = omx_vmalloc_user_node(OMX_EVENTQ_SIZE(endpoint->exp_eventq_entry_nr), endpoint->numa_node);
 	if (!endpoint->exp_eventq) {
 		printk(KERN_ERR "Open-MX: failed to allocate exp eventq\n");
 		goto out_with_recvq;
 	}
-	endpoint->unexp_eventq = omx_vmalloc_user(OMX_UNEXP_EVENTQ_SIZE);
+	endpoint->unexp_eventq = omx_vmalloc_user_node(OMX_EVENTQ_SIZE(endpoint->recvq_entry_nr), endpoint->numa_node);
 	if (!endpoint->unexp_eventq) {
 		printk(KERN_ERR "Open-MX: failed to allocate unexp eventq\n");
 		goto out_with_exp_eventq;
 	}
 
-	sendq_pages = kmalloc(OMX_SENDQ_SIZE/PAGE_SIZE * sizeof(struct page *), GFP_KERNEL);
+	sendq_pages = kmalloc_node(OMX_SENDQ_SIZE(endpoint->sendq_entry_nr)/PAGE_SIZE * sizeof(struct page *), GFP_KERNEL,
+				   endpoint->numa_node);
 	if (!sendq_pages) {
 		printk(KERN_ERR "Open-MX: failed to allocate sendq pages array\n");
 		goto out_with_unexp_eventq;
 	}
-	for(i=0; i<OMX_SENDQ_SIZE/PAGE_SIZE; i++) {
+	for(i=0; i<OMX_SENDQ_SIZE(endpoint->sendq_entry_nr)/PAGE_SIZE; i++) {
 		struct page * page;
 		page = vmalloc_to_page(endpoint->sendq + (i << PAGE_SHIFT));
 		BUG_ON(!page);
@@ -99,12 +142,13 @@ omx_endpoint_alloc_resources(struct omx_endpoint * endpoint)
 	}
 	endpoint->sendq_pages = sendq_pages;
 
-	recvq_pages = kmalloc(OMX_RECVQ_SIZE/PAGE_SIZE * sizeof(struct page *), GFP_KERNEL);
+	recvq_pages = kmalloc_node(OMX_RECVQ_SIZE(endpoint->recvq_entry_nr)/PAGE_SIZE * sizeof(struct page *), GFP_KERNEL,
+				   endpoint->numa_node);
 	if (!recvq_pages) {
 		printk(KERN_ERR "Open-MX: failed to allocate recvq pages array\n");
 		goto out_with_sendq_pages;
 	}
-	for(i=0; i<OMX_RECVQ_SIZE/PAGE_SIZE; i++) {
+	for(i=0; i<OMX_RECVQ_SIZE(endpoint->recvq_entry_nr)/PAGE_SIZE; i++) {
 		struct page * page;
 		page = vmalloc_to_page(endpoint->recvq + (i << PAGE_SHIFT));
 		BUG_ON(!page);
@@ -121,6 +165,12 @@ omx_endpoint_alloc_resources(struct omx_endpoint * endpoint)
 	/* initialize pull handles */
 	omx_endpoint_pull_handles_init(endpoint);
 
+	/* initialize direct medium receive tracking */
+	omx_endpoint_medium_direct_init(endpoint);
+
+	/* initialize the list of retained unexpected packets */
+	omx_endpoint_unexp_retained_init(endpoint);
+
 #ifdef OMX_HAVE_DMA_ENGINE
 	/* take a reference on the dmaengine subsystem */
 	omx_dmaengine_get();
@@ -152,8 +202,16 @@ omx_endpoint_free_resources(struct omx_endpoint * endpoint)
 	/* destroy all pending pull handles */
 	omx_endpoint_pull_handles_exit(endpoint);
 
+	/* release regions attached for direct medium receive */
+	omx_endpoint_medium_direct_exit(endpoint);
+
 	omx_endpoint_user_regions_exit(endpoint);
 
+	/* drop unexpected packets that were never delivered */
+	omx_endpoint_unexp_retained_exit(endpoint);
+
+	omx_endpoint_queues_exit(endpoint);
+
 	kfree(endpoint->recvq_pages);
 	kfree(endpoint->sendq_pages);
 	vfree(endpoint->unexp_eventq);
@@ -236,7 +294,7 @@ omx_endpoint_open(struct omx_endpoint * endpoint, const void __user * uparam)
 	spin_unlock(&endpoint->status_lock);
 
 	/* alloc internal fields */
-	ret = omx_endpoint_alloc_resources(endpoint);
+	ret = omx_endpoint_alloc_resources(endpoint, &param);
 	if (ret < 0)
 		goto out_with_init;
 
@@ -442,6 +500,10 @@ static int (*omx_ioctl_with_endpoint_handlers[])(struct omx_endpoint * endpoint,
 	[OMX_EPCMD_WAKEUP]			= omx_ioctl_wakeup,
 	[OMX_EPCMD_RELEASE_EXP_SLOTS]		= omx_ioctl_release_exp_slots,
 	[OMX_EPCMD_RELEASE_UNEXP_SLOTS]		= omx_ioctl_release_unexp_slots,
+	[OMX_EPCMD_SUBMIT_CMDS]			= omx_ioctl_submit_cmds,
+	[OMX_EPCMD_SEND_MEDIUMSQ]		= omx_ioctl_send_mediumsq,
+	[OMX_EPCMD_MEDIUM_DIRECT]		= omx_ioctl_medium_direct,
+	[OMX_EPCMD_DELIVER_UNEXP_RETAINED]	= omx_ioctl_deliver_unexp_retained,
 };
 
 /*
@@ -776,22 +838,22 @@ omx_miscdev_mmap(struct file * file, struct vm_area_struct * vma)
 	if (offset == OMX_ENDPOINT_DESC_FILE_OFFSET && size == PAGE_ALIGN(OMX_ENDPOINT_DESC_SIZE)) {
 		return omx_remap_vmalloc_range(vma, endpoint->userdesc, 0);
 
-	} else if (offset == OMX_SENDQ_FILE_OFFSET && size == OMX_SENDQ_SIZE) { /* page-alignment enforced at init */
+	} else if (offset == OMX_SENDQ_FILE_OFFSET && size == OMX_SENDQ_SIZE(endpoint->sendq_entry_nr)) { /* page-alignment enforced at open */
 		if (vma->vm_flags & VM_READ) /* may open for reading but cannot mmap for reading */
 			return -EPERM;
 		return omx_remap_vmalloc_range(vma, endpoint->sendq, 0);
 
-	} else if (offset == OMX_RECVQ_FILE_OFFSET && size == OMX_RECVQ_SIZE) { /* page-alignment enforced at init */
+	} else if (offset == OMX_RECVQ_FILE_OFFSET && size == OMX_RECVQ_SIZE(endpoint->recvq_entry_nr)) { /* page-alignment enforced at open */
 		if (vma->vm_flags & VM_WRITE) /* may open for writing but cannot mmap for writing */
 			return -EPERM;
 		return omx_remap_vmalloc_range(vma, endpoint->recvq, 0);
 
-	} else if (offset == OMX_EXP_EVENTQ_FILE_OFFSET && size == OMX_EXP_EVENTQ_SIZE) { /* page-alignment enforced at init */
+	} else if (offset == OMX_EXP_EVENTQ_FILE_OFFSET && size == OMX_EVENTQ_SIZE(endpoint->exp_eventq_entry_nr)) { /* page-alignment enforced at open */
 		if (vma->vm_flags & VM_WRITE) /* may open for writing but cannot mmap for writing */
 			return -EPERM;
 		return omx_remap_vmalloc_range(vma, endpoint->exp_eventq, 0);
 
-	} else if (offset == OMX_UNEXP_EVENTQ_FILE_OFFSET && size == OMX_UNEXP_EVENTQ_SIZE) { /* page-alignment enforced at init */
+	} else if (offset == OMX_UNEXP_EVENTQ_FILE_OFFSET && size == OMX_EVENTQ_SIZE(endpoint->recvq_entry_nr)) { /* page-alignment enforced at open */
 		if (vma->vm_flags & VM_WRITE) /* may open for writing but cannot mmap for writing */
 			return -EPERM;
 		return omx_remap_vmalloc_range(vma, endpoint->unexp_eventq, 0);
@@ -872,21 +934,22 @@ omx_dev_init(void)
 		}
 #endif
 
-	/* check that mmap will work. we cannot page-align these since there are allocated all at once */
-	if (OMX_SENDQ_SIZE & ~PAGE_MASK) {
-		printk(KERN_ERR "Open-MX: Cannot use sendq with non-page-aligned size %lx\n", OMX_SENDQ_SIZE);
-		return -EINVAL;
-	}
-	if (OMX_RECVQ_SIZE & ~PAGE_MASK) {
-		printk(KERN_ERR "Open-MX: Cannot use recvq with non-page-aligned size %lx\n", OMX_RECVQ_SIZE);
+	/* check that mmap will work with the default queue sizes.
+	 * we cannot page-align these since there are allocated all at once
+	 */
+	if (!omx_endpoint_queue_entry_nr(0, OMX_SENDQ_ENTRY_NR_DEFAULT, OMX_SENDQ_ENTRY_SIZE)) {
+		printk(KERN_ERR "Open-MX: Cannot use sendq with non-page-aligned size %lx\n",
+		       OMX_SENDQ_SIZE(OMX_SENDQ_ENTRY_NR_DEFAULT));
 		return -EINVAL;
 	}
-	if (OMX_EXP_EVENTQ_SIZE & ~PAGE_MASK) {
-		printk(KERN_ERR "Open-MX: Cannot use exp eventq with non-page-aligned size %lx\n", OMX_EXP_EVENTQ_SIZE);
+	if (!omx_endpoint_queue_entry_nr(0, OMX_RECVQ_ENTRY_NR_DEFAULT, OMX_EVENTQ_ENTRY_SIZE)) {
+		printk(KERN_ERR "Open-MX: Cannot use recvq and unexp eventq with non-page-aligned size %lx\n",
+		       OMX_EVENTQ_SIZE(OMX_RECVQ_ENTRY_NR_DEFAULT));
 		return -EINVAL;
 	}
-	if (OMX_UNEXP_EVENTQ_SIZE & ~PAGE_MASK) {
-		printk(KERN_ERR "Open-MX: Cannot use unexp eventq with non-page-aligned size %lx\n", OMX_UNEXP_EVENTQ_SIZE);
+	if (!omx_endpoint_queue_entry_nr(0, OMX_EXP_EVENTQ_ENTRY_NR_DEFAULT, OMX_EVENTQ_ENTRY_SIZE)) {
+		printk(KERN_ERR "Open-MX: Cannot use exp eventq with non-page-aligned size %lx\n",
+		       OMX_EVENTQ_SIZE(OMX_EXP_EVENTQ_ENTRY_NR_DEFAULT));
 		return -EINVAL;
 	}
 
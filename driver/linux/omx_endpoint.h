@@ -25,8 +25,11 @@
 #include <linux/kref.h>
 #include <linux/list.h>
 #include <linux/wait.h>
+#include <linux/interrupt.h>
 #include <linux/idr.h>
 #include <linux/mm.h>
+#include <linux/skbuff.h>
+#include <linux/timer.h>
 #ifdef CONFIG_MMU_NOTIFIER
 #include <linux/mmu_notifier.h>
 #endif
@@ -35,6 +38,10 @@
 
 struct omx_iface;
 struct page;
+struct omx_user_region;
+
+/* number of medium messages whose fragments may be tracked at the same time per endpoint */
+#define OMX_MEDIUM_DIRECT_ENTRY_NR 16
 
 enum omx_endpoint_status {
 	/* endpoint is free and may be open */
@@ -63,6 +70,14 @@ struct omx_endpoint {
 
 	struct omx_iface * iface;
 
+	/* node where the queues and the pull handles are allocated */
+	int numa_node;
+
+	/* number of entries of each queue, chosen when opening the endpoint (powers of 2) */
+	uint32_t sendq_entry_nr;
+	uint32_t recvq_entry_nr; /* also the number of unexpected event slots */
+	uint32_t exp_eventq_entry_nr;
+
 	/* send queue stuff */
 	void * sendq;
 	struct page ** sendq_pages;
@@ -76,11 +91,14 @@ struct omx_endpoint {
 	/* common event queues stuff */
 	struct list_head waiters;
 	spinlock_t waiters_lock;
+	atomic_t waiters_nr; /* checked without locking before waking up waiters */
+	atomic_t wakeup_pending; /* set while wakeup_tasklet is scheduled */
+	struct tasklet_struct wakeup_tasklet; /* wakes up waiters once per bottom half batch of events */
 
 	/* expected event queue stuff */
 	void * exp_eventq;
 	omx_eventq_index_t nextfree_exp_eventq_index; /* modified with atomics instead of protected by exp_lock */
-	omx_eventq_index_t nextreleased_exp_eventq_index;
+	omx_eventq_index_t nextreleased_exp_eventq_index; /* refreshed from the user descriptor when the queue looks full */
 	spinlock_t release_exp_lock;
 
 	/* unexpected event queue stuff */
@@ -88,7 +106,7 @@ struct omx_endpoint {
 	omx_eventq_index_t nextfree_unexp_eventq_index;
 	omx_eventq_index_t nextreserved_unexp_eventq_index;
 	spinlock_t unexp_lock;
-	omx_eventq_index_t nextreleased_unexp_eventq_index;
+	omx_eventq_index_t nextreleased_unexp_eventq_index; /* refreshed from the user descriptor when the queue looks full */
 	spinlock_t release_unexp_lock;
 
 	/* receive queue stuff (used with the unexp eventq) */
@@ -96,12 +114,34 @@ struct omx_endpoint {
 	omx_eventq_index_t next_recvq_index;
 	struct page ** recvq_pages;
 
+	/* unexpected packets retained while the queue is full, see omx_recv_prepare_unexp_with_recvq() */
+	struct sk_buff_head unexp_retained;
+	atomic_t unexp_retained_bytes;
+	unsigned long unexp_retained_delivering; /* bit 0 set while somebody delivers them */
+
 	spinlock_t user_regions_lock;
 	struct omx_user_region __rcu * user_regions[OMX_USER_REGION_MAX];
 
+	/* multi-fragment medium messages being received, see omx_recv_medium_frag_direct() */
+	struct omx_medium_direct {
+		uint16_t peer_index;
+		uint8_t src_endpoint;
+		uint16_t seqnum;
+		uint32_t frags_missing_mask; /* 0 if the entry is unused */
+		struct omx_user_region * region; /* posted receive buffer, if attached by the library */
+		uint32_t offset; /* offset of the receive buffer in the region */
+		uint32_t length; /* length that may be written in the receive buffer */
+	} medium_direct[OMX_MEDIUM_DIRECT_ENTRY_NR];
+	int medium_direct_next; /* next entry to replace */
+	spinlock_t medium_direct_lock;
+
 	struct list_head pull_handles_list;
 	struct list_head pull_handle_slots_free_list;
 	void * pull_handle_slots_array;
+	struct list_head pull_handles_pool; /* preallocated handles, ready for the next pull */
+	int pull_handles_pool_nr;
+	struct timer_list pull_handles_timer; /* scans the handles list for retransmission */
+	int pull_handles_closing;
 	spinlock_t pull_handles_lock;
 
 #ifdef CONFIG_MMU_NOTIFIER
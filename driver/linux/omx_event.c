@@ -103,6 +103,51 @@ omx_wakeup_waiter_list(struct omx_endpoint *endpoint,
 	rcu_read_unlock();
 }
 
+static void
+omx_wakeup_tasklet_handler(unsigned long data)
+{
+	struct omx_endpoint *endpoint = (struct omx_endpoint *) data;
+
+	/* events notified from now on will need another wakeup */
+	atomic_set(&endpoint->wakeup_pending, 0);
+	smp_mb();
+
+	omx_wakeup_waiter_list(endpoint, OMX_CMD_WAIT_EVENT_STATUS_EVENT);
+}
+
+/*
+ * Wake up waiters after an event was written in a queue.
+ * Nothing to do if nobody sleeps, which is the common case when polling.
+ * In bottom halves, the wakeup is deferred to a tasklet that runs once
+ * after the current batch of received packets.
+ */
+static INLINE void
+omx_wakeup_waiters_on_event(struct omx_endpoint *endpoint)
+{
+	/* order the event with the waiters_nr check, see omx_ioctl_wait_event() */
+	smp_mb();
+
+	if (likely(!atomic_read(&endpoint->waiters_nr))) {
+		omx_counter_inc(endpoint->iface, EVENT_WAKEUP_NO_SLEEPER);
+		return;
+	}
+
+	if (!in_softirq()) {
+		omx_counter_inc(endpoint->iface, EVENT_WAKEUP);
+		omx_wakeup_waiter_list(endpoint, OMX_CMD_WAIT_EVENT_STATUS_EVENT);
+		return;
+	}
+
+	if (atomic_xchg(&endpoint->wakeup_pending, 1)) {
+		/* the pending tasklet will see this event */
+		omx_counter_inc(endpoint->iface, EVENT_WAKEUP_COALESCED);
+		return;
+	}
+
+	omx_counter_inc(endpoint->iface, EVENT_WAKEUP);
+	tasklet_schedule(&endpoint->wakeup_tasklet);
+}
+
 static void
 omx_wakeup_on_timeout_handler(unsigned long data)
 {
@@ -136,22 +181,22 @@ omx_endpoint_queues_init(struct omx_endpoint *endpoint)
 	BUILD_BUG_ON(PAGE_SIZE%OMX_SENDQ_ENTRY_SIZE != 0 && OMX_SENDQ_ENTRY_SIZE%PAGE_SIZE != 0);
 	BUILD_BUG_ON(PAGE_SIZE%OMX_RECVQ_ENTRY_SIZE != 0 && OMX_RECVQ_ENTRY_SIZE%PAGE_SIZE != 0);
 	BUILD_BUG_ON(sizeof(union omx_evt) != OMX_EVENTQ_ENTRY_SIZE);
-	BUILD_BUG_ON(OMX_UNEXP_EVENTQ_ENTRY_NR != OMX_RECVQ_ENTRY_NR);
+	BUILD_BUG_ON((omx_eventq_index_t) -1 <= OMX_QUEUE_ENTRY_NR_MAX);
 
 	/* initialize all expected events */
 	for(evt = endpoint->exp_eventq;
-	    (void *) evt < endpoint->exp_eventq + OMX_EXP_EVENTQ_SIZE;
+	    (void *) evt < endpoint->exp_eventq + OMX_EVENTQ_SIZE(endpoint->exp_eventq_entry_nr);
 	    evt++)
 		evt->generic.id = 0;
 
 	/* initialize indexes */
 	endpoint->nextfree_exp_eventq_index = 0;
 	endpoint->nextreleased_exp_eventq_index = 0;
-	BUILD_BUG_ON((omx_eventq_index_t) -1 <= OMX_EXP_EVENTQ_ENTRY_NR);
+	BUILD_BUG_ON(sizeof(endpoint->userdesc->exp_eventq_released_index) != sizeof(omx_eventq_index_t));
 
 	/* initialize all unexpected events */
 	for(evt = endpoint->unexp_eventq;
-	    (void *) evt < endpoint->unexp_eventq + OMX_UNEXP_EVENTQ_SIZE;
+	    (void *) evt < endpoint->unexp_eventq + OMX_EVENTQ_SIZE(endpoint->recvq_entry_nr);
 	    evt++)
 		evt->generic.id = 0;
 
@@ -159,19 +204,97 @@ omx_endpoint_queues_init(struct omx_endpoint *endpoint)
 	endpoint->nextfree_unexp_eventq_index = 0;
 	endpoint->nextreserved_unexp_eventq_index = 0;
 	endpoint->nextreleased_unexp_eventq_index = 0;
-	BUILD_BUG_ON((omx_eventq_index_t) -1 <= OMX_UNEXP_EVENTQ_ENTRY_NR);
+	BUILD_BUG_ON(sizeof(endpoint->userdesc->unexp_eventq_released_index) != sizeof(omx_eventq_index_t));
 
 	/* set the first recvq slot */
 	endpoint->next_recvq_index = 0;
-	BUILD_BUG_ON((omx_eventq_index_t) -1 <= OMX_RECVQ_ENTRY_NR);
 
 	INIT_LIST_HEAD(&endpoint->waiters);
 	spin_lock_init(&endpoint->waiters_lock);
+	atomic_set(&endpoint->waiters_nr, 0);
+	atomic_set(&endpoint->wakeup_pending, 0);
+	tasklet_init(&endpoint->wakeup_tasklet, omx_wakeup_tasklet_handler, (unsigned long) endpoint);
 	spin_lock_init(&endpoint->unexp_lock);
 	spin_lock_init(&endpoint->release_exp_lock);
 	spin_lock_init(&endpoint->release_unexp_lock);
 }
 
+void
+omx_endpoint_queues_exit(struct omx_endpoint *endpoint)
+{
+	/* nobody may notify events anymore, wait for a pending wakeup */
+	tasklet_kill(&endpoint->wakeup_tasklet);
+}
+
+/******************************************
+ * Lazy release of event slots
+ */
+
+/*
+ * The library publishes the index of the first event slot that it did not
+ * process yet in the endpoint descriptor instead of calling the release
+ * ioctls. We only look at it when a queue looks full, so that the common
+ * case does not touch the user-mapped descriptor.
+ */
+
+static void
+omx_refresh_released_exp_slots(struct omx_endpoint *endpoint)
+{
+	omx_eventq_index_t released, nr;
+
+	spin_lock_bh(&endpoint->release_exp_lock);
+	released = *(volatile omx_eventq_index_t *) &endpoint->userdesc->exp_eventq_released_index;
+	nr = released - endpoint->nextreleased_exp_eventq_index;
+	/* ignore bogus indexes, slots cannot be released before being given to user-space */
+	if (nr && nr <= endpoint->nextfree_exp_eventq_index - endpoint->nextreleased_exp_eventq_index) {
+		endpoint->nextreleased_exp_eventq_index = released;
+		omx_counter_add(endpoint->iface, EXP_EVENTQ_RELEASE_SHARED, nr / OMX_RELEASE_SLOTS_BATCH_NR(endpoint->exp_eventq_entry_nr));
+	}
+	spin_unlock_bh(&endpoint->release_exp_lock);
+}
+
+static void
+omx_refresh_released_unexp_slots(struct omx_endpoint *endpoint)
+{
+	omx_eventq_index_t released, nr;
+
+	spin_lock_bh(&endpoint->release_unexp_lock);
+	released = *(volatile omx_eventq_index_t *) &endpoint->userdesc->unexp_eventq_released_index;
+	nr = released - endpoint->nextreleased_unexp_eventq_index;
+	/* ignore bogus indexes, slots cannot be released before being given to user-space */
+	if (nr && nr <= endpoint->nextreserved_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index) {
+		endpoint->nextreleased_unexp_eventq_index = released;
+		omx_counter_add(endpoint->iface, UNEXP_EVENTQ_RELEASE_SHARED, nr / OMX_RELEASE_SLOTS_BATCH_NR(endpoint->recvq_entry_nr));
+	}
+	spin_unlock_bh(&endpoint->release_unexp_lock);
+}
+
+/* check whether the expected queue is full, after looking at released slots if needed */
+static inline int
+omx_exp_eventq_full(struct omx_endpoint *endpoint)
+{
+	if (likely(endpoint->nextfree_exp_eventq_index - endpoint->nextreleased_exp_eventq_index
+		   <= endpoint->exp_eventq_entry_nr))
+		return 0;
+
+	omx_refresh_released_exp_slots(endpoint);
+	return endpoint->nextfree_exp_eventq_index - endpoint->nextreleased_exp_eventq_index
+		> endpoint->exp_eventq_entry_nr;
+}
+
+/* check whether the unexpected queue is full, after looking at released slots if needed */
+static inline int
+omx_unexp_eventq_full(struct omx_endpoint *endpoint)
+{
+	if (likely(endpoint->nextfree_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
+		   <= endpoint->recvq_entry_nr))
+		return 0;
+
+	omx_refresh_released_unexp_slots(endpoint);
+	return endpoint->nextfree_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
+		> endpoint->recvq_entry_nr;
+}
+
 /******************************************
  * Report an expected event to users-space
  */
@@ -185,8 +308,7 @@ omx_notify_exp_event(struct omx_endpoint *endpoint, const void *event, int lengt
 	/* take the next slot and update the queue */
 	index = atomic_inc_return((atomic_t *) &endpoint->nextfree_exp_eventq_index) - 1;
 
-	if (unlikely(endpoint->nextfree_exp_eventq_index - endpoint->nextreleased_exp_eventq_index
-		     > OMX_EXP_EVENTQ_ENTRY_NR)) {
+	if (unlikely(omx_exp_eventq_full(endpoint))) {
 		/* we went too far, rollback */
 		atomic_dec((atomic_t *) &endpoint->nextfree_exp_eventq_index);
 		/* the application sucks, it did not check
@@ -200,7 +322,7 @@ omx_notify_exp_event(struct omx_endpoint *endpoint, const void *event, int lengt
 		return -EBUSY;
 	}
 
-	slot = endpoint->exp_eventq + (index % OMX_EXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+	slot = endpoint->exp_eventq + (index & (endpoint->exp_eventq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
 	/* store the event without setting the id first */
 	memcpy(slot, event, length);
 	wmb();
@@ -210,7 +332,7 @@ omx_notify_exp_event(struct omx_endpoint *endpoint, const void *event, int lengt
 	/* wake up waiters */
 	dprintk(EVENT, "notify_exp waking up everybody\n");
 
-	omx_wakeup_waiter_list(endpoint, OMX_CMD_WAIT_EVENT_STATUS_EVENT);
+	omx_wakeup_waiters_on_event(endpoint);
 
 	return 0;
 }
@@ -232,8 +354,7 @@ omx_notify_unexp_event(struct omx_endpoint *endpoint, const void *event, int len
 	index = endpoint->nextreserved_unexp_eventq_index++;
 	spin_unlock_bh(&endpoint->unexp_lock);
 
-	if (unlikely(endpoint->nextfree_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
-		     > OMX_UNEXP_EVENTQ_ENTRY_NR)) {
+	if (unlikely(omx_unexp_eventq_full(endpoint))) {
 		/* we went too far, rollback */
 		spin_lock_bh(&endpoint->unexp_lock);
 		endpoint->nextfree_unexp_eventq_index--;
@@ -248,7 +369,7 @@ omx_notify_unexp_event(struct omx_endpoint *endpoint, const void *event, int len
 		return -EBUSY;
 	}
 
-	slot = endpoint->unexp_eventq + (index % OMX_UNEXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+	slot = endpoint->unexp_eventq + (index & (endpoint->recvq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
 	/* store the event without setting the id first */
 	memcpy(slot, event, length);
 	wmb();
@@ -258,7 +379,7 @@ omx_notify_unexp_event(struct omx_endpoint *endpoint, const void *event, int len
 	/* wake up waiters */
 	dprintk(EVENT, "notify_unexp waking up everybody\n");
 
-	omx_wakeup_waiter_list(endpoint, OMX_CMD_WAIT_EVENT_STATUS_EVENT);
+	omx_wakeup_waiters_on_event(endpoint);
 
 	return 0;
 }
@@ -289,8 +410,7 @@ omx_prepare_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint,
 	recvq_index = endpoint->next_recvq_index++;
 	spin_unlock_bh(&endpoint->unexp_lock);
 
-	if (unlikely(endpoint->nextfree_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
-		     > OMX_UNEXP_EVENTQ_ENTRY_NR)) {
+	if (unlikely(omx_unexp_eventq_full(endpoint))) {
 		/* we went too far, rollback */
 		spin_lock_bh(&endpoint->unexp_lock);
 		endpoint->nextfree_unexp_eventq_index--;
@@ -305,7 +425,7 @@ omx_prepare_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint,
 		return -EBUSY;
 	}
 
-	*recvq_offset_p = (recvq_index % OMX_RECVQ_ENTRY_NR) * OMX_RECVQ_ENTRY_SIZE;
+	*recvq_offset_p = (recvq_index & (endpoint->recvq_entry_nr - 1)) * OMX_RECVQ_ENTRY_SIZE;
 	return 0;
 }
 
@@ -324,8 +444,7 @@ omx_prepare_notify_unexp_events_with_recvq(struct omx_endpoint *endpoint,
 	endpoint->next_recvq_index += nr;
 	spin_unlock_bh(&endpoint->unexp_lock);
 
-	if (unlikely(endpoint->nextfree_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
-		     > OMX_UNEXP_EVENTQ_ENTRY_NR)) {
+	if (unlikely(omx_unexp_eventq_full(endpoint))) {
 		/* we went too far, rollback */
 		spin_lock_bh(&endpoint->unexp_lock);
 		endpoint->nextfree_unexp_eventq_index -= nr;
@@ -341,7 +460,7 @@ omx_prepare_notify_unexp_events_with_recvq(struct omx_endpoint *endpoint,
 	}
 
 	for(i=0; i<nr; i++)
-		recvq_offset_p[i] = ((first_recvq_index+i) % OMX_RECVQ_ENTRY_NR) * OMX_RECVQ_ENTRY_SIZE;
+		recvq_offset_p[i] = ((first_recvq_index+i) & (endpoint->recvq_entry_nr - 1)) * OMX_RECVQ_ENTRY_SIZE;
 	return 0;
 }
 
@@ -368,7 +487,7 @@ omx_commit_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint,
 
 	spin_unlock_bh(&endpoint->unexp_lock);
 
-	slot = endpoint->unexp_eventq + (index % OMX_UNEXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+	slot = endpoint->unexp_eventq + (index & (endpoint->recvq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
 	/* store the event without setting the id first */
 	memcpy(slot, event, length);
 	wmb();
@@ -378,7 +497,7 @@ omx_commit_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint,
 	/* wake up waiters */
 	dprintk(EVENT, "commit_notify_unexp waking up everybody\n");
 
-	omx_wakeup_waiter_list(endpoint, OMX_CMD_WAIT_EVENT_STATUS_EVENT);
+	omx_wakeup_waiters_on_event(endpoint);
 }
 
 /*
@@ -404,7 +523,7 @@ omx_cancel_notify_unexp_event_with_recvq(struct omx_endpoint *endpoint)
 
 	spin_unlock_bh(&endpoint->unexp_lock);
 
-	slot = endpoint->unexp_eventq + (index % OMX_UNEXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+	slot = endpoint->unexp_eventq + (index & (endpoint->recvq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
 	/* store the event without setting the id first */
 	((struct omx_evt_generic *) slot)->id = 0;
 	((struct omx_evt_generic *) slot)->type = OMX_EVT_IGNORE;
@@ -461,6 +580,11 @@ omx_ioctl_wait_event(struct omx_endpoint * endpoint, void __user * uparam)
 		goto out;
 	}
 
+	/* deliver retained packets now that the library processed its events,
+	 * the check below will then prevent us from sleeping
+	 */
+	omx_endpoint_deliver_unexp_retained(endpoint);
+
 	/* FIXME: wait on some event type only */
 
 	/* queue ourself on the wait queue first, in case a packet arrives in the meantime */
@@ -470,6 +594,11 @@ omx_ioctl_wait_event(struct omx_endpoint * endpoint, void __user * uparam)
 	spin_lock(&endpoint->waiters_lock);
 	list_add_tail_rcu(&waiter->list_elt, &endpoint->waiters);
 	spin_unlock(&endpoint->waiters_lock);
+	atomic_inc(&endpoint->waiters_nr);
+	/* order waiters_nr with the check of event indexes below,
+	 * event notifiers check waiters_nr after writing their event
+	 */
+	smp_mb();
 
 	/* did we deposit an event before the lib decided to go to sleep ? */
 	BUILD_BUG_ON(sizeof(cmd.next_exp_event_index) != sizeof(endpoint->nextfree_exp_eventq_index));
@@ -543,6 +672,7 @@ omx_ioctl_wait_event(struct omx_endpoint * endpoint, void __user * uparam)
 	spin_lock(&endpoint->waiters_lock);
 	list_del_rcu(&waiter->list_elt);
 	spin_unlock(&endpoint->waiters_lock);
+	atomic_dec(&endpoint->waiters_nr);
 
 	if (waiter->status == OMX_CMD_WAIT_EVENT_STATUS_NONE) {
 		/* status didn't changed, we have been interrupted */
@@ -573,13 +703,13 @@ int
 omx_ioctl_release_exp_slots(struct omx_endpoint *endpoint, void __user *uparam)
 {
 	int err = 0;
-	spin_lock(&endpoint->release_exp_lock);
+	spin_lock_bh(&endpoint->release_exp_lock);
 	if (endpoint->nextfree_exp_eventq_index - endpoint->nextreleased_exp_eventq_index
-	    < OMX_EXP_RELEASE_SLOTS_BATCH_NR)
+	    < OMX_RELEASE_SLOTS_BATCH_NR(endpoint->exp_eventq_entry_nr))
 		err = -EINVAL;
 	else
-		endpoint->nextreleased_exp_eventq_index += OMX_EXP_RELEASE_SLOTS_BATCH_NR;
-	spin_unlock(&endpoint->release_exp_lock);
+		endpoint->nextreleased_exp_eventq_index += OMX_RELEASE_SLOTS_BATCH_NR(endpoint->exp_eventq_entry_nr);
+	spin_unlock_bh(&endpoint->release_exp_lock);
 	return err;
 }
 
@@ -587,16 +717,23 @@ int
 omx_ioctl_release_unexp_slots(struct omx_endpoint *endpoint, void __user *uparam)
 {
 	int err = 0;
-	spin_lock(&endpoint->release_unexp_lock);
+	spin_lock_bh(&endpoint->release_unexp_lock);
 	if (endpoint->nextreserved_unexp_eventq_index - endpoint->nextreleased_unexp_eventq_index
-	    < OMX_UNEXP_RELEASE_SLOTS_BATCH_NR)
+	    < OMX_RELEASE_SLOTS_BATCH_NR(endpoint->recvq_entry_nr))
 		err = -EINVAL;
 	else
-		endpoint->nextreleased_unexp_eventq_index += OMX_UNEXP_RELEASE_SLOTS_BATCH_NR;
-	spin_unlock(&endpoint->release_unexp_lock);
+		endpoint->nextreleased_unexp_eventq_index += OMX_RELEASE_SLOTS_BATCH_NR(endpoint->recvq_entry_nr);
+	spin_unlock_bh(&endpoint->release_unexp_lock);
 	return err;
 }
 
+int
+omx_ioctl_deliver_unexp_retained(struct omx_endpoint *endpoint, void __user *uparam)
+{
+	omx_endpoint_deliver_unexp_retained(endpoint);
+	return 0;
+}
+
 int
 omx_ioctl_wakeup(struct omx_endpoint * endpoint, void __user * uparam)
 {
@@ -62,6 +62,44 @@ omx_vmalloc_user(unsigned long size)
 }
 #endif /* !OMX_HAVE_VMALLOC_USER */
 
+#ifdef OMX_HAVE_WORK_ON_CPU
+#include <linux/workqueue.h>
+#include <linux/topology.h>
+
+static long
+omx__vmalloc_user_workfn(void *arg)
+{
+	return (long) omx_vmalloc_user(*(unsigned long *) arg);
+}
+
+/*
+ * vmalloc_user() has no node argument, let a cpu of the target node
+ * allocate the area so that its pages come from this node
+ */
+static inline void *
+omx_vmalloc_user_node(unsigned long size, int node)
+{
+	unsigned cpu;
+
+	if (node < 0 || node == numa_node_id())
+		return omx_vmalloc_user(size);
+
+	cpu = cpumask_any_and(cpumask_of_node(node), cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		return omx_vmalloc_user(size);
+
+	return (void *) work_on_cpu(cpu, omx__vmalloc_user_workfn, &size);
+}
+#else /* !OMX_HAVE_WORK_ON_CPU */
+#define omx_vmalloc_user_node(size, node) omx_vmalloc_user(size)
+#endif /* !OMX_HAVE_WORK_ON_CPU */
+
+#ifdef OMX_HAVE_KMEM_CACHE_CREATE_DTOR
+#define omx_kmem_cache_create(name, size, align, flags) kmem_cache_create(name, size, align, flags, NULL, NULL)
+#else
+#define omx_kmem_cache_create(name, size, align, flags) kmem_cache_create(name, size, align, flags, NULL)
+#endif
+
 #if (defined OMX_HAVE_REMAP_VMALLOC_RANGE) && !(defined OMX_HAVE_VMALLOC_USER)
 /*
  * Do not use the official remap_vmalloc_range() since it requires VM_USERMAP
@@ -302,6 +340,13 @@ omx_get_user_pages_fast(unsigned long start, int nr_pages, int write, struct pag
 }
 #endif /* !OMX_HAVE_GET_USER_PAGES_FAST */
 
+#ifdef OMX_HAVE_VMA_KERNEL_PAGESIZE
+#include <linux/hugetlb.h>
+#else
+/* no way to know about huge pages, pin regular pages only */
+#define vma_kernel_pagesize(vma) PAGE_SIZE
+#endif
+
 /* skb_frag_page() added in 3.2 */
 #ifndef OMX_HAVE_SKB_FRAG_PAGE
 static inline struct page *skb_frag_page(const skb_frag_t *frag) { return frag->page; }
@@ -134,6 +134,47 @@ omx_ifaces_get_count(void)
 	return count;
 }
 
+/*
+ * Return whether any endpoint is open on any omx iface.
+ *
+ * Called with ifaces mutex hold. endpoint_nr is read without the iface
+ * endpoints mutex, a concurrent open or close does not matter to callers.
+ */
+int
+omx_ifaces_have_endpoints(void)
+{
+	int i;
+
+	for (i=0; i<omx_iface_max; i++) {
+		struct omx_iface * iface = rcu_dereference_protected(omx_ifaces[i], 1);
+		if (iface && iface->endpoint_nr)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * NUMA node of the board, or -1 if unknown
+ */
+int
+omx_iface_get_numa_node(uint32_t board_index)
+{
+	struct omx_iface * iface;
+	int node = -1;
+
+	if (board_index >= omx_iface_max)
+		return -1;
+
+	rcu_read_lock();
+	iface = rcu_dereference(omx_ifaces[board_index]);
+	if (iface)
+		node = omx_ifp_node(iface->eth_ifp);
+	rcu_read_unlock();
+
+	return node;
+}
+
 /*
  * Return the address and name of an iface.
  */
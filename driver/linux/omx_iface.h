@@ -104,7 +104,9 @@ extern int omx_ifnames_get_kp(char *buf, struct kernel_param *kp);
 extern int omx_ifnames_set_kp(const char *buf, struct kernel_param *kp);
 
 extern int omx_ifaces_get_count(void);
+extern int omx_ifaces_have_endpoints(void);
 extern int omx_iface_get_info(uint32_t board_index, struct omx_board_info *info);
+extern int omx_iface_get_numa_node(uint32_t board_index);
 extern struct omx_iface * omx_iface_find_by_ifp(const struct net_device *ifp);
 extern struct omx_iface * omx_iface_find_by_addr(uint64_t addr);
 extern int omx_iface_get_counters(uint32_t board_index, int clear, uint64_t buffer_addr, uint32_t buffer_length);
@@ -121,8 +123,13 @@ extern struct omx_iface * omx_shared_fake_iface;
 do {						\
 	iface->counters[OMX_COUNTER_##index]++;	\
 } while (0)
+#  define omx_counter_add(iface, index, nr)		\
+do {							\
+	iface->counters[OMX_COUNTER_##index] += (nr);	\
+} while (0)
 #else
 #  define omx_counter_inc(iface, index) (void) iface /* to silence unused warning */
+#  define omx_counter_add(iface, index, nr) (void) iface /* to silence unused warning */
 #endif /* OMX_DRIVER_COUNTERS */
 
 #endif /* __omx_iface_h__ */
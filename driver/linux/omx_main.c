@@ -83,6 +83,10 @@ int omx_skb_copy_max = 0;
 module_param_named(skbcopy, omx_skb_copy_max, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(skbcopy, "Maximum length of data to copy in linear skb instead of attaching pages");
 
+int omx_skb_cache_nr = 32;
+module_param_named(skbcache, omx_skb_cache_nr, uint, S_IRUGO);
+MODULE_PARM_DESC(skbcache, "Number of preallocated header-sized skbs per cpu for sending");
+
 int omx_pin_synchronous = 1;
 module_param_named(pinsync, omx_pin_synchronous, uint, S_IRUGO); /* not writable to simplify things */
 MODULE_PARM_DESC(pinsync, "Pin user regions synchronously on register");
@@ -99,6 +103,18 @@ int omx_pin_chunk_pages_max = 1024;
 module_param_named(pinchunkmax, omx_pin_chunk_pages_max, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(pinchunkmax, "Maximum number of pages to pin at once");
 
+int omx_pull_blocks_min = 4;
+module_param_named(pullblocksmin, omx_pull_blocks_min, uint, S_IRUGO); /* not writable to simplify things */
+MODULE_PARM_DESC(pullblocksmin, "Initial number of pull blocks requested in parallel");
+
+int omx_pull_blocks_max = OMX_PULL_BLOCK_DESCS_MAX;
+module_param_named(pullblocksmax, omx_pull_blocks_max, uint, S_IRUGO); /* not writable to simplify things */
+MODULE_PARM_DESC(pullblocksmax, "Maximal number of pull blocks requested in parallel");
+
+int omx_unexp_retain_kb = 1024;
+module_param_named(unexpretain, omx_unexp_retain_kb, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(unexpretain, "Kilobytes of unexpected packets retained per endpoint while its queue is full");
+
 int omx_pin_invalidate = 0;
 module_param_named(pininvalidate, omx_pin_invalidate, uint, S_IRUGO); /* not writable to simplify things */
 MODULE_PARM_DESC(pininvalidate, "User region pin invalidating when MMU notifiers are supported");
@@ -268,14 +284,14 @@ omx_get_driver_string(unsigned int *lenp)
 	buflen += len;
 
 	len = snprintf(tmp, OMX_DRIVER_STRING_LEN-buflen,
-		       " SendQ: %ldB x %ld slots\n",
-		       (unsigned long) OMX_SENDQ_ENTRY_SIZE, (unsigned long) OMX_SENDQ_ENTRY_NR);
+		       " SendQ: %ldB x %ld slots by default\n",
+		       (unsigned long) OMX_SENDQ_ENTRY_SIZE, (unsigned long) OMX_SENDQ_ENTRY_NR_DEFAULT);
 	tmp += len;
 	buflen += len;
 
 	len = snprintf(tmp, OMX_DRIVER_STRING_LEN-buflen,
-		       " RecvQ: %ldB x %ld slots\n",
-		       (unsigned long) OMX_RECVQ_ENTRY_SIZE, (unsigned long) OMX_RECVQ_ENTRY_NR);
+		       " RecvQ: %ldB x %ld slots by default\n",
+		       (unsigned long) OMX_RECVQ_ENTRY_SIZE, (unsigned long) OMX_RECVQ_ENTRY_NR_DEFAULT);
 	tmp += len;
 	buflen += len;
 
@@ -286,16 +302,17 @@ omx_get_driver_string(unsigned int *lenp)
 	buflen += len;
 
 	len = snprintf(tmp, OMX_DRIVER_STRING_LEN-buflen,
-		       " LargeMessages: %ld requests in parallel, %ld x %ldB pull replies per request\n",
-		       (unsigned long) OMX_PULL_BLOCK_DESCS_NR,
+		       " LargeMessages: %ld-%ld requests in parallel, %ld x %ldB pull replies per request\n",
+		       (unsigned long) omx_pull_blocks_min,
+		       (unsigned long) omx_pull_blocks_max,
 		       (unsigned long) OMX_PULL_REPLY_PER_BLOCK,
 		       (unsigned long) OMX_PULL_REPLY_LENGTH_MAX);
 	tmp += len;
 	buflen += len;
 
 	len = snprintf(tmp, OMX_DRIVER_STRING_LEN-buflen,
-		       " SkBuff: <=%d frags%s, ForcedCopy <=%dB\n",
-		       omx_skb_frags, omx_skb_frags ? "" : " (always linear)", omx_skb_copy_max);
+		       " SkBuff: <=%d frags%s, ForcedCopy <=%dB, Cache %d/cpu\n",
+		       omx_skb_frags, omx_skb_frags ? "" : " (always linear)", omx_skb_copy_max, omx_skb_cache_nr);
 	tmp += len;
 	buflen += len;
 
@@ -416,6 +433,16 @@ omx_init(void)
 		printk(KERN_INFO "Open-MX: Cannot use progressive pinning while synchronous\n");
 		omx_pin_progressive = 0;
 	}
+	if (omx_pull_blocks_max < 1 || omx_pull_blocks_max > OMX_PULL_BLOCK_DESCS_MAX) {
+		printk(KERN_INFO "Open-MX: Cannot request more than %d pull blocks in parallel\n",
+		       OMX_PULL_BLOCK_DESCS_MAX);
+		omx_pull_blocks_max = OMX_PULL_BLOCK_DESCS_MAX;
+	}
+	if (omx_pull_blocks_min < 1 || omx_pull_blocks_min > omx_pull_blocks_max) {
+		printk(KERN_INFO "Open-MX: Initial number of parallel pull blocks must be between 1 and %d\n",
+		       omx_pull_blocks_max);
+		omx_pull_blocks_min = omx_pull_blocks_max;
+	}
 
 	/* setup driver abi config, feature mask and mtu */
 	omx_driver_userdesc->abi_config = omx_get_abi_config();
@@ -456,10 +483,18 @@ omx_init(void)
 	if (ret < 0)
 		goto out_with_timer;
 
-	ret = omx_peers_init();
+	ret = omx_pull_init();
 	if (ret < 0)
 		goto out_with_dma;
 
+	ret = omx_send_init();
+	if (ret < 0)
+		goto out_with_pull;
+
+	ret = omx_peers_init();
+	if (ret < 0)
+		goto out_with_send;
+
 	ret = omx_net_init();
 	if (ret < 0)
 		goto out_with_peers;
@@ -481,6 +516,10 @@ omx_init(void)
 	omx_net_exit();
  out_with_peers:
 	omx_peers_init();
+ out_with_send:
+	omx_send_exit();
+ out_with_pull:
+	omx_pull_exit();
  out_with_dma:
 	omx_dma_exit();
  out_with_timer:
@@ -501,6 +540,8 @@ omx_exit(void)
 	omx_raw_exit();
 	omx_net_exit();
 	omx_peers_exit();
+	omx_send_exit();
+	omx_pull_exit();
 	omx_dma_exit();
 	del_timer_sync(&omx_driver_userdesc_update_timer);
 	vfree(omx_driver_userdesc);
@@ -24,6 +24,10 @@
 #include <linux/list.h>
 #include <linux/timer.h>
 #include <linux/rcupdate.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+#include <linux/bitmap.h>
 #ifdef OMX_HAVE_MUTEX
 #include <linux/mutex.h>
 #endif
@@ -38,7 +42,11 @@
 
 static struct omx_peer __rcu ** omx_peer_array;
 static struct list_head * omx_peer_addr_hash_array;
-static int omx_peer_next_nr;
+static unsigned int omx_peer_addr_hash_bits;
+static int omx_peers_nr; /* number of used indexes in the peer array */
+static int omx_peer_first_free; /* no index below this one is free */
+static unsigned long * omx_peer_retired_map; /* removed indexes that cannot be reused yet */
+static int omx_peers_retired_nr;
 static int omx_peer_table_full;
 
 static struct list_head omx_host_query_peer_list;
@@ -58,7 +66,7 @@ static struct omx_cmd_peer_table_state omx_peer_table_state = {
   *  - per-index array of peers
   *  - per-index array of ifaces
   *  - hashed lists
-  *  - next_nr
+  *  - peers_nr, first_free and the retired indexes
   *  - all peer hostnames (never accessed by the bottom half)
   *  - the host_query peer list
   *
@@ -70,7 +78,12 @@ struct mutex omx_ifaces_peers_mutex;
 /* magic number used in host_query/reply */
 static int omx_host_query_magic = 0x13052008;
 
-#define OMX_PEER_ADDR_HASH_NR 256
+/*
+ * The addr hash is sized according to the peer table size
+ * so that lookups by address only walk very short lists.
+ */
+#define OMX_PEER_ADDR_HASH_NR_MIN 256
+#define OMX_PEER_ADDR_HASH_NR (1U << omx_peer_addr_hash_bits)
 
 /* forward declaration */
 static void omx_peer_host_query(const struct omx_peer *peer);
@@ -129,15 +142,117 @@ omx_init_iface_reverse_indexes(struct omx_iface *iface)
  * Peer Table Management
  */
 
-static INLINE __pure uint8_t
+static INLINE __pure uint32_t
 omx_peer_addr_hash(uint64_t board_addr)
 {
-	uint32_t tmp24;
-	uint8_t tmp8;
+	return hash_64(board_addr, omx_peer_addr_hash_bits);
+}
+
+/*
+ * Make the retired indexes available again once no endpoint is open,
+ * since no library may have cached partners using them anymore.
+ *
+ * Called with peers mutex hold
+ */
+static void
+omx_peer_reclaim_retired_indexes(void)
+{
+	int i;
+
+	if (!omx_peers_retired_nr || omx_ifaces_have_endpoints())
+		return;
+
+	dprintk(PEER, "reclaiming %d retired peer indexes\n", omx_peers_retired_nr);
+
+	for(i=0; i<omx_peer_max; i++)
+		if (test_bit(i, omx_peer_retired_map)) {
+			__clear_bit(i, omx_peer_retired_map);
+			omx_peers_nr--;
+			if (i < omx_peer_first_free)
+				omx_peer_first_free = i;
+		}
+	omx_peers_retired_nr = 0;
+
+	if (omx_peer_table_full) {
+		omx_peer_table_full = 0;
+		omx_peer_table_state.status &= ~OMX_PEER_TABLE_STATUS_FULL;
+	}
+}
+
+/*
+ * Find a free index in the peer array, reusing indexes of removed peers.
+ * Returns -1 if the table is full.
+ *
+ * Called with peers mutex hold
+ */
+static int
+omx_peer_find_free_index(void)
+{
+	int i;
+
+	omx_peer_reclaim_retired_indexes();
+
+	if (omx_peers_nr == omx_peer_max)
+		return -1;
+
+	for(i=omx_peer_first_free; i<omx_peer_max; i++)
+		if (!rcu_access_pointer(omx_peer_array[i])
+		    && !test_bit(i, omx_peer_retired_map))
+			return i;
+
+	BUG();
+	return -1;
+}
+
+/*
+ * Hash a peer and store it in the peer array at its index.
+ *
+ * Called with peers mutex hold
+ */
+static void
+omx_peer_table_insert(struct omx_peer *peer, uint32_t hash)
+{
+	uint32_t index = peer->index;
 
-	tmp24 = board_addr ^ (board_addr >> 24);
-	tmp8 = tmp24 ^ (tmp24 >> 8) ^ (tmp24 >> 16);
-	return tmp8;
+	list_add_tail_rcu(&peer->addr_hash_elt, &omx_peer_addr_hash_array[hash]);
+	rcu_assign_pointer(omx_peer_array[index], peer);
+
+	omx_peers_nr++;
+	if (index == omx_peer_first_free)
+		omx_peer_first_free++;
+}
+
+/*
+ * Unhash a peer and make its index available again.
+ * While some endpoints are open, the index is only retired since
+ * libraries cache partners by peer index and would not notice that
+ * it now designates another peer.
+ * The caller must wait for a RCU grace period before freeing the peer.
+ *
+ * Called with peers mutex hold
+ */
+static void
+omx_peer_table_remove(struct omx_peer *peer)
+{
+	uint32_t index = peer->index;
+
+	list_del_rcu(&peer->addr_hash_elt);
+	RCU_INIT_POINTER(omx_peer_array[index], NULL);
+
+	if (omx_ifaces_have_endpoints()) {
+		__set_bit(index, omx_peer_retired_map);
+		omx_peers_retired_nr++;
+		return;
+	}
+
+	omx_peers_nr--;
+	if (index < omx_peer_first_free)
+		omx_peer_first_free = index;
+
+	if (omx_peer_table_full) {
+		omx_peer_table_full = 0;
+		omx_peer_table_state.status &= ~OMX_PEER_TABLE_STATUS_FULL;
+	}
 }
 
 static void
@@ -151,6 +266,7 @@ __omx_peer_rcu_free_callback(struct rcu_head *rcu_head)
 void
 omx_peers_clear(int local)
 {
+	int nr;
 	int i;
 
 	dprintk(PEER, "clearing all peers\n");
@@ -171,8 +287,7 @@ omx_peers_clear(int local)
 			continue;
 		}
 
-		list_del_rcu(&peer->addr_hash_elt);
-		RCU_INIT_POINTER(omx_peer_array[i], NULL);
+		omx_peer_table_remove(peer);
 
 		if (iface) {
 			dprintk(PEER, "detaching iface %s (%s) peer #%d\n",
@@ -198,27 +313,37 @@ omx_peers_clear(int local)
 			call_rcu(&peer->rcu_head, __omx_peer_rcu_free_callback);
 		}
 	}
-	omx_peer_next_nr = 0;
 	omx_peer_table_full = 0;
 	omx_peer_table_state.status &= ~OMX_PEER_TABLE_STATUS_FULL;
 
+	/* clearing renumbers the whole table anyway, forget about retired indexes */
+	bitmap_zero(omx_peer_retired_map, omx_peer_max);
+	omx_peers_nr -= omx_peers_retired_nr;
+	omx_peers_retired_nr = 0;
+
 	if (!local) {
 		/* move local ifaces back to the beginning */
+		nr = 0;
 		for(i=0; i<omx_peer_max; i++) {
 			struct omx_peer * peer = rcu_dereference_protected(omx_peer_array[i], 1);
 			if (!peer)
 				continue;
-			if (i != omx_peer_next_nr) {
-				peer->index = omx_peer_next_nr;
-				rcu_assign_pointer(omx_peer_array[omx_peer_next_nr], peer);
+			if (i != nr) {
+				peer->index = nr;
+				rcu_assign_pointer(omx_peer_array[nr], peer);
 				RCU_INIT_POINTER(omx_peer_array[i], NULL);
 			}
-			omx_peer_next_nr++;
+			nr++;
 		}
-		if (omx_peer_next_nr == omx_peer_max) {
+		BUG_ON(nr != omx_peers_nr);
+		omx_peer_first_free = nr;
+		if (nr == omx_peer_max) {
 			omx_peer_table_full = 1;
 			omx_peer_table_state.status |= OMX_PEER_TABLE_STATUS_FULL;
 		}
+	} else {
+		BUG_ON(omx_peers_nr);
+		omx_peer_first_free = 0;
 	}
 
 	omx_ifaces_peers_unlock();
@@ -230,8 +355,8 @@ omx_peer_add(uint64_t board_addr, const char *hostname)
 	struct omx_peer * peer;
 	struct omx_iface * iface;
 	char * new_hostname = NULL;
-	uint16_t index;
-	uint8_t hash;
+	int index = -1;
+	uint32_t hash;
 	int already_hashed = 0;
 	int needshostquery = 0;
 	int err;
@@ -257,7 +382,8 @@ omx_peer_add(uint64_t board_addr, const char *hostname)
 	/* if not already hashed, check that we can get a new peer index */
 	if (!already_hashed) {
 		err = -ENOMEM;
-		if (omx_peer_next_nr == omx_peer_max) {
+		index = omx_peer_find_free_index();
+		if (index < 0) {
 			/* only warn once when failing to add a remote peer */
 			if (!omx_peer_table_full) {
 				printk(KERN_INFO "Failed to add peer addr %012llx name %s, peer table is full\n",
@@ -350,8 +476,8 @@ omx_peer_add(uint64_t board_addr, const char *hostname)
 	}
 
 	if (!already_hashed) {
-		/* this is a new peer, allocate an index and hash it */
-		peer->index = index = omx_peer_next_nr;
+		/* this is a new peer, use the free index and hash it */
+		peer->index = index;
 
 		if (iface) {
 			dprintk(PEER, "adding peer %d with addr %012llx (local peer)\n",
@@ -363,9 +489,7 @@ omx_peer_add(uint64_t board_addr, const char *hostname)
 			omx_init_peer_reverse_indexes(peer->index, 0);
 		}
 
-		list_add_tail_rcu(&peer->addr_hash_elt, &omx_peer_addr_hash_array[hash]);
-		rcu_assign_pointer(omx_peer_array[omx_peer_next_nr], peer);
-		omx_peer_next_nr++;
+		omx_peer_table_insert(peer, hash);
 	}
 
 	if (needshostquery)
@@ -392,8 +516,8 @@ omx_peers_notify_iface_attach(struct omx_iface * iface)
 {
 	struct omx_peer * oldpeer, * ifacepeer;
 	uint64_t board_addr;
-	uint32_t index;
-	uint8_t hash;
+	int index;
+	uint32_t hash;
 	int err;
 
 	ifacepeer = &iface->peer;
@@ -449,7 +573,8 @@ omx_peers_notify_iface_attach(struct omx_iface * iface)
 	/* the iface is not in the peer table yet, add it */
 
 	err = -ENOMEM;
-	if (omx_peer_next_nr == omx_peer_max) {
+	index = omx_peer_find_free_index();
+	if (index < 0) {
 		/* always warn when failing to add a local iface */
 		printk(KERN_INFO "Failed to attach local iface %s (%s) with address %012llx, peer table is full\n",
 		       iface->eth_ifp->name, ifacepeer->hostname, (unsigned long long) board_addr);
@@ -458,8 +583,7 @@ omx_peers_notify_iface_attach(struct omx_iface * iface)
 		goto out;
 	}
 
-	/* this is a new peer, allocate an index and hash it */
-	index = omx_peer_next_nr;
+	/* this is a new peer, use the free index and hash it */
 
 	/* board_addr already set */
 	ifacepeer->local_iface = iface;
@@ -474,9 +598,7 @@ omx_peers_notify_iface_attach(struct omx_iface * iface)
 
 	/* no need to host query */
 
-	list_add_tail_rcu(&ifacepeer->addr_hash_elt, &omx_peer_addr_hash_array[hash]);
-	rcu_assign_pointer(omx_peer_array[index], ifacepeer);
-	omx_peer_next_nr++;
+	omx_peer_table_insert(ifacepeer, hash);
 
 	return 0;
 
@@ -498,9 +620,10 @@ omx_peers_notify_iface_detach(struct omx_iface * iface)
 		dprintk(PEER, "detaching iface %s (%s) peer #%d\n",
 			iface->eth_ifp->name, peer->hostname, index);
 
-		/* the iface is in the array, just remove it, we don't really care about still having it in the peer table */
-		list_del_rcu(&peer->addr_hash_elt);
-		RCU_INIT_POINTER(omx_peer_array[index], NULL);
+		/* the iface is in the array, just remove it, we don't really care about still having it in the peer table.
+		 * its index may be reused by a new peer once no endpoint is open anymore.
+		 */
+		omx_peer_table_remove(peer);
 		/* no need to bother using call_rcu() here, waiting a bit long in synchronize_rcu() is ok */
 		synchronize_rcu();
 
@@ -692,7 +815,7 @@ omx_peer_lookup_by_index(uint32_t index,
 struct omx_peer *
 omx_peer_lookup_by_addr_locked(uint64_t board_addr)
 {
-	uint8_t hash;
+	uint32_t hash;
 	struct omx_peer * peer;
 
 	hash = omx_peer_addr_hash(board_addr);
@@ -1166,7 +1289,9 @@ omx_peers_init(void)
 
 	mutex_init(&omx_ifaces_peers_mutex);
 
-	omx_peer_next_nr = 0;
+	omx_peers_nr = 0;
+	omx_peer_first_free = 0;
+	omx_peers_retired_nr = 0;
 	omx_peer_table_full = 0;
 	omx_peer_table_state.status &= ~OMX_PEER_TABLE_STATUS_FULL;
 
@@ -1179,11 +1304,20 @@ omx_peers_init(void)
 	for(i=0; i<omx_peer_max; i++)
 		RCU_INIT_POINTER(omx_peer_array[i], NULL);
 
-	omx_peer_addr_hash_array = kmalloc(OMX_PEER_ADDR_HASH_NR * sizeof(*omx_peer_addr_hash_array), GFP_KERNEL);
+	omx_peer_retired_map = vmalloc(BITS_TO_LONGS(omx_peer_max) * sizeof(*omx_peer_retired_map));
+	if (!omx_peer_retired_map) {
+		printk(KERN_ERR "Open-MX: Failed to allocate the peer retired index map\n");
+		err = -ENOMEM;
+		goto out_with_peer_array;
+	}
+	bitmap_zero(omx_peer_retired_map, omx_peer_max);
+
+	omx_peer_addr_hash_bits = ilog2(roundup_pow_of_two(max(omx_peer_max, OMX_PEER_ADDR_HASH_NR_MIN)));
+	omx_peer_addr_hash_array = vmalloc(OMX_PEER_ADDR_HASH_NR * sizeof(*omx_peer_addr_hash_array));
 	if (!omx_peer_addr_hash_array) {
 		printk(KERN_ERR "Open-MX: Failed to allocate the peer addr hash array\n");
 		err = -ENOMEM;
-		goto out_with_peer_array;
+		goto out_with_retired_map;
 	}
 	for(i=0; i<OMX_PEER_ADDR_HASH_NR; i++)
 		INIT_LIST_HEAD(&omx_peer_addr_hash_array[i]);
@@ -1195,6 +1329,8 @@ omx_peers_init(void)
 
 	return 0;
 
+ out_with_retired_map:
+	vfree(omx_peer_retired_map);
  out_with_peer_array:
 	vfree(omx_peer_array);
  out:
@@ -1213,7 +1349,8 @@ omx_peers_exit(void)
 	del_timer_sync(&omx_host_query_timer);
 	/* and let the caller flush any outstanding deferred work */
 
-	kfree(omx_peer_addr_hash_array);
+	vfree(omx_peer_addr_hash_array);
+	vfree(omx_peer_retired_map);
 	vfree(omx_peer_array);
 	skb_queue_purge(&omx_host_query_list);
 	skb_queue_purge(&omx_host_reply_list);
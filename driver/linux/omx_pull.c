@@ -41,6 +41,12 @@
 #define OMX_PULL_RETRANSMIT_TIMEOUT_MS	1000
 #define OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES (OMX_PULL_RETRANSMIT_TIMEOUT_MS*HZ/1000)
 
+/* the endpoint timer looks for handles to retransmit several times per timeout */
+#define OMX_PULL_HANDLES_TIMER_JIFFIES ((OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES+3)/4)
+
+/* number of pull handles preallocated and kept in each endpoint pool */
+#define OMX_PULL_HANDLES_POOL_NR 32
+
 #ifdef OMX_MX_WIRE_COMPAT
 #if OMX_PULL_REPLY_LENGTH_MAX >= 65536
 #error Cannot store rdma offsets > 65535 in 16bits offsets on the wire
@@ -70,26 +76,19 @@ typedef uint8_t omx_block_frame_bitmask_t;
 
 enum omx_pull_handle_status {
 	/*
-	 * The handle is normal, being processed as usual and its timeout handler is running ok.
-	 * It is queued on the endpoint list.
+	 * The handle is normal, being processed as usual.
+	 * It is in the slot array and queued on the endpoint list,
+	 * where the endpoint timer looks for retransmissions.
 	 */
 	OMX_PULL_HANDLE_STATUS_OK,
 
-	/*
-	 * The handle has been removed from the slot array since no incoming packet can use it.
-	 * But the timeout handler is still running, so the handle is still queued on the endpoint list.
-	 * Either the pull has completed (or aborted on error), or the endpoint is being closed and
-	 * the timeout handle must exit net time it runs (or del_timer_sync will kill it first).
-	 */
-	OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT,
-
 	/*
 	 * The handle has been removed from the slot array and the endpoint list.
-	 * Its timeout handler has exited and released its reference on the handle and endpoint.
-	 * Either the pull has completed (or aborted on error) and the handler caught the MUST_EXIT status,
-	 * or the timeout was reached and its handler aborted the handle directly.
+	 * Either the pull has completed (or aborted on error or timeout),
+	 * or the endpoint is being closed.
+	 * The reference of the endpoint list is released after a RCU grace period.
 	 */
-	OMX_PULL_HANDLE_STATUS_TIMER_EXITED,
+	OMX_PULL_HANDLE_STATUS_DONE,
 };
 
 struct omx_pull_block_desc {
@@ -101,17 +100,20 @@ struct omx_pull_block_desc {
 
 struct omx_pull_handle {
 	struct kref refcount;
-	struct list_head list_elt; /* always queued on one of the endpoint lists */
+	struct list_head list_elt; /* queued on the endpoint list while OK, or in the endpoint pool when free */
+	struct list_head timeout_list_elt; /* queued on the endpoint timer local list while being processed */
+	struct rcu_head rcu_head;
 
 	uint32_t slot_id; /* 32bits slot identifier */
 
-	/* timer for retransmission */
-	struct timer_list retransmit_timer;
+	/* retransmission */
+	uint64_t retransmit_jiffies; /* when to request missing blocks again */
 	uint64_t last_retransmit_jiffies;
 
 	/* global pull fields */
 	struct omx_endpoint * endpoint;
 	struct omx_user_region * region;
+	uint32_t puller_rdma_offset; /* offset of the receive buffer in the region */
 	uint32_t total_length;
 	uint32_t pulled_rdma_offset;
 
@@ -124,8 +126,9 @@ struct omx_pull_handle {
 	uint32_t nr_requested_frames; /* number of frames requested */
 	uint32_t nr_missing_frames; /* frames requested but not received yet */
 	uint32_t nr_valid_block_descs;
-	uint32_t already_rerequested_blocks; /* amount of first blocks that were requested again since the last timer */
-	struct omx_pull_block_desc block_desc[OMX_PULL_BLOCK_DESCS_NR];
+	uint32_t block_window; /* number of blocks that may be requested in parallel */
+	uint32_t already_rerequested_blocks; /* amount of first blocks that were requested again since the last retransmit deadline */
+	struct omx_pull_block_desc block_desc[OMX_PULL_BLOCK_DESCS_MAX];
 
 	/* synchronous host copies */
 	uint32_t host_copy_nr_frames; /* frames received but not copied yet*/
@@ -145,7 +148,7 @@ struct omx_pull_handle {
 	struct omx_hdr pkt_hdr;
 };
 
-static void omx_pull_handle_timeout_handler(unsigned long data);
+static void omx_endpoint_pull_handles_timer_handler(unsigned long data);
 
 #ifdef OMX_HAVE_DMA_ENGINE
 static void omx_pull_handle_poll_dma_completions(struct omx_pull_handle *handle);
@@ -163,21 +166,25 @@ static void omx_pull_handle_deferred_dma_completions_wait_workfunc(omx_work_stru
  * It also protects its handle status and its queueing in the endpoint lists and slot array.
  * This lock is always taken *before* the endpoint pull handle lock.
  *
- * The handle is always queued on endpoint list as long as its timer is running.
- * As long as the timer is pending, a reference on the handle and endpoint is held.
- * The endpoint closing enforces its destruction. When the endpoint starts to be
- * closed (either ioctl, or last closing of the file descriptor, or interface being
- * removed), it calls pull_handles_exit which sets all handles to timer_must_exit
- * and uses del_timer_sync to either cancel the next timer or wait for it to end.
- * Then the timer will never run again and the handle may safely be destroyed.
+ * The handle is queued on the endpoint list as long as its status is OK.
+ * This list owns a reference on the handle and endpoint. It is released
+ * after a RCU grace period once the handle is done, so that the lockless
+ * lookup in the slot array never acquires a handle that is being freed.
+ * A single timer per endpoint scans this list for handles to retransmit,
+ * it only runs while the list is not empty. When the endpoint resources are
+ * freed, pull_handles_exit removes remaining handles and stops this timer.
+ *
+ * Free handles are kept in a per-endpoint pool (protected by the endpoint
+ * pull handle lock) so that creating a handle usually does not allocate.
  *
  * The pile of handles for an endpoint is protected by a spinlock. It is not taken
  * when acquiring an handle (when a pull reply or nack mcp arrives, likely in a
  * bottom half) because this is RCU protected. It is only taken for modification
  * when creating a handle (when the application request a pull), finishing a handle
  * (when a pull reply completes the pull request, likely in a bottom half), when
- * completing a handle on timeout (from the timer softirq), and when destroying
- * remaining handles (when the endpoint is closed).
+ * scanning or completing handles on timeout (from the timer softirq), when
+ * destroying remaining handles (when the endpoint is closed), and when putting
+ * a free handle back in the pool.
  * Since a bottom half and the application may both acquire the spinlock, we must
  * always disable bottom halves when taking the spinlock.
  */
@@ -185,22 +192,30 @@ static void omx_pull_handle_deferred_dma_completions_wait_workfunc(omx_work_stru
 /*
  * Notes about retransmission:
  *
- * The puller requests OMX_PULL_BLOCK_DESCS_NR blocks of data, and waits for
+ * The puller requests up to block_window blocks of data, and waits for
  * OMX_PULL_REPLY_PER_BLOCK replies for each of them.
  *
- * A timer is set to detect when nothing has been received for a while.  It is
- * updated every time a new reply is received. This timer repost requests to
- * get current blocks (using descriptors that were cached in the pull handle).
+ * The window starts at the pullblocksmin module parameter. It grows by one
+ * block each time the first block completes while the whole window was in
+ * flight and no loss was suspected, up to pullblocksmax. It is halved when
+ * the timeout handler has to request blocks again.
+ *
+ * A retransmit deadline is set to detect when nothing has been received for a while.
+ * It is updated every time a new reply is received. When the endpoint timer
+ * finds it expired, it reposts requests to get current blocks (using descriptors
+ * that were cached in the pull handle).
  *
  * Additionally, if the second (or more) block completes before the first one,
  * there is a good chance that one packet got lost for the former blocks.
  * In this case, we optimistically re-request the former blocks.
  * To avoid re-requesting too often, we do it only once per timeout.
  *
- * In the end, the timer is only called if:
+ * In the end, the deadline only expires if:
  * + one packet is lost in all outstanding blocks
  * + or one packet is missing in the first block after one optimistic re-request.
  * So the timeout doesn't need to be short, 1 second is enough.
+ * The endpoint timer runs 4 times per timeout, so it is actually
+ * detected between 1 and 1.25 second.
  */
 
 #ifdef OMX_DRIVER_DEBUG
@@ -212,6 +227,73 @@ static unsigned long omx_PULL_REQ_packet_loss_index = 0;
 static unsigned long omx_PULL_REPLY_packet_loss_index = 0;
 #endif /* OMX_DRIVER_DEBUG */
 
+/*******************************
+ * Pull handles cache and pools
+ */
+
+static struct kmem_cache *omx_pull_handle_cachep = NULL;
+
+int
+omx_pull_init(void)
+{
+	omx_pull_handle_cachep = omx_kmem_cache_create("omx_pull_handle",
+						       sizeof(struct omx_pull_handle),
+						       0, SLAB_HWCACHE_ALIGN);
+	if (!omx_pull_handle_cachep) {
+		printk(KERN_ERR "Open-MX: Failed to create the pull handle cache\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void
+omx_pull_exit(void)
+{
+	/* wait for the last handles to be released by RCU callbacks */
+	rcu_barrier();
+	kmem_cache_destroy(omx_pull_handle_cachep);
+}
+
+/*
+ * Get a free handle from the endpoint pool, or NULL if empty.
+ *
+ * Called with the endpoint pull lock held
+ */
+static INLINE struct omx_pull_handle *
+omx_pull_handle_pool_get(struct omx_endpoint * endpoint)
+{
+	struct omx_pull_handle * handle;
+
+	if (unlikely(list_empty(&endpoint->pull_handles_pool)))
+		return NULL;
+
+	handle = list_first_entry(&endpoint->pull_handles_pool, struct omx_pull_handle, list_elt);
+	list_del(&handle->list_elt);
+	endpoint->pull_handles_pool_nr--;
+	return handle;
+}
+
+/*
+ * Put a free handle back in the endpoint pool,
+ * or really free it if the pool is full or the endpoint is being closed.
+ */
+static void
+omx_pull_handle_free(struct omx_endpoint * endpoint,
+		     struct omx_pull_handle * handle)
+{
+	spin_lock_bh(&endpoint->pull_handles_lock);
+	if (likely(!endpoint->pull_handles_closing
+		   && endpoint->pull_handles_pool_nr < OMX_PULL_HANDLES_POOL_NR)) {
+		list_add(&handle->list_elt, &endpoint->pull_handles_pool);
+		endpoint->pull_handles_pool_nr++;
+		handle = NULL;
+	}
+	spin_unlock_bh(&endpoint->pull_handles_lock);
+
+	if (handle)
+		kmem_cache_free(omx_pull_handle_cachep, handle);
+}
+
 /**********************************
  * Pull handle acquiring/releasing
  */
@@ -239,12 +321,13 @@ __omx_pull_handle_last_release(struct kref * kref)
 	dprintk(KREF, "releasing the last reference on pull handle %p\n",
 		handle);
 
-	BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_TIMER_EXITED);
+	BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_DONE);
 
 	/* release the region now that we are sure that nobody else uses it */
 	omx_user_region_release(handle->region);
 
-	kfree(handle);
+	/* the endpoint is still acquired by whoever released the handle */
+	omx_pull_handle_free(handle->endpoint, handle);
 }
 
 /*
@@ -293,8 +376,8 @@ omx_pull_handle_slots_init(struct omx_endpoint *endpoint)
 	struct omx_pull_handle_slot *slots;
 	int i;
 
-	slots = kmalloc(OMX_PULL_HANDLE_SLOT_INDEX_MAX*sizeof(*slots),
-			GFP_KERNEL);
+	slots = kmalloc_node(OMX_PULL_HANDLE_SLOT_INDEX_MAX*sizeof(*slots),
+			     GFP_KERNEL, endpoint->numa_node);
 	if (!slots)
 		return -ENOMEM;
 	endpoint->pull_handle_slots_array = slots;
@@ -431,17 +514,70 @@ omx_pull_handle_acquire_from_slot(struct omx_endpoint *endpoint,
  * Per-endpoint pull handles management
  */
 
+/* RCU callback releasing the reference of the endpoint list on a done handle */
+static void
+__omx_pull_handle_rcu_release_callback(struct rcu_head *rcu_head)
+{
+	struct omx_pull_handle * handle = container_of(rcu_head, struct omx_pull_handle, rcu_head);
+	struct omx_endpoint * endpoint = handle->endpoint;
+
+	omx_pull_handle_release(handle);
+	omx_endpoint_release(endpoint);
+}
+
+/*
+ * Mark a handle as done, remove it from the slot array so that
+ * no incoming packet can find it anymore, and from the endpoint list.
+ *
+ * Called with the handle lock held
+ */
+static void
+omx_pull_handle_unlink(struct omx_endpoint * endpoint,
+		       struct omx_pull_handle * handle)
+{
+	BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_OK);
+	handle->status = OMX_PULL_HANDLE_STATUS_DONE;
+
+	spin_lock_bh(&endpoint->pull_handles_lock);
+	omx_pull_handle_free_slot(endpoint, handle);
+	list_del(&handle->list_elt);
+	spin_unlock_bh(&endpoint->pull_handles_lock);
+
+	/* lookups in the slot array may still see the handle until the end of the grace period */
+	call_rcu(&handle->rcu_head, __omx_pull_handle_rcu_release_callback);
+}
+
 int
 omx_endpoint_pull_handles_init(struct omx_endpoint * endpoint)
 {
+	int i;
+
 	INIT_LIST_HEAD(&endpoint->pull_handles_list);
 	omx_pull_handle_slots_init(endpoint);
 	spin_lock_init(&endpoint->pull_handles_lock);
+
+	setup_timer(&endpoint->pull_handles_timer, omx_endpoint_pull_handles_timer_handler,
+		    (unsigned long) endpoint);
+	endpoint->pull_handles_closing = 0;
+
+	/* preallocate some handles, the pool will grow back to this size when they are freed */
+	INIT_LIST_HEAD(&endpoint->pull_handles_pool);
+	endpoint->pull_handles_pool_nr = 0;
+	for(i=0; i<OMX_PULL_HANDLES_POOL_NR; i++) {
+		struct omx_pull_handle * handle;
+
+		handle = kmem_cache_alloc_node(omx_pull_handle_cachep, GFP_KERNEL, endpoint->numa_node);
+		if (!handle)
+			break;
+		list_add(&handle->list_elt, &endpoint->pull_handles_pool);
+		endpoint->pull_handles_pool_nr++;
+	}
+
 	return 0;
 }
 
 /*
- * Called when the endpoint starts to be closed.
+ * Called when the endpoint resources are freed.
  */
 void
 omx_endpoint_pull_handles_exit(struct omx_endpoint * endpoint)
@@ -449,15 +585,16 @@ omx_endpoint_pull_handles_exit(struct omx_endpoint * endpoint)
 	might_sleep();
 
 	/*
-	 * ask all pull handles of the endpoint to stop their timer.
+	 * remove all pull handles of the endpoint.
 	 * but we can't take endpoint->pull_handles_lock before handle->lock since that would deadlock
 	 * so we use a tricky loop to take locks in order
 	 */
 
 	spin_lock_bh(&endpoint->pull_handles_lock);
+	/* prevent the timer from being armed again and freed handles from going back to the pool */
+	endpoint->pull_handles_closing = 1;
 	while (!list_empty(&endpoint->pull_handles_list)) {
 		struct omx_pull_handle * handle;
-		int ret;
 
 		/* get the first handle of the list, acquire it and release the list lock */
 		handle = list_first_entry(&endpoint->pull_handles_list, struct omx_pull_handle, list_elt);
@@ -467,44 +604,11 @@ omx_endpoint_pull_handles_exit(struct omx_endpoint * endpoint)
 		/* take the handle lock and check the status in case it changed while the lock was released */
 		spin_lock_bh(&handle->lock);
 		if (handle->status == OMX_PULL_HANDLE_STATUS_OK) {
-			/* the handle didn't change, remove from the slot array so that no incoming packet can find it anymore */
-			dprintk(PULL, "(endpoint close) removing pull handle %p from slot array\n", handle);
-			spin_lock(&endpoint->pull_handles_lock);
-			omx_pull_handle_free_slot(endpoint, handle);
-			spin_unlock(&endpoint->pull_handles_lock);
-
-			/* release the lock and wait for the timer to exit */
-			handle->status = OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT;
+			dprintk(PULL, "(endpoint close) removing pull handle %p\n", handle);
+			omx_pull_handle_unlink(endpoint, handle);
 		}
 		spin_unlock_bh(&handle->lock);
 
-		dprintk(PULL, "(endpoint close) stopping handle %p timer with del_sync_timer\n", handle);
-		ret = del_timer_sync(&handle->retransmit_timer);
-		if (ret) {
-			/* we deactivated the timer, cleanup ourself */
-			spin_lock_bh(&handle->lock);
-
-			/* mark the timer as exited */
-			dprintk(PULL, "(endpoint close) del_timer_sync stopped pull handle %p timer\n", handle);
-			BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT);
-			handle->status = OMX_PULL_HANDLE_STATUS_TIMER_EXITED;
-
-			/* remove from the list */
-			spin_lock(&endpoint->pull_handles_lock);
-			list_del(&handle->list_elt);
-			spin_unlock(&endpoint->pull_handles_lock);
-
-			/* release the timer reference on the pull handle and endpoint */
-			spin_unlock_bh(&handle->lock);
-			omx_pull_handle_release(handle);
-			omx_endpoint_release(endpoint);
-
-		} else {
-			/* the timer expired meanwhile, the handle is already removed from the list */
-			BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_TIMER_EXITED);
-			dprintk(PULL, "(endpoint close) pull handle %p timer already exited\n", handle);
-		}
-
 		omx_pull_handle_release(handle);
 
 		/* take the list lock back before processing another handle */
@@ -512,6 +616,15 @@ omx_endpoint_pull_handles_exit(struct omx_endpoint * endpoint)
 	}
 	spin_unlock_bh(&endpoint->pull_handles_lock);
 
+	/* the timer cannot be armed again now */
+	del_timer_sync(&endpoint->pull_handles_timer);
+
+	/* empty the pool */
+	while (!list_empty(&endpoint->pull_handles_pool)) {
+		struct omx_pull_handle * handle = omx_pull_handle_pool_get(endpoint);
+		kmem_cache_free(omx_pull_handle_cachep, handle);
+	}
+
 	omx_pull_handle_slots_exit(endpoint);
 }
 
@@ -580,18 +693,24 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 	int i;
 	int err;
 
-	/* alloc the pull handle */
-	handle = kmalloc(sizeof(struct omx_pull_handle), GFP_KERNEL);
+	spin_lock_bh(&endpoint->pull_handles_lock);
+
+	/* get a preallocated pull handle, or allocate one close to the endpoint queues */
+	handle = omx_pull_handle_pool_get(endpoint);
 	if (unlikely(!handle)) {
-		printk(KERN_INFO "Open-MX: Failed to allocate a pull handle\n");
-		err = -ENOMEM;
-		goto out;
+		spin_unlock_bh(&endpoint->pull_handles_lock);
+		handle = kmem_cache_alloc_node(omx_pull_handle_cachep, GFP_KERNEL, endpoint->numa_node);
+		if (unlikely(!handle)) {
+			printk(KERN_INFO "Open-MX: Failed to allocate a pull handle\n");
+			err = -ENOMEM;
+			goto out;
+		}
+		spin_lock_bh(&endpoint->pull_handles_lock);
 	}
+
 	/* initialize the lock, we will acquire it soon */
 	spin_lock_init(&handle->lock);
 
-	spin_lock_bh(&endpoint->pull_handles_lock);
-
 	err = omx_pull_handle_alloc_slot(endpoint, handle);
 	if (unlikely(err < 0)) {
 		printk(KERN_ERR "Open-MX: Failed to find a slot for pull handle\n");
@@ -604,9 +723,10 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 	__acquire(&handle->lock);
 
 	/* we are good now, finish filling the handle */
-	kref_init(&handle->refcount); /* the timer's reference */
+	kref_init(&handle->refcount); /* the endpoint list's reference */
 	handle->endpoint = endpoint;
 	handle->region = (struct omx_user_region *) region;
+	handle->puller_rdma_offset = cmd->puller_rdma_offset;
 	handle->total_length = cmd->length;
 	handle->pulled_rdma_offset = cmd->pulled_rdma_offset;
 
@@ -618,9 +738,11 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 	handle->nr_requested_frames = 0;
 	handle->nr_missing_frames = 0;
 	handle->nr_valid_block_descs = 0;
-	for(i=0; i<OMX_PULL_BLOCK_DESCS_NR-1; i++)
+	handle->block_window = omx_pull_blocks_min;
+	for(i=0; i<OMX_PULL_BLOCK_DESCS_MAX; i++)
 		handle->block_desc[i].frames_missing_bitmap = 0; /* make sure the invalid block descs are easy to check */
 	handle->already_rerequested_blocks = 0;
+	handle->retransmit_jiffies = get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES;
 	handle->last_retransmit_jiffies = get_jiffies_64() + cmd->resend_timeout_jiffies;
 
 	handle->host_copy_nr_frames = 0;
@@ -645,12 +767,12 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 	if (err < 0)
 		goto out_with_slot;
 
-	/* init timer */
-	setup_timer(&handle->retransmit_timer, omx_pull_handle_timeout_handler,
-		    (unsigned long) handle);
-	omx_endpoint_reacquire(endpoint); /* keep a reference for the timer */
+	omx_endpoint_reacquire(endpoint); /* keep a reference for the endpoint list */
 
-	/* queue in the endpoint list */
+	/* queue in the endpoint list, and start its timer if we are the first one there */
+	if (list_empty(&endpoint->pull_handles_list))
+		mod_timer(&endpoint->pull_handles_timer,
+			  get_jiffies_64() + OMX_PULL_HANDLES_TIMER_JIFFIES);
 	list_add_tail(&handle->list_elt, &endpoint->pull_handles_list);
 
 	spin_unlock_bh(&endpoint->pull_handles_lock);
@@ -667,7 +789,7 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 	spin_unlock_bh(&endpoint->pull_handles_lock);
 	spin_unlock(&handle->lock);
  out_with_handle:
-	kfree(handle);
+	omx_pull_handle_free(endpoint, handle);
  out:
 	return ERR_PTR(err);
 }
@@ -679,11 +801,8 @@ omx_pull_handle_create(struct omx_endpoint * endpoint,
 /*
  * Takes an acquired and locked pull handle, unhash it and set its status.
  * Called by the BH after receiving a pull reply or a nack,
- * or by the retransmit timer when expired.
- *
- * If the timeout expired, status is OMX_EVT_PULL_DONE_TIMEOUT
- * and the timer will exit right after returning from here.
- * In the other cases, the timer needs to catch TIMER_MUST_EXIT.
+ * or by the endpoint timer when the last retransmit time is reached
+ * (status is OMX_EVT_PULL_DONE_TIMEOUT then).
  */
 static INLINE void
 omx_pull_handle_mark_completed(struct omx_pull_handle * handle, uint8_t status)
@@ -693,13 +812,7 @@ omx_pull_handle_mark_completed(struct omx_pull_handle * handle, uint8_t status)
 	/* tell the sparse checker that the caller took the lock */
 	__acquire(&handle->lock);
 
-	BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_OK);
-	handle->status = OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT;
-
-	/* remove from the slot array so that no incoming packet can find it anymore */
-	spin_lock_bh(&endpoint->pull_handles_lock);
-	omx_pull_handle_free_slot(endpoint, handle);
-	spin_unlock_bh(&endpoint->pull_handles_lock);
+	omx_pull_handle_unlink(endpoint, handle);
 
 	/* finish filling the event for user-space */
 	/* enforce that nack type and pull status have same values */
@@ -799,7 +912,8 @@ omx_pull_handle_first_block_done(struct omx_pull_handle * handle)
 		handle->already_rerequested_blocks--;
 	memmove(&handle->block_desc[0], &handle->block_desc[1],
 		sizeof(struct omx_pull_block_desc) * handle->nr_valid_block_descs);
-	handle->block_desc[OMX_PULL_BLOCK_DESCS_NR-1].frames_missing_bitmap = 0; /* make sure the invalid block descs are easy to check */
+	/* the former last desc is now duplicated right after the valid ones */
+	handle->block_desc[handle->nr_valid_block_descs].frames_missing_bitmap = 0; /* make sure the invalid block descs are easy to check */
 
 	dprintk(PULL, "first block of pull handle %p done, removing %d requested frames, now requested %ld-%ld\n",
 		handle, first_block_frames,
@@ -867,7 +981,7 @@ omx_ioctl_pull(struct omx_endpoint * endpoint,
 	struct omx_pull_handle * handle;
 	struct omx_user_region * region;
 	struct omx_iface * iface = endpoint->iface;
-	struct sk_buff * skb, * skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_NR-1] = NULL };
+	struct sk_buff * skb, * skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_MAX-1] = NULL };
 	uint32_t block_length;
 	uint32_t pulled_rdma_offset_in_frame;
 	int i;
@@ -929,7 +1043,7 @@ omx_ioctl_pull(struct omx_endpoint * endpoint,
 	omx_pull_handle_append_needed_frames(handle, block_length, pulled_rdma_offset_in_frame);
 
 	/* prepare as many new blocks as needed */
-	while (handle->nr_valid_block_descs < OMX_PULL_BLOCK_DESCS_NR
+	while (handle->nr_valid_block_descs < handle->block_window
 	       && handle->remaining_length) {
 		/* prepare the next block */
 		block_length = OMX_PULL_BLOCK_LENGTH_MAX;
@@ -956,10 +1070,8 @@ omx_ioctl_pull(struct omx_endpoint * endpoint,
 	}
 
  skbs_ready:
-	/* schedule the timeout handler now that we are ready to send the requests */
-	/* timer not pending yet, use the regular mod_timer() */
-	mod_timer(&handle->retransmit_timer,
-		  get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES);
+	/* set the retransmit deadline now that we are ready to send the requests */
+	handle->retransmit_jiffies = get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES;
 
 	/*
 	 * do not keep the lock while sending
@@ -967,7 +1079,7 @@ omx_ioctl_pull(struct omx_endpoint * endpoint,
 	 */
 	spin_unlock(&handle->lock);
 
-	for(i=0; i<OMX_PULL_BLOCK_DESCS_NR; i++)
+	for(i=0; i<OMX_PULL_BLOCK_DESCS_MAX; i++)
 		if (likely(skbs[i]))
 			omx_queue_xmit(iface, skbs[i], PULL_REQ);
 
@@ -987,7 +1099,7 @@ static INLINE void
 omx_progress_pull_on_handle_timeout_handle_locked(struct omx_iface * iface,
 						  struct omx_pull_handle * handle)
 {
-	struct sk_buff *skb, *skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_NR-1] = NULL };
+	struct sk_buff *skb, *skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_MAX-1] = NULL };
 	int i;
 
 	/* tell the sparse checker that the lock has been taken by the caller */
@@ -996,6 +1108,12 @@ omx_progress_pull_on_handle_timeout_handle_locked(struct omx_iface * iface,
 	/* request the first block again */
 	omx_counter_inc(iface, PULL_TIMEOUT_HANDLER_FIRST_BLOCK);
 
+	/* something got lost, request less blocks in parallel from now on */
+	if (handle->block_window > omx_pull_blocks_min) {
+		handle->block_window = max_t(uint32_t, handle->block_window / 2, omx_pull_blocks_min);
+		omx_counter_inc(iface, PULL_WINDOW_SHRINK);
+	}
+
 	skb = omx_fill_pull_block_request(handle, 0);
 	if (unlikely(IS_ERR(skb))) {
 		BUG_ON(PTR_ERR(skb) != -ENOMEM);
@@ -1011,7 +1129,7 @@ omx_progress_pull_on_handle_timeout_handle_locked(struct omx_iface * iface,
 	 * This shouldn't happen often since it means a packet has been lost
 	 * in each block.
 	 */
-	for(i=1; i<OMX_PULL_BLOCK_DESCS_NR; i++) {
+	for(i=1; i<OMX_PULL_BLOCK_DESCS_MAX; i++) {
 		if (handle->block_desc[i].frames_missing_bitmap) {
 			omx_counter_inc(iface, PULL_TIMEOUT_HANDLER_NONFIRST_BLOCK);
 
@@ -1029,10 +1147,8 @@ omx_progress_pull_on_handle_timeout_handle_locked(struct omx_iface * iface,
 	/* cleanup a bit of dma-offloaded copies */
 	omx_pull_handle_poll_dma_completions(handle);
 
-	/* reschedule another timeout handler */
-	/* timer already expired, use the regular mod_timer() */
-	mod_timer(&handle->retransmit_timer,
-		  get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES);
+	/* set another retransmit deadline */
+	handle->retransmit_jiffies = get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES;
 
 	/*
 	 * do not keep the lock while sending
@@ -1040,74 +1156,94 @@ omx_progress_pull_on_handle_timeout_handle_locked(struct omx_iface * iface,
 	 */
 	spin_unlock(&handle->lock);
 
-	for(i=0; i<OMX_PULL_BLOCK_DESCS_NR; i++)
+	for(i=0; i<OMX_PULL_BLOCK_DESCS_MAX; i++)
 		if (likely(skbs[i]))
 			omx_queue_xmit(iface, skbs[i], PULL_REQ);
 }
 
 /*
- * Retransmission callback, owns a reference on the handle and endpoint.
- * Running as long as status is OMX_PULL_HANDLE_STATUS_OK.
+ * Retransmit or abort a handle whose retransmit deadline expired.
+ * The handle is acquired, but not locked.
  */
 static void
-omx_pull_handle_timeout_handler(unsigned long data)
+omx_pull_handle_timeout(struct omx_endpoint * endpoint,
+			struct omx_pull_handle * handle)
 {
-	struct omx_pull_handle * handle = (void *) data;
-	struct omx_endpoint * endpoint = handle->endpoint;
 	struct omx_iface * iface = endpoint->iface;
-
-	dprintk(PULL, "pull handle %p timer reached, might need to request again\n", handle);
+	uint64_t now = get_jiffies_64();
 
 	spin_lock(&handle->lock);
 
-	if (handle->status != OMX_PULL_HANDLE_STATUS_OK) {
-		BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT);
-
-		dprintk(PULL, "pull handle %p timer exiting on close request\n", handle);
-		spin_lock_bh(&endpoint->pull_handles_lock);
-		list_del(&handle->list_elt);
-		spin_unlock_bh(&endpoint->pull_handles_lock);
-
-		handle->status = OMX_PULL_HANDLE_STATUS_TIMER_EXITED;
+	/* check the status and deadline again now that we own the lock */
+	if (handle->status != OMX_PULL_HANDLE_STATUS_OK
+	    || !time_after64(now, handle->retransmit_jiffies)) {
 		spin_unlock(&handle->lock);
-
 		omx_pull_handle_release(handle);
-		omx_endpoint_release(endpoint);
-
-		return; /* timer will never be called again (status is TIMER_EXITED) */
+		return;
 	}
 
-	if (time_after64(get_jiffies_64(), handle->last_retransmit_jiffies)) {
-		BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_OK);
-
+	if (time_after64(now, handle->last_retransmit_jiffies)) {
 		dprintk(PULL, "pull handle %p last retransmit time reached, reporting an error\n", handle);
 		omx_counter_inc(iface, PULL_TIMEOUT_ABORT);
 
 		omx_pull_handle_mark_completed(handle, OMX_EVT_PULL_DONE_TIMEOUT);
 
-		dprintk(PULL, "pull handle %p timer done, removing from endpoint list\n", handle);
-		spin_lock_bh(&endpoint->pull_handles_lock);
-		list_del(&handle->list_elt);
-		spin_unlock_bh(&endpoint->pull_handles_lock);
-
-		BUG_ON(handle->status != OMX_PULL_HANDLE_STATUS_TIMER_MUST_EXIT);
-		handle->status = OMX_PULL_HANDLE_STATUS_TIMER_EXITED;
-
 		/* nobody is going to use this handle, no need to lock anymore */
 		spin_unlock(&handle->lock);
 
 		/* let notify release the handle and endpoint */
+		omx_endpoint_reacquire(endpoint);
 		omx_pull_handle_bh_notify(handle);
-
-		return; /* timer will never be called again (status is TIMER_EXITED) */
+		return;
 	}
 
 	BUG_ON(!handle->block_desc[0].frames_missing_bitmap);
 
+	dprintk(PULL, "pull handle %p retransmit deadline reached, requesting again\n", handle);
+
 	/* request more replies if necessary */
 	omx_progress_pull_on_handle_timeout_handle_locked(iface, handle);
 	/* tell sparse checker that the lock has been released by omx_progress_pull_on_handle_timeout_handle_locked() */
 	__release(&handle->lock);
+
+	omx_pull_handle_release(handle);
+}
+
+/*
+ * Endpoint retransmission timer, running as long as the endpoint has some pull handles.
+ * Instead of having one timer per handle that is modified on each pull reply,
+ * look at the deadline of all handles a few times per retransmit timeout.
+ */
+static void
+omx_endpoint_pull_handles_timer_handler(unsigned long data)
+{
+	struct omx_endpoint * endpoint = (void *) data;
+	struct omx_pull_handle * handle, * next;
+	uint64_t now = get_jiffies_64();
+	LIST_HEAD(expired);
+
+	/* acquire expired handles, we can't take their lock while holding the list lock */
+	spin_lock_bh(&endpoint->pull_handles_lock);
+	list_for_each_entry(handle, &endpoint->pull_handles_list, list_elt) {
+		if (time_after64(now, handle->retransmit_jiffies)) {
+			omx_pull_handle_acquire(handle);
+			list_add_tail(&handle->timeout_list_elt, &expired);
+		}
+	}
+	spin_unlock_bh(&endpoint->pull_handles_lock);
+
+	list_for_each_entry_safe(handle, next, &expired, timeout_list_elt) {
+		list_del(&handle->timeout_list_elt);
+		omx_pull_handle_timeout(endpoint, handle);
+	}
+
+	/* run again as long as some handles remain */
+	spin_lock_bh(&endpoint->pull_handles_lock);
+	if (!endpoint->pull_handles_closing
+	    && !list_empty(&endpoint->pull_handles_list))
+		mod_timer(&endpoint->pull_handles_timer,
+			  get_jiffies_64() + OMX_PULL_HANDLES_TIMER_JIFFIES);
+	spin_unlock_bh(&endpoint->pull_handles_lock);
 }
 
 /*******************************************
@@ -1563,7 +1699,7 @@ omx_progress_pull_on_recv_pull_reply_locked(struct omx_iface * iface,
 					    struct omx_pull_handle * handle,
 					    int idesc)
 {
-	struct sk_buff * skb, * skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_NR-1] = NULL };
+	struct sk_buff * skb, * skbs[] = { [0 ... OMX_PULL_BLOCK_DESCS_MAX-1] = NULL };
 	int completed_block = !handle->block_desc[idesc].frames_missing_bitmap;
 	int i;
 
@@ -1608,9 +1744,21 @@ omx_progress_pull_on_recv_pull_reply_locked(struct omx_iface * iface,
 
 		int first_block;
 
+		/*
+		 * grow the window if the whole window was in flight and nothing seems lost,
+		 * the link could likely handle more blocks in parallel
+		 */
+		if (handle->nr_valid_block_descs >= handle->block_window
+		    && handle->block_window < omx_pull_blocks_max
+		    && !handle->already_rerequested_blocks
+		    && handle->remaining_length) {
+			handle->block_window++;
+			omx_counter_inc(iface, PULL_WINDOW_GROW);
+		}
+
 		omx_pull_handle_first_block_done(handle);
 		/* drop next blocks if they are done */
-		for(i=1; i<OMX_PULL_BLOCK_DESCS_NR; i++) {
+		for(i=1; i<OMX_PULL_BLOCK_DESCS_MAX; i++) {
 			if (!handle->nr_valid_block_descs
 			    || handle->block_desc[0].frames_missing_bitmap)
 				break;
@@ -1619,7 +1767,7 @@ omx_progress_pull_on_recv_pull_reply_locked(struct omx_iface * iface,
 		first_block = handle->nr_valid_block_descs;
 
 		/* prepare as many new blocks as needed */
-		while (handle->nr_valid_block_descs < OMX_PULL_BLOCK_DESCS_NR
+		while (handle->nr_valid_block_descs < handle->block_window
 		       && handle->remaining_length) {
 			uint32_t block_length;
 			/* prepare the next block */
@@ -1656,10 +1804,8 @@ omx_progress_pull_on_recv_pull_reply_locked(struct omx_iface * iface,
 		omx_pull_handle_poll_dma_completions(handle);
 	}
 
-	/* reschedule the timeout handler now that we are ready to send the requests */
-	/* timer still pending, use the mod_timer_pending() */
-	omx_mod_timer_pending(&handle->retransmit_timer,
-			      get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES);
+	/* push the retransmit deadline back now that we are ready to send the requests */
+	handle->retransmit_jiffies = get_jiffies_64() + OMX_PULL_RETRANSMIT_TIMEOUT_JIFFIES;
 
 	/*
 	 * do not keep the lock while sending
@@ -1667,37 +1813,40 @@ omx_progress_pull_on_recv_pull_reply_locked(struct omx_iface * iface,
 	 */
 	spin_unlock(&handle->lock);
 
-	for(i=0; i<OMX_PULL_BLOCK_DESCS_NR; i++)
+	for(i=0; i<OMX_PULL_BLOCK_DESCS_MAX; i++)
 		if (likely(skbs[i]))
 			omx_queue_xmit(iface, skbs[i], PULL_REQ);
 }
 
-int
-omx_recv_pull_reply(struct omx_iface * iface,
-		    struct omx_hdr * mh,
-		    struct sk_buff * skb)
+/*
+ * Process one pull reply frame for an acquired handle.
+ *
+ * Returns 1 if the handle got completed, its notification then releases
+ * the handle and endpoint. Returns 0 if the caller still has to release them.
+ * The skb is always consumed.
+ */
+static int
+omx_recv_pull_reply_frame(struct omx_iface * iface,
+			  struct omx_endpoint * endpoint,
+			  struct omx_pull_handle * handle,
+			  struct omx_hdr * mh,
+			  struct sk_buff * skb)
 {
 	struct omx_pkt_pull_reply *pull_reply_n = &mh->body.pull_reply;
 	size_t hdr_len = sizeof(struct omx_pkt_head) + sizeof(struct omx_pkt_pull_reply);
-	uint32_t dst_pull_handle = OMX_NTOH_32(pull_reply_n->dst_pull_handle);
-	uint32_t dst_magic = OMX_NTOH_32(pull_reply_n->dst_magic);
 	uint32_t frame_length = OMX_NTOH_16(pull_reply_n->frame_length);
 	uint32_t frame_seqnum = OMX_NTOH_8(pull_reply_n->frame_seqnum);
 	uint32_t msg_offset = OMX_NTOH_32(pull_reply_n->msg_offset);
 	uint32_t frame_seqnum_offset; /* unsigned to make seqnum offset easy to check */
 	int idesc;
-	struct omx_endpoint * endpoint;
-	struct omx_pull_handle * handle;
 	omx_block_frame_bitmask_t bitmap_mask;
 	int remaining_copy = frame_length;
-	int err = 0;
+	int completed = 0;
 	int free_skb = 1;
 
-	omx_counter_inc(iface, RECV_PULL_REPLY);
-
 	omx_recv_dprintk(&mh->head.eth, "PULL REPLY handle %lx magic %lx frame seqnum %ld length %ld skb length %ld",
-			 (unsigned long) dst_pull_handle,
-			 (unsigned long) dst_magic,
+			 (unsigned long) OMX_NTOH_32(pull_reply_n->dst_pull_handle),
+			 (unsigned long) OMX_NTOH_32(pull_reply_n->dst_magic),
 			 (unsigned long) frame_seqnum,
 			 (unsigned long) frame_length,
 			 (unsigned long) skb->len - hdr_len);
@@ -1708,32 +1857,9 @@ omx_recv_pull_reply(struct omx_iface * iface,
 		omx_drop_dprintk(&mh->head.eth, "PULL REPLY packet with %ld bytes instead of %d",
 				 (unsigned long) skb->len - hdr_len,
 				 (unsigned) frame_length);
-		err = -EINVAL;
 		goto out;
 	}
 
-	/* acquire the endpoint */
-	endpoint = omx_endpoint_acquire_by_iface_index(iface, dst_magic ^ OMX_ENDPOINT_PULL_MAGIC_XOR);
-	if (unlikely(IS_ERR(endpoint))) {
-		omx_counter_inc(iface, DROP_PULL_REPLY_BAD_MAGIC_ENDPOINT);
-		omx_drop_dprintk(&mh->head.eth, "PULL REPLY packet with bad endpoint index within magic %ld",
-				 (unsigned long) dst_magic);
-		/* no need to nack this */
-		err = -EINVAL;
-		goto out;
-	}
-
-	/* acquire the handle within the endpoint slot array */
-	handle = omx_pull_handle_acquire_from_slot(endpoint, dst_pull_handle);
-	if (unlikely(!handle)) {
-		omx_counter_inc(iface, DROP_PULL_REPLY_BAD_WIRE_HANDLE);
-		omx_drop_dprintk(&mh->head.eth, "PULL REPLY packet with bad wire handle %lx",
-				 (unsigned long) dst_pull_handle);
-		/* no need to nack this */
-		err = -EINVAL;
-		goto out_with_endpoint;
-	}
-
 	/* no session to check */
 
 	/* lock the handle */
@@ -1743,9 +1869,7 @@ omx_recv_pull_reply(struct omx_iface * iface,
 	if (handle->status != OMX_PULL_HANDLE_STATUS_OK) {
 		/* the handle is being closed, forget about this packet */
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		err = 0;
-		goto out_with_endpoint;
+		goto out;
 	}
 
 	/*
@@ -1764,9 +1888,7 @@ omx_recv_pull_reply(struct omx_iface * iface,
 				 (unsigned long) (msg_offset+OMX_PULL_REPLY_LENGTH_MAX-1) / OMX_PULL_REPLY_LENGTH_MAX,
 				 (unsigned long) msg_offset);
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		err = 0;
-		goto out_with_endpoint;
+		goto out;
 	}
 
 	/* check that the frame is from this block, and handle wrap around 256 */
@@ -1778,9 +1900,7 @@ omx_recv_pull_reply(struct omx_iface * iface,
 				 (unsigned long) handle->frame_index,
 				 (unsigned long) handle->frame_index + handle->nr_requested_frames);
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		err = 0;
-		goto out_with_endpoint;
+		goto out;
 	}
 
 	/* check that the frame is not a duplicate */
@@ -1794,9 +1914,7 @@ omx_recv_pull_reply(struct omx_iface * iface,
 				 (unsigned long) handle->frame_index,
 				 (unsigned long) handle->frame_index + handle->nr_requested_frames);
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		err = 0;
-		goto out_with_endpoint;
+		goto out;
 	}
 	handle->block_desc[idesc].frames_missing_bitmap &= ~bitmap_mask;
 	handle->nr_missing_frames--;
@@ -1805,7 +1923,9 @@ omx_recv_pull_reply(struct omx_iface * iface,
 	if (omx_dmaengine
 	    && frame_length >= omx_dma_async_frag_min
 	    && handle->total_length >= omx_dma_async_min) {
-		remaining_copy = omx_pull_handle_reply_try_dma_copy(iface, handle, skb, msg_offset, frame_length);
+		remaining_copy = omx_pull_handle_reply_try_dma_copy(iface, handle, skb,
+								    handle->puller_rdma_offset + msg_offset,
+								    frame_length);
 		if (likely(remaining_copy != frame_length))
 			free_skb = 0;
 	}
@@ -1821,14 +1941,16 @@ omx_recv_pull_reply(struct omx_iface * iface,
 
 #ifndef OMX_NORECVCOPY
 	if (remaining_copy) {
+		int err;
+
 		/* fill segment pages, if something remains to be copied */
 		dprintk(PULL, "copying PULL_REPLY %ld bytes for msg_offset %ld at region offset %ld\n",
 		       (unsigned long) frame_length,
 		       (unsigned long) msg_offset,
-		       (unsigned long) msg_offset);
+		       (unsigned long) handle->puller_rdma_offset + msg_offset);
 		err = omx_user_region_fill_pages(handle->region,
-						 msg_offset,
-						 skb,
+						 handle->puller_rdma_offset + msg_offset,
+						 skb, hdr_len,
 						 frame_length);
 		if (unlikely(err < 0)) {
 			omx_counter_inc(iface, PULL_REPLY_FILL_FAILED);
@@ -1842,6 +1964,7 @@ omx_recv_pull_reply(struct omx_iface * iface,
 			/* nobody is going to use this handle, no need to lock anymore */
 			spin_unlock(&handle->lock);
 			omx_pull_handle_bh_notify(handle);
+			completed = 1;
 			goto out;
 		}
 	}
@@ -1857,37 +1980,131 @@ omx_recv_pull_reply(struct omx_iface * iface,
 	if (handle->status != OMX_PULL_HANDLE_STATUS_OK) {
 		/* the handle is being closed, forget about this packet */
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		err = 0;
-		goto out_with_endpoint;
+		goto out;
 	}
 
 	if (!handle->remaining_length && !handle->nr_missing_frames && !handle->host_copy_nr_frames) {
 		/* handle is done, notify the completion */
 		dprintk(PULL, "notifying pull completion\n");
+		if (handle->block_window <= 4)
+			omx_counter_inc(iface, PULL_DONE_WINDOW_1_4);
+		else if (handle->block_window <= 8)
+			omx_counter_inc(iface, PULL_DONE_WINDOW_5_8);
+		else
+			omx_counter_inc(iface, PULL_DONE_WINDOW_9_MORE);
 		omx_pull_handle_mark_completed(handle, OMX_EVT_PULL_DONE_SUCCESS);
 		/* nobody is going to use this handle, no need to lock anymore */
 		spin_unlock(&handle->lock);
 		omx_pull_handle_bh_notify(handle);
+		completed = 1;
 	} else {
-		/* there's more to receive or copy, just release the handle */
+		/* there's more to receive or copy */
 		spin_unlock(&handle->lock);
-		omx_pull_handle_release(handle);
-		omx_endpoint_release(endpoint);
 	}
 
+ out:
 	if (free_skb)
 		dev_kfree_skb(skb);
+	return completed;
+}
+
+int
+omx_recv_pull_reply(struct omx_iface * iface,
+		    struct omx_hdr * mh,
+		    struct sk_buff * skb)
+{
+	struct omx_pkt_pull_reply *pull_reply_n = &mh->body.pull_reply;
+	uint32_t dst_pull_handle = OMX_NTOH_32(pull_reply_n->dst_pull_handle);
+	uint32_t dst_magic = OMX_NTOH_32(pull_reply_n->dst_magic);
+	struct omx_endpoint * endpoint;
+	struct omx_pull_handle * handle;
+	int err;
+
+	omx_counter_inc(iface, RECV_PULL_REPLY);
+
+	/* acquire the endpoint */
+	endpoint = omx_endpoint_acquire_by_iface_index(iface, dst_magic ^ OMX_ENDPOINT_PULL_MAGIC_XOR);
+	if (unlikely(IS_ERR(endpoint))) {
+		omx_counter_inc(iface, DROP_PULL_REPLY_BAD_MAGIC_ENDPOINT);
+		omx_drop_dprintk(&mh->head.eth, "PULL REPLY packet with bad endpoint index within magic %ld",
+				 (unsigned long) dst_magic);
+		/* no need to nack this */
+		err = -EINVAL;
+		goto out;
+	}
+
+	/* acquire the handle within the endpoint slot array */
+	handle = omx_pull_handle_acquire_from_slot(endpoint, dst_pull_handle);
+	if (unlikely(!handle)) {
+		omx_counter_inc(iface, DROP_PULL_REPLY_BAD_WIRE_HANDLE);
+		omx_drop_dprintk(&mh->head.eth, "PULL REPLY packet with bad wire handle %lx",
+				 (unsigned long) dst_pull_handle);
+		/* no need to nack this */
+		err = -EINVAL;
+		goto out_with_endpoint;
+	}
+
+	if (!omx_recv_pull_reply_frame(iface, endpoint, handle, mh, skb)) {
+		omx_pull_handle_release(handle);
+		omx_endpoint_release(endpoint);
+	}
 	return 0;
 
  out_with_endpoint:
 	omx_endpoint_release(endpoint);
  out:
-	if (free_skb)
-		dev_kfree_skb(skb);
+	dev_kfree_skb(skb);
 	return err;
 }
 
+#ifdef OMX_HAVE_PACKET_TYPE_LIST_FUNC
+/*
+ * Process consecutive pull replies of a receive batch that target the same handle,
+ * acquiring the endpoint and handle only once for all of them.
+ * Their header must be linear.
+ */
+void
+omx_recv_pull_replies(struct omx_iface * iface,
+		      struct sk_buff_head * queue)
+{
+	struct sk_buff * skb = skb_peek(queue);
+	struct omx_pkt_pull_reply *pull_reply_n = &omx_skb_mac_header(skb)->body.pull_reply;
+	uint32_t dst_pull_handle = OMX_NTOH_32(pull_reply_n->dst_pull_handle);
+	uint32_t dst_magic = OMX_NTOH_32(pull_reply_n->dst_magic);
+	struct omx_endpoint * endpoint;
+	struct omx_pull_handle * handle;
+
+	if (skb_queue_len(queue) == 1)
+		goto one_by_one;
+
+	endpoint = omx_endpoint_acquire_by_iface_index(iface, dst_magic ^ OMX_ENDPOINT_PULL_MAGIC_XOR);
+	if (unlikely(IS_ERR(endpoint)))
+		goto one_by_one;
+
+	handle = omx_pull_handle_acquire_from_slot(endpoint, dst_pull_handle);
+	if (unlikely(!handle)) {
+		omx_endpoint_release(endpoint);
+		goto one_by_one;
+	}
+
+	while ((skb = __skb_dequeue(queue)) != NULL) {
+		omx_counter_inc(iface, RECV_PULL_REPLY);
+		if (omx_recv_pull_reply_frame(iface, endpoint, handle, omx_skb_mac_header(skb), skb))
+			/* the handle is gone, let the remaining replies be dropped as usual */
+			goto one_by_one;
+	}
+
+	omx_pull_handle_release(handle);
+	omx_endpoint_release(endpoint);
+	return;
+
+ one_by_one:
+	/* let the usual path report errors */
+	while ((skb = __skb_dequeue(queue)) != NULL)
+		omx_recv_pull_reply(iface, omx_skb_mac_header(skb), skb);
+}
+#endif /* OMX_HAVE_PACKET_TYPE_LIST_FUNC */
+
 /******************
  * Recv pull nacks
  */
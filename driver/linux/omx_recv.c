@@ -28,6 +28,7 @@
 #include "omx_iface.h"
 #include "omx_peer.h"
 #include "omx_endpoint.h"
+#include "omx_reg.h"
 #include "omx_dma.h"
 
 /***************************
@@ -274,6 +275,131 @@ omx_recv_tiny(struct omx_iface * iface,
 	return err;
 }
 
+/*
+ * Retention of unexpected packets while the unexpected queue is full.
+ *
+ * Small and medium packets need a recvq slot that the library releases only
+ * after processing the corresponding event. When it does not consume the
+ * queue fast enough, the skbs are kept in a per-endpoint list (up to
+ * omx_unexp_retain_kb of skb memory) instead of being dropped and resent.
+ * They are delivered again, in order, before any newer packet once some
+ * slots are released, when the library asks for it or goes to sleep.
+ */
+
+/* set in the skb control buffer once retained */
+#define OMX_SKB_RETAINED(skb) (*(uint8_t *) (skb)->cb)
+
+static int omx_recv_skb(struct omx_iface * iface, struct sk_buff * skb);
+
+void
+omx_endpoint_unexp_retained_init(struct omx_endpoint * endpoint)
+{
+	skb_queue_head_init(&endpoint->unexp_retained);
+	atomic_set(&endpoint->unexp_retained_bytes, 0);
+	endpoint->unexp_retained_delivering = 0;
+	endpoint->userdesc->unexp_retained_nr = 0;
+}
+
+void
+omx_endpoint_unexp_retained_exit(struct omx_endpoint * endpoint)
+{
+	skb_queue_purge(&endpoint->unexp_retained);
+	atomic_set(&endpoint->unexp_retained_bytes, 0);
+}
+
+/* returns 0 if the skb is now retained, or -ENOBUFS if it should be dropped */
+static int
+omx_unexp_retain(struct omx_endpoint * endpoint, struct sk_buff * skb)
+{
+	if (OMX_SKB_RETAINED(skb)) {
+		/* still no slot to deliver it again, put it back in front of the others */
+		atomic_add(skb->truesize, &endpoint->unexp_retained_bytes);
+		skb_queue_head(&endpoint->unexp_retained, skb);
+		return 0;
+	}
+
+	if (atomic_read(&endpoint->unexp_retained_bytes) + skb->truesize > omx_unexp_retain_kb << 10) {
+		omx_counter_inc(endpoint->iface, UNEXP_RETAIN_LIMIT);
+		return -ENOBUFS;
+	}
+
+	OMX_SKB_RETAINED(skb) = 1;
+	atomic_add(skb->truesize, &endpoint->unexp_retained_bytes);
+	skb_queue_tail(&endpoint->unexp_retained, skb);
+	endpoint->userdesc->unexp_retained_nr = skb_queue_len(&endpoint->unexp_retained);
+	omx_counter_inc(endpoint->iface, UNEXP_RETAINED);
+	return 0;
+}
+
+/* true if newer packets must be retained behind the older ones */
+static INLINE int
+omx_endpoint_unexp_retained_pending(struct omx_endpoint * endpoint)
+{
+	/* the deliverer may have dequeued the last retained skb without having delivered it yet */
+	return !skb_queue_empty(&endpoint->unexp_retained)
+		|| test_bit(0, &endpoint->unexp_retained_delivering);
+}
+
+void
+omx_endpoint_deliver_unexp_retained(struct omx_endpoint * endpoint)
+{
+	struct sk_buff * skb;
+	int full;
+
+ again:
+	if (skb_queue_empty(&endpoint->unexp_retained))
+		return;
+
+	/* a single deliverer at a time to preserve the order */
+	if (test_and_set_bit(0, &endpoint->unexp_retained_delivering))
+		return;
+
+	full = 0;
+	local_bh_disable();
+	while ((skb = skb_dequeue(&endpoint->unexp_retained)) != NULL) {
+		atomic_sub(skb->truesize, &endpoint->unexp_retained_bytes);
+		if (omx_recv_skb(endpoint->iface, skb) == -EAGAIN) {
+			/* retained again, the queue is still full */
+			full = 1;
+			break;
+		}
+		omx_counter_inc(endpoint->iface, UNEXP_RETAINED_DELIVERED);
+	}
+	local_bh_enable();
+
+	endpoint->userdesc->unexp_retained_nr = skb_queue_len(&endpoint->unexp_retained);
+	clear_bit(0, &endpoint->unexp_retained_delivering);
+
+	/* newer packets may have been retained after our last dequeue, while we were still delivering */
+	smp_mb();
+	if (!full)
+		goto again;
+}
+
+/*
+ * Get the unexpected event and recvq slots for a packet, or retain it.
+ * Returns -EAGAIN if the skb is retained, another negative error if it should be dropped.
+ */
+static int
+omx_recv_prepare_unexp_with_recvq(struct omx_endpoint * endpoint, struct sk_buff * skb,
+				  unsigned long *recvq_offset_p)
+{
+	if (unlikely(omx_endpoint_unexp_retained_pending(endpoint)) && !OMX_SKB_RETAINED(skb)) {
+		/* older retained packets go first */
+		omx_endpoint_deliver_unexp_retained(endpoint);
+		if (omx_endpoint_unexp_retained_pending(endpoint))
+			goto retain;
+	}
+
+	if (likely(!omx_prepare_notify_unexp_event_with_recvq(endpoint, recvq_offset_p)))
+		return 0;
+
+ retain:
+	if (!omx_unexp_retain_kb || omx_unexp_retain(endpoint, skb) < 0)
+		return -EBUSY;
+	return -EAGAIN;
+}
+
 static int
 omx_recv_small(struct omx_iface * iface,
 	       struct omx_hdr * mh,
@@ -350,9 +476,14 @@ omx_recv_small(struct omx_iface * iface,
 	}
 
 	/* get the eventq slot */
-	err = omx_prepare_notify_unexp_event_with_recvq(endpoint, &recvq_offset);
+	err = omx_recv_prepare_unexp_with_recvq(endpoint, skb, &recvq_offset);
 	if (unlikely(err < 0)) {
-		/* no more unexpected eventq slot? just drop the packet, it will be resent anyway */
+		if (err == -EAGAIN) {
+			/* retained until the library releases some slots */
+			omx_endpoint_release(endpoint);
+			return err;
+		}
+		/* no more unexpected eventq slot nor room to retain? just drop the packet, it will be resent anyway */
 		omx_drop_dprintk(eh, "SMALL packet because of unexpected event queue full");
 		goto out_with_endpoint;
 	}
@@ -393,6 +524,241 @@ omx_recv_small(struct omx_iface * iface,
 	return err;
 }
 
+/*
+ * Direct placement of expected medium fragments.
+ *
+ * Multi-fragment medium messages are tracked in a small per-endpoint
+ * table until all their fragments went through. Once the library matched
+ * the first fragment with a posted receive, it attaches the corresponding
+ * user region to the entry so that the next fragments get copied from the
+ * skb straight into the receive buffer instead of going through the recvq.
+ * Anything that is not tracked anymore (evicted or already complete) just
+ * goes back to the usual recvq path.
+ */
+
+void
+omx_endpoint_medium_direct_init(struct omx_endpoint * endpoint)
+{
+	memset(endpoint->medium_direct, 0, sizeof(endpoint->medium_direct));
+	endpoint->medium_direct_next = 0;
+	spin_lock_init(&endpoint->medium_direct_lock);
+}
+
+void
+omx_endpoint_medium_direct_exit(struct omx_endpoint * endpoint)
+{
+	int i;
+
+	for(i=0; i<OMX_MEDIUM_DIRECT_ENTRY_NR; i++) {
+		struct omx_medium_direct * entry = &endpoint->medium_direct[i];
+		if (entry->region)
+			omx_user_region_release(entry->region);
+		entry->region = NULL;
+		entry->frags_missing_mask = 0;
+	}
+}
+
+/* must be called with the medium_direct_lock held */
+static inline struct omx_medium_direct *
+omx_medium_direct_find(struct omx_endpoint * endpoint,
+		       uint16_t peer_index, uint8_t src_endpoint, uint16_t seqnum)
+{
+	int i;
+
+	for(i=0; i<OMX_MEDIUM_DIRECT_ENTRY_NR; i++) {
+		struct omx_medium_direct * entry = &endpoint->medium_direct[i];
+		if (entry->frags_missing_mask
+		    && entry->seqnum == seqnum
+		    && entry->peer_index == peer_index
+		    && entry->src_endpoint == src_endpoint)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Account a fragment of a multi-fragment medium message,
+ * and copy it in the attached receive buffer if any.
+ * Returns 1 if the fragment has been placed and notified,
+ * 0 if it should go through the recvq,
+ * or a negative error if it should be dropped.
+ */
+static int
+omx_recv_medium_frag_direct(struct omx_endpoint * endpoint,
+			    struct omx_evt_recv_msg * event,
+			    const struct sk_buff * skb, size_t hdr_len)
+{
+	uint32_t msg_length = event->specific.medium_frag.msg_length;
+	uint16_t frag_length = event->specific.medium_frag.frag_length;
+	uint8_t frag_seqnum = event->specific.medium_frag.frag_seqnum;
+#ifdef OMX_MX_WIRE_COMPAT
+	unsigned long frag_max = 1UL << event->specific.medium_frag.frag_pipeline;
+#else
+	unsigned long frag_max = OMX_MEDIUM_FRAG_LENGTH_MAX;
+#endif
+	unsigned long offset = frag_seqnum * frag_max;
+	unsigned long frags_nr = (msg_length + frag_max - 1) / frag_max;
+	struct omx_medium_direct * entry;
+	struct omx_user_region * region = NULL, * released_region = NULL;
+	uint32_t frag_bit;
+	int ret = 0;
+
+	if (unlikely(frags_nr > 32 || frag_seqnum >= frags_nr))
+		/* cannot track this one, let the library take care of it */
+		return 0;
+	frag_bit = 1U << frag_seqnum;
+
+	spin_lock(&endpoint->medium_direct_lock);
+
+	entry = omx_medium_direct_find(endpoint, event->peer_index, event->src_endpoint, event->seqnum);
+	if (!entry) {
+		/* start tracking this message, replacing the oldest one if needed */
+		entry = &endpoint->medium_direct[endpoint->medium_direct_next];
+		endpoint->medium_direct_next = (endpoint->medium_direct_next + 1) % OMX_MEDIUM_DIRECT_ENTRY_NR;
+		if (entry->frags_missing_mask)
+			omx_counter_inc(endpoint->iface, MEDIUM_DIRECT_EVICTED);
+		released_region = entry->region;
+		entry->region = NULL;
+		entry->peer_index = event->peer_index;
+		entry->src_endpoint = event->src_endpoint;
+		entry->seqnum = event->seqnum;
+		entry->frags_missing_mask = frags_nr == 32 ? ~0U : (1U << frags_nr) - 1;
+	}
+
+	if (unlikely(!(entry->frags_missing_mask & frag_bit)))
+		/* duplicate fragment, the library will drop it */
+		goto out_with_lock;
+
+	region = entry->region;
+	if (region
+	    && likely(region->status == OMX_USER_REGION_STATUS_PINNED
+		      && region->total_registered_length == region->total_length)) {
+#ifndef OMX_NORECVCOPY
+		unsigned long copy = 0;
+
+		if (offset < entry->length)
+			copy = min_t(unsigned long, frag_length, entry->length - offset);
+
+		if (copy) {
+			ret = omx_user_region_fill_pages(region, entry->offset + offset, skb, hdr_len, copy);
+			if (unlikely(ret < 0)) {
+				/* let the recvq path take care of it */
+				ret = 0;
+				goto out_with_lock;
+			}
+		}
+#endif
+
+		event->specific.medium_frag.direct = 1;
+		event->specific.medium_frag.recvq_offset = 0;
+		ret = omx_notify_unexp_event(endpoint, event, sizeof(*event));
+		if (unlikely(ret < 0))
+			/* no more unexpected eventq slot, it will be resent anyway */
+			goto out_with_lock;
+		ret = 1;
+	}
+
+	/*
+	 * mark the fragment as seen even if it goes through the recvq and
+	 * its slot cannot be reserved, a resent copy will just use the recvq again
+	 */
+	entry->frags_missing_mask &= ~frag_bit;
+	if (!entry->frags_missing_mask && entry->region) {
+		/* the whole message went through, the library does not need the region anymore */
+		released_region = entry->region;
+		entry->region = NULL;
+	}
+
+ out_with_lock:
+	spin_unlock(&endpoint->medium_direct_lock);
+	if (released_region)
+		omx_user_region_release(released_region);
+	return ret;
+}
+
+int
+omx_ioctl_medium_direct(struct omx_endpoint * endpoint,
+			void __user * uparam)
+{
+	struct omx_cmd_medium_direct cmd;
+	struct omx_medium_direct * entry;
+	struct omx_user_region * region;
+	int err;
+
+	err = copy_from_user(&cmd, uparam, sizeof(cmd));
+	if (unlikely(err != 0)) {
+		printk(KERN_ERR "Open-MX: Failed to read medium direct cmd\n");
+		err = -EFAULT;
+		goto out;
+	}
+
+	if (cmd.detach) {
+		/* the library gave up on this message, stop writing to its buffer */
+		region = NULL;
+		spin_lock_bh(&endpoint->medium_direct_lock);
+		entry = omx_medium_direct_find(endpoint, cmd.peer_index, cmd.src_endpoint, cmd.seqnum);
+		if (entry) {
+			region = entry->region;
+			entry->region = NULL;
+		}
+		spin_unlock_bh(&endpoint->medium_direct_lock);
+		if (region)
+			omx_user_region_release(region);
+		return 0;
+	}
+
+	/* acquire the region */
+	region = omx_user_region_acquire(endpoint, cmd.rdma_id);
+	if (unlikely(!region)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	if (unlikely(cmd.offset > region->total_length)) {
+		err = -EINVAL;
+		goto out_with_region;
+	}
+
+	region->dirty = 1;
+
+	if (!omx_pin_synchronous) {
+		/* make sure the region is pinned before the bottom half writes to it */
+		struct omx_user_region_pin_state pinstate;
+
+		omx_user_region_demand_pin_init(&pinstate, region);
+		pinstate.next_chunk_pages = omx_pin_chunk_pages_max;
+		err = omx_user_region_demand_pin_finish(&pinstate);
+		if (err < 0) {
+			dprintk(REG, "failed to pin user region\n");
+			goto out_with_region;
+		}
+	}
+
+	spin_lock_bh(&endpoint->medium_direct_lock);
+	entry = omx_medium_direct_find(endpoint, cmd.peer_index, cmd.src_endpoint, cmd.seqnum);
+	if (likely(entry && !entry->region)) {
+		entry->region = region;
+		entry->offset = cmd.offset;
+		entry->length = min_t(unsigned long, cmd.length, region->total_length - cmd.offset);
+		region = NULL;
+	}
+	spin_unlock_bh(&endpoint->medium_direct_lock);
+
+	if (region) {
+		/* all fragments already arrived, or the entry got evicted */
+		omx_counter_inc(endpoint->iface, MEDIUM_DIRECT_MISSED);
+		omx_user_region_release(region);
+	}
+
+	return 0;
+
+ out_with_region:
+	omx_user_region_release(region);
+ out:
+	return err;
+}
+
 static int
 omx_recv_medium_frag(struct omx_iface * iface,
 		     struct omx_hdr * mh,
@@ -474,10 +840,50 @@ omx_recv_medium_frag(struct omx_iface * iface,
 		goto out_with_endpoint;
 	}
 
+	/* fill event */
+	event.id = 0;
+	event.type = OMX_EVT_RECV_MEDIUM_FRAG;
+	event.peer_index = peer_index;
+	event.src_endpoint = src_endpoint;
+	event.match_info = OMX_NTOH_MATCH_INFO(medium_n);
+	event.seqnum = lib_seqnum;
+	event.piggyack = lib_piggyack;
+#ifdef OMX_MX_WIRE_COMPAT
+	event.specific.medium_frag.msg_length = OMX_NTOH_16(medium_n->length);
+	event.specific.medium_frag.frag_pipeline = OMX_NTOH_8(medium_n->frag_pipeline);
+#else
+	event.specific.medium_frag.msg_length = OMX_NTOH_32(medium_n->length);
+#endif
+	event.specific.medium_frag.frag_length = frag_length;
+	event.specific.medium_frag.frag_seqnum = OMX_NTOH_8(medium_n->frag_seqnum);
+	event.specific.medium_frag.checksum = OMX_NTOH_16(medium_n->checksum);
+	event.specific.medium_frag.direct = 0;
+
+	/* try to place fragments of multi-fragment messages directly in the posted receive buffer */
+	if (event.specific.medium_frag.msg_length > frag_length) {
+		err = omx_recv_medium_frag_direct(endpoint, &event, skb, hdr_len);
+		if (unlikely(err < 0)) {
+			/* no more unexpected eventq slot? just drop the packet, it will be resent anyway */
+			omx_drop_dprintk(eh, "MEDIUM packet because of unexpected event queue full");
+			goto out_with_endpoint;
+		} else if (err > 0) {
+			omx_recv_dprintk(eh, "MEDIUM_FRAG length %ld placed directly", (unsigned long) frag_length);
+			omx_counter_inc(iface, RECV_MEDIUM_FRAG_DIRECT);
+			omx_endpoint_release(endpoint);
+			dev_kfree_skb(skb);
+			return 0;
+		}
+	}
+
 	/* get the eventq slot */
-	err = omx_prepare_notify_unexp_event_with_recvq(endpoint, &recvq_offset);
+	err = omx_recv_prepare_unexp_with_recvq(endpoint, skb, &recvq_offset);
 	if (unlikely(err < 0)) {
-		/* no more unexpected eventq slot? just drop the packet, it will be resent anyway */
+		if (err == -EAGAIN) {
+			/* retained until the library releases some slots */
+			omx_endpoint_release(endpoint);
+			return err;
+		}
+		/* no more unexpected eventq slot nor room to retain? just drop the packet, it will be resent anyway */
 		omx_drop_dprintk(eh, "MEDIUM packet because of unexpected event queue full");
 		goto out_with_endpoint;
 	}
@@ -509,23 +915,7 @@ omx_recv_medium_frag(struct omx_iface * iface,
 	}
 #endif
 
-	/* fill event */
-	event.id = 0;
-	event.type = OMX_EVT_RECV_MEDIUM_FRAG;
-	event.peer_index = peer_index;
-	event.src_endpoint = src_endpoint;
-	event.match_info = OMX_NTOH_MATCH_INFO(medium_n);
-	event.seqnum = lib_seqnum;
-	event.piggyack = lib_piggyack;
-#ifdef OMX_MX_WIRE_COMPAT
-	event.specific.medium_frag.msg_length = OMX_NTOH_16(medium_n->length);
-	event.specific.medium_frag.frag_pipeline = OMX_NTOH_8(medium_n->frag_pipeline);
-#else
-	event.specific.medium_frag.msg_length = OMX_NTOH_32(medium_n->length);
-#endif
-	event.specific.medium_frag.frag_length = frag_length;
-	event.specific.medium_frag.frag_seqnum = OMX_NTOH_8(medium_n->frag_seqnum);
-	event.specific.medium_frag.checksum = OMX_NTOH_16(medium_n->checksum);
+	/* fill the recvq offset in the event now that we have it */
 	event.specific.medium_frag.recvq_offset = recvq_offset;
 
 	omx_recv_dprintk(eh, "MEDIUM_FRAG length %ld", (unsigned long) frag_length);
@@ -818,6 +1208,9 @@ omx_recv_truc(struct omx_iface * iface,
 		liback_event.acknum = OMX_NTOH_32(truc_n->liback.acknum);
 		liback_event.send_seq = OMX_NTOH_16(truc_n->liback.send_seq);
 		liback_event.resent = OMX_NTOH_8(truc_n->liback.resent);
+		/* MX peers do not send any sack mask */
+		liback_event.sack_mask = data_length >= OMX_PKT_TRUC_LIBACK_SACK_DATA_LENGTH
+			? OMX_NTOH_32(truc_n->liback.sack_mask) : 0;
 
 		/* notify the event */
 		err = omx_notify_unexp_event(endpoint, &liback_event, sizeof(liback_event));
@@ -1042,32 +1435,16 @@ omx_pkt_types_init(void)
  * Main receive routine
  */
 
+/* process a packet whose ethernet header was pushed back, either received or retained */
 static int
-omx_recv(struct sk_buff *skb, struct net_device *ifp, struct packet_type *pt,
-	  struct net_device *orig_dev)
+omx_recv_skb(struct omx_iface * iface, struct sk_buff * skb)
 {
-	struct omx_iface *iface;
 	struct omx_hdr linear_header;
 	struct omx_hdr *mh;
 	omx_packet_type_t ptype;
 	size_t hdr_len;
 	int err;
 
-	skb = skb_share_check(skb, GFP_ATOMIC);
-	if (unlikely(skb == NULL))
-		return 0;
-
-	/* len doesn't include header */
-	skb_push(skb, ETH_HLEN);
-
-	iface = omx_iface_find_by_ifp(ifp);
-	if (unlikely(!iface)) {
-		/* at least the ethhdr is linear in the skb */
-		omx_drop_dprintk(&omx_skb_mac_header(skb)->head.eth, "packet on non-Open-MX interface %s",
-				 ifp->name);
-		goto out;
-	}
-
 	/* pointer to the data, assuming it is linear */
 	mh = omx_skb_mac_header(skb);
 
@@ -1116,15 +1493,134 @@ omx_recv(struct sk_buff *skb, struct net_device *ifp, struct packet_type *pt,
 	/* no need to check ptype since there is a default error handler
 	 * for all erroneous values
 	 */
-	omx_pkt_type_handler[ptype](iface, mh, skb);
+	return omx_pkt_type_handler[ptype](iface, mh, skb);
 
  out:
 	return 0;
 }
 
+static int
+omx_recv(struct sk_buff *skb, struct net_device *ifp, struct packet_type *pt,
+	  struct net_device *orig_dev)
+{
+	struct omx_iface *iface;
+
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (unlikely(skb == NULL))
+		return 0;
+
+	/* len doesn't include header */
+	skb_push(skb, ETH_HLEN);
+
+	iface = omx_iface_find_by_ifp(ifp);
+	if (unlikely(!iface)) {
+		/* at least the ethhdr is linear in the skb */
+		omx_drop_dprintk(&omx_skb_mac_header(skb)->head.eth, "packet on non-Open-MX interface %s",
+				 ifp->name);
+		dev_kfree_skb(skb);
+		return 0;
+	}
+
+	/* the control buffer contains garbage from the lower layers */
+	OMX_SKB_RETAINED(skb) = 0;
+
+	omx_recv_skb(iface, skb);
+	return 0;
+}
+
+#ifdef OMX_HAVE_PACKET_TYPE_LIST_FUNC
+/*
+ * Pull replies whose header is linear are gathered in the batch
+ * when they target the same handle as the previous packet.
+ */
+static INLINE int
+omx_recv_list_is_pull_reply(const struct sk_buff *skb)
+{
+	return skb_headlen(skb) >= omx_pkt_type_hdr_len[OMX_PKT_TYPE_PULL_REPLY]
+		&& omx_skb_mac_header(skb)->body.generic.ptype == OMX_PKT_TYPE_PULL_REPLY;
+}
+
+static INLINE int
+omx_recv_list_same_pull_handle(const struct sk_buff *skb1, const struct sk_buff *skb2)
+{
+	const struct omx_pkt_pull_reply *reply1 = &omx_skb_mac_header(skb1)->body.pull_reply;
+	const struct omx_pkt_pull_reply *reply2 = &omx_skb_mac_header(skb2)->body.pull_reply;
+
+	return reply1->dst_pull_handle == reply2->dst_pull_handle
+		&& reply1->dst_magic == reply2->dst_magic;
+}
+
+/*
+ * Batched receive of all packets of a NAPI poll that came from the same device.
+ * The iface is only looked up when the device changes, and consecutive pull replies
+ * for the same handle acquire their endpoint and handle only once.
+ */
+static void
+omx_recv_list(struct list_head *head, struct packet_type *pt,
+	      struct net_device *orig_dev)
+{
+	struct net_device *ifp = NULL;
+	struct omx_iface *iface = NULL;
+	struct sk_buff_head pull_replies;
+	struct omx_iface *pull_replies_iface = NULL;
+	struct sk_buff *skb, *next;
+
+	__skb_queue_head_init(&pull_replies);
+
+	list_for_each_entry_safe(skb, next, head, list) {
+		list_del(&skb->list);
+		skb->next = NULL;
+
+		skb = skb_share_check(skb, GFP_ATOMIC);
+		if (unlikely(skb == NULL))
+			continue;
+
+		/* len doesn't include header */
+		skb_push(skb, ETH_HLEN);
+
+		if (skb->dev != ifp) {
+			ifp = skb->dev;
+			iface = omx_iface_find_by_ifp(ifp);
+		}
+		if (unlikely(!iface)) {
+			/* at least the ethhdr is linear in the skb */
+			omx_drop_dprintk(&omx_skb_mac_header(skb)->head.eth, "packet on non-Open-MX interface %s",
+					 ifp->name);
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		/* the control buffer contains garbage from the lower layers */
+		OMX_SKB_RETAINED(skb) = 0;
+
+		if (omx_recv_list_is_pull_reply(skb)) {
+			if (!skb_queue_empty(&pull_replies)
+			    && (iface != pull_replies_iface
+				|| !omx_recv_list_same_pull_handle(skb_peek_tail(&pull_replies), skb)))
+				omx_recv_pull_replies(pull_replies_iface, &pull_replies);
+			pull_replies_iface = iface;
+			__skb_queue_tail(&pull_replies, skb);
+			continue;
+		}
+
+		/* keep packets in order */
+		if (!skb_queue_empty(&pull_replies))
+			omx_recv_pull_replies(pull_replies_iface, &pull_replies);
+
+		omx_recv_skb(iface, skb);
+	}
+
+	if (!skb_queue_empty(&pull_replies))
+		omx_recv_pull_replies(pull_replies_iface, &pull_replies);
+}
+#endif /* OMX_HAVE_PACKET_TYPE_LIST_FUNC */
+
 struct packet_type omx_pt = {
 	.type = __constant_htons(ETH_P_OMX),
 	.func = omx_recv,
+#ifdef OMX_HAVE_PACKET_TYPE_LIST_FUNC
+	.list_func = omx_recv_list,
+#endif
 };
 
 /*
@@ -24,6 +24,7 @@
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
 #include <linux/hardirq.h>
+#include <linux/log2.h>
 
 #include "omx_hal.h"
 #include "omx_io.h"
@@ -85,6 +86,7 @@ omx_user_region_add_segment(const struct omx_cmd_user_segment * useg,
 	segment->length = useglen;
 	segment->nr_pages = nr_pages;
 	segment->pinned_pages = 0;
+	segment->page_shift = PAGE_SHIFT;
 	segment->pages = pages;
 
 	return 0;
@@ -93,13 +95,32 @@ omx_user_region_add_segment(const struct omx_cmd_user_segment * useg,
 	return ret;
 }
 
+/*
+ * Release pinned pages.
+ * When backed by huge pages, only the first page of each huge page
+ * (or of the segment) holds a reference, see omx__user_region_pin_huge_pages().
+ */
 static void
-omx_user_region_destroy_segment(struct omx_user_region_segment * segment)
+omx_user_region_put_pages(struct page ** pages, unsigned long aligned_vaddr,
+			  unsigned long nr_pages, unsigned page_shift, int dirty)
 {
+	unsigned long huge_mask = (1UL << page_shift) - 1;
 	unsigned long i;
 
-	for(i=0; i<segment->pinned_pages; i++)
-		put_page(segment->pages[i]);
+	for(i=0; i<nr_pages; i++) {
+		if (i && ((aligned_vaddr + (i << PAGE_SHIFT)) & huge_mask))
+			continue;
+		if (dirty)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+}
+
+static void
+omx_user_region_destroy_segment(struct omx_user_region_segment * segment)
+{
+	omx_user_region_put_pages(segment->pages, segment->aligned_vaddr,
+				  segment->pinned_pages, segment->page_shift, 0);
 
 	if (segment->vmalloced)
 		vfree(segment->pages);
@@ -146,12 +167,65 @@ omx__user_region_pin_new_segment(struct omx_user_region_pin_state *pinstate)
 	 * here, we know it is valid since we are pinning more memory.
 	 */
 	struct omx_user_region_segment *segment = pinstate->segment;
+	struct vm_area_struct *vma;
+
+	/*
+	 * Pin per huge page if the whole segment is in a single huge page mapping.
+	 * The caller holds mmap_sem, so the mapping cannot change while we pin.
+	 */
+	segment->page_shift = PAGE_SHIFT;
+	vma = find_vma(current->mm, segment->aligned_vaddr);
+	if (vma && vma->vm_start <= segment->aligned_vaddr
+	    && vma->vm_end >= segment->aligned_vaddr + (segment->nr_pages << PAGE_SHIFT))
+		segment->page_shift = ilog2(vma_kernel_pagesize(vma));
+	dprintk(REG, "pinning segment with page shift %d\n", segment->page_shift);
+
 	pinstate->aligned_vaddr = segment->aligned_vaddr;
 	pinstate->pages = segment->pages;
 	pinstate->remaining = segment->length;
 	pinstate->chunk_offset = segment->first_page_offset;
 }
 
+/*
+ * Pin pages backed by huge pages.
+ * Only take a reference on the first page of each huge page
+ * (or on the first page of the chunk), it keeps the whole compound page pinned.
+ * Other pages are derived from it without walking the page tables again.
+ */
+static int
+omx__user_region_pin_huge_pages(unsigned long aligned_vaddr, int nr_pages,
+				unsigned page_shift, struct page ** pages)
+{
+	unsigned long huge_mask = (1UL << page_shift) - 1;
+	int i, j;
+	int ret;
+
+	for(i=0; i<nr_pages; i += j) {
+		unsigned long vaddr = aligned_vaddr + ((unsigned long) i << PAGE_SHIFT);
+		int nr = (((vaddr | huge_mask) + 1 - vaddr) >> PAGE_SHIFT);
+		if (nr > nr_pages - i)
+			nr = nr_pages - i;
+
+		ret = omx_get_user_pages_fast(vaddr, 1, 1, &pages[i]);
+		if (unlikely(ret != 1))
+			goto out;
+		if (unlikely(!PageCompound(pages[i]))) {
+			put_page(pages[i]);
+			goto out;
+		}
+
+		for(j=1; j<nr; j++)
+			pages[i+j] = nth_page(pages[i], j);
+	}
+
+	return nr_pages;
+
+ out:
+	/* release the huge pages we already acquired */
+	omx_user_region_put_pages(pages, aligned_vaddr, i, page_shift, 0);
+	return i;
+}
+
 static int
 omx__user_region_pin_add_chunk(struct omx_user_region_pin_state *pinstate)
 {
@@ -188,21 +262,42 @@ omx__user_region_pin_add_chunk(struct omx_user_region_pin_state *pinstate)
 	else
 		chunk_length = (chunk_pages<<PAGE_SHIFT) - chunk_offset;
 
+	if (seg->page_shift != PAGE_SHIFT) {
+		/* end the chunk on a huge page boundary so that references are only taken on head pages */
+		unsigned long huge_size = 1UL << seg->page_shift;
+		unsigned long chunk_end = ALIGN(aligned_vaddr + chunk_offset + chunk_length, huge_size);
+		if (chunk_end - aligned_vaddr - chunk_offset < remaining)
+			chunk_length = chunk_end - aligned_vaddr - chunk_offset;
+		else
+			chunk_length = remaining;
+	}
+
 	/* compute the actual corresponding number of pages to pin */
 	chunk_pages = (chunk_offset + chunk_length + PAGE_SIZE-1) >> PAGE_SHIFT;
 
-	ret = omx_get_user_pages_fast(aligned_vaddr, chunk_pages, 1, pages);
-	if (unlikely(ret != chunk_pages)) {
-		printk(KERN_ERR "Open-MX: Failed to pin user buffer (%d pages at 0x%lx), get_user_pages returned %d\n",
-		       chunk_pages, aligned_vaddr, ret);
-		if (ret >= 0) {
-			/* if some pages were acquired, release them */
-			int i;
-			for(i=0; i<ret; i++)
-				put_page(pages[i]);
+	if (seg->page_shift != PAGE_SHIFT) {
+		/* releases what it acquired on failure */
+		ret = omx__user_region_pin_huge_pages(aligned_vaddr, chunk_pages, seg->page_shift, pages);
+		if (unlikely(ret != chunk_pages)) {
+			printk(KERN_ERR "Open-MX: Failed to pin user buffer (%d pages at 0x%lx in huge pages), only got %d\n",
+			       chunk_pages, aligned_vaddr, ret);
 			ret = -EFAULT;
+			goto out;
+		}
+	} else {
+		ret = omx_get_user_pages_fast(aligned_vaddr, chunk_pages, 1, pages);
+		if (unlikely(ret != chunk_pages)) {
+			printk(KERN_ERR "Open-MX: Failed to pin user buffer (%d pages at 0x%lx), get_user_pages returned %d\n",
+			       chunk_pages, aligned_vaddr, ret);
+			if (ret >= 0) {
+				/* if some pages were acquired, release them */
+				int i;
+				for(i=0; i<ret; i++)
+					put_page(pages[i]);
+				ret = -EFAULT;
+			}
+			goto out;
 		}
-		goto out;
 	}
 
 	seg->pinned_pages += chunk_pages;
@@ -521,7 +616,6 @@ omx_invalidate_region(const struct omx_endpoint *endpoint,
 	BUG_ON(region->status == OMX_USER_REGION_STATUS_FAILED); /* FIXME */
 
 	if (region->status == OMX_USER_REGION_STATUS_PINNED) {
-		unsigned long j;
 		int i;
 
 		/* wait for the pinner to be done */
@@ -531,12 +625,10 @@ omx_invalidate_region(const struct omx_endpoint *endpoint,
 		/* release pages */
 		for(i=0; i<region->nr_segments; i++) {
 			struct omx_user_region_segment * segment = &region->segments[i];
-			for(j=0; j<segment->pinned_pages; j++) {
-				if (region->dirty)
-					set_page_dirty_lock(segment->pages[j]);
-				put_page(segment->pages[j]);
-				segment->pinned_pages = 0;
-			}
+			omx_user_region_put_pages(segment->pages, segment->aligned_vaddr,
+						  segment->pinned_pages, segment->page_shift,
+						  region->dirty);
+			segment->pinned_pages = 0;
 		}
 		region->total_registered_length = 0;
 		region->status = OMX_USER_REGION_STATUS_NOT_PINNED;
@@ -1386,10 +1478,10 @@ int
 omx_user_region_fill_pages(const struct omx_user_region * region,
 			   unsigned long region_offset,
 			   const struct sk_buff * skb,
+			   unsigned long skb_offset,
 			   unsigned long length)
 {
 	unsigned long segment_offset = region_offset;
-	unsigned long skb_offset = sizeof(struct omx_pkt_head) + sizeof(struct omx_pkt_pull_reply);
 	unsigned long copied = 0;
 	unsigned long remaining = length;
 	int iseg;
@@ -1784,6 +1876,122 @@ omx_copy_between_user_regions(struct omx_user_region * src_region, unsigned long
 		return omx_memcpy_between_user_regions_to_current(src_region, src_offset, dst_region, dst_offset, length);
 }
 
+/*
+ * Copy from a region directly into user segments of the current process,
+ * used by shared pulls so that the receiver does not need a region.
+ */
+int
+omx_copy_from_user_region_to_current_segments(struct omx_user_region * src_region, unsigned long src_offset,
+					       const struct omx_cmd_user_segment * usegs, uint32_t nseg,
+					       unsigned long length)
+{
+	unsigned long remaining = length;
+	unsigned long tmp;
+	const struct omx_user_region_segment *sseg; /* current segment */
+	unsigned long soff; /* current offset in region */
+	unsigned long sseglen; /* length of current segment */
+	unsigned long ssegoff; /* current offset in current segment */
+	struct page **spage; /* current page */
+	unsigned int spageoff; /* current offset in current page */
+	void *spageaddr; /* current page mapping */
+	const struct omx_cmd_user_segment *useg = &usegs[0]; /* current user segment */
+	unsigned long usegoff = 0; /* current offset in current user segment */
+	unsigned long spinlen; /* currently pinned length in region */
+	int ret;
+
+	if (unlikely(!length))
+		return 0;
+
+	for(tmp=0,useg=&usegs[0]; useg<&usegs[nseg]; useg++)
+		tmp += useg->len;
+	if (src_offset + length > src_region->total_length || length > tmp)
+		return -EINVAL;
+
+	dprintk(REG, "shared region copy of %ld bytes from region #%ld len %ld starting at %ld into %ld user segments\n",
+		length,
+		(unsigned long) src_region->id, src_region->total_length, src_offset,
+		(unsigned long) nseg);
+
+	/* initialize the src state */
+	for(tmp=0,sseg=&src_region->segments[0];; sseg++) {
+		sseglen = sseg->length;
+		if (tmp + sseglen > src_offset)
+			break;
+		tmp += sseglen;
+	}
+	soff = src_offset;
+	ssegoff = src_offset - tmp;
+	spage = &sseg->pages[(ssegoff + sseg->first_page_offset) >> PAGE_SHIFT];
+	spageoff = (ssegoff + sseg->first_page_offset) & (~PAGE_MASK);
+	spinlen = 0;
+
+	/* skip empty user segments */
+	useg = &usegs[0];
+	while (!useg->len)
+		useg++;
+
+	while (1) {
+		/* compute the chunk size */
+		unsigned chunk = remaining;
+		if (chunk > PAGE_SIZE - spageoff)
+			chunk = PAGE_SIZE - spageoff;
+		if (chunk > sseglen - ssegoff)
+			chunk = sseglen - ssegoff;
+		if (chunk > useg->len - usegoff)
+			chunk = useg->len - usegoff;
+
+		if (omx_pin_progressive && spinlen < soff + chunk) {
+			spinlen = soff + chunk;
+			ret = omx_user_region_parallel_pin_wait(src_region, &spinlen);
+			if (ret < 0)
+				return ret;
+		}
+		/* *spage is valid now */
+
+		spageaddr = kmap(*spage);
+		ret = copy_to_user((void __user *)(unsigned long) useg->vaddr + usegoff, spageaddr + spageoff, chunk);
+		kunmap(*spage);
+		if (ret)
+			return -EFAULT;
+
+		soff += chunk;
+		remaining -= chunk;
+		if (!remaining)
+			break;
+
+		/* update the source */
+		if (ssegoff + chunk == sseglen) {
+			/* next segment */
+			sseg++;
+			sseglen = sseg->length;
+			ssegoff = 0;
+			spage = &sseg->pages[0];
+			spageoff = sseg->first_page_offset;
+		} else if (spageoff + chunk == PAGE_SIZE) {
+			/* next page */
+			ssegoff += chunk;
+			spage++;
+			spageoff = 0;
+		} else {
+			/* same page */
+			ssegoff += chunk;
+			spageoff += chunk;
+		}
+
+		/* update the destination */
+		usegoff += chunk;
+		if (usegoff == useg->len) {
+			/* next non-empty segment */
+			do {
+				useg++;
+			} while (!useg->len);
+			usegoff = 0;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * Local variables:
  *  tab-width: 8
@@ -59,6 +59,7 @@ struct omx_user_region {
 		unsigned long length;
 		unsigned long nr_pages;
 		unsigned long pinned_pages;
+		unsigned page_shift; /* pinning granularity, PAGE_SHIFT unless backed by huge pages */
 		int vmalloced;
 		struct page ** pages;
 	} segments[0];
@@ -112,8 +113,9 @@ omx_user_region_release(struct omx_user_region * region)
 }
 
 extern int omx_user_region_offset_cache_init(struct omx_user_region *region, struct omx_user_region_offset_cache *cache, unsigned long offset, unsigned long length);
-extern int omx_user_region_fill_pages(const struct omx_user_region * region, unsigned long region_offset, const struct sk_buff * skb, unsigned long length);
+extern int omx_user_region_fill_pages(const struct omx_user_region * region, unsigned long region_offset, const struct sk_buff * skb, unsigned long skb_offset, unsigned long length);
 extern int omx_copy_between_user_regions(struct omx_user_region * src_region, unsigned long src_offset, struct omx_user_region * dst_region, unsigned long dst_offset, unsigned long length);
+extern int omx_copy_from_user_region_to_current_segments(struct omx_user_region * src_region, unsigned long src_offset, const struct omx_cmd_user_segment * usegs, uint32_t nseg, unsigned long length);
 
 struct omx_user_region_pin_state {
 	struct omx_user_region *region;
@@ -22,6 +22,8 @@
 #include <linux/skbuff.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
 
 #include "omx_misc.h"
 #include "omx_hal.h"
@@ -60,15 +62,99 @@ static unsigned long omx_NACK_LIB_packet_loss_index = 0;
 static unsigned long omx_NACK_MCP_packet_loss_index = 0;
 #endif /* OMX_DRIVER_DEBUG */
 
+/*******************************
+ * Per-cpu send resource caches
+ *
+ * Each cpu keeps some preallocated skbs that are large enough for headers
+ * and small messages, so that most packets are sent without allocating
+ * in atomic context. The cache is refilled by a work that may sleep,
+ * which lets the allocator reclaim memory instead of failing.
+ * Deferred events are also recycled in a per-cpu cache once their skbs
+ * are released.
+ */
+
+#define OMX_SKB_CACHE_LEN \
+	max_t(unsigned long, ETH_ZLEN, \
+	      sizeof(struct omx_pkt_head) + sizeof(struct omx_pkt_msg) + OMX_SMALL_MSG_LENGTH_MAX)
+#define OMX_DEFERRED_EVENT_CACHE_NR 32
+
+struct omx_deferred_event;
+
+struct omx_send_cache {
+	struct sk_buff_head skbs;
+	struct work_struct refill_work;
+	/* only accessed by the owning cpu with interrupts disabled */
+	struct omx_deferred_event *defevents;
+	int defevents_nr;
+};
+
+static DEFINE_PER_CPU(struct omx_send_cache, omx_send_caches);
+
+static void
+omx_send_cache_refill(struct omx_send_cache *cache)
+{
+	while (skb_queue_len(&cache->skbs) < omx_skb_cache_nr) {
+		struct sk_buff *skb = alloc_skb(OMX_SKB_CACHE_LEN, GFP_KERNEL);
+		if (!skb)
+			break;
+		skb_queue_tail(&cache->skbs, skb);
+	}
+}
+
+static void
+omx_send_cache_refill_workfunc(omx_work_struct_data_t data)
+{
+	struct omx_send_cache *cache = OMX_WORK_STRUCT_DATA(data, struct omx_send_cache, refill_work);
+	omx_send_cache_refill(cache);
+}
+
+/* get a skb from the current cpu cache, and refill it in the background when getting low */
+static INLINE struct sk_buff *
+omx_send_cache_get_skb(void)
+{
+	struct omx_send_cache *cache = &get_cpu_var(omx_send_caches);
+	struct sk_buff *skb;
+
+	skb = skb_dequeue(&cache->skbs);
+	if (skb_queue_len(&cache->skbs) < omx_skb_cache_nr / 2)
+		schedule_work(&cache->refill_work);
+
+	put_cpu_var(omx_send_caches);
+	return skb;
+}
+
+int
+omx_send_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct omx_send_cache *cache = &per_cpu(omx_send_caches, cpu);
+		skb_queue_head_init(&cache->skbs);
+		OMX_INIT_WORK(&cache->refill_work, omx_send_cache_refill_workfunc, cache);
+		cache->defevents = NULL;
+		cache->defevents_nr = 0;
+	}
+
+	/* other cpus will fill their cache on first use */
+	for_each_online_cpu(cpu)
+		omx_send_cache_refill(&per_cpu(omx_send_caches, cpu));
+
+	return 0;
+}
+
 /*************************************
  * Allocate and initialize a OMX skb
  */
 struct sk_buff *
 omx_new_skb(unsigned long len)
 {
-	struct sk_buff *skb;
+	struct sk_buff *skb = NULL;
 
-	skb = alloc_skb(len, GFP_ATOMIC);
+	if (likely(len <= OMX_SKB_CACHE_LEN))
+		skb = omx_send_cache_get_skb();
+	if (unlikely(!skb))
+		skb = alloc_skb(len, GFP_ATOMIC);
 	if (likely(skb != NULL)) {
 		omx_skb_reset_mac_header(skb);
 		omx_skb_reset_network_header(skb);
@@ -94,23 +180,96 @@ omx_new_skb(unsigned long len)
 
 struct omx_deferred_event {
 	struct omx_endpoint *endpoint;
-	struct omx_evt_send_mediumsq_frag_done evt;
+	atomic_t refcount; /* one per skb using the sendq, plus one while submitting a whole mediumsq */
+	union omx_evt evt;
+	struct omx_deferred_event *next_free; /* when queued in a cpu cache */
 };
 
-/* medium frag skb destructor to release sendq pages */
+/* get a deferred event from the current cpu cache, or allocate one */
+static struct omx_deferred_event *
+omx_deferred_event_alloc(void)
+{
+	struct omx_send_cache *cache;
+	struct omx_deferred_event *defevent;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cache = &per_cpu(omx_send_caches, smp_processor_id());
+	defevent = cache->defevents;
+	if (likely(defevent)) {
+		cache->defevents = defevent->next_free;
+		cache->defevents_nr--;
+	}
+	local_irq_restore(flags);
+
+	if (unlikely(!defevent))
+		defevent = kmalloc(sizeof(*defevent), GFP_KERNEL);
+	return defevent;
+}
+
+/* put a deferred event back in the current cpu cache, may be called from a skb destructor */
 static void
-omx_medium_frag_skb_destructor(struct sk_buff *skb)
+omx_deferred_event_free(struct omx_deferred_event *defevent)
+{
+	struct omx_send_cache *cache;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cache = &per_cpu(omx_send_caches, smp_processor_id());
+	if (likely(cache->defevents_nr < OMX_DEFERRED_EVENT_CACHE_NR)) {
+		defevent->next_free = cache->defevents;
+		cache->defevents = defevent;
+		cache->defevents_nr++;
+		defevent = NULL;
+	}
+	local_irq_restore(flags);
+
+	if (unlikely(defevent))
+		kfree(defevent);
+}
+
+void
+omx_send_exit(void)
+{
+	int cpu;
+
+	/* make sure no refill is running anymore */
+	flush_scheduled_work();
+
+	for_each_possible_cpu(cpu) {
+		struct omx_send_cache *cache = &per_cpu(omx_send_caches, cpu);
+		skb_queue_purge(&cache->skbs);
+		while (cache->defevents) {
+			struct omx_deferred_event *defevent = cache->defevents;
+			cache->defevents = defevent->next_free;
+			kfree(defevent);
+		}
+		cache->defevents_nr = 0;
+	}
+}
+
+static void
+omx_deferred_event_put(struct omx_deferred_event * defevent)
 {
-	struct omx_deferred_event * defevent = omx_get_skb_destructor_data(skb);
 	struct omx_endpoint * endpoint = defevent->endpoint;
 
+	if (!atomic_dec_and_test(&defevent->refcount))
+		return;
+
 	/* report the event to user-space */
 	omx_notify_exp_event(endpoint,
 			     &defevent->evt, sizeof(defevent->evt));
 
 	/* release objects now */
 	omx_endpoint_release(endpoint);
-	kfree(defevent);
+	omx_deferred_event_free(defevent);
+}
+
+/* medium frag skb destructor to release sendq pages */
+static void
+omx_medium_frag_skb_destructor(struct sk_buff *skb)
+{
+	omx_deferred_event_put(omx_get_skb_destructor_data(skb));
 }
 
 /*********************
@@ -476,16 +635,22 @@ omx_ioctl_send_small(struct omx_endpoint * endpoint,
 	return ret;
 }
 
-int
-omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
-			     void __user * uparam)
+/*
+ * Send a single mediumsq fragment.
+ * If msg_defevent is NULL, a done event is reported for this fragment.
+ * Otherwise the fragment only takes a reference on msg_defevent,
+ * and the caller reports a single done event for the whole message.
+ */
+static int
+omx_send_mediumsq_frag(struct omx_endpoint * endpoint,
+		       const struct omx_cmd_send_mediumsq_frag * cmd,
+		       struct omx_deferred_event * msg_defevent)
 {
 	struct sk_buff *skb;
 	struct omx_hdr *mh;
 	struct omx_pkt_head *ph;
 	struct ethhdr *eh;
 	struct omx_pkt_medium_frag *medium_n;
-	struct omx_cmd_send_mediumsq_frag cmd;
 	struct omx_iface * iface = endpoint->iface;
 	struct net_device * ifp = iface->eth_ifp;
 	uint32_t sendq_offset;
@@ -494,17 +659,10 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 	int ret;
 	uint32_t frag_length;
 
-	ret = copy_from_user(&cmd, uparam, sizeof(cmd));
-	if (unlikely(ret != 0)) {
-		printk(KERN_ERR "Open-MX: Failed to read send mediumsq frag cmd hdr\n");
-		ret = -EFAULT;
-		goto out;
-	}
-
 	BUILD_BUG_ON(OMX_MEDIUM_FRAG_LENGTH_MAX > OMX_SENDQ_ENTRY_SIZE);
 	BUILD_BUG_ON(OMX_MEDIUM_FRAG_PACKET_SIZE_OF_PAYLOAD(OMX_MEDIUM_FRAG_LENGTH_MAX) > OMX_MTU);
 
-	frag_length = cmd.frag_length;
+	frag_length = cmd->frag_length;
 	if (unlikely(frag_length > OMX_SENDQ_ENTRY_SIZE)) {
 		printk(KERN_ERR "Open-MX: Cannot send more than %ld as a mediumsq frag (tried %ld)\n",
 		       OMX_SENDQ_ENTRY_SIZE, (unsigned long) frag_length);
@@ -512,16 +670,16 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 		goto out;
 	}
 
-	sendq_offset = cmd.sendq_offset;
-	if (unlikely(sendq_offset >= OMX_SENDQ_SIZE)) {
+	sendq_offset = cmd->sendq_offset;
+	if (unlikely(sendq_offset >= OMX_SENDQ_SIZE(endpoint->sendq_entry_nr))) {
 		printk(KERN_ERR "Open-MX: Cannot send mediumsq fragment from sendq offset %ld (max %ld)\n",
-		       (unsigned long) sendq_offset, (unsigned long) OMX_SENDQ_SIZE);
+		       (unsigned long) sendq_offset, OMX_SENDQ_SIZE(endpoint->sendq_entry_nr));
 		ret = -EINVAL;
 		goto out;
 	}
 
-	if (unlikely(cmd.shared))
-		return omx_shared_send_mediumsq_frag(endpoint, &cmd);
+	if (unlikely(cmd->shared))
+		return omx_shared_send_mediumsq_frag(endpoint, cmd, msg_defevent == NULL);
 
 	if (unlikely(frag_length > omx_skb_copy_max
 		     && hdr_len + frag_length >= ETH_ZLEN
@@ -540,12 +698,16 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 			goto out;
 		}
 
-		defevent = kmalloc(sizeof(*defevent), GFP_KERNEL);
-		if (unlikely(!defevent)) {
-			omx_counter_inc(iface, SEND_NOMEM_MEDIUM_DEFEVENT);
-			printk(KERN_INFO "Open-MX: Failed to allocate mediumsq frag deferred event\n");
-			ret = -ENOMEM;
-			goto out_with_skb;
+		if (msg_defevent) {
+			defevent = msg_defevent;
+		} else {
+			defevent = omx_deferred_event_alloc();
+			if (unlikely(!defevent)) {
+				omx_counter_inc(iface, SEND_NOMEM_MEDIUM_DEFEVENT);
+				printk(KERN_INFO "Open-MX: Failed to allocate mediumsq frag deferred event\n");
+				ret = -ENOMEM;
+				goto out_with_skb;
+			}
 		}
 
 		/* locate headers */
@@ -555,10 +717,11 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 		medium_n = (struct omx_pkt_medium_frag *) (ph + 1);
 
 		/* set destination peer */
-		ret = omx_set_target_peer(ph, iface, cmd.peer_index);
+		ret = omx_set_target_peer(ph, iface, cmd->peer_index);
 		if (ret < 0) {
 			printk(KERN_INFO "Open-MX: Failed to fill target peer in mediumsq frag header\n");
-			kfree(defevent);
+			if (!msg_defevent)
+				omx_deferred_event_free(defevent);
 			goto out_with_skb;
 		}
 
@@ -581,16 +744,20 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 		skb->data_len = frag_length;
 
 		/* prepare the deferred event now that we cannot fail anymore */
-		omx_endpoint_reacquire(endpoint); /* keep a reference in the defevent */
-		defevent->endpoint = endpoint;
-		defevent->evt.id = 0;
-		defevent->evt.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
-		defevent->evt.sendq_offset = cmd.sendq_offset;
+		if (msg_defevent) {
+			atomic_inc(&defevent->refcount);
+		} else {
+			omx_endpoint_reacquire(endpoint); /* keep a reference in the defevent */
+			defevent->endpoint = endpoint;
+			atomic_set(&defevent->refcount, 1);
+			defevent->evt.send_mediumsq_frag_done.id = 0;
+			defevent->evt.send_mediumsq_frag_done.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
+			defevent->evt.send_mediumsq_frag_done.sendq_offset = cmd->sendq_offset;
+		}
 		omx_set_skb_destructor(skb, omx_medium_frag_skb_destructor, defevent);
 
 	} else {
 		/* use a linear skb */
-		struct omx_evt_send_mediumsq_frag_done evt;
 		void *data;
 
 		omx_counter_inc(iface, MEDIUMSQ_FRAG_SEND_LINEAR);
@@ -612,7 +779,7 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 		data = (char*) (medium_n + 1);
 
 		/* set destination peer */
-		ret = omx_set_target_peer(ph, iface, cmd.peer_index);
+		ret = omx_set_target_peer(ph, iface, cmd->peer_index);
 		if (ret < 0) {
 			printk(KERN_INFO "Open-MX: Failed to fill target peer in mediumsq frag header\n");
 			goto out_with_skb;
@@ -621,12 +788,15 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 		/* copy the data in the linear skb */
 		memcpy(data, endpoint->sendq + sendq_offset, frag_length);
 
-		/* notify the event right now */
-		evt.id = 0;
-		evt.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
-		evt.sendq_offset = cmd.sendq_offset;
-		omx_notify_exp_event(endpoint,
-				     &evt, sizeof(evt));
+		/* notify the event right now, unless the caller reports it for the whole message */
+		if (!msg_defevent) {
+			struct omx_evt_send_mediumsq_frag_done evt;
+			evt.id = 0;
+			evt.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
+			evt.sendq_offset = cmd->sendq_offset;
+			omx_notify_exp_event(endpoint,
+					     &evt, sizeof(evt));
+		}
 	}
 
 	/* fill ethernet header */
@@ -635,21 +805,21 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 
 	/* fill omx header */
 	OMX_HTON_8(medium_n->src_endpoint, endpoint->endpoint_index);
-	OMX_HTON_8(medium_n->dst_endpoint, cmd.dest_endpoint);
+	OMX_HTON_8(medium_n->dst_endpoint, cmd->dest_endpoint);
 	OMX_HTON_8(medium_n->ptype, OMX_PKT_TYPE_MEDIUM);
 #ifdef OMX_MX_WIRE_COMPAT
-	OMX_HTON_16(medium_n->length, cmd.msg_length);
-	OMX_HTON_8(medium_n->frag_pipeline, cmd.frag_pipeline);
+	OMX_HTON_16(medium_n->length, cmd->msg_length);
+	OMX_HTON_8(medium_n->frag_pipeline, cmd->frag_pipeline);
 #else
-	OMX_HTON_32(medium_n->length, cmd.msg_length);
+	OMX_HTON_32(medium_n->length, cmd->msg_length);
 #endif
-	OMX_HTON_16(medium_n->lib_seqnum, cmd.seqnum);
-	OMX_HTON_16(medium_n->lib_piggyack, cmd.piggyack);
-	OMX_HTON_32(medium_n->session, cmd.session_id);
-	OMX_HTON_MATCH_INFO(medium_n, cmd.match_info);
+	OMX_HTON_16(medium_n->lib_seqnum, cmd->seqnum);
+	OMX_HTON_16(medium_n->lib_piggyack, cmd->piggyack);
+	OMX_HTON_32(medium_n->session, cmd->session_id);
+	OMX_HTON_MATCH_INFO(medium_n, cmd->match_info);
 	OMX_HTON_16(medium_n->frag_length, frag_length);
-	OMX_HTON_8(medium_n->frag_seqnum, cmd.frag_seqnum);
-	OMX_HTON_16(medium_n->checksum, cmd.checksum);
+	OMX_HTON_8(medium_n->frag_seqnum, cmd->frag_seqnum);
+	OMX_HTON_16(medium_n->checksum, cmd->checksum);
 
 	omx_send_dprintk(eh, "MEDIUMSQ FRAG length %ld", (unsigned long) frag_length);
 
@@ -663,6 +833,189 @@ omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
 	return ret;
 }
 
+int
+omx_ioctl_send_mediumsq_frag(struct omx_endpoint * endpoint,
+			     void __user * uparam)
+{
+	struct omx_cmd_send_mediumsq_frag cmd;
+	int ret;
+
+	ret = copy_from_user(&cmd, uparam, sizeof(cmd));
+	if (unlikely(ret != 0)) {
+		printk(KERN_ERR "Open-MX: Failed to read send mediumsq frag cmd hdr\n");
+		return -EFAULT;
+	}
+
+	return omx_send_mediumsq_frag(endpoint, &cmd, NULL);
+}
+
+/*
+ * Send all fragments of a mediumsq message at once,
+ * and report a single done event once all of them are gone.
+ * If some fragments cannot be sent, the done event is still reported
+ * and retransmission will take care of the whole message later.
+ */
+int
+omx_ioctl_send_mediumsq(struct omx_endpoint * endpoint,
+			void __user * uparam)
+{
+	struct omx_cmd_send_mediumsq cmd;
+	struct omx_cmd_send_mediumsq_frag frag_cmd;
+	struct omx_deferred_event * defevent;
+	uint32_t remaining;
+	int i;
+	int ret;
+
+	ret = copy_from_user(&cmd, uparam, sizeof(cmd));
+	if (unlikely(ret != 0)) {
+		printk(KERN_ERR "Open-MX: Failed to read send mediumsq cmd hdr\n");
+		ret = -EFAULT;
+		goto out;
+	}
+
+	if (unlikely(!cmd.frags_nr || cmd.frags_nr > OMX_MEDIUM_FRAGS_MAX
+		     || cmd.msg_length > cmd.frags_nr * OMX_MEDIUM_FRAG_LENGTH_MAX)) {
+		printk(KERN_ERR "Open-MX: Cannot send mediumsq of length %ld as %ld frags (max %ld)\n",
+		       (unsigned long) cmd.msg_length, (unsigned long) cmd.frags_nr,
+		       (unsigned long) OMX_MEDIUM_FRAGS_MAX);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	defevent = omx_deferred_event_alloc();
+	if (unlikely(!defevent)) {
+		omx_counter_inc(endpoint->iface, SEND_NOMEM_MEDIUM_DEFEVENT);
+		printk(KERN_INFO "Open-MX: Failed to allocate mediumsq deferred event\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+	omx_endpoint_reacquire(endpoint); /* keep a reference in the defevent */
+	defevent->endpoint = endpoint;
+	atomic_set(&defevent->refcount, 1); /* dropped once all frags are submitted */
+	defevent->evt.send_mediumsq_done.id = 0;
+	defevent->evt.send_mediumsq_done.type = OMX_EVT_SEND_MEDIUMSQ_DONE;
+	defevent->evt.send_mediumsq_done.sendq_offset = (uint32_t) cmd.sendq_index[0] << OMX_SENDQ_ENTRY_SHIFT;
+
+	frag_cmd.peer_index = cmd.peer_index;
+	frag_cmd.dest_endpoint = cmd.dest_endpoint;
+	frag_cmd.shared = cmd.shared;
+	frag_cmd.session_id = cmd.session_id;
+	frag_cmd.seqnum = cmd.seqnum;
+	frag_cmd.piggyack = cmd.piggyack;
+	frag_cmd.msg_length = cmd.msg_length;
+	frag_cmd.frag_pipeline = cmd.frag_pipeline;
+	frag_cmd.match_info = cmd.match_info;
+
+	remaining = cmd.msg_length;
+	for(i=0; i<cmd.frags_nr; i++) {
+		uint32_t chunk = remaining > OMX_MEDIUM_FRAG_LENGTH_MAX ? OMX_MEDIUM_FRAG_LENGTH_MAX : remaining;
+
+		frag_cmd.frag_length = chunk;
+		frag_cmd.frag_seqnum = i;
+		frag_cmd.checksum = cmd.frag_checksum[i];
+		frag_cmd.sendq_offset = (uint32_t) cmd.sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT;
+
+		ret = omx_send_mediumsq_frag(endpoint, &frag_cmd, defevent);
+		if (unlikely(ret < 0))
+			/* assume the remaining frags got lost */
+			break;
+
+		remaining -= chunk;
+	}
+
+	/* report the done event now, or when the last skb using the sendq is released */
+	omx_deferred_event_put(defevent);
+	return 0;
+
+ out:
+	return ret;
+}
+
+/*
+ * Count the user pages that the next mediumva frag spans,
+ * starting at the current position in the user segments.
+ */
+static unsigned int
+omx_mediumva_frag_pages_nr(const struct omx_cmd_user_segment * cur_useg, uint32_t cur_useg_remaining,
+			   unsigned long cur_uaddr, uint32_t frag_length)
+{
+	unsigned int pages_nr = 0;
+
+	while (1) {
+		uint32_t chunk = frag_length > cur_useg_remaining ? cur_useg_remaining : frag_length;
+		if (chunk)
+			pages_nr += ((cur_uaddr + chunk - 1) >> PAGE_SHIFT) - (cur_uaddr >> PAGE_SHIFT) + 1;
+		frag_length -= chunk;
+		if (!frag_length)
+			break;
+		cur_useg++;
+		cur_useg_remaining = cur_useg->len;
+		cur_uaddr = cur_useg->vaddr;
+	}
+
+	return pages_nr;
+}
+
+/*
+ * Pin the user pages of the next mediumva frag and attach them to the skb,
+ * and update the current position in the user segments.
+ * The skb owns the page references and drops them when it is freed,
+ * so the data remains valid even if the application unmaps the buffer
+ * before the NIC is done with it.
+ */
+static int
+omx_mediumva_frag_attach_user_pages(struct sk_buff * skb,
+				    struct omx_cmd_user_segment ** cur_usegp, uint32_t * cur_useg_remainingp,
+				    void __user ** cur_udatap, uint32_t frag_length)
+{
+	struct omx_cmd_user_segment * cur_useg = *cur_usegp;
+	uint32_t cur_useg_remaining = *cur_useg_remainingp;
+	unsigned long cur_uaddr = (unsigned long) *cur_udatap;
+	int desc = 0;
+	int ret = 0;
+
+	while (frag_length) {
+		uint32_t chunk = frag_length > cur_useg_remaining ? cur_useg_remaining : frag_length;
+		unsigned long pageoff = cur_uaddr & (~PAGE_MASK);
+
+		if (chunk > PAGE_SIZE - pageoff)
+			chunk = PAGE_SIZE - pageoff;
+
+		if (chunk) {
+			struct page * page;
+
+			ret = omx_get_user_pages_fast(cur_uaddr & PAGE_MASK, 1, 0, &page);
+			if (unlikely(ret != 1)) {
+				printk(KERN_ERR "Open-MX: Failed to pin mediumva user page at 0x%lx, get_user_pages returned %d\n",
+				       cur_uaddr, ret);
+				ret = -EFAULT;
+				goto out;
+			}
+			ret = 0;
+
+			skb_fill_page_desc(skb, desc, page, pageoff, chunk);
+			desc++;
+			skb->len += chunk;
+			skb->data_len += chunk;
+		}
+
+		frag_length -= chunk;
+		cur_useg_remaining -= chunk;
+		cur_uaddr += chunk;
+		if (!cur_useg_remaining && frag_length) {
+			cur_useg++;
+			cur_useg_remaining = cur_useg->len;
+			cur_uaddr = cur_useg->vaddr;
+		}
+	}
+
+ out:
+	*cur_usegp = cur_useg;
+	*cur_useg_remainingp = cur_useg_remaining;
+	*cur_udatap = (void __user *) cur_uaddr;
+	return ret;
+}
+
 int
 omx_ioctl_send_mediumva(struct omx_endpoint * endpoint,
 			void __user * uparam)
@@ -696,6 +1049,12 @@ omx_ioctl_send_mediumva(struct omx_endpoint * endpoint,
 	}
 #endif
 	frags_nr = (msg_length+OMX_MEDIUM_FRAG_LENGTH_MAX-1) / OMX_MEDIUM_FRAG_LENGTH_MAX;
+	if (unlikely(frags_nr > OMX_MEDIUM_FRAGS_MAX)) {
+		printk(KERN_ERR "Open-MX: Cannot send mediumva of length %ld as more than %ld frags\n",
+		       (unsigned long) msg_length, (unsigned long) OMX_MEDIUM_FRAGS_MAX);
+		ret = -EINVAL;
+		goto out;
+	}
 	nseg = cmd.nr_segments;
 
 	if (unlikely(cmd.shared))
@@ -739,14 +1098,26 @@ omx_ioctl_send_mediumva(struct omx_endpoint * endpoint,
 		struct omx_pkt_medium_frag *medium_n;
 		size_t hdr_len = sizeof(struct omx_pkt_head) + sizeof(struct omx_pkt_medium_frag);
 		uint16_t frag_length = remaining > OMX_MEDIUM_FRAG_LENGTH_MAX ? OMX_MEDIUM_FRAG_LENGTH_MAX : remaining;
-		uint16_t frag_remaining = frag_length;
-		void *data;
+		int zerocopy = 0;
+
+		if (cmd.zerocopy) {
+			if (frag_length > omx_skb_copy_max
+			    && hdr_len + frag_length >= ETH_ZLEN
+			    && omx_skb_frags >= omx_mediumva_frag_pages_nr(cur_useg, cur_useg_remaining,
+									   (unsigned long) cur_udata, frag_length))
+				zerocopy = 1;
+			else
+				omx_counter_inc(iface, MEDIUMVA_FRAG_SEND_LINEAR);
+		}
 
-		skb = omx_new_skb(/* pad to ETH_ZLEN */
-				  max_t(unsigned long, hdr_len + frag_length, ETH_ZLEN));
+		skb = omx_new_skb(zerocopy
+				  /* only allocate space for the header now, we'll attach pages later */
+				  ? hdr_len
+				  /* pad to ETH_ZLEN */
+				  : max_t(unsigned long, hdr_len + frag_length, ETH_ZLEN));
 		if (unlikely(skb == NULL)) {
 			omx_counter_inc(iface, SEND_NOMEM_SKB);
-			printk(KERN_INFO "Open-MX: Failed to create linear mediumva skb\n");
+			printk(KERN_INFO "Open-MX: Failed to create mediumva skb\n");
 			ret = -ENOMEM;
 			goto out_with_usegs;
 		}
@@ -756,7 +1127,6 @@ omx_ioctl_send_mediumva(struct omx_endpoint * endpoint,
 		ph = &mh->head;
 		eh = &ph->eth;
 		medium_n = (struct omx_pkt_medium_frag *) (ph + 1);
-		data = (char*) (medium_n + 1);
 
 		/* set destination peer */
 		ret = omx_set_target_peer(ph, iface, cmd.peer_index);
@@ -785,29 +1155,43 @@ omx_ioctl_send_mediumva(struct omx_endpoint * endpoint,
 		OMX_HTON_MATCH_INFO(medium_n, cmd.match_info);
 		OMX_HTON_16(medium_n->frag_length, frag_length);
 		OMX_HTON_8(medium_n->frag_seqnum, i);
+		OMX_HTON_16(medium_n->checksum, cmd.frag_checksum[i]);
 
 		omx_send_dprintk(eh, "MEDIUMVA length %ld", (unsigned long) frag_length);
 
-		/* copy the data right after the header */
-		while (frag_remaining) {
-			uint16_t chunk = frag_remaining > cur_useg_remaining ? cur_useg_remaining : frag_remaining;
-			ret = copy_from_user(data, cur_udata, chunk);
-			if (unlikely(ret != 0)) {
-				printk(KERN_ERR "Open-MX: Failed to read send mediumva cmd data\n");
-				ret = -EFAULT;
+		if (zerocopy) {
+			/* attach the user pages */
+			ret = omx_mediumva_frag_attach_user_pages(skb, &cur_useg, &cur_useg_remaining,
+								  &cur_udata, frag_length);
+			if (unlikely(ret < 0))
 				goto out_with_skb;
+			omx_counter_inc(iface, MEDIUMVA_FRAG_SEND_ZEROCOPY);
+
+		} else {
+			/* copy the data right after the header */
+			char *data = (char*) (medium_n + 1);
+			uint16_t frag_remaining = frag_length;
+
+			while (frag_remaining) {
+				uint16_t chunk = frag_remaining > cur_useg_remaining ? cur_useg_remaining : frag_remaining;
+				ret = copy_from_user(data, cur_udata, chunk);
+				if (unlikely(ret != 0)) {
+					printk(KERN_ERR "Open-MX: Failed to read send mediumva cmd data\n");
+					ret = -EFAULT;
+					goto out_with_skb;
+				}
+
+				if (chunk == cur_useg_remaining) {
+					cur_useg++;
+					cur_udata = (__user void *)(unsigned long) cur_useg->vaddr;
+					cur_useg_remaining = cur_useg->len;
+				} else {
+					cur_udata += chunk;
+					cur_useg_remaining -= chunk;
+				}
+				frag_remaining -= chunk;
+				data += chunk;
 			}
-
-			if (chunk == cur_useg_remaining) {
-				cur_useg++;
-				cur_udata = (__user void *)(unsigned long) cur_useg->vaddr;
-				cur_useg_remaining = cur_useg->len;
-			} else {
-				cur_udata += chunk;
-				cur_useg_remaining -= chunk;
-			}
-			frag_remaining -= chunk;
-			data += chunk;
 		}
 		remaining -= frag_length;
 
@@ -1051,7 +1435,12 @@ omx_ioctl_send_liback(struct omx_endpoint * endpoint,
 	OMX_HTON_8(truc_n->src_endpoint, endpoint->endpoint_index);
 	OMX_HTON_8(truc_n->dst_endpoint, cmd.dest_endpoint);
 	OMX_HTON_8(truc_n->ptype, OMX_PKT_TYPE_TRUC);
+#ifdef OMX_MX_WIRE_COMPAT
 	OMX_HTON_8(truc_n->length, OMX_PKT_TRUC_LIBACK_DATA_LENGTH);
+#else
+	OMX_HTON_8(truc_n->length, OMX_PKT_TRUC_LIBACK_SACK_DATA_LENGTH);
+	OMX_HTON_32(truc_n->liback.sack_mask, cmd.sack_mask);
+#endif
 	OMX_HTON_32(truc_n->session, cmd.session_id);
 	OMX_HTON_8(truc_n->type, OMX_PKT_TRUC_DATA_TYPE_ACK);
 	OMX_HTON_16(truc_n->liback.lib_seqnum, cmd.lib_seqnum);
@@ -1070,6 +1459,110 @@ omx_ioctl_send_liback(struct omx_endpoint * endpoint,
 	return ret;
 }
 
+/*
+ * Process a batch of send commands at once,
+ * so that a burst of small messages costs a single kernel crossing.
+ *
+ * Each entry is given to the regular ioctl handler as if it came from its own
+ * ioctl. Failures are not reported to user-space, the library lets retransmission
+ * take care of them, as it does for the regular ioctls.
+ */
+int
+omx_ioctl_submit_cmds(struct omx_endpoint * endpoint,
+		      void __user * uparam)
+{
+	struct omx_cmd_submit_cmds cmd;
+	struct omx_cmd_submit_entry __user * uentries;
+	struct omx_iface * iface = endpoint->iface;
+	uint32_t i;
+	int ret;
+
+	ret = copy_from_user(&cmd, uparam, sizeof(cmd));
+	if (unlikely(ret != 0)) {
+		printk(KERN_ERR "Open-MX: Failed to read submit cmds cmd hdr\n");
+		ret = -EFAULT;
+		goto out;
+	}
+
+	if (unlikely(cmd.nr > OMX_SUBMIT_CMDS_MAX)) {
+		printk(KERN_ERR "Open-MX: Cannot submit more than %d commands at once (tried %ld)\n",
+		       OMX_SUBMIT_CMDS_MAX, (unsigned long) cmd.nr);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (cmd.nr < 2)
+		omx_counter_inc(iface, SUBMIT_BATCH_1);
+	else if (cmd.nr < 4)
+		omx_counter_inc(iface, SUBMIT_BATCH_2_3);
+	else if (cmd.nr < 8)
+		omx_counter_inc(iface, SUBMIT_BATCH_4_7);
+	else if (cmd.nr < 16)
+		omx_counter_inc(iface, SUBMIT_BATCH_8_15);
+	else
+		omx_counter_inc(iface, SUBMIT_BATCH_16_MORE);
+
+	uentries = (struct omx_cmd_submit_entry __user *)(unsigned long) cmd.entries;
+	for(i=0; i<cmd.nr; i++) {
+		struct omx_cmd_submit_entry __user * uentry = &uentries[i];
+		uint32_t epcmd;
+
+		ret = get_user(epcmd, &uentry->epcmd);
+		if (unlikely(ret != 0)) {
+			printk(KERN_ERR "Open-MX: Failed to read submitted cmd #%ld type\n",
+			       (unsigned long) i);
+			ret = -EFAULT;
+			goto out;
+		}
+
+		switch (epcmd) {
+		case OMX_EPCMD_SEND_TINY:
+			ret = omx_ioctl_send_tiny(endpoint, &uentry->cmd.send_tiny);
+			break;
+		case OMX_EPCMD_SEND_SMALL:
+			ret = omx_ioctl_send_small(endpoint, &uentry->cmd.send_small);
+			break;
+		case OMX_EPCMD_SEND_MEDIUMSQ_FRAG:
+			ret = omx_ioctl_send_mediumsq_frag(endpoint, &uentry->cmd.send_mediumsq_frag);
+			if (unlikely(ret < 0)) {
+				/*
+				 * the library waits for one done event per fragment,
+				 * report the fragment as sent and let retransmission resend it later
+				 */
+				struct omx_evt_send_mediumsq_frag_done evt;
+				uint32_t sendq_offset;
+
+				if (get_user(sendq_offset, &uentry->cmd.send_mediumsq_frag.sendq_offset) == 0) {
+					evt.id = 0;
+					evt.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
+					evt.sendq_offset = sendq_offset;
+					omx_notify_exp_event(endpoint, &evt, sizeof(evt));
+				}
+			}
+			break;
+		case OMX_EPCMD_SEND_NOTIFY:
+			ret = omx_ioctl_send_notify(endpoint, &uentry->cmd.send_notify);
+			break;
+		case OMX_EPCMD_SEND_LIBACK:
+			ret = omx_ioctl_send_liback(endpoint, &uentry->cmd.send_liback);
+			break;
+		default:
+			printk(KERN_ERR "Open-MX: Cannot submit command type %ld\n",
+			       (unsigned long) epcmd);
+			ret = -EINVAL;
+			break;
+		}
+
+		if (unlikely(ret < 0))
+			omx_counter_inc(iface, SUBMIT_CMD_FAILED);
+	}
+
+	return 0;
+
+ out:
+	return ret;
+}
+
 void
 omx_send_nack_lib(struct omx_iface * iface, uint32_t peer_index, enum omx_nack_type nack_type,
 		  uint8_t src_endpoint, uint8_t dst_endpoint, uint16_t lib_seqnum)
@@ -1225,6 +1718,15 @@ omx_ioctl_bench(struct omx_endpoint * endpoint, void __user * uparam)
 	if (cmd.type == OMX_CMD_BENCH_TYPE_PARAMS)
 		goto out;
 
+	/* level 21: lookup a peer by address */
+	if (cmd.type == OMX_CMD_BENCH_TYPE_PEER_LOOKUP) {
+		rcu_read_lock();
+		if (!omx_peer_lookup_by_addr_locked(cmd.board_addr))
+			ret = -EINVAL;
+		rcu_read_unlock();
+		goto out;
+	}
+
 	skb = omx_new_skb(ETH_ZLEN);
 	if (unlikely(skb == NULL)) {
 		printk(KERN_INFO "Open-MX: Failed to create bench skb\n");
@@ -351,7 +351,8 @@ omx_shared_send_small(struct omx_endpoint *src_endpoint,
 
 int
 omx_shared_send_mediumsq_frag(struct omx_endpoint *src_endpoint,
-			      const struct omx_cmd_send_mediumsq_frag *hdr)
+			      const struct omx_cmd_send_mediumsq_frag *hdr,
+			      int notify_done)
 {
 	struct omx_endpoint * dst_endpoint;
 	struct omx_evt_recv_msg dst_event;
@@ -451,11 +452,13 @@ omx_shared_send_mediumsq_frag(struct omx_endpoint *src_endpoint,
 	/* notify the dst event */
 	omx_commit_notify_unexp_event_with_recvq(dst_endpoint, &dst_event, sizeof(dst_event));
 
-	/* fill and notify the src event */
-	src_event.id = 0;
-	src_event.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
-	src_event.sendq_offset = hdr->sendq_offset;
-	omx_notify_exp_event(src_endpoint, &src_event, sizeof(src_event));
+	/* fill and notify the src event, unless the caller reports it for the whole message */
+	if (notify_done) {
+		src_event.id = 0;
+		src_event.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
+		src_event.sendq_offset = hdr->sendq_offset;
+		omx_notify_exp_event(src_endpoint, &src_event, sizeof(src_event));
+	}
 	omx_endpoint_release(dst_endpoint);
 
 	omx_counter_inc(omx_shared_fake_iface, SHARED_MEDIUMSQ_FRAG);
@@ -464,10 +467,12 @@ omx_shared_send_mediumsq_frag(struct omx_endpoint *src_endpoint,
 
  out_with_endpoint:
 	/* fill and notify the src event anyway, so that the sender doesn't leak eventq slots */
-	src_event.id = 0;
-	src_event.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
-	src_event.sendq_offset = hdr->sendq_offset;
-	omx_notify_exp_event(src_endpoint, &src_event, sizeof(src_event));
+	if (notify_done) {
+		src_event.id = 0;
+		src_event.type = OMX_EVT_SEND_MEDIUMSQ_FRAG_DONE;
+		src_event.sendq_offset = hdr->sendq_offset;
+		omx_notify_exp_event(src_endpoint, &src_event, sizeof(src_event));
+	}
 
 	omx_endpoint_release(dst_endpoint);
 	return err;
@@ -718,16 +723,35 @@ omx_shared_pull(struct omx_endpoint *src_endpoint,
 {
 	struct omx_endpoint * dst_endpoint;
 	struct omx_evt_pull_done event;
-	struct omx_user_region *src_region, *dst_region = NULL;
+	struct omx_user_region *src_region = NULL, *dst_region = NULL;
+	struct omx_cmd_user_segment *usegs = NULL;
+	uint32_t nseg = hdr->puller_nr_segments;
 	enum omx_nack_type nack_type = OMX_NACK_TYPE_NONE;
 	int err;
 
-	/* get our region */
-	src_region = omx_user_region_acquire(src_endpoint, hdr->puller_rdma_id);
-	if (!src_region) {
-		/* source region is invalid, return an immediate error */
-		err = -EINVAL;
-		goto out;
+	if (nseg) {
+		/* copy directly into the receive buffer, no need for our region */
+		usegs = kmalloc(nseg * sizeof(struct omx_cmd_user_segment), GFP_KERNEL);
+		if (!usegs) {
+			printk(KERN_ERR "Open-MX: Cannot allocate segments for shared pull\n");
+			err = -ENOMEM;
+			goto out;
+		}
+		err = copy_from_user(usegs, (void __user *)(unsigned long) hdr->puller_segments,
+				     nseg * sizeof(struct omx_cmd_user_segment));
+		if (unlikely(err != 0)) {
+			printk(KERN_ERR "Open-MX: Failed to read shared pull segments cmd\n");
+			err = -EFAULT;
+			goto out_with_usegs;
+		}
+	} else {
+		/* get our region */
+		src_region = omx_user_region_acquire(src_endpoint, hdr->puller_rdma_id);
+		if (!src_region) {
+			/* source region is invalid, return an immediate error */
+			err = -EINVAL;
+			goto out;
+		}
 	}
 
 	dst_endpoint = omx_shared_get_endpoint_or_nack_type(hdr->peer_index, hdr->dest_endpoint,
@@ -751,10 +775,15 @@ omx_shared_pull(struct omx_endpoint *src_endpoint,
 	}
 
 #ifndef OMX_NORECVCOPY
-	/* pull from the dst region into the src region */
-	err = omx_copy_between_user_regions(dst_region, hdr->pulled_rdma_offset,
-					    src_region, 0,
-					    hdr->length);
+	if (nseg)
+		/* pull from the dst region into the receive buffer */
+		err = omx_copy_from_user_region_to_current_segments(dst_region, hdr->pulled_rdma_offset,
+								    usegs, nseg, hdr->length);
+	else
+		/* pull from the dst region into the src region */
+		err = omx_copy_between_user_regions(dst_region, hdr->pulled_rdma_offset,
+						    src_region, hdr->puller_rdma_offset,
+						    hdr->length);
 	event.status = err < 0 ? OMX_EVT_PULL_DONE_ABORTED : OMX_EVT_PULL_DONE_SUCCESS;
 #else
 	event.status = OMX_EVT_PULL_DONE_SUCCESS;
@@ -763,7 +792,9 @@ omx_shared_pull(struct omx_endpoint *src_endpoint,
 	/* release stuff */
 	omx_user_region_release(dst_region);
 	omx_endpoint_release(dst_endpoint);
-	omx_user_region_release(src_region);
+	if (src_region)
+		omx_user_region_release(src_region);
+	kfree(usegs);
 
 	/* fill and notify the event */
 	event.id = 0;
@@ -772,14 +803,19 @@ omx_shared_pull(struct omx_endpoint *src_endpoint,
 	event.puller_rdma_id = hdr->puller_rdma_id;
 	omx_notify_exp_event(src_endpoint, &event, sizeof(event));
 
-	omx_counter_inc(omx_shared_fake_iface, SHARED_PULL);
+	if (nseg)
+		omx_counter_inc(omx_shared_fake_iface, SHARED_PULL_DIRECT);
+	else
+		omx_counter_inc(omx_shared_fake_iface, SHARED_PULL);
 
 	return 0;
 
  out_notify_nack_with_dst_endpoint:
 	omx_endpoint_release(dst_endpoint);
  out_notify_nack:
-	omx_user_region_release(src_region);
+	if (src_region)
+		omx_user_region_release(src_region);
+	kfree(usegs);
 
 	event.id = 0;
 	event.type = OMX_EVT_PULL_DONE;
@@ -788,6 +824,8 @@ omx_shared_pull(struct omx_endpoint *src_endpoint,
 	omx_notify_exp_event(src_endpoint, &event, sizeof(event));
 	return 0;
 
+ out_with_usegs:
+	kfree(usegs);
  out:
 	return err;
 }
@@ -859,6 +897,7 @@ omx_shared_send_liback(struct omx_endpoint *src_endpoint,
 	event.lib_seqnum = hdr->lib_seqnum;
 	event.send_seq = hdr->send_seq;
 	event.resent = hdr->resent;
+	event.sack_mask = hdr->sack_mask;
 
 	/* notify the event */
 	err = omx_notify_unexp_event(dst_endpoint, &event, sizeof(event));
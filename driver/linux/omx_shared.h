@@ -37,7 +37,8 @@ omx_shared_send_small(struct omx_endpoint *src_endpoint,
 
 extern int
 omx_shared_send_mediumsq_frag(struct omx_endpoint *src_endpoint,
-			      const struct omx_cmd_send_mediumsq_frag *hdr);
+			      const struct omx_cmd_send_mediumsq_frag *hdr,
+			      int notify_done);
 
 extern int
 omx_shared_send_mediumva(struct omx_endpoint *src_endpoint,
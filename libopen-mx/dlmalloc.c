@@ -42,13 +42,38 @@ int pthread_mutexattr_setkind_np(pthread_mutexattr_t *attr, int kind)
 #include <unistd.h>
 #include <sys/syscall.h>
 
+#ifdef OMX_LIB_MALLOC_HOOKS
+/* tell the regcache about memory given back to the system (see omx_hooks.c) */
+extern void omx__hooks_invalidate(void *ptr, size_t size);
+extern void omx__hooks_remap(void *old_ptr, size_t old_size, void *new_ptr, size_t new_size);
+extern void * __sbrk(intptr_t increment);
+
+static void * dlmorecore(intptr_t increment)
+{
+  if (increment < 0)
+    omx__hooks_invalidate((char *) __sbrk(0) + increment, -increment);
+  return __sbrk(increment);
+}
+#define MORECORE dlmorecore
+
+/* the allocator is exported to the application, it needs its own locking */
+#define USE_LOCKS 1
+#endif /* OMX_LIB_MALLOC_HOOKS */
+
 static void * dlmremap(void * old_ptr, size_t old_size, size_t new_size, int maymove)
 {
-  return (void *) syscall(__NR_mremap, old_ptr, old_size, new_size, maymove);
+  void * new_ptr = (void *) syscall(__NR_mremap, old_ptr, old_size, new_size, maymove);
+#ifdef OMX_LIB_MALLOC_HOOKS
+  omx__hooks_remap(old_ptr, old_size, new_ptr, new_size);
+#endif
+  return new_ptr;
 }
 
 static int dlmunmap(void *old_ptr, size_t old_size)
 {
+#ifdef OMX_LIB_MALLOC_HOOKS
+  omx__hooks_invalidate(old_ptr, old_size);
+#endif
   return (int) syscall(__NR_munmap, old_ptr, old_size);
 }
 
@@ -1956,7 +1981,7 @@ static void init_malloc_global_mutex() {
 #define USE_LOCK_BIT               (2U)
 #else  /* USE_LOCKS */
 #define USE_LOCK_BIT               (0U)
-#define INITIAL_LOCK(l)
+#define INITIAL_LOCK(l)            (0)
 #endif /* USE_LOCKS */
 
 #if USE_LOCKS
@@ -3059,7 +3084,7 @@ static int init_mparams(void) {
 #if !ONLY_MSPACES
     /* Set up lock for main malloc area */
     gm->mflags = mparams.default_mflags;
-    INITIAL_LOCK(&gm->mutex);
+    (void) INITIAL_LOCK(&gm->mutex);
 #endif
 
     {
@@ -5009,7 +5034,7 @@ static mstate init_user_mstate(char* tbase, size_t tsize) {
   mchunkptr msp = align_as_chunk(tbase);
   mstate m = (mstate)(chunk2mem(msp));
   memset(m, 0, msize);
-  INITIAL_LOCK(&m->mutex);
+  (void) INITIAL_LOCK(&m->mutex);
   msp->head = (msize|INUSE_BITS);
   m->seg.base = m->least_addr = tbase;
   m->seg.size = m->footprint = m->max_footprint = tsize;
@@ -31,7 +31,7 @@ omx__mark_request_acked(struct omx_endpoint *ep,
 			omx_return_t status)
 {
   omx__debug_assert(req->generic.state & OMX_REQUEST_STATE_NEED_ACK);
-  req->generic.state &= ~OMX_REQUEST_STATE_NEED_ACK;
+  req->generic.state &= ~(OMX_REQUEST_STATE_NEED_ACK | OMX_REQUEST_STATE_SACKED);
 
   switch (req->generic.type) {
 
@@ -82,6 +82,68 @@ omx__mark_request_acked(struct omx_endpoint *ep,
   }
 }
 
+/*********************
+ * Resend Delays
+ */
+
+/*
+ * Update the partner RTT estimation with a new sample, as TCP does (RFC 6298),
+ * and derive the delay before resending messages to this partner.
+ */
+static INLINE void
+omx__partner_rtt_sample(struct omx__partner *partner, uint64_t rtt)
+{
+  uint32_t delay;
+
+  if (rtt > omx__globals.resend_delay_jiffies)
+    rtt = omx__globals.resend_delay_jiffies;
+
+  if (!partner->srtt_x8 && !partner->rttvar_x4) {
+    partner->srtt_x8 = rtt << 3;
+    partner->rttvar_x4 = rtt << 1;
+  } else {
+    int32_t err = (int32_t) rtt - (int32_t) (partner->srtt_x8 >> 3);
+    /* srtt += err/8 */
+    partner->srtt_x8 += err;
+    /* rttvar += (|err| - rttvar)/4 */
+    if (err < 0)
+      err = -err;
+    partner->rttvar_x4 += err - (partner->rttvar_x4 >> 2);
+  }
+
+  if (!omx__globals.resend_rtt)
+    return;
+
+  /* srtt + 4*rttvar, at least one jiffy of variation */
+  delay = (partner->srtt_x8 >> 3) + (partner->rttvar_x4 ? partner->rttvar_x4 : 1);
+  if (delay < omx__globals.resend_delay_min_jiffies)
+    delay = omx__globals.resend_delay_min_jiffies;
+  else if (delay > omx__globals.resend_delay_jiffies)
+    delay = omx__globals.resend_delay_jiffies;
+  partner->resend_delay_jiffies = delay;
+}
+
+/*
+ * A request got acked by the partner (selectively or not) for the first time.
+ * Only requests that were sent once give valid RTT samples (Karn's algorithm).
+ * Resent requests that get acked less than half a RTT after the last resend
+ * were actually acked for a previous copy, their resend was spurious.
+ */
+static INLINE void
+omx__request_first_acked(struct omx_endpoint *ep,
+			 union omx_request *req, uint64_t now)
+{
+  struct omx__partner *partner = req->generic.partner;
+  uint64_t elapsed = now - req->generic.last_send_jiffies;
+
+  if (req->generic.resends <= 1)
+    omx__partner_rtt_sample(partner, elapsed);
+  else if (elapsed * 16 < partner->srtt_x8)
+    ep->resends_spurious++;
+  else
+    ep->resends_needed++;
+}
+
 /***********************
  * Handle Received Acks
  */
@@ -102,11 +164,12 @@ omx__handle_ack(struct omx_endpoint *ep,
 
   } else {
     union omx_request *req, *next;
+    uint64_t now = omx__now();
 
     omx__debug_printf(ACK, ep, "marking seqnums up to %d (#%d) as acked (jiffies %lld)\n",
 		      (unsigned) OMX__SEQNUM(ack_before - 1),
 		      (unsigned) OMX__SESNUM_SHIFTED(ack_before - 1),
-		      (unsigned long long) omx__driver_desc->jiffies);
+		      (unsigned long long) now);
 
     omx__foreach_partner_request_safe(&partner->non_acked_req_q, req, next) {
       /* take care of the seqnum wrap around here too */
@@ -123,6 +186,8 @@ omx__handle_ack(struct omx_endpoint *ep,
       omx__debug_printf(ACK, ep, "marking req with seqnum %x (#%d) as acked\n",
 			(unsigned) OMX__SEQNUM(req->generic.send_seqnum),
 			(unsigned) OMX__SESNUM_SHIFTED(req->generic.send_seqnum));
+      if (!(req->generic.state & OMX_REQUEST_STATE_SACKED))
+	omx__request_first_acked(ep, req, now);
       omx___dequeue_partner_request(req);
       omx__mark_request_acked(ep, req, OMX_SUCCESS);
     }
@@ -134,6 +199,40 @@ omx__handle_ack(struct omx_endpoint *ep,
   }
 }
 
+/*
+ * Bit i of the sack mask means that seqnum ack_before+1+i was received.
+ * Mark these requests so that they are not resent too early,
+ * and unmark the other ones in case the peer dropped them in the meantime.
+ */
+static void
+omx__handle_sack(struct omx_endpoint *ep,
+		 struct omx__partner *partner, omx__seqnum_t ack_before,
+		 uint32_t sack_mask)
+{
+  union omx_request *req;
+  uint64_t now = omx__now();
+
+  omx__foreach_partner_request(&partner->non_acked_req_q, req) {
+    omx__seqnum_t index = OMX__SEQNUM(req->generic.send_seqnum - ack_before);
+
+    if (index > 32)
+      /* the remaining ones are not covered by the mask */
+      break;
+
+    if (index >= 1 && index <= 32 && (sack_mask & (1U << (index - 1)))) {
+      if (!(req->generic.state & OMX_REQUEST_STATE_SACKED)) {
+	omx__debug_printf(ACK, ep, "marking req with seqnum %x (#%d) as selectively acked\n",
+			  (unsigned) OMX__SEQNUM(req->generic.send_seqnum),
+			  (unsigned) OMX__SESNUM_SHIFTED(req->generic.send_seqnum));
+	req->generic.state |= OMX_REQUEST_STATE_SACKED;
+	omx__request_first_acked(ep, req, now);
+      }
+    } else {
+      req->generic.state &= ~OMX_REQUEST_STATE_SACKED;
+    }
+  }
+}
+
 void
 omx__handle_liback(struct omx_endpoint *ep,
 		   struct omx__partner *partner,
@@ -162,6 +261,10 @@ omx__handle_liback(struct omx_endpoint *ep,
 		    (unsigned) OMX__SEQNUM(ack - 1),
 		    (unsigned) OMX__SESNUM_SHIFTED(ack - 1));
   omx__handle_ack(ep, partner, ack);
+
+  /* only look at the sack mask if the ack is not obsolete */
+  if (ack == partner->next_acked_send_seq)
+    omx__handle_sack(ep, partner, ack, liback->sack_mask);
 }
 
 /************************
@@ -219,8 +322,44 @@ omx__handle_nack(struct omx_endpoint *ep,
  * Handle Acks to Send
  */
 
+/*
+ * Bit i of the sack mask means that seqnum ack_upto+1+i was entirely received:
+ * matched messages that are not partial mediums anymore,
+ * and early single-fragment messages.
+ */
+static uint32_t
+omx__get_partner_sack_mask(struct omx_endpoint *ep,
+			   struct omx__partner *partner, omx__seqnum_t ack_upto)
+{
+  omx__seqnum_t matched = OMX__SEQNUM(partner->next_match_recv_seq - ack_upto);
+  struct omx__early_packet *early;
+  union omx_request *req;
+  uint32_t mask = 0;
+
+  if (matched > 1)
+    mask = matched > 32 ? (uint32_t) -1 : (1U << (matched - 1)) - 1;
+
+  omx__foreach_partner_request(&partner->partial_medium_recv_req_q, req) {
+    omx__seqnum_t index = OMX__SEQNUM(req->recv.seqnum - ack_upto);
+    if (index > 32)
+      break;
+    if (index >= 1)
+      mask &= ~(1U << (index - 1));
+  }
+
+  omx__foreach_partner_early_packet(partner, early) {
+    omx__seqnum_t index = OMX__SEQNUM(early->msg.seqnum - ack_upto);
+    if (index > 32)
+      break;
+    if (index >= 1 && early->msg.type != OMX_EVT_RECV_MEDIUM_FRAG)
+      mask |= 1U << (index - 1);
+  }
+
+  return mask;
+}
+
 static omx_return_t
-omx__submit_send_liback(const struct omx_endpoint *ep,
+omx__submit_send_liback(struct omx_endpoint *ep,
 			struct omx__partner * partner)
 {
   struct omx_cmd_send_liback liback_param;
@@ -238,8 +377,9 @@ omx__submit_send_liback(const struct omx_endpoint *ep,
   liback_param.lib_seqnum = ack_upto;
   liback_param.send_seq = ack_upto; /* FIXME? partner->send_seq */
   liback_param.resent = 0; /* FIXME? partner->requeued */
+  liback_param.sack_mask = omx__globals.sack ? omx__get_partner_sack_mask(ep, partner, ack_upto) : 0;
 
-  err = ioctl(ep->fd, OMX_CMD_SEND_LIBACK, &liback_param);
+  err = omx__submit_cmd(ep, SEND_LIBACK, &liback_param);
   if (unlikely(err < 0)) {
     omx_return_t ret = omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
 							  OMX_SUCCESS,
@@ -258,7 +398,7 @@ void
 omx__process_partners_to_ack(struct omx_endpoint *ep)
 {
   struct omx__partner *partner, *next;
-  uint64_t now = omx__driver_desc->jiffies;
+  uint64_t now;
 
   /* look at the immediate list */
   list_for_each_entry_safe(partner, next,
@@ -269,7 +409,7 @@ omx__process_partners_to_ack(struct omx_endpoint *ep)
 		      (unsigned long long) partner->board_addr, (unsigned) partner->endpoint_index,
 		      (unsigned) OMX__SEQNUM(partner->next_frag_recv_seq - 1),
 		      (unsigned) OMX__SESNUM_SHIFTED(partner->next_frag_recv_seq - 1),
-		      (unsigned long long) now);
+		      (unsigned long long) omx__now());
 
     ret = omx__submit_send_liback(ep, partner);
     if (ret != OMX_SUCCESS)
@@ -279,7 +419,11 @@ omx__process_partners_to_ack(struct omx_endpoint *ep)
     omx__mark_partner_ack_sent(ep, partner);
   }
 
+  if (list_empty(&ep->partners_to_ack_delayed_list))
+    return;
+
   /* no need to bother looking at the delayed list if the time didn't change */
+  now = omx__now();
   if (now == ep->last_partners_acking_jiffies)
     return;
   ep->last_partners_acking_jiffies = now;
@@ -327,7 +471,7 @@ omx__flush_partners_to_ack(struct omx_endpoint *ep)
 		      (unsigned long long) partner->board_addr, (unsigned) partner->endpoint_index,
 		      (unsigned) OMX__SEQNUM(partner->next_frag_recv_seq - 1),
 		      (unsigned) OMX__SESNUM_SHIFTED(partner->next_frag_recv_seq - 1),
-		      (unsigned long long) omx__driver_desc->jiffies,
+		      (unsigned long long) omx__now(),
 		      (unsigned long long) partner->oldest_recv_time_not_acked);
 
     ret = omx__submit_send_liback(ep, partner);
@@ -356,7 +500,7 @@ omx__prepare_progress_wakeup(struct omx_endpoint *ep)
     tmp = partner->oldest_recv_time_not_acked + omx__globals.ack_delay_jiffies;
 
     omx__debug_printf(WAIT, ep, "need to wakeup at %lld jiffies (in %ld) for delayed acks\n",
-		      (unsigned long long) tmp, (unsigned long) (tmp - omx__driver_desc->jiffies));
+		      (unsigned long long) tmp, (unsigned long) (tmp - omx__now()));
 
     if (tmp < wakeup_jiffies || wakeup_jiffies == OMX_NO_WAKEUP_JIFFIES)
       wakeup_jiffies = tmp;
@@ -366,11 +510,19 @@ omx__prepare_progress_wakeup(struct omx_endpoint *ep)
   if (!omx__empty_queue(&ep->non_acked_req_q)) {
     uint64_t tmp;
 
+    /* requests are sorted by last send time but their resend delays vary */
     req = omx__first_request(&ep->non_acked_req_q);
-    tmp = req->generic.last_send_jiffies + omx__globals.resend_delay_jiffies;
+    tmp = req->generic.last_send_jiffies + omx__request_resend_delay(req);
+    omx__foreach_request(&ep->non_acked_req_q, req) {
+      if (req->generic.last_send_jiffies + omx__globals.resend_delay_min_jiffies >= tmp)
+	/* the remaining ones cannot be resent earlier */
+	break;
+      if (req->generic.last_send_jiffies + omx__request_resend_delay(req) < tmp)
+	tmp = req->generic.last_send_jiffies + omx__request_resend_delay(req);
+    }
 
     omx__debug_printf(WAIT, ep, "need to wakeup at %lld jiffies (in %ld) for resend\n",
-		      (unsigned long long) tmp, (unsigned long) (tmp - omx__driver_desc->jiffies));
+		      (unsigned long long) tmp, (unsigned long) (tmp - omx__now()));
 
     if (tmp < wakeup_jiffies || wakeup_jiffies == OMX_NO_WAKEUP_JIFFIES)
       wakeup_jiffies = tmp;
@@ -384,7 +536,7 @@ omx__prepare_progress_wakeup(struct omx_endpoint *ep)
     tmp = req->generic.last_send_jiffies + omx__globals.resend_delay_jiffies;
 
     omx__debug_printf(WAIT, ep, "need to wakeup at %lld jiffies (in %ld) for resend\n",
-		      (unsigned long long) tmp, (unsigned long) (tmp - omx__driver_desc->jiffies));
+		      (unsigned long long) tmp, (unsigned long) (tmp - omx__now()));
 
     if (tmp < wakeup_jiffies || wakeup_jiffies == OMX_NO_WAKEUP_JIFFIES)
       wakeup_jiffies = tmp;
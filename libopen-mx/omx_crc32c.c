@@ -0,0 +1,181 @@
+/*
+ * Open-MX
+ * Copyright © inria 2007-2010 (see AUTHORS file)
+ *
+ * The development of this software has been funded by Myricom, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU Lesser General Public License in COPYING.LGPL for more details.
+ */
+
+/*
+ * CRC32C (Castagnoli) for the end-to-end checksum of messages (OMX_CHECKSUM).
+ *
+ * The SSE4.2 crc32 instruction is used when the processor supports it,
+ * otherwise a slice-by-8 table-driven implementation.
+ * Both follow the usual convention (inverted initial and final values),
+ * so that omx__crc32c(omx__crc32c(0, a, n), b, m) is the CRC of a and b.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "omx_lib.h"
+
+#define OMX__CRC32C_POLY 0x82f63b78 /* reflected 0x1edc6f41 */
+
+static uint32_t omx__crc32c_table[8][256];
+
+uint32_t
+omx__crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+
+  crc = ~crc;
+
+  while (len && ((uintptr_t) p & 7)) {
+    crc = omx__crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    len--;
+  }
+
+  while (len >= 8) {
+    uint32_t low, high;
+    memcpy(&low, p, 4);
+    memcpy(&high, p+4, 4);
+#if __BYTE_ORDER == __BIG_ENDIAN
+    low = __builtin_bswap32(low);
+    high = __builtin_bswap32(high);
+#endif
+    low ^= crc;
+    crc = omx__crc32c_table[7][low & 0xff]
+      ^ omx__crc32c_table[6][(low >> 8) & 0xff]
+      ^ omx__crc32c_table[5][(low >> 16) & 0xff]
+      ^ omx__crc32c_table[4][low >> 24]
+      ^ omx__crc32c_table[3][high & 0xff]
+      ^ omx__crc32c_table[2][(high >> 8) & 0xff]
+      ^ omx__crc32c_table[1][(high >> 16) & 0xff]
+      ^ omx__crc32c_table[0][high >> 24];
+    p += 8;
+    len -= 8;
+  }
+
+  while (len--)
+    crc = omx__crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+#ifdef OMX__CRC32C_HW
+
+uint32_t __attribute__((target("sse4.2")))
+omx__crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+
+  crc = ~crc;
+
+  while (len && ((uintptr_t) p & 7)) {
+    crc = __builtin_ia32_crc32qi(crc, *p++);
+    len--;
+  }
+
+#ifdef __x86_64__
+  while (len >= 8) {
+    uint64_t val;
+    memcpy(&val, p, 8);
+    crc = (uint32_t) __builtin_ia32_crc32di(crc, val);
+    p += 8;
+    len -= 8;
+  }
+#endif
+
+  while (len >= 4) {
+    uint32_t val;
+    memcpy(&val, p, 4);
+    crc = __builtin_ia32_crc32si(crc, val);
+    p += 4;
+    len -= 4;
+  }
+
+  while (len--)
+    crc = __builtin_ia32_crc32qi(crc, *p++);
+
+  return ~crc;
+}
+
+int
+omx__crc32c_hw_available(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#else /* !OMX__CRC32C_HW */
+
+int
+omx__crc32c_hw_available(void)
+{
+  return 0;
+}
+
+#endif /* !OMX__CRC32C_HW */
+
+uint32_t (*omx__crc32c)(uint32_t crc, const void *buf, size_t len) = omx__crc32c_sw;
+
+/*
+ * Copy and checksum by blocks small enough to still be in the cache
+ * when they are checksummed, so that the data is only loaded from memory once.
+ */
+uint32_t
+omx__crc32c_copy(void *dst, const void *src, size_t len, uint32_t crc)
+{
+#define OMX__CRC32C_COPY_BLOCK 2048
+  char *d = dst;
+  const char *s = src;
+
+  while (len) {
+    size_t chunk = len > OMX__CRC32C_COPY_BLOCK ? OMX__CRC32C_COPY_BLOCK : len;
+    memcpy(d, s, chunk);
+    crc = omx__crc32c(crc, d, chunk);
+    d += chunk;
+    s += chunk;
+    len -= chunk;
+  }
+
+  return crc;
+}
+
+void
+omx__crc32c_init(void)
+{
+  unsigned i, j;
+
+  for(i=0; i<256; i++) {
+    uint32_t crc = i;
+    for(j=0; j<8; j++)
+      crc = crc & 1 ? (crc >> 1) ^ OMX__CRC32C_POLY : crc >> 1;
+    omx__crc32c_table[0][i] = crc;
+  }
+
+  for(i=0; i<256; i++)
+    for(j=1; j<8; j++)
+      omx__crc32c_table[j][i] = (omx__crc32c_table[j-1][i] >> 8)
+	^ omx__crc32c_table[0][omx__crc32c_table[j-1][i] & 0xff];
+
+#ifdef OMX__CRC32C_HW
+  if (omx__crc32c_hw_available())
+    omx__crc32c = omx__crc32c_hw;
+#endif
+}
+
+/* vim: shiftwidth=2 softtabstop=2
+ */
@@ -92,20 +92,20 @@ omx__endpoint_sendq_map_init(struct omx_endpoint * ep)
   struct omx__sendq_entry * array;
   unsigned i;
 
-  array = omx_malloc_ep(ep, OMX_SENDQ_ENTRY_NR * sizeof(struct omx__sendq_entry));
+  array = omx_malloc_ep(ep, ep->sendq_entry_nr * sizeof(struct omx__sendq_entry));
   if (!array)
     /* let the caller handle the error */
     return OMX_NO_RESOURCES;
 
   ep->sendq_map.array = array;
 
-  for(i=0; i<OMX_SENDQ_ENTRY_NR; i++) {
+  for(i=0; i<ep->sendq_entry_nr; i++) {
     array[i].user = NULL;
     array[i].next_free = i+1;
   }
-  array[OMX_SENDQ_ENTRY_NR-1].next_free = -1;
+  array[ep->sendq_entry_nr-1].next_free = -1;
   ep->sendq_map.first_free = 0;
-  ep->sendq_map.nr_free = OMX_SENDQ_ENTRY_NR;
+  ep->sendq_map.nr_free = ep->sendq_entry_nr;
 
   return OMX_SUCCESS;
 }
@@ -162,6 +162,61 @@ omx__endpoint_bind_process(const struct omx_endpoint *ep, const char *bindstring
     }
     fclose(file);
 
+  } else if (!strcmp(bindstring, "nic")) {
+    /* spread the endpoints on the cpus of the NUMA node of the interface */
+    char filename[64];
+    char line[OMX_PROCESS_BINDING_LENGTH_MAX];
+    unsigned long first, last;
+    unsigned nr = 0, target;
+    char *c;
+    FILE *file;
+
+    if (ep->board_info.numa_node == (uint32_t) -1) {
+      omx__verbose_printf(NULL, "Not binding process pid %ld, NUMA node of interface %s is unknown\n",
+			  (unsigned long) getpid(), ep->board_info.ifacename);
+      return;
+    }
+
+    snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%u/cpulist",
+	     (unsigned) ep->board_info.numa_node);
+    file = fopen(filename, "r");
+    if (!file) {
+      omx__verbose_printf(NULL, "Not binding process pid %ld, failed to open %s, %m\n",
+			  (unsigned long) getpid(), filename);
+      return;
+    }
+    c = fgets(line, OMX_PROCESS_BINDING_LENGTH_MAX, file);
+    fclose(file);
+    if (!c)
+      return;
+
+    /* count the cpus of the node, then find the endpoint_index-th modulo this number */
+    for(target = (unsigned) -1; ; ) {
+      for(c = line; *c >= '0' && *c <= '9'; ) {
+	first = last = strtoul(c, &c, 10);
+	if (*c == '-')
+	  last = strtoul(c+1, &c, 10);
+	for(i = first; i <= last; i++) {
+	  if (nr == target)
+	    goto found;
+	  nr++;
+	}
+	if (*c == ',')
+	  c++;
+      }
+      if (!nr || target != (unsigned) -1)
+	return;
+      target = ep->endpoint_index % nr;
+      nr = 0;
+    }
+
+  found:
+    CPU_SET(i, &cs);
+    omx__verbose_printf(NULL, "Binding process pid %ld with endpoint %d on cpu #%d of interface %s NUMA node %u\n",
+			(unsigned long) getpid(), ep->endpoint_index, i,
+			ep->board_info.ifacename, (unsigned) ep->board_info.numa_node);
+    sched_setaffinity(0, sizeof(cpu_set_t), &cs);
+
   } else {
     if (!strncmp(bindstring, "all:", 4)) {
       /* same binding whatever the endpoint */
@@ -203,6 +258,11 @@ omx__open_one_endpoint(int fd,
 
   open_param.board_index = board_index;
   open_param.endpoint_index = endpoint_index;
+  open_param.sendq_entry_nr = omx__globals.sendq_entry_nr;
+  open_param.recvq_entry_nr = omx__globals.recvq_entry_nr;
+  open_param.exp_eventq_entry_nr = omx__globals.exp_eventq_entry_nr;
+  open_param.numa_placement = omx__globals.endpoint_numa_placement;
+  open_param.pad = 0;
   err = ioctl(fd, OMX_CMD_OPEN_ENDPOINT, &open_param);
   if (err < 0) {
     /* let the caller handle the error */
@@ -319,11 +379,13 @@ omx__check_mmap(const char * string)
 
 static int omx_comms_initialized = 0;
 
-/* API omx_open_endpoint */
-omx_return_t
-omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
-		  omx_endpoint_param_t * param_array, uint32_t param_count,
-		  struct omx_endpoint **epp)
+static void
+omx__endpoint_open_rails(struct omx_endpoint *ep);
+
+static omx_return_t
+omx__open_endpoint_common(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
+			  omx_endpoint_param_t * param_array, uint32_t param_count,
+			  struct omx_endpoint *rail_primary, struct omx_endpoint **epp)
 {
   /* FIXME: add parameters to choose the board name? */
   struct omx_endpoint * ep;
@@ -439,7 +501,7 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   omx__board_addr_sprintf(ep->board_addr_str, ep->board_info.addr);
 
   /* bind the process if needed */
-  if (omx__globals.process_binding)
+  if (omx__globals.process_binding && !rail_primary)
     omx__endpoint_bind_process(ep, omx__globals.process_binding);
 
   /* create the endpoint malloc data */
@@ -449,36 +511,46 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
     goto out_with_attached;
   }
 
-  /* prepare the sendq */
-  ret = omx__endpoint_sendq_map_init(ep);
-  if (ret != OMX_SUCCESS) {
-    ret = omx__error(ret, "Initializing new endpoint send queue map");
-    goto out_with_ep_malloc;
-  }
-
   /* mmap desc */
   desc = mmap(0, OMX_ENDPOINT_DESC_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, OMX_ENDPOINT_DESC_FILE_OFFSET);
   if (desc == MAP_FAILED) {
     ret = omx__check_mmap("endpoint descriptor");
-    goto out_with_sendq_map;
+    goto out_with_ep_malloc;
   }
   ep->desc = desc;
+
+  /* get the queue sizes that the driver chose */
+  ep->sendq_entry_nr = desc->sendq_entry_nr;
+  ep->recvq_entry_nr = desc->recvq_entry_nr;
+  ep->exp_eventq_entry_nr = desc->exp_eventq_entry_nr;
+  ep->unexp_eventq_entry_nr = desc->unexp_eventq_entry_nr;
+  omx__debug_printf(ENDPOINT, NULL, "using %ld sendq, %ld recvq, %ld exp eventq and %ld unexp eventq entries\n",
+		    (unsigned long) ep->sendq_entry_nr, (unsigned long) ep->recvq_entry_nr,
+		    (unsigned long) ep->exp_eventq_entry_nr, (unsigned long) ep->unexp_eventq_entry_nr);
+
+  /* prepare the sendq */
+  ret = omx__endpoint_sendq_map_init(ep);
+  if (ret != OMX_SUCCESS) {
+    ret = omx__error(ret, "Initializing new endpoint send queue map");
+    goto out_with_desc;
+  }
+
   /* mmap sendq */
-  sendq = mmap(0, OMX_SENDQ_SIZE, PROT_WRITE, MAP_SHARED, fd, OMX_SENDQ_FILE_OFFSET);
+  sendq = mmap(0, OMX_SENDQ_SIZE(ep->sendq_entry_nr), PROT_WRITE, MAP_SHARED, fd, OMX_SENDQ_FILE_OFFSET);
   if (sendq == MAP_FAILED) {
     ret = omx__check_mmap("endpoint send queue");
-    goto out_with_desc;
+    goto out_with_sendq_map;
   }
   ep->sendq = sendq;
   /* mmap recvq */
-  recvq = mmap(0, OMX_RECVQ_SIZE, PROT_READ, MAP_SHARED, fd, OMX_RECVQ_FILE_OFFSET);
+  recvq = mmap(0, OMX_RECVQ_SIZE(ep->recvq_entry_nr), PROT_READ, MAP_SHARED, fd, OMX_RECVQ_FILE_OFFSET);
   if (recvq == MAP_FAILED) {
     ret = omx__check_mmap("endpoint recv queue");
     goto out_with_sendq;
   }
   ep->recvq = recvq;
   /* mmap exp eventq */
-  exp_eventq = mmap(0, OMX_EXP_EVENTQ_SIZE, PROT_READ, MAP_SHARED, fd, OMX_EXP_EVENTQ_FILE_OFFSET);
+  exp_eventq = mmap(0, OMX_EVENTQ_SIZE(ep->exp_eventq_entry_nr), PROT_READ, MAP_SHARED, fd, OMX_EXP_EVENTQ_FILE_OFFSET);
   if (exp_eventq == MAP_FAILED) {
     ret = omx__check_mmap("endpoint expected event queue");
     goto out_with_recvq;
@@ -487,7 +559,7 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   ep->next_exp_event_index = 0;
 
   /* mmap unexp eventq */
-  unexp_eventq = mmap(0, OMX_UNEXP_EVENTQ_SIZE, PROT_READ, MAP_SHARED, fd, OMX_UNEXP_EVENTQ_FILE_OFFSET);
+  unexp_eventq = mmap(0, OMX_EVENTQ_SIZE(ep->unexp_eventq_entry_nr), PROT_READ, MAP_SHARED, fd, OMX_UNEXP_EVENTQ_FILE_OFFSET);
   if (unexp_eventq == MAP_FAILED) {
     ret = omx__check_mmap("endpoint unexpected event queue");
     goto out_with_exp_eventq;
@@ -505,14 +577,16 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
 		    ep->board_info.hostname, ep->board_info.ifacename, ep->board_addr_str);
 
   /* init most of the endpoint state */
-  ep->avail_exp_events = OMX_EXP_EVENTQ_ENTRY_NR - (OMX_EXP_RELEASE_SLOTS_BATCH_NR - 1); /* up to BATCH_NR-1 event slots may have been
-											  * processed but not released to the kernel yet */
-  BUILD_BUG_ON(OMX_EXP_EVENTQ_ENTRY_NR - (OMX_EXP_RELEASE_SLOTS_BATCH_NR - 1)
+  ep->avail_exp_events = ep->exp_eventq_entry_nr
+    - (OMX_RELEASE_SLOTS_BATCH_NR(ep->exp_eventq_entry_nr) - 1); /* up to BATCH_NR-1 event slots may have been
+								   * processed but not released to the kernel yet */
+  BUILD_BUG_ON(OMX_QUEUE_ENTRY_NR_MIN - (OMX_RELEASE_SLOTS_BATCH_NR(OMX_QUEUE_ENTRY_NR_MIN) - 1)
 	       < OMX_MEDIUM_FRAGS_MAX); /* make sure a single request has enough expected event slots in the ring */
   ep->req_resends_max = omx__globals.req_resends_max;
   ep->pull_resend_timeout_jiffies = omx__globals.resend_delay_jiffies * omx__globals.req_resends_max;
   ep->check_status_delay_jiffies = omx__driver_desc->hz; /* once per second */
   ep->last_check_jiffies = 0;
+  ep->last_timers_jiffies = 0;
 #ifdef OMX_LIB_DEBUG
   ep->last_progress_jiffies = 0;
 #endif
@@ -524,15 +598,21 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   omx__unlock(&omx__global_lock);
 
   /* initialize some sub-structures */
-  omx__request_alloc_init(ep);
   omx__lock_init(&ep->lock);
   omx__cond_init(&ep->in_handler_cond);
 
+  /* preallocate requests */
+  ret = omx__request_alloc_init(ep);
+  if (ret != OMX_SUCCESS) {
+    ret = omx__error(ret, "Preallocating new endpoint requests");
+    goto out_with_requests;
+  }
+
   /* prepare the large regions */
   ret = omx__endpoint_large_region_map_init(ep);
   if (ret != OMX_SUCCESS) {
     ret = omx__error(ret, "Initializing new endpoint large region map");
-    goto out_with_message_prefix;
+    goto out_with_requests;
   }
 
   /* allocate partners */
@@ -562,9 +642,37 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
     goto out_with_myself;
   }
 
+  /* matching hash tables */
+  ep->recv_match_hash = omx_malloc_ep(ep, 2 * OMX__MATCH_HASH_NR * sizeof(*ep->recv_match_hash));
+  if (!ep->recv_match_hash) {
+    ret = omx__error(OMX_NO_RESOURCES, "Allocating new endpoint matching hash tables");
+    goto out_with_ctxid;
+  }
+  ep->unexp_match_hash = ep->recv_match_hash + OMX__MATCH_HASH_NR;
+  for(i=0; i<OMX__MATCH_HASH_NR; i++) {
+    list_head_init(&ep->recv_match_hash[i]);
+    list_head_init(&ep->unexp_match_hash[i]);
+  }
+  ep->next_recv_post_seqnum = 0;
+
+  /* command submission queue */
+  ep->submitq = NULL;
+  ep->submitq_nr = 0;
+  ep->submitq_max = omx__globals.submit_batch_max > 1 ? omx__globals.submit_batch_max : 0;
+  if (ep->submitq_max) {
+    ep->submitq = omx_malloc_ep(ep, ep->submitq_max * sizeof(*ep->submitq));
+    if (!ep->submitq) {
+      ret = omx__error(OMX_NO_RESOURCES, "Allocating new endpoint command submission queue");
+      goto out_with_match_hash;
+    }
+  }
+
   /* init lib specific fieds */
   ep->unexp_handler = NULL;
   ep->progression_disabled = 0;
+  ep->rails_nr = 0;
+  ep->rail_pulls_nr = 0;
+  ep->rail_primary = rail_primary;
 
   list_head_init(&ep->anyctxid.done_req_q);
   list_head_init(&ep->anyctxid.unexp_req_q);
@@ -572,6 +680,7 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   for(i=0; i<ep->ctxid_max; i++) {
     list_head_init(&ep->ctxid[i].unexp_req_q);
     list_head_init(&ep->ctxid[i].recv_req_q);
+    list_head_init(&ep->ctxid[i].recv_wildcard_req_q);
     list_head_init(&ep->ctxid[i].done_req_q);
   }
 
@@ -593,41 +702,53 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   list_head_init(&ep->partners_to_ack_immediate_list);
   ep->last_partners_acking_jiffies = 0;
   list_head_init(&ep->partners_to_ack_delayed_list);
+  ep->resends_needed = ep->resends_spurious = 0;
+  ep->checksum_errors = 0;
   list_head_init(&ep->throttling_partners_list);
 
   list_head_init(&ep->sleepers);
 
   ep->desc->user_event_index = 0;
 
-  omx__add_endpoint_to_list(ep);
+  /* rails are only progressed through their primary endpoint */
+  if (!rail_primary) {
+    if (omx__globals.rails_nr)
+      omx__endpoint_open_rails(ep);
+    omx__add_endpoint_to_list(ep);
+  }
 
-  omx__progress(ep);
+  omx__progress_and_flush(ep);
 
   *epp = ep;
 
   return OMX_SUCCESS;
 
+ out_with_match_hash:
+  omx_free_ep(ep, ep->recv_match_hash);
+ out_with_ctxid:
+  omx_free_ep(ep, ep->ctxid);
  out_with_myself:
   omx_free_ep(ep, ep->myself);
  out_with_partners:
   omx_free_ep(ep, ep->partners);
  out_with_large_regions:
   omx__endpoint_large_region_map_exit(ep);
- out_with_message_prefix:
+ out_with_requests:
+  omx__request_alloc_exit(ep);
   omx__lock(&omx__global_lock);
   omx_free(ep->message_prefix);
   omx__unlock(&omx__global_lock);
-  munmap((void *) ep->exp_eventq, OMX_EXP_EVENTQ_SIZE);
+  munmap((void *) ep->exp_eventq, OMX_EVENTQ_SIZE(ep->exp_eventq_entry_nr));
  out_with_exp_eventq:
-  munmap((void *) ep->unexp_eventq, OMX_UNEXP_EVENTQ_SIZE);
+  munmap((void *) ep->unexp_eventq, OMX_EVENTQ_SIZE(ep->unexp_eventq_entry_nr));
  out_with_recvq:
-  munmap((void *) ep->recvq, OMX_RECVQ_SIZE);
+  munmap((void *) ep->recvq, OMX_RECVQ_SIZE(ep->recvq_entry_nr));
  out_with_sendq:
-  munmap(ep->sendq, OMX_SENDQ_SIZE);
- out_with_desc:
-  munmap(ep->desc, OMX_ENDPOINT_DESC_SIZE);
+  munmap(ep->sendq, OMX_SENDQ_SIZE(ep->sendq_entry_nr));
  out_with_sendq_map:
   omx__endpoint_sendq_map_exit(ep);
+ out_with_desc:
+  munmap(ep->desc, OMX_ENDPOINT_DESC_SIZE);
  out_with_ep_malloc:
   omx__exit_ep_malloc(ep);
  out_with_attached:
@@ -644,6 +765,81 @@ omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
   return ret;
 }
 
+/* API omx_open_endpoint */
+omx_return_t
+omx_open_endpoint(uint32_t board_index, uint32_t endpoint_index, uint32_t key,
+		  omx_endpoint_param_t * param_array, uint32_t param_count,
+		  struct omx_endpoint **epp)
+{
+  return omx__open_endpoint_common(board_index, endpoint_index, key,
+				   param_array, param_count, NULL, epp);
+}
+
+/*********************
+ * Multi-rail support
+ */
+
+/* link speed in Mb/s, used to weight the striping across rails */
+static unsigned
+omx__endpoint_link_speed(const struct omx_endpoint *ep)
+{
+  char path[64 + OMX_IF_NAMESIZE];
+  FILE *file;
+  int speed = 0;
+
+  snprintf(path, sizeof(path), "/sys/class/net/%s/speed", ep->board_info.ifacename);
+  file = fopen(path, "r");
+  if (file) {
+    if (fscanf(file, "%d", &speed) != 1)
+      speed = 0;
+    fclose(file);
+  }
+
+  /* virtual interfaces may not report any speed, consider them all equal */
+  return speed > 0 ? speed : 10000;
+}
+
+/*
+ * Open the same endpoint index on each OMX_RAILS board.
+ * These endpoints are hidden from the application, they only carry
+ * a part of our large pulls towards the rail endpoints of the peers.
+ */
+static void
+omx__endpoint_open_rails(struct omx_endpoint *ep)
+{
+  omx_endpoint_param_t param;
+  unsigned i;
+
+  ep->rail_weights[0] = omx__endpoint_link_speed(ep);
+  ep->rail_weights_total = ep->rail_weights[0];
+
+  /* rail failures (mostly connecting to peers without rails) should not go to the application */
+  param.key = OMX_ENDPOINT_PARAM_ERROR_HANDLER;
+  param.val.error_handler = OMX_ERRORS_RETURN;
+
+  for(i=0; i<omx__globals.rails_nr; i++) {
+    struct omx_endpoint *rail;
+    omx_return_t ret;
+
+    if (omx__globals.rails[i] == ep->board_index)
+      continue;
+
+    ret = omx__open_endpoint_common(omx__globals.rails[i], ep->endpoint_index, ep->app_key,
+				    &param, 1, ep, &rail);
+    if (ret != OMX_SUCCESS) {
+      omx__verbose_printf(ep, "Failed to open rail endpoint on board #%d (%s), ignoring it\n",
+			  omx__globals.rails[i], omx_strerror(ret));
+      continue;
+    }
+
+    ep->rails[ep->rails_nr++] = rail;
+    ep->rail_weights[ep->rails_nr] = omx__endpoint_link_speed(rail);
+    ep->rail_weights_total += ep->rail_weights[ep->rails_nr];
+    omx__verbose_printf(ep, "Striping large pulls on rail board #%d (%s, %d Mb/s)\n",
+			rail->board_index, rail->board_info.ifacename, ep->rail_weights[ep->rails_nr]);
+  }
+}
+
 /* API omx_close_endpoint */
 omx_return_t
 omx_close_endpoint(struct omx_endpoint *ep)
@@ -658,18 +854,36 @@ omx_close_endpoint(struct omx_endpoint *ep)
     goto out_with_lock;
   }
 
-  ret = omx__remove_endpoint_from_list(ep);
-  if (ret != OMX_SUCCESS) {
-    ret = omx__error(ret, "Closing endpoint");
-    goto out_with_lock;
+  if (!ep->rail_primary) {
+    ret = omx__remove_endpoint_from_list(ep);
+    if (ret != OMX_SUCCESS) {
+      ret = omx__error(ret, "Closing endpoint");
+      goto out_with_lock;
+    }
   }
 
+  /* close the rails first so that they do not complete pulls of our requests anymore */
+  for(i=0; i<ep->rails_nr; i++)
+    omx_close_endpoint(ep->rails[i]);
+  ep->rails_nr = 0; /* their regions are gone with them */
+
   omx__flush_partners_to_ack(ep);
+  omx__flush_submitq(ep);
+
+  if (ep->resends_needed || ep->resends_spurious)
+    omx__verbose_printf(ep, "Resent %ld messages that were lost and %ld that were only late\n",
+			ep->resends_needed, ep->resends_spurious);
+  if (ep->checksum_errors)
+    omx__verbose_printf(ep, "Dropped %ld packets with invalid checksum\n",
+			ep->checksum_errors);
 
   omx__destroy_requests_on_close(ep);
   omx__request_alloc_check(ep);
   omx__request_alloc_exit(ep);
 
+  if (ep->submitq)
+    omx_free_ep(ep, ep->submitq);
+  omx_free_ep(ep, ep->recv_match_hash);
   omx_free_ep(ep, ep->ctxid);
   for(i=0; i<omx__driver_desc->peer_max * omx__driver_desc->endpoint_max; i++)
     if (ep->partners[i])
@@ -679,12 +893,12 @@ omx_close_endpoint(struct omx_endpoint *ep)
   omx__lock(&omx__global_lock);
   omx_free(ep->message_prefix);
   omx__unlock(&omx__global_lock);
-  munmap((void *) ep->unexp_eventq, OMX_UNEXP_EVENTQ_SIZE);
-  munmap((void *) ep->exp_eventq, OMX_EXP_EVENTQ_SIZE);
-  munmap((void *) ep->recvq, OMX_RECVQ_SIZE);
-  munmap(ep->sendq, OMX_SENDQ_SIZE);
-  munmap(ep->desc, OMX_ENDPOINT_DESC_SIZE);
+  munmap((void *) ep->unexp_eventq, OMX_EVENTQ_SIZE(ep->unexp_eventq_entry_nr));
+  munmap((void *) ep->exp_eventq, OMX_EVENTQ_SIZE(ep->exp_eventq_entry_nr));
+  munmap((void *) ep->recvq, OMX_RECVQ_SIZE(ep->recvq_entry_nr));
+  munmap(ep->sendq, OMX_SENDQ_SIZE(ep->sendq_entry_nr));
   omx__endpoint_sendq_map_exit(ep);
+  munmap(ep->desc, OMX_ENDPOINT_DESC_SIZE);
   omx__exit_ep_malloc(ep);
   /* nothing to do for detach, close will do it */
   close(ep->fd);
@@ -761,7 +975,8 @@ omx__destroy_unlinked_request_on_close(struct omx_endpoint *ep, union omx_reques
       /* nothing to do */
     } else {
       if (!(resources & OMX_REQUEST_RESOURCE_LARGE_REGION)
-	  && (state & OMX_REQUEST_STATE_RECV_PARTIAL))
+	  && (state & OMX_REQUEST_STATE_RECV_PARTIAL)
+	  && req->recv.specific.large.local_region)
 	omx__put_region(ep, req->recv.specific.large.local_region, NULL);
       omx_free_segments(ep, &req->send.segs);
     }
@@ -860,7 +1075,7 @@ omx__destroy_requests_on_close(struct omx_endpoint *ep)
   /* free ctxid.recv and ctxid.unexp requests */
   for(i=0; i<ep->ctxid_max; i++) {
     omx__foreach_request_safe(&ep->ctxid[i].recv_req_q, req, next) {
-      omx___dequeue_request(req);
+      omx___dequeue_recv_request(req);
       /* cannot be done */
       omx__destroy_unlinked_request_on_close(ep, req);
     }
@@ -868,9 +1083,7 @@ omx__destroy_requests_on_close(struct omx_endpoint *ep)
 
   /* free unexp reqs */
   omx__foreach_request_safe(&ep->anyctxid.unexp_req_q, req, next) {
-    omx___dequeue_request(req);
-    if (unlikely(HAS_CTXIDS(ep)))
-      omx___dequeue_ctxid_request(req);
+    omx___dequeue_unexp_request(ep, req);
     /* cannot be done */
     omx__destroy_unlinked_request_on_close(ep, req);
   }
@@ -939,6 +1152,37 @@ omx__destroy_requests_on_close(struct omx_endpoint *ep)
 #endif
 }
 
+/*********************
+ * Request Allocation
+ */
+
+omx_return_t
+omx__request_cache_grow(struct omx_endpoint *ep, unsigned nr)
+{
+  char * chunk;
+  unsigned i;
+
+  /* the first cache line of the chunk only links it in the endpoint list of chunks */
+  chunk = omx_memalign_ep(ep, OMX__CACHELINE_SIZE, OMX__CACHELINE_SIZE + nr * OMX__REQUEST_SLOT_SIZE);
+  if (unlikely(!chunk))
+    return OMX_NO_RESOURCES;
+
+  *(void **) chunk = ep->req_cache.chunks;
+  ep->req_cache.chunks = chunk;
+  ep->req_cache.chunks_nr++;
+
+  /* queue the new slots in order so that the first ones are allocated first */
+  for(i=nr; i>0; i--) {
+    union omx_request * req = (union omx_request *) (chunk + OMX__CACHELINE_SIZE + (i-1) * OMX__REQUEST_SLOT_SIZE);
+    req->generic.queue_elt.nxt = (struct list_head *) ep->req_cache.free_list;
+    ep->req_cache.free_list = req;
+  }
+
+  omx__debug_printf(ENDPOINT, ep, "Allocated %d more requests in cache (%d chunks)\n",
+		    nr, ep->req_cache.chunks_nr);
+  return OMX_SUCCESS;
+}
+
 /***************************
  * Request Allocation Debug
  */
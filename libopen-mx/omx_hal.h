@@ -23,6 +23,9 @@
 #define __malloc __attribute__((malloc))
 #define __may_alias __attribute__((may_alias))
 
+/* full memory barrier */
+#define omx__mb() __sync_synchronize()
+
 #endif /* __omx_hal_h__ */
 
 /*
@@ -0,0 +1,273 @@
+/*
+ * Open-MX
+ * Copyright © inria 2007-2010 (see AUTHORS file)
+ *
+ * The development of this software has been funded by Myricom, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU Lesser General Public License in COPYING.LGPL for more details.
+ */
+
+/*
+ * Memory release interception for the regcache (--enable-malloc-hooks).
+ *
+ * The internal dlmalloc is exported as the application malloc, and munmap,
+ * mremap, brk and sbrk are intercepted. Every range that is given back to
+ * the system (by the application or by dlmalloc itself) is recorded in a
+ * global invalidation log. Memory may be released from anywhere, including
+ * from the library while an endpoint is locked, so recording never takes any
+ * endpoint lock. Instead, each endpoint applies the new entries of the log to
+ * its regcache before looking it up (see omx__get_region()).
+ */
+
+#define _GNU_SOURCE 1 /* for mremap */
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "omx_lib.h"
+
+/* must be a power of 2 so that the seqnum wrap-around does not matter */
+#define OMX_HOOKS_INVAL_NR 256
+
+static struct omx__hooks_inval {
+  unsigned long begin, end;
+} omx__hooks_invals[OMX_HOOKS_INVAL_NR];
+
+static volatile unsigned long omx__hooks_inval_seqnum = 0;
+
+#ifdef OMX_LIB_THREAD_SAFETY
+static struct omx__lock omx__hooks_lock = OMX__LOCK_INITIALIZER;
+#endif
+
+/* glibc keeps track of the current break, go through it instead of the raw syscall */
+extern void * __sbrk(intptr_t increment);
+
+/*************************
+ * Invalidation recording
+ */
+
+void
+omx__hooks_invalidate(void *ptr, size_t size)
+{
+  struct omx__hooks_inval *inval;
+
+  if (!size)
+    return;
+
+  omx__lock(&omx__hooks_lock);
+  inval = &omx__hooks_invals[omx__hooks_inval_seqnum & (OMX_HOOKS_INVAL_NR-1)];
+  inval->begin = (uintptr_t) ptr;
+  inval->end = inval->begin + size;
+  omx__hooks_inval_seqnum++;
+  omx__unlock(&omx__hooks_lock);
+}
+
+void
+omx__hooks_remap(void *old_ptr, size_t old_size, void *new_ptr, size_t new_size)
+{
+  if (new_ptr == MAP_FAILED)
+    return;
+
+  if (new_ptr != old_ptr)
+    omx__hooks_invalidate(old_ptr, old_size);
+  else if (new_size < old_size)
+    omx__hooks_invalidate((char *) old_ptr + new_size, old_size - new_size);
+}
+
+unsigned long
+omx__hooks_seqnum(void)
+{
+  return omx__hooks_inval_seqnum;
+}
+
+/*
+ * Get the next invalidated range after *seqnump and update it.
+ * Returns 1 if a range was stored in *beginp and *endp, 0 if there is none,
+ * or -1 if some ranges were overwritten meanwhile and the caller should
+ * invalidate everything it can.
+ */
+int
+omx__hooks_next_invalidation(unsigned long *seqnump,
+			     unsigned long *beginp, unsigned long *endp)
+{
+  unsigned long seqnum = *seqnump;
+  int ret = 1;
+
+  /* nothing new, don't bother locking */
+  if (likely(seqnum == omx__hooks_inval_seqnum))
+    return 0;
+
+  omx__lock(&omx__hooks_lock);
+  if (omx__hooks_inval_seqnum - seqnum > OMX_HOOKS_INVAL_NR) {
+    *seqnump = omx__hooks_inval_seqnum;
+    ret = -1;
+  } else {
+    struct omx__hooks_inval *inval = &omx__hooks_invals[seqnum & (OMX_HOOKS_INVAL_NR-1)];
+    *beginp = inval->begin;
+    *endp = inval->end;
+    *seqnump = seqnum + 1;
+  }
+  omx__unlock(&omx__hooks_lock);
+
+  return ret;
+}
+
+/*******************
+ * Exported malloc
+ */
+
+/* hidden so that omx__hooks_active() can compare it with the global malloc */
+void * omx__hooks_malloc(size_t size) __attribute__((visibility("hidden")));
+
+void *
+omx__hooks_malloc(size_t size)
+{
+  return dlmalloc(size);
+}
+
+void * malloc(size_t size) __attribute__((alias("omx__hooks_malloc")));
+
+void
+free(void *ptr)
+{
+  dlfree(ptr);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+  return dlcalloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  return dlrealloc(ptr, size);
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+  return dlmemalign(alignment, size);
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+  return dlmemalign(alignment, size);
+}
+
+int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  void *mem;
+
+  if (alignment % sizeof(void *) || (alignment & (alignment-1)))
+    return EINVAL;
+
+  mem = dlmemalign(alignment, size);
+  if (!mem)
+    return ENOMEM;
+
+  *memptr = mem;
+  return 0;
+}
+
+void *
+valloc(size_t size)
+{
+  return dlvalloc(size);
+}
+
+void *
+pvalloc(size_t size)
+{
+  return dlpvalloc(size);
+}
+
+size_t
+malloc_usable_size(void *ptr)
+{
+  return dlmalloc_usable_size(ptr);
+}
+
+/***************************
+ * Intercepted memory calls
+ */
+
+/* hidden so that omx__hooks_active() can compare it with the global munmap */
+int omx__hooks_munmap(void *addr, size_t length) __attribute__((visibility("hidden")));
+
+int
+omx__hooks_munmap(void *addr, size_t length)
+{
+  omx__hooks_invalidate(addr, length);
+  return (int) syscall(__NR_munmap, addr, length);
+}
+
+int munmap(void *addr, size_t length) __attribute__((alias("omx__hooks_munmap")));
+
+void *
+mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...)
+{
+  void *new_address = NULL;
+  void *ptr;
+
+  if (flags & MREMAP_FIXED) {
+    va_list ap;
+    va_start(ap, flags);
+    new_address = va_arg(ap, void *);
+    va_end(ap);
+  }
+
+  ptr = (void *) syscall(__NR_mremap, old_address, old_size, new_size, flags, new_address);
+  omx__hooks_remap(old_address, old_size, ptr, new_size);
+  if (ptr != MAP_FAILED && (flags & MREMAP_FIXED))
+    /* whatever was mapped at the destination is gone as well */
+    omx__hooks_invalidate(new_address, new_size);
+  return ptr;
+}
+
+void *
+sbrk(intptr_t increment)
+{
+  if (increment < 0)
+    omx__hooks_invalidate((char *) __sbrk(0) + increment, -increment);
+  return __sbrk(increment);
+}
+
+int
+brk(void *addr)
+{
+  char *cur = __sbrk(0);
+
+  if ((char *) addr < cur)
+    omx__hooks_invalidate(addr, cur - (char *) addr);
+  return __sbrk((char *) addr - cur) == (void *) -1 ? -1 : 0;
+}
+
+/*
+ * The hooks only work if the process actually resolves these symbols to us,
+ * which is not the case if the library was dlopen'ed after the libc.
+ */
+int
+omx__hooks_active(void)
+{
+  void * volatile global_malloc = (void *) malloc;
+  void * volatile global_munmap = (void *) munmap;
+
+  return global_malloc == (void *) omx__hooks_malloc
+    && global_munmap == (void *) omx__hooks_munmap;
+}
@@ -246,6 +246,74 @@ omx__init_api(int app_api)
   return ret;
 }
 
+/*
+ * Setup the time source used by omx__now()
+ */
+static void
+omx__init_clock(void)
+{
+#ifdef OMX_HAVE_CLOCK_MONOTONIC_COARSE
+  struct timespec res, ts;
+  uint32_t hz = omx__driver_desc->hz;
+  uint32_t nsec_per_jiffy = 1000000000UL / hz;
+  uint64_t jiffies;
+  char *env;
+  int i;
+
+  omx__globals.coarse_clock = 0;
+
+  env = getenv("OMX_COARSE_CLOCK");
+  if (env && !atoi(env)) {
+    omx__verbose_printf(NULL, "Forcing the driver jiffies as the time source\n");
+    return;
+  }
+
+  /* only use the coarse clock if it ticks with the same period as the driver jiffies */
+  if (clock_getres(CLOCK_MONOTONIC_COARSE, &res) < 0
+      || res.tv_sec || res.tv_nsec != nsec_per_jiffy) {
+    omx__verbose_printf(NULL, "Cannot use the coarse monotonic clock, using the driver jiffies as the time source\n");
+    return;
+  }
+
+  /* make sure the driver jiffies did not change while reading the clock */
+  for(i=0; i<10; i++) {
+    jiffies = omx__driver_desc->jiffies;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    if (jiffies == omx__driver_desc->jiffies)
+      break;
+  }
+
+  omx__globals.coarse_clock_hz = hz;
+  omx__globals.coarse_clock_nsec_per_jiffy = nsec_per_jiffy;
+  omx__globals.coarse_clock_offset = jiffies
+    - ((uint64_t) ts.tv_sec * hz + ts.tv_nsec / nsec_per_jiffy);
+  omx__globals.coarse_clock = 1;
+#else /* !OMX_HAVE_CLOCK_MONOTONIC_COARSE */
+  omx__globals.coarse_clock = 0;
+#endif /* !OMX_HAVE_CLOCK_MONOTONIC_COARSE */
+}
+
+/* returns the number of queue entries forced in the environment, or 0 for the driver default */
+static unsigned
+omx__init_queue_entry_nr(const char *name, const char *queue)
+{
+  char *env = getenv(name);
+  unsigned nr;
+
+  if (!env)
+    return 0;
+
+  nr = atoi(env);
+  if (nr < OMX_QUEUE_ENTRY_NR_MIN || nr > OMX_QUEUE_ENTRY_NR_MAX || (nr & (nr-1))) {
+    omx__warning(NULL, "Ignoring %s=%s, the number of %s entries must be a power of 2 between %ld and %ld\n",
+		 name, env, queue, (unsigned long) OMX_QUEUE_ENTRY_NR_MIN, (unsigned long) OMX_QUEUE_ENTRY_NR_MAX);
+    return 0;
+  }
+
+  omx__verbose_printf(NULL, "Forcing %d %s entries per endpoint\n", nr, queue);
+  return nr;
+}
+
 void
 omx__init_comms(void)
 {
@@ -256,8 +324,11 @@ omx__init_comms(void)
    * Misc globals
    */
 
+  omx__init_clock();
+
   omx__globals.ack_delay_jiffies = omx__ack_delay_jiffies();
   omx__globals.resend_delay_jiffies = omx__resend_delay_jiffies();
+  omx__globals.resend_delay_min_jiffies = omx__resend_delay_min_jiffies();
 
   /********************************
    * Endpoint debug initialization
@@ -298,6 +369,26 @@ omx__init_comms(void)
   }
 #endif
 
+  /*******************
+   * End-to-end checksum
+   */
+  omx__crc32c_init();
+  omx__globals.checksum = 0;
+  env = getenv("OMX_CHECKSUM");
+  if (env) {
+    omx__globals.checksum = atoi(env);
+    omx__verbose_printf(NULL, "Forcing end-to-end checksum to %s\n",
+			omx__globals.checksum ? "enabled" : "disabled");
+  }
+  if (omx__globals.checksum) {
+    omx__verbose_printf(NULL, "Using %s CRC32C\n",
+			omx__crc32c == omx__crc32c_sw ? "table-driven" : "SSE4.2");
+    if (omx__globals.debug_checksum) {
+      omx__verbose_printf(NULL, "Disabling debug checksum since end-to-end checksum is enabled\n");
+      omx__globals.debug_checksum = 0;
+    }
+  }
+
   /**********************************************
    * Shared and self communication configuration
    */
@@ -387,6 +478,31 @@ omx__init_comms(void)
       omx__verbose_printf(NULL, "Forcing shared rndv threshold to %d\n",
 			  omx__globals.shared_rndv_threshold);
     }
+
+    /*
+     * shared messages between the single-copy and the rndv thresholds are sent as rndv
+     * and copied directly from the sender pages into the receive buffer once matched
+     */
+    omx__globals.shared_single_copy_threshold = 0;
+    env = getenv("OMX_SHARED_SINGLE_COPY_THRESHOLD");
+    if (env) {
+      int val = atoi(env);
+      if (val > 0 && val < OMX_SMALL_MSG_LENGTH_MAX) {
+	omx__verbose_printf(NULL, "Cannot set a single-copy threshold to less than %d\n",
+			    OMX_SMALL_MSG_LENGTH_MAX);
+	val = OMX_SMALL_MSG_LENGTH_MAX;
+      }
+      if (val >= (int) omx__globals.shared_rndv_threshold) {
+	omx__verbose_printf(NULL, "Ignoring single-copy threshold %d since it is not below the shared rndv threshold %d\n",
+			    val, omx__globals.shared_rndv_threshold);
+	val = 0;
+      }
+      if (val > 0) {
+	omx__globals.shared_single_copy_threshold = val;
+	omx__verbose_printf(NULL, "Forcing shared single-copy threshold to %d\n",
+			    omx__globals.shared_single_copy_threshold);
+      }
+    }
   }
 
   /*******************************
@@ -408,6 +524,26 @@ omx__init_comms(void)
     omx__verbose_printf(NULL, "Forcing resends max to %ld\n", (unsigned long) omx__globals.req_resends_max);
   }
 
+  /* adapt resend delays to the RTT of each partner */
+  omx__globals.resend_rtt = 1;
+  env = getenv("OMX_RESEND_RTT");
+  if (env) {
+    omx__globals.resend_rtt = atoi(env);
+    omx__verbose_printf(NULL, "Forcing RTT-based resend delays to %s\n",
+			omx__globals.resend_rtt ? "enabled" : "disabled");
+  }
+  if (!omx__globals.resend_rtt)
+    omx__globals.resend_delay_min_jiffies = omx__globals.resend_delay_jiffies;
+
+  /* selective acks */
+  omx__globals.sack = 1;
+  env = getenv("OMX_SACK");
+  if (env) {
+    omx__globals.sack = atoi(env);
+    omx__verbose_printf(NULL, "Forcing selective acks to %s\n",
+			omx__globals.sack ? "enabled" : "disabled");
+  }
+
   /* zombie send configuration */
   omx__globals.zombie_max = OMX_ZOMBIE_MAX_DEFAULT;
   env = getenv("OMX_ZOMBIE_SEND");
@@ -440,6 +576,37 @@ omx__init_comms(void)
 			omx__globals.not_acked_max);
   }
 
+  /*******************************
+   * Request cache configuration
+   */
+  omx__globals.request_cache_nr = 256;
+  env = getenv("OMX_REQUEST_CACHE");
+  if (env) {
+    omx__globals.request_cache_nr = atoi(env);
+    omx__verbose_printf(NULL, "Forcing %d preallocated requests per endpoint\n",
+			omx__globals.request_cache_nr);
+  }
+
+  /***************************************
+   * Command submission batch configuration
+   */
+  omx__globals.submit_batch_max = 16;
+  env = getenv("OMX_SUBMIT_BATCH");
+  if (env) {
+    omx__globals.submit_batch_max = atoi(env);
+    if (omx__globals.submit_batch_max > OMX_SUBMIT_CMDS_MAX)
+      omx__globals.submit_batch_max = OMX_SUBMIT_CMDS_MAX;
+    omx__verbose_printf(NULL, "Forcing batches of up to %d submitted commands\n",
+			omx__globals.submit_batch_max);
+  }
+
+  /*******************************
+   * Endpoint queues configuration
+   */
+  omx__globals.sendq_entry_nr = omx__init_queue_entry_nr("OMX_SENDQ_ENTRIES", "send queue");
+  omx__globals.recvq_entry_nr = omx__init_queue_entry_nr("OMX_RECVQ_ENTRIES", "receive queue");
+  omx__globals.exp_eventq_entry_nr = omx__init_queue_entry_nr("OMX_EXPQ_ENTRIES", "expected event queue");
+
   /*************************
    * Sleeping configuration
    */
@@ -454,6 +621,15 @@ omx__init_comms(void)
 			omx__globals.waitspin ? "enabled" : "disabled");
   }
 
+  /* non-blocking test configuration */
+  omx__globals.test_trylock = 1;
+  env = getenv("OMX_TEST_TRYLOCK");
+  if (env) {
+    omx__globals.test_trylock = atoi(env);
+    omx__verbose_printf(NULL, "Forcing non-blocking tests to %s for the endpoint lock\n",
+			omx__globals.test_trylock ? "not wait" : "wait");
+  }
+
   /* interrupted wait configuration */
   omx__globals.waitintr = 0;
   env = getenv("OMX_WAITINTR");
@@ -472,6 +648,39 @@ omx__init_comms(void)
 			omx__globals.connect_pollall ? "enabled" : "disabled");
   }
 
+  /****************************
+   * Multi-rail configuration
+   */
+  omx__globals.rails_nr = 0;
+  env = getenv("OMX_RAILS");
+  if (env) {
+#ifdef OMX_MX_WIRE_COMPAT
+    omx__verbose_printf(NULL, "Ignoring OMX_RAILS since MX wire compatibility cannot pull at large offsets\n");
+#else
+    char *next = env;
+    while (*next && omx__globals.rails_nr < OMX__RAILS_MAX) {
+      char *end;
+      unsigned long val = strtoul(next, &end, 0);
+      if (end == next)
+	break;
+      omx__globals.rails[omx__globals.rails_nr++] = val;
+      omx__verbose_printf(NULL, "Adding board #%lu as rail #%d\n",
+			  val, omx__globals.rails_nr);
+      next = end;
+      if (*next == ',')
+	next++;
+    }
+#endif
+  }
+
+  omx__globals.rails_stripe_min = 256*1024;
+  env = getenv("OMX_RAILS_STRIPE_MIN");
+  if (env) {
+    omx__globals.rails_stripe_min = atoi(env);
+    omx__verbose_printf(NULL, "Forcing multi-rail striping of pulls above %d bytes\n",
+			omx__globals.rails_stripe_min);
+  }
+
   /*************************
    * Regcache configuration
    */
@@ -488,6 +697,14 @@ omx__init_comms(void)
     omx__globals.regcache = 1;
     omx__verbose_printf(NULL, "Enabling regcache by default since driver reports pin-invalidate support\n");
   }
+#ifdef OMX_LIB_MALLOC_HOOKS
+  else if (omx__hooks_active()) {
+    omx__globals.regcache = 1;
+    omx__verbose_printf(NULL, "Enabling regcache by default since malloc hooks are active\n");
+  } else {
+    omx__verbose_printf(NULL, "Malloc hooks are not active (library loaded after the libc?), not enabling regcache by default\n");
+  }
+#endif
   env = getenv("OMX_RCACHE");
 #ifdef OMX_MX_ABI_COMPAT
   if (!omx__globals.ignore_mx_env && !env) {
@@ -507,6 +724,24 @@ omx__init_comms(void)
    */
   omx__globals.process_binding = getenv("OMX_PROCESS_BINDING");
 
+  /*****************************
+   * Endpoint memory placement
+   */
+  omx__globals.endpoint_numa_placement = OMX_ENDPOINT_NUMA_PLACEMENT_LOCAL;
+  if (omx__globals.process_binding && !strcmp(omx__globals.process_binding, "nic"))
+    omx__globals.endpoint_numa_placement = OMX_ENDPOINT_NUMA_PLACEMENT_NIC;
+  env = getenv("OMX_ENDPOINT_NUMA");
+  if (env) {
+    if (!strcmp(env, "nic"))
+      omx__globals.endpoint_numa_placement = OMX_ENDPOINT_NUMA_PLACEMENT_NIC;
+    else if (!strcmp(env, "local"))
+      omx__globals.endpoint_numa_placement = OMX_ENDPOINT_NUMA_PLACEMENT_LOCAL;
+    else
+      omx__warning(NULL, "Ignoring unknown OMX_ENDPOINT_NUMA value %s\n", env);
+    omx__verbose_printf(NULL, "Forcing endpoint memory placement on the %s NUMA node\n",
+			omx__globals.endpoint_numa_placement == OMX_ENDPOINT_NUMA_PLACEMENT_NIC ? "interface" : "local");
+  }
+
   /********************
    * Tune medium frags
    */
@@ -518,6 +753,36 @@ omx__init_comms(void)
 			omx__globals.medium_sendq ? "enabled" : "disabled");
   }
 
+  /*
+   * direct placement of expected medium frags is only worth it when regions are cached,
+   * and the end-to-end checksum must be verified before the frag data is placed
+   */
+  omx__globals.medium_direct = omx__globals.regcache && !omx__globals.checksum;
+  env = getenv("OMX_MEDIUM_DIRECT");
+  if (env) {
+    omx__globals.medium_direct = atoi(env);
+    omx__verbose_printf(NULL, "Forcing medium direct placement to %s\n",
+			omx__globals.medium_direct ? "enabled" : "disabled");
+  }
+  if (omx__globals.medium_direct && omx__globals.checksum) {
+    omx__verbose_printf(NULL, "Disabling medium direct placement since end-to-end checksum is enabled\n");
+    omx__globals.medium_direct = 0;
+  }
+
+  /* large mediums may be sent from the pinned application pages instead of being copied,
+   * disabled by default since these sends only complete once acked
+   */
+  omx__globals.medium_zerocopy_min = 0;
+  env = getenv("OMX_MEDIUM_ZEROCOPY");
+  if (env) {
+    omx__globals.medium_zerocopy_min = atoi(env);
+    if (omx__globals.medium_zerocopy_min)
+      omx__verbose_printf(NULL, "Forcing medium zero-copy send from %u bytes\n",
+			  omx__globals.medium_zerocopy_min);
+    else
+      omx__verbose_printf(NULL, "Forcing medium zero-copy send to disabled\n");
+  }
+
   /*********
    * Ctxids
    */
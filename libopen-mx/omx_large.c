@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 
 #include "omx_io.h"
@@ -59,6 +60,12 @@ omx__endpoint_large_region_map_init(struct omx_endpoint * ep)
   list_head_init(&ep->reg_list);
   list_head_init(&ep->reg_unused_list);
   list_head_init(&ep->reg_vect_list);
+  ep->regcache_root = NULL;
+  ep->regcache_hits = ep->regcache_misses = 0;
+#ifdef OMX_LIB_MALLOC_HOOKS
+  /* whatever was released earlier cannot be in our regcache */
+  ep->regcache_hooks_seqnum = omx__hooks_seqnum();
+#endif
   ep->large_sends_avail_nr = OMX_USER_REGION_MAX/2;
 
   return OMX_SUCCESS;
@@ -118,15 +125,21 @@ omx__endpoint_large_region_map_exit(struct omx_endpoint * ep)
   struct omx__large_region *region, *next;
 
   list_for_each_entry_safe(region, next, &ep->reg_list, reg_elt) {
-    if (!region->use_count)
+    if (region->nodes && !region->use_count)
       list_del(&region->reg_unused_elt);
     omx__destroy_region(ep, region);
   }
 
   list_for_each_entry_safe(region, next, &ep->reg_vect_list, reg_elt) {
+    if (region->nodes && !region->use_count)
+      list_del(&region->reg_unused_elt);
     omx__destroy_region(ep, region);
   }
 
+  if (omx__globals.regcache)
+    omx__verbose_printf(ep, "Regcache hit %ld times and missed %ld times\n",
+			ep->regcache_hits, ep->regcache_misses);
+
   omx_free_ep(ep, ep->large_region_map.array);
 }
 
@@ -147,8 +160,8 @@ omx__check_driver_pinning_error(const struct omx_endpoint *ep, omx_return_t ret)
 }
 
 static INLINE omx_return_t
-omx__register_region(const struct omx_endpoint *ep,
-		     const struct omx__large_region *region)
+omx__register_region_on(const struct omx_endpoint *ep, int fd,
+			const struct omx__large_region *region)
 {
   struct omx_cmd_create_user_region reg;
   omx_return_t ret = OMX_SUCCESS;
@@ -160,7 +173,7 @@ omx__register_region(const struct omx_endpoint *ep,
   reg.nr_segments = region->segs.nseg;
   reg.segments = (uintptr_t) region->segs.segs;
 
-  err = ioctl(ep->fd, OMX_CMD_CREATE_USER_REGION, &reg);
+  err = ioctl(fd, OMX_CMD_CREATE_USER_REGION, &reg);
   if (unlikely(err < 0)) {
     ret = omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
 					     OMX_INTERNAL_MISC_EFAULT, /* for failure to pin */
@@ -177,19 +190,350 @@ omx__register_region(const struct omx_endpoint *ep,
 }
 
 static INLINE void
-omx__deregister_region(const struct omx_endpoint *ep,
-		       const struct omx__large_region *region)
+omx__deregister_region_on(int fd,
+			  const struct omx__large_region *region)
 {
   struct omx_cmd_destroy_user_region dereg;
   int err;
 
   dereg.id = region->id;
 
-  err = ioctl(ep->fd, OMX_CMD_DESTROY_USER_REGION, &dereg);
+  err = ioctl(fd, OMX_CMD_DESTROY_USER_REGION, &dereg);
   if (unlikely(err < 0))
     omx__ioctl_errno_to_return_checked(OMX_SUCCESS, "destroy user region %d", region->id);
 }
 
+/*
+ * Regions are mirrored with the same id on the rails,
+ * so that a pull may target any rail of the peer with the rndv region id
+ */
+static INLINE omx_return_t
+omx__register_region(const struct omx_endpoint *ep,
+		     const struct omx__large_region *region)
+{
+  omx_return_t ret;
+  unsigned i;
+
+  ret = omx__register_region_on(ep, ep->fd, region);
+  if (unlikely(ret != OMX_SUCCESS))
+    return ret;
+
+  for(i=0; i<ep->rails_nr; i++) {
+    ret = omx__register_region_on(ep, ep->rails[i]->fd, region);
+    if (unlikely(ret != OMX_SUCCESS)) {
+      while (i--)
+	omx__deregister_region_on(ep->rails[i]->fd, region);
+      omx__deregister_region_on(ep->fd, region);
+      return ret;
+    }
+  }
+
+  return OMX_SUCCESS;
+}
+
+static INLINE void
+omx__deregister_region(const struct omx_endpoint *ep,
+		       const struct omx__large_region *region)
+{
+  unsigned i;
+
+  for(i=0; i<ep->rails_nr; i++)
+    omx__deregister_region_on(ep->rails[i]->fd, region);
+  omx__deregister_region_on(ep->fd, region);
+}
+
+/***********************
+ * Regcache Interval Tree
+ */
+
+/*
+ * Cached regions are stored in an AVL tree of their segments, sorted by
+ * start address, where each node also knows the highest end address in its
+ * subtree. It lets us find cached regions covering a buffer and regions
+ * intersecting an invalidated range in O(log n) instead of walking all
+ * of them.
+ */
+
+static INLINE int
+omx__regcache_node_height(const struct omx__regcache_node *node)
+{
+  return node ? node->height : 0;
+}
+
+static INLINE void
+omx__regcache_node_update(struct omx__regcache_node *node)
+{
+  int left_height = omx__regcache_node_height(node->left);
+  int right_height = omx__regcache_node_height(node->right);
+
+  node->height = 1 + (left_height > right_height ? left_height : right_height);
+
+  node->max_end = node->end;
+  if (node->left && node->left->max_end > node->max_end)
+    node->max_end = node->left->max_end;
+  if (node->right && node->right->max_end > node->max_end)
+    node->max_end = node->right->max_end;
+}
+
+static INLINE struct omx__regcache_node *
+omx__regcache_rotate_right(struct omx__regcache_node *node)
+{
+  struct omx__regcache_node *left = node->left;
+  node->left = left->right;
+  left->right = node;
+  omx__regcache_node_update(node);
+  omx__regcache_node_update(left);
+  return left;
+}
+
+static INLINE struct omx__regcache_node *
+omx__regcache_rotate_left(struct omx__regcache_node *node)
+{
+  struct omx__regcache_node *right = node->right;
+  node->right = right->left;
+  right->left = node;
+  omx__regcache_node_update(node);
+  omx__regcache_node_update(right);
+  return right;
+}
+
+static struct omx__regcache_node *
+omx__regcache_balance(struct omx__regcache_node *node)
+{
+  int balance;
+
+  omx__regcache_node_update(node);
+  balance = omx__regcache_node_height(node->left) - omx__regcache_node_height(node->right);
+
+  if (balance > 1) {
+    if (omx__regcache_node_height(node->left->left) < omx__regcache_node_height(node->left->right))
+      node->left = omx__regcache_rotate_left(node->left);
+    return omx__regcache_rotate_right(node);
+  }
+
+  if (balance < -1) {
+    if (omx__regcache_node_height(node->right->right) < omx__regcache_node_height(node->right->left))
+      node->right = omx__regcache_rotate_right(node->right);
+    return omx__regcache_rotate_left(node);
+  }
+
+  return node;
+}
+
+/* sort by start address, and by node address for identical starts */
+static INLINE int
+omx__regcache_node_before(const struct omx__regcache_node *node1,
+			  const struct omx__regcache_node *node2)
+{
+  if (node1->begin != node2->begin)
+    return node1->begin < node2->begin;
+  return node1 < node2;
+}
+
+static struct omx__regcache_node *
+omx__regcache_insert(struct omx__regcache_node *root,
+		     struct omx__regcache_node *node)
+{
+  if (!root) {
+    node->left = node->right = NULL;
+    omx__regcache_node_update(node);
+    return node;
+  }
+
+  if (omx__regcache_node_before(node, root))
+    root->left = omx__regcache_insert(root->left, node);
+  else
+    root->right = omx__regcache_insert(root->right, node);
+  return omx__regcache_balance(root);
+}
+
+static struct omx__regcache_node *
+omx__regcache_remove_first(struct omx__regcache_node *root,
+			   struct omx__regcache_node **firstp)
+{
+  if (!root->left) {
+    *firstp = root;
+    return root->right;
+  }
+
+  root->left = omx__regcache_remove_first(root->left, firstp);
+  return omx__regcache_balance(root);
+}
+
+static struct omx__regcache_node *
+omx__regcache_remove(struct omx__regcache_node *root,
+		     struct omx__regcache_node *node)
+{
+  omx__debug_assert(root);
+
+  if (root == node) {
+    struct omx__regcache_node *left = node->left, *right = node->right, *first;
+    if (!right)
+      return left;
+    /* replace the node with the first one of its right subtree */
+    right = omx__regcache_remove_first(right, &first);
+    first->left = left;
+    first->right = right;
+    return omx__regcache_balance(first);
+  }
+
+  if (omx__regcache_node_before(node, root))
+    root->left = omx__regcache_remove(root->left, node);
+  else
+    root->right = omx__regcache_remove(root->right, node);
+  return omx__regcache_balance(root);
+}
+
+/*
+ * Check whether the region of a node may be used for the given segments.
+ * Contigous regions may contain the buffer anywhere if the caller accepts an offset,
+ * vectorial regions must have exactly the same segments.
+ */
+static INLINE int
+omx__regcache_node_matches(const struct omx__regcache_node *node,
+			   const struct omx__req_segs *reqsegs,
+			   int need_offset_zero, const void *reserver)
+{
+  const struct omx__large_region *region = node->region;
+  const struct omx_cmd_user_segment *seg = &reqsegs->segs[0];
+
+  if (node->iseg != 0
+      || (reserver && region->reserver)
+      || (!omx__globals.parallel_regcache && region->use_count))
+    return 0;
+
+  if (reqsegs->nseg == 1) {
+    return region->segs.nseg == 1
+      && node->begin <= seg->vaddr
+      && node->end >= seg->vaddr + seg->len
+      && (!need_offset_zero || node->begin == seg->vaddr);
+  } else {
+    return region->segs.nseg == reqsegs->nseg
+      && !memcmp(region->segs.segs, reqsegs->segs, reqsegs->nseg * sizeof(*seg));
+  }
+}
+
+static struct omx__regcache_node *
+omx__regcache_lookup(struct omx__regcache_node *node,
+		     const struct omx__req_segs *reqsegs,
+		     int need_offset_zero, const void *reserver)
+{
+  unsigned long begin = reqsegs->segs[0].vaddr;
+  unsigned long end = begin + reqsegs->segs[0].len;
+  struct omx__regcache_node *found;
+
+  /* nothing in this subtree goes far enough */
+  if (!node || node->max_end < end)
+    return NULL;
+
+  found = omx__regcache_lookup(node->left, reqsegs, need_offset_zero, reserver);
+  if (found)
+    return found;
+
+  /* this node and its right subtree start too late */
+  if (node->begin > begin)
+    return NULL;
+
+  if (omx__regcache_node_matches(node, reqsegs, need_offset_zero, reserver))
+    return node;
+
+  return omx__regcache_lookup(node->right, reqsegs, need_offset_zero, reserver);
+}
+
+static INLINE int
+omx__segments_intersect(unsigned long begin1, unsigned long end1,
+			unsigned long begin2, unsigned long end2)
+{
+  /* [a:b] intersecs [c:d] if min(b,d) > max(a,c) */
+  unsigned long min_end = end1 > end2 ? end2 : end1;
+  unsigned long max_begin = begin1 > begin2 ? begin1 : begin2;
+  return min_end > max_begin;
+}
+
+static struct omx__regcache_node *
+omx__regcache_lookup_intersect(struct omx__regcache_node *node,
+			       unsigned long begin, unsigned long end)
+{
+  struct omx__regcache_node *found;
+
+  /* nothing in this subtree goes far enough */
+  if (!node || node->max_end <= begin)
+    return NULL;
+
+  found = omx__regcache_lookup_intersect(node->left, begin, end);
+  if (found)
+    return found;
+
+  /* this node and its right subtree start too late */
+  if (node->begin >= end)
+    return NULL;
+
+  if (omx__segments_intersect(begin, end, node->begin, node->end))
+    return node;
+
+  return omx__regcache_lookup_intersect(node->right, begin, end);
+}
+
+/*
+ * Make a region cachable by inserting its segments in the tree.
+ * Vectorial regions need their own copy of the segment array
+ * since the request that created them will free its own.
+ */
+static INLINE omx_return_t
+omx__regcache_insert_region(struct omx_endpoint *ep,
+			    struct omx__large_region *region)
+{
+  struct omx__regcache_node *nodes;
+  uint32_t nseg = region->segs.nseg;
+  uint32_t i;
+
+  if (nseg == 1) {
+    nodes = &region->single_node;
+  } else {
+    struct omx_cmd_user_segment *segs;
+
+    /* allocate both the nodes and the segments at once */
+    nodes = omx_malloc_ep(ep, nseg * (sizeof(*nodes) + sizeof(*segs)));
+    if (!nodes)
+      /* let the caller handle the error */
+      return OMX_NO_RESOURCES;
+
+    segs = (void *) &nodes[nseg];
+    memcpy(segs, region->segs.segs, nseg * sizeof(*segs));
+    region->segs.segs = segs;
+  }
+
+  for(i=0; i<nseg; i++) {
+    struct omx__regcache_node *node = &nodes[i];
+    node->begin = region->segs.segs[i].vaddr;
+    node->end = node->begin + region->segs.segs[i].len;
+    node->iseg = i;
+    node->region = region;
+    ep->regcache_root = omx__regcache_insert(ep->regcache_root, node);
+  }
+
+  region->nodes = nodes;
+  return OMX_SUCCESS;
+}
+
+static INLINE void
+omx__regcache_remove_region(struct omx_endpoint *ep,
+			    struct omx__large_region *region)
+{
+  uint32_t i;
+
+  if (!region->nodes)
+    return;
+
+  for(i=0; i<region->segs.nseg; i++)
+    ep->regcache_root = omx__regcache_remove(ep->regcache_root, &region->nodes[i]);
+
+  if (region->segs.nseg > 1)
+    /* the segment array is freed with the nodes */
+    omx_free_ep(ep, region->nodes);
+  region->nodes = NULL;
+}
+
 /***************************
  * Registration Cache Layer
  */
@@ -200,9 +544,10 @@ omx__destroy_region(struct omx_endpoint *ep,
 {
   omx__deregister_region(ep, region);
   list_del(&region->reg_elt);
-  /* no need to free the reqseqs segment array since the request owns it
+  /* no need to free the reqseqs segment array if not cached since the request owns it
    * (see omx__create_region())
    */
+  omx__regcache_remove_region(ep, region);
   omx__endpoint_large_region_free(ep, region);
 }
 
@@ -247,20 +592,23 @@ omx__create_region(struct omx_endpoint *ep,
     goto out;
 
   /* Just clone the reqsegs structure.
-   * We should normally duplicate the segment array as well
-   * since it will be freed with the caller request while the
-   * regcache could still be using it.
-   * However, this array is only allocated in case of vectorial
-   * regions, and there's no regcache in this case, so we just
-   * don't duplicate and let the request free the array.
+   * The segment array of vectorial regions is only duplicated
+   * when inserting in the regcache below since the request
+   * owns it and will free it.
    */
   omx_clone_segments(&region->segs, reqsegs);
+  region->nodes = NULL;
 
   ret = omx__register_region(ep, region);
   if (ret != OMX_SUCCESS)
     /* let the caller handle the error */
     goto out_with_region;
 
+  if (omx__globals.regcache
+      && omx__regcache_insert_region(ep, region) != OMX_SUCCESS)
+    /* not cached, it will be destroyed when released */
+    omx__verbose_printf(ep, "Failed to insert region %d in the regcache\n", region->id);
+
   region->reserver = NULL;
   *regionp = region;
   return OMX_SUCCESS;
@@ -271,13 +619,24 @@ omx__create_region(struct omx_endpoint *ep,
   return ret;
 }
 
-static INLINE omx_return_t
-omx__get_contigous_region(struct omx_endpoint *ep,
-			  const struct omx__req_segs *reqsegs,
-			  struct omx__large_region **regionp,
-			  const void *reserver)
+#ifdef OMX_LIB_MALLOC_HOOKS
+static void omx__endpoint_regcache_check_hooks(struct omx_endpoint *ep);
+#endif
+
+/*
+ * Get a region containing the segments, from the regcache if possible.
+ * If offsetp is NULL, the segments must start at the beginning of the region.
+ * Otherwise, it is set to the offset of the segments within the region.
+ */
+omx_return_t
+omx__get_region(struct omx_endpoint *ep,
+		const struct omx__req_segs *reqsegs,
+		struct omx__large_region **regionp,
+		uint32_t *offsetp,
+		const void *reserver)
 {
   struct omx__large_region *region = NULL;
+  uint32_t offset = 0;
   omx_return_t ret;
 
   if (reserver)
@@ -286,69 +645,41 @@ omx__get_contigous_region(struct omx_endpoint *ep,
     omx__debug_printf(LARGE, ep, "need a region without reserving it\n");
 
   if (omx__globals.regcache) {
-    const struct omx_cmd_user_segment *seg = &reqsegs->single;
-    list_for_each_entry(region, &ep->reg_list, reg_elt) {
-      if ((!reserver || !region->reserver)
-	  && (omx__globals.parallel_regcache || !region->use_count)
-	  && region->segs.single.vaddr == seg->vaddr
-	  && region->segs.single.len >= seg->len) {
-
-	if (!(region->use_count++))
-	  list_del(&region->reg_unused_elt);
-	omx__debug_printf(LARGE, ep, "regcache reusing region %d (usecount %d)\n", region->id, region->use_count);
-	goto found;
-      }
-    }
-  }
-
-  ret = omx__create_region(ep, reqsegs, &region);
-  if (ret != OMX_SUCCESS)
-    /* let the caller handle the error */
-    goto out;
+    struct omx__regcache_node *node;
 
-  list_add_tail(&region->reg_elt, &ep->reg_list);
-  region->use_count++;
-  omx__debug_printf(LARGE, ep, "created contigous region %d (usecount %d)\n", region->id, region->use_count);
+#ifdef OMX_LIB_MALLOC_HOOKS
+    omx__endpoint_regcache_check_hooks(ep);
+#endif
 
- found:
-  if (reserver) {
-    omx__debug_assert(!region->reserver);
-    omx__debug_printf(LARGE, ep, "reserving region %d for object %p\n", region->id, reserver);
-    region->reserver = (void *) reserver;
+    node = omx__regcache_lookup(ep->regcache_root, reqsegs, offsetp == NULL, reserver);
+    if (node) {
+      region = node->region;
+      offset = reqsegs->segs[0].vaddr - node->begin;
+      if (!(region->use_count++))
+	list_del(&region->reg_unused_elt);
+      ep->regcache_hits++;
+      omx__debug_printf(LARGE, ep, "regcache reusing region %d at offset %ld (usecount %d)\n",
+			region->id, (unsigned long) offset, region->use_count);
+      goto found;
+    }
+    ep->regcache_misses++;
   }
 
-  *regionp = region;
-  return OMX_SUCCESS;
-
- out:
-  return ret;
-}
-
-static INLINE omx_return_t
-omx__get_vect_region(struct omx_endpoint *ep,
-		     const struct omx__req_segs *reqsegs,
-		     struct omx__large_region **regionp,
-		     const void *reserver)
-{
-  struct omx__large_region *region = NULL;
-  omx_return_t ret;
-
-  if (reserver)
-    omx__debug_printf(LARGE, ep, "need a region reserved for object %p\n", reserver);
-  else
-    omx__debug_printf(LARGE, ep, "need a region without reserving it\n");
-
-  /* no regcache for vectorials */
-
   ret = omx__create_region(ep, reqsegs, &region);
   if (ret != OMX_SUCCESS)
     /* let the caller handle the error */
     goto out;
 
-  list_add_tail(&region->reg_elt, &ep->reg_vect_list);
+  if (reqsegs->nseg > 1)
+    list_add_tail(&region->reg_elt, &ep->reg_vect_list);
+  else
+    list_add_tail(&region->reg_elt, &ep->reg_list);
   region->use_count++;
-  omx__debug_printf(LARGE, ep, "created vectorial region %d (usecount %d)\n", region->id, region->use_count);
+  omx__debug_printf(LARGE, ep, "created %s region %d (usecount %d)\n",
+		    reqsegs->nseg > 1 ? "vectorial" : "contigous",
+		    region->id, region->use_count);
 
+ found:
   if (reserver) {
     omx__debug_assert(!region->reserver);
     omx__debug_printf(LARGE, ep, "reserving region %d for object %p\n", region->id, reserver);
@@ -356,26 +687,14 @@ omx__get_vect_region(struct omx_endpoint *ep,
   }
 
   *regionp = region;
+  if (offsetp)
+    *offsetp = offset;
   return OMX_SUCCESS;
 
  out:
   return ret;
 }
 
-omx_return_t
-omx__get_region(struct omx_endpoint *ep,
-		const struct omx__req_segs *reqsegs,
-		struct omx__large_region **regionp,
-		const void *reserver)
-{
-  uint32_t nseg = reqsegs->nseg;
-  if (nseg > 1) {
-    return omx__get_vect_region(ep, reqsegs, regionp, reserver);
-  } else {
-    return omx__get_contigous_region(ep, reqsegs, regionp, reserver);
-  }
-}
-
 omx_return_t
 omx__put_region(struct omx_endpoint *ep,
 		struct omx__large_region *region,
@@ -389,7 +708,7 @@ omx__put_region(struct omx_endpoint *ep,
     region->reserver = NULL;
   }
 
-  if (omx__globals.regcache && region->segs.nseg == 1) {
+  if (region->nodes) {
     if (!region->use_count)
       list_add_tail(&region->reg_unused_elt, &ep->reg_unused_list);
     omx__debug_printf(LARGE, ep, "regcache keeping region %d (usecount %d)\n", region->id, region->use_count);
@@ -405,14 +724,31 @@ omx__put_region(struct omx_endpoint *ep,
  * Invalid Regcache Entries
  */
 
-static INLINE int
-omx__segments_intersect(unsigned long begin1, unsigned long end1,
-			unsigned long begin2, unsigned long end2)
+/* must be called with the endpoint lock held */
+static void
+omx__endpoint_regcache_clean_range(struct omx_endpoint *ep,
+				   unsigned long begin, unsigned long end)
 {
-  /* [a:b] intersecs [c:d] if min(b,d) > max(a,c) */
-  unsigned long min_end = end1 > end2 ? end2 : end1;
-  unsigned long max_begin = begin1 > begin2 ? begin1 : begin2;
-  return min_end > max_begin;
+  struct omx__regcache_node *node;
+
+  /* destroying a region removes all its segments from the tree, so look up again each time */
+  while ((node = omx__regcache_lookup_intersect(ep->regcache_root, begin, end)) != NULL) {
+    struct omx__large_region *region = node->region;
+
+    if (region->use_count)
+      /* Invalidating a region that's being used is an application bug */
+      omx__abort(ep, "Application is freeing segment [%lx:%lx] under use by region %d segment [%lx:%lx]\n",
+		 begin, end,
+		 (unsigned) region->id,
+		 node->begin, node->end);
+
+    omx__verbose_printf(ep, "cleaning regcache [0x%lx:0x%lx] for region #%d segment [0x%lx:0x%lx]\n",
+			begin, end,
+			(unsigned) region->id,
+			node->begin, node->end);
+    list_del(&region->reg_unused_elt);
+    omx__destroy_region(ep, region);
+  }
 }
 
 struct omx_regcache_clean_segment {
@@ -422,32 +758,10 @@ struct omx_regcache_clean_segment {
 static void
 omx__endpoint_regcache_clean(struct omx_endpoint *ep, void *data)
 {
-  struct omx__large_region *region, *next;
   struct omx_regcache_clean_segment *inval_seg = (void *)data;
 
   OMX__ENDPOINT_LOCK(ep);
-  list_for_each_entry_safe(region, next, &ep->reg_list, reg_elt) {
-    unsigned long reg_begin = region->segs.single.vaddr;
-    unsigned long reg_end = reg_begin + region->segs.single.len;
-
-    /* If the invalidated segment intersects the region segment */
-    if (omx__segments_intersect(inval_seg->begin, inval_seg->end, reg_begin, reg_end)) {
-
-      if (region->use_count)
-	/* Invalidating a region that's being used is an application bug */
-	omx__abort(ep, "Application is freeing segment [%lx:%lx] under use by region %d segment [%lx:%lx]\n",
-		   inval_seg->begin, inval_seg->end,
-		   (unsigned) region->id,
-		   reg_begin, reg_end);
-
-      omx__verbose_printf(ep, "cleaning regcache [0x%lx:0x%lx] for region #%d segment [0x%lx:0x%lx]\n",
-			  inval_seg->begin, inval_seg->end,
-			  (unsigned) region->id,
-			  reg_begin, reg_end);
-      list_del(&region->reg_unused_elt);
-      omx__destroy_region(ep, region);
-    }
-  }
+  omx__endpoint_regcache_clean_range(ep, inval_seg->begin, inval_seg->end);
   OMX__ENDPOINT_UNLOCK(ep);
 }
 
@@ -468,10 +782,143 @@ omx__regcache_clean(void *ptr, size_t size)
   omx__foreach_endpoint(omx__endpoint_regcache_clean, &inval_seg);
 }
 
+#ifdef OMX_LIB_MALLOC_HOOKS
+/*
+ * Apply the ranges that the malloc hooks recorded since our last lookup.
+ * Any region that is acquired again goes through here first, so a region
+ * that is still in use when its memory was released is an application bug.
+ */
+static void
+omx__endpoint_regcache_check_hooks(struct omx_endpoint *ep)
+{
+  unsigned long begin, end;
+  int ret;
+
+  while ((ret = omx__hooks_next_invalidation(&ep->regcache_hooks_seqnum, &begin, &end)) != 0) {
+    if (ret > 0) {
+      omx__endpoint_regcache_clean_range(ep, begin, end);
+    } else {
+      /* we missed some ranges, release all unused regions */
+      omx__verbose_printf(ep, "Missed some malloc hooks invalidations, flushing the regcache\n");
+      while (!list_empty(&ep->reg_unused_list)) {
+	struct omx__large_region *region;
+	region = list_first_entry(&ep->reg_unused_list, struct omx__large_region, reg_unused_elt);
+	list_del(&region->reg_unused_elt);
+	omx__destroy_region(ep, region);
+      }
+    }
+  }
+}
+#endif /* OMX_LIB_MALLOC_HOOKS */
+
 /***************************
  * Large Messages Managment
  */
 
+/*
+ * Return the peer endpoint on our rail #rail, once connected.
+ * The connection is started on first use and completes in the background
+ * while the whole pulls go through this endpoint.
+ */
+static struct omx__partner *
+omx__rail_partner(struct omx_endpoint *ep, struct omx__partner *partner, unsigned rail)
+{
+  struct omx_endpoint *rail_ep = ep->rails[rail];
+  struct omx__partner *rail_partner = partner->rail_partners[rail];
+  uint64_t board_addr;
+  omx_return_t ret;
+
+  BUILD_BUG_ON(OMX__RAILS_MAX > 8*sizeof(partner->rails_missing));
+
+  if (likely(rail_partner))
+    /* usable once the connect reply gave us its session */
+    return rail_partner->back_session_id != (uint32_t) -1 ? rail_partner : NULL;
+
+  if (partner->rails_missing & (1 << rail))
+    return NULL;
+
+  /* assume the peer rails are as far from its primary board as ours */
+  ret = omx__peer_index_to_rail_addr(partner->peer_index,
+				     (int) rail_ep->board_index - (int) ep->board_index, &board_addr);
+  if (ret == OMX_SUCCESS)
+    ret = omx__rail_connect(rail_ep, board_addr, partner->endpoint_index, ep->app_key, &rail_partner);
+  if (ret != OMX_SUCCESS) {
+    omx__verbose_printf(ep, "Not striping pulls from peer index %d on rail board #%d (%s)\n",
+			(unsigned) partner->peer_index, rail_ep->board_index, omx_strerror(ret));
+    partner->rails_missing |= 1 << rail;
+    return NULL;
+  }
+
+  partner->rail_partners[rail] = rail_partner;
+  return NULL;
+}
+
+/*
+ * Pull the beginning of a large message through the rails,
+ * proportionally to their link speed and by entire pull blocks.
+ * Whatever could not be posted on a rail (not connected yet, no free
+ * event slot or pull handle) is left to this endpoint, which pulls
+ * the remaining end of the message, so the transfer never waits for a rail.
+ */
+static void
+omx__rails_submit_pull(struct omx_endpoint * ep,
+		       union omx_request * req)
+{
+  struct omx__partner * partner = req->generic.partner;
+  struct omx__large_region * region = req->recv.specific.large.local_region;
+  uint32_t xfer_length = req->generic.status.xfer_length;
+  uint32_t offset = 0;
+  unsigned i;
+
+  for(i=0; i<ep->rails_nr; i++) {
+    struct omx_endpoint *rail = ep->rails[i];
+    struct omx__partner *rail_partner;
+    struct omx_cmd_pull pull_param;
+    uint32_t length;
+    int err;
+
+    length = (uint64_t) xfer_length * ep->rail_weights[i+1] / ep->rail_weights_total;
+    length -= length % OMX_PULL_BLOCK_LENGTH_MAX;
+    if (!length || rail->avail_exp_events < 1)
+      continue;
+
+    rail_partner = omx__rail_partner(ep, partner, i);
+    if (!rail_partner)
+      continue;
+
+    pull_param.peer_index = rail_partner->peer_index;
+    pull_param.dest_endpoint = rail_partner->endpoint_index;
+    pull_param.shared = 0;
+    pull_param.length = length;
+    pull_param.session_id = rail_partner->back_session_id;
+    pull_param.lib_cookie = (uintptr_t) req;
+    /* regions have the same id on all rails */
+    pull_param.puller_rdma_id = region->id;
+    pull_param.puller_rdma_offset = req->recv.specific.large.local_region_offset + offset;
+    pull_param.puller_nr_segments = 0;
+    pull_param.pulled_rdma_id = req->recv.specific.large.pulled_rdma_id;
+    pull_param.pulled_rdma_seqnum = req->recv.specific.large.pulled_rdma_seqnum;
+    pull_param.pulled_rdma_offset = req->recv.specific.large.pulled_rdma_offset + offset;
+    pull_param.resend_timeout_jiffies = rail->pull_resend_timeout_jiffies;
+
+    err = ioctl(rail->fd, OMX_CMD_PULL, &pull_param);
+    if (unlikely(err < 0))
+      /* leave this part to the next rails */
+      continue;
+
+    rail->avail_exp_events--;
+    rail->rail_pulls_nr++;
+    ep->rail_pulls_nr++;
+    req->recv.specific.large.pulls_pending++;
+    offset += length;
+  }
+
+  omx__debug_printf(LARGE, ep, "striped %ld bytes out of %ld on %d pulls\n",
+		    (unsigned long) offset, (unsigned long) xfer_length,
+		    (unsigned) req->recv.specific.large.pulls_pending - 1);
+  req->recv.specific.large.primary_pull_offset = offset;
+}
+
 omx_return_t
 omx__alloc_setup_pull(struct omx_endpoint * ep,
 		      union omx_request * req)
@@ -481,6 +928,7 @@ omx__alloc_setup_pull(struct omx_endpoint * ep,
   uint32_t xfer_length = req->generic.status.xfer_length;
   struct omx__partner * partner = req->generic.partner;
   int res = req->generic.missing_resources;
+  uint32_t offset;
   omx_return_t ret;
   int err;
 
@@ -499,25 +947,52 @@ omx__alloc_setup_pull(struct omx_endpoint * ep,
   req->generic.missing_resources &= ~OMX_REQUEST_RESOURCE_EXP_EVENT;
 
  need_region:
+  if (omx__partner_localization_shared(partner)
+      && req->generic.status.msg_length <= omx__globals.shared_rndv_threshold) {
+    /* single-copy shared rndv, the driver copies straight into our segments */
+    req->generic.missing_resources &= ~OMX_REQUEST_RESOURCE_LARGE_REGION;
+    req->recv.specific.large.local_region = NULL;
+    goto need_pull;
+  }
+
   /* FIXME: could register xfer_length instead of the whole segments */
-  ret = omx__get_region(ep, &req->recv.segs, &region, NULL);
+  ret = omx__get_region(ep, &req->recv.segs, &region,
+			&req->recv.specific.large.local_region_offset, NULL);
   if (unlikely(ret != OMX_SUCCESS)) {
     omx__debug_assert(ret == OMX_INTERNAL_MISSING_RESOURCES);
     return ret;
   }
   req->generic.missing_resources &= ~OMX_REQUEST_RESOURCE_LARGE_REGION;
+  /* store the region now since we may have to try the pull again later */
+  req->recv.specific.large.local_region = region;
+
+  /* only once since the region is kept if we have to try the pull again */
+  if (ep->rails_nr && xfer_length >= omx__globals.rails_stripe_min
+      && !omx__partner_localization_shared(partner))
+    omx__rails_submit_pull(ep, req);
 
  need_pull:
+  region = req->recv.specific.large.local_region;
+  offset = req->recv.specific.large.primary_pull_offset; /* the rails pull what is before */
   pull_param.peer_index = partner->peer_index;
   pull_param.dest_endpoint = partner->endpoint_index;
   pull_param.shared = omx__partner_localization_shared(partner);
-  pull_param.length = xfer_length;
+  pull_param.length = xfer_length - offset;
   pull_param.session_id = partner->back_session_id;
   pull_param.lib_cookie = (uintptr_t) req;
-  pull_param.puller_rdma_id = region->id;
+  if (region) {
+    pull_param.puller_rdma_id = region->id;
+    pull_param.puller_rdma_offset = req->recv.specific.large.local_region_offset + offset;
+    pull_param.puller_nr_segments = 0;
+  } else {
+    pull_param.puller_rdma_id = 0;
+    pull_param.puller_rdma_offset = 0;
+    pull_param.puller_nr_segments = req->recv.segs.nseg;
+    pull_param.puller_segments = (uintptr_t) req->recv.segs.segs;
+  }
   pull_param.pulled_rdma_id = req->recv.specific.large.pulled_rdma_id;
   pull_param.pulled_rdma_seqnum = req->recv.specific.large.pulled_rdma_seqnum;
-  pull_param.pulled_rdma_offset = req->recv.specific.large.pulled_rdma_offset;
+  pull_param.pulled_rdma_offset = req->recv.specific.large.pulled_rdma_offset + offset;
   pull_param.resend_timeout_jiffies = ep->pull_resend_timeout_jiffies;
 
   err = ioctl(ep->fd, OMX_CMD_PULL, &pull_param);
@@ -534,7 +1009,6 @@ omx__alloc_setup_pull(struct omx_endpoint * ep,
   req->generic.missing_resources &= ~OMX_REQUEST_RESOURCE_PULL_HANDLE;
   omx__debug_assert(!req->generic.missing_resources);
 
-  req->recv.specific.large.local_region = region;
   req->generic.state |= OMX_REQUEST_STATE_DRIVER_PULLING;
   omx__enqueue_request(&ep->driver_pulling_req_q, req);
 
@@ -550,6 +1024,8 @@ omx__submit_pull(struct omx_endpoint * ep,
   if (req->generic.status.xfer_length) {
     /* we need to pull some data */
     req->generic.missing_resources = OMX_REQUEST_PULL_RESOURCES;
+    req->recv.specific.large.pulls_pending = 1;
+    req->recv.specific.large.primary_pull_offset = 0;
     ret = omx__alloc_setup_pull(ep, req);
     if (unlikely(ret != OMX_SUCCESS)) {
       omx__debug_assert(ret == OMX_INTERNAL_MISSING_RESOURCES);
@@ -576,16 +1052,16 @@ omx__process_pull_done(struct omx_endpoint * ep,
 {
   union omx_request * req;
   uintptr_t reqptr = event->lib_cookie;
-  uint32_t region_id = event->puller_rdma_id;
   struct omx__large_region * region;
   omx_return_t status;
 
   /* FIXME: use cookie since region might be used for something else? */
   req = (void *) reqptr;
-  region = &ep->large_region_map.array[region_id].region;
   omx__debug_assert(req);
   omx__debug_assert(req->generic.type == OMX_REQUEST_TYPE_RECV_LARGE);
-  omx__debug_assert(req->recv.specific.large.local_region == region);
+  /* no local region for single-copy shared pulls */
+  region = req->recv.specific.large.local_region;
+  omx__debug_assert(!region || region == &ep->large_region_map.array[event->puller_rdma_id].region);
 
   omx__debug_printf(LARGE, ep, "pull done with status %d\n", event->status);
 
@@ -616,13 +1092,19 @@ omx__process_pull_done(struct omx_endpoint * ep,
 	       event->status);
   }
 
-  if (unlikely(status != OMX_SUCCESS)) {
+  /* only report the first failure of a striped pull */
+  if (unlikely(status != OMX_SUCCESS) && req->generic.status.xfer_length) {
     req->generic.status.code = omx__error_with_req(ep, req, status,
 						   "Completing large receive request");
     req->generic.status.xfer_length = 0;
   }
 
-  omx__put_region(ep, region, NULL);
+  if (--req->recv.specific.large.pulls_pending)
+    /* other parts are still being pulled on the rails */
+    return;
+
+  if (region)
+    omx__put_region(ep, region, NULL);
   omx__dequeue_request(&ep->driver_pulling_req_q, req);
   req->generic.state &= ~(OMX_REQUEST_STATE_DRIVER_PULLING | OMX_REQUEST_STATE_RECV_PARTIAL);
 
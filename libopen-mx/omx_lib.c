@@ -113,10 +113,40 @@ omx__process_event(struct omx_endpoint * ep, const union omx_evt * evt)
     break;
   }
 
+  case OMX_EVT_SEND_MEDIUMSQ_DONE: {
+    omx_sendq_map_index_t sendq_index = evt->send_mediumsq_done.sendq_offset >> OMX_SENDQ_ENTRY_SHIFT;
+    union omx_request * req = omx__endpoint_sendq_map_user(ep, sendq_index);
+
+    omx__debug_assert(req);
+    omx__debug_assert(req->generic.type == OMX_REQUEST_TYPE_SEND_MEDIUMSQ);
+
+    ep->avail_exp_events++;
+
+    /* all frags of the message are done at once */
+    req->send.specific.mediumsq.frags_pending_nr = 0;
+
+    req->generic.state &= ~OMX_REQUEST_STATE_DRIVER_MEDIUMSQ_SENDING;
+    omx__dequeue_request(&ep->driver_mediumsq_sending_req_q, req);
+
+    if (likely(req->generic.state & OMX_REQUEST_STATE_NEED_ACK))
+      omx__enqueue_request(&ep->non_acked_req_q, req);
+    else
+      omx__send_complete(ep, req, OMX_SUCCESS);
+
+    break;
+  }
+
   case OMX_EVT_PULL_DONE: {
     ep->avail_exp_events++;
 
-    omx__process_pull_done(ep, &evt->pull_done);
+    if (unlikely(ep->rail_primary)) {
+      /* a striped part of a request of our primary endpoint */
+      ep->rail_pulls_nr--;
+      ep->rail_primary->rail_pulls_nr--;
+      omx__process_pull_done(ep->rail_primary, &evt->pull_done);
+    } else {
+      omx__process_pull_done(ep, &evt->pull_done);
+    }
     break;
   }
 
@@ -146,7 +176,7 @@ omx__process_event(struct omx_endpoint * ep, const union omx_evt * evt)
 static INLINE void
 omx__check_endpoint_desc(struct omx_endpoint * ep)
 {
-  uint64_t now = omx__driver_desc->jiffies;
+  uint64_t now = omx__now();
   uint64_t last = ep->last_check_jiffies;
   uint64_t driver_status;
   struct omx__partner *partner;
@@ -168,7 +198,9 @@ omx__check_endpoint_desc(struct omx_endpoint * ep)
   }
   if (driver_status & OMX_ENDPOINT_DESC_STATUS_UNEXP_EVENTQ_FULL) {
     omx__verbose_printf(ep, "Driver reporting unexpected event queue full\n");
-    omx__verbose_printf(ep, "Some packets are being dropped, they will be resent by the sender\n");
+    omx__verbose_printf(ep, "Some packets are being retained by the driver or dropped and resent by the sender\n");
+    omx__verbose_printf(ep, "Increasing OMX_RECVQ_ENTRIES (currently %ld) may help\n",
+			(unsigned long) ep->unexp_eventq_entry_nr);
   }
   if (driver_status & OMX_ENDPOINT_DESC_STATUS_IFACE_DOWN) {
     omx__warning(ep, "Driver reporting that interface %s (%s) for endpoint %d is NOT up, check dmesg\n",
@@ -196,7 +228,7 @@ static INLINE void
 omx__check_enough_progression(struct omx_endpoint * ep)
 {
 #ifdef OMX_LIB_DEBUG
-  unsigned long long now = omx__driver_desc->jiffies;
+  unsigned long long now = omx__now();
   unsigned long long last = ep->last_progress_jiffies;
   unsigned long long delay = now - last;
 
@@ -208,11 +240,31 @@ omx__check_enough_progression(struct omx_endpoint * ep)
 #endif
 }
 
+void
+omx__flush_submitq(struct omx_endpoint * ep)
+{
+  struct omx_cmd_submit_cmds submit_param;
+  int err;
+
+  if (likely(!ep->submitq_nr))
+    return;
+
+  submit_param.entries = (uintptr_t) ep->submitq;
+  submit_param.nr = ep->submitq_nr;
+  ep->submitq_nr = 0;
+
+  err = ioctl(ep->fd, OMX_CMD_SUBMIT_CMDS, &submit_param);
+  if (unlikely(err < 0))
+    omx__abort(ep, "Failed to submit a batch of %ld commands\n",
+	       (unsigned long) submit_param.nr);
+}
+
 omx_return_t
 omx__progress(struct omx_endpoint * ep)
 {
-  omx_eventq_index_t index;
-  int err;
+  omx_eventq_index_t index, exp_index;
+  uint64_t now;
+  unsigned i;
 
   if (unlikely(ep->progression_disabled))
     return OMX_SUCCESS;
@@ -224,7 +276,7 @@ omx__progress(struct omx_endpoint * ep)
    */
   index = ep->next_unexp_event_index;
   while (1) {
-    const volatile union omx_evt * evt = ep->unexp_eventq + (index % OMX_UNEXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+    const volatile union omx_evt * evt = ep->unexp_eventq + (index & (ep->unexp_eventq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
     int id = 1 + (index % OMX_EVENT_ID_MAX);
 
     if (unlikely(evt->generic.id != id))
@@ -235,20 +287,30 @@ omx__progress(struct omx_endpoint * ep)
     /* next event */
     index++;
 
-    /* Acknowledgement per batch of event slots */
-    BUILD_BUG_ON(OMX_UNEXP_RELEASE_SLOTS_BATCH_NR < 1); /* make sure we release something */
-    if (unlikely(index % OMX_UNEXP_RELEASE_SLOTS_BATCH_NR == 0)) {
-      err = ioctl(ep->fd, OMX_CMD_RELEASE_UNEXP_SLOTS);
-      if (err < 0)
-	omx__abort(ep, "Failed to release a batch of unexpected slots\n");
+    /* Acknowledgement per batch of event slots,
+     * published in the endpoint descriptor where the driver reads it when the queue looks full
+     */
+    BUILD_BUG_ON(OMX_RELEASE_SLOTS_BATCH_NR(OMX_QUEUE_ENTRY_NR_MIN) < 1); /* make sure we release something */
+    if (unlikely((index & (OMX_RELEASE_SLOTS_BATCH_NR(ep->unexp_eventq_entry_nr) - 1)) == 0)) {
+      omx__mb(); /* we are done with the slots (and their recvq data) before releasing them */
+      ep->desc->unexp_eventq_released_index = index;
     }
   }
   ep->next_unexp_event_index = index;
 
+  /* the driver retained some packets while the queue was full,
+   * release everything we processed and let it deliver them
+   */
+  if (unlikely(ep->desc->unexp_retained_nr)) {
+    omx__mb();
+    ep->desc->unexp_eventq_released_index = index;
+    ioctl(ep->fd, OMX_CMD_DELIVER_UNEXP_RETAINED);
+  }
+
   /* process expected events then */
-  index = ep->next_exp_event_index;
+  index = exp_index = ep->next_exp_event_index;
   while (1) {
-    const volatile union omx_evt * evt = ep->exp_eventq + (index % OMX_EXP_EVENTQ_ENTRY_NR) * OMX_EVENTQ_ENTRY_SIZE;
+    const volatile union omx_evt * evt = ep->exp_eventq + (index & (ep->exp_eventq_entry_nr - 1)) * OMX_EVENTQ_ENTRY_SIZE;
     int id = 1 + (index % OMX_EVENT_ID_MAX);
 
     if (unlikely(evt->generic.id != id))
@@ -259,18 +321,36 @@ omx__progress(struct omx_endpoint * ep)
     /* next event */
     index++;
 
-    /* Acknowledgement per batch of event slots */
-    BUILD_BUG_ON(OMX_EXP_RELEASE_SLOTS_BATCH_NR < 1); /* make sure we release something */
-    if (unlikely(index % OMX_EXP_RELEASE_SLOTS_BATCH_NR == 0)) {
-      err = ioctl(ep->fd, OMX_CMD_RELEASE_EXP_SLOTS);
-      if (err < 0)
-	omx__abort(ep, "Failed to release a batch of expected slots\n");
+    /* Acknowledgement per batch of event slots,
+     * published in the endpoint descriptor where the driver reads it when the queue looks full
+     */
+    BUILD_BUG_ON(OMX_RELEASE_SLOTS_BATCH_NR(OMX_QUEUE_ENTRY_NR_MIN) < 1); /* make sure we release something */
+    if (unlikely((index & (OMX_RELEASE_SLOTS_BATCH_NR(ep->exp_eventq_entry_nr) - 1)) == 0)) {
+      omx__mb(); /* we are done with the slots (and their recvq data) before releasing them */
+      ep->desc->exp_eventq_released_index = index;
     }
   }
   ep->next_exp_event_index = index;
 
-  /* resend requests that didn't get acked/replied */
-  omx__process_resend_requests(ep);
+  /* our hidden rail endpoints are only progressed from here */
+  for(i=0; i<ep->rails_nr; i++)
+    omx__progress_and_flush(ep->rails[i]);
+
+  /*
+   * Timer-based work only needs to be looked at when the time changed,
+   * or when expected events may have made some requests resendable
+   * (mediumsq send done or expected event slots released).
+   */
+  now = omx__now();
+  if (unlikely(now != ep->last_timers_jiffies || index != exp_index)) {
+    ep->last_timers_jiffies = now;
+
+    /* resend requests that didn't get acked/replied */
+    omx__process_resend_requests(ep);
+
+    /* check the endpoint descriptor */
+    omx__check_endpoint_desc(ep);
+  }
 
   /* post delayed requests */
   omx__process_delayed_requests(ep);
@@ -278,9 +358,6 @@ omx__progress(struct omx_endpoint * ep)
   /* ack partners that didn't get acked recently */
   omx__process_partners_to_ack(ep);
 
-  /* check the endpoint descriptor */
-  omx__check_endpoint_desc(ep);
-
 #ifdef OMX_LIB_DEBUG
   /* check if we leaked some requests */
   if (omx__globals.check_request_alloc)
@@ -313,7 +390,7 @@ omx_progress(omx_endpoint_t ep)
 
   OMX__ENDPOINT_LOCK(ep);
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
 
   OMX__ENDPOINT_UNLOCK(ep);
   return ret;
@@ -341,7 +418,7 @@ omx_disable_progression(struct omx_endpoint *ep)
   ep->progression_disabled = OMX_PROGRESSION_DISABLED_BY_API;
 
 #ifdef OMX_LIB_DEBUG
-  omx_disable_progression_jiffies_start = omx__driver_desc->jiffies;
+  omx_disable_progression_jiffies_start = omx__now();
 #endif
 
  out_with_lock:
@@ -364,7 +441,7 @@ omx_reenable_progression(struct omx_endpoint *ep)
 
 #ifdef OMX_LIB_DEBUG
   {
-    uint64_t now = omx__driver_desc->jiffies;
+    uint64_t now = omx__now();
     uint64_t delay = now - omx_disable_progression_jiffies_start;
     if (delay > omx__driver_desc->hz)
       omx__verbose_printf(ep, "Application disabled progression during %lld seconds (%lld jiffies)\n",
@@ -372,7 +449,7 @@ omx_reenable_progression(struct omx_endpoint *ep)
   }
 #endif
 
-  omx__progress(ep);
+  omx__progress_and_flush(ep);
 
  out_with_lock:
   OMX__ENDPOINT_UNLOCK(ep);
@@ -24,6 +24,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/ioctl.h>
 
 #include "open-mx.h"
 #include "omx_types.h"
@@ -52,7 +54,9 @@ static inline omx_return_t omx__init_ep_malloc(struct omx_endpoint *ep) {
 #define omx_malloc_ep(ep,size) mspace_malloc((ep)->malloc_data, size)
 #define omx_calloc_ep(ep,nb_elt,size_elt) mspace_calloc((ep)->malloc_data, nb_elt, size_elt)
 #define omx_free_ep(ep,ptr) mspace_free((ep)->malloc_data, ptr)
+#define omx_memalign_ep(ep,align,size) mspace_memalign((ep)->malloc_data, align, size)
 #else /* !OMX_LIB_DLMALLOC */
+#include <malloc.h>
 #define omx_malloc malloc
 #define omx_calloc calloc
 #define omx_free   free
@@ -61,6 +65,7 @@ static inline int omx__init_ep_malloc(struct omx_endpoint *ep) { return OMX_SUCC
 #define omx_malloc_ep(ep,size) malloc(size)
 #define omx_calloc_ep(ep,nb_elt,size_elt) calloc(nb_elt,size_elt)
 #define omx_free_ep(ep,ptr) free(ptr)
+#define omx_memalign_ep(ep,align,size) memalign(align,size)
 #endif /* !OMX_LIB_DLMALLOC */
 
 /*************
@@ -75,6 +80,8 @@ static inline int omx__init_ep_malloc(struct omx_endpoint *ep) { return OMX_SUCC
 #define unlikely(x)	(x)
 #endif
 
+#define OMX__CACHELINE_SIZE 64
+
 /******************
  * Various globals
  */
@@ -89,11 +96,34 @@ extern volatile struct omx_driver_desc * omx__driver_desc;
  * Timing routines
  */
 
+/*
+ * Current time in driver jiffies.
+ * CLOCK_MONOTONIC_COARSE has the same resolution, it is converted into jiffies
+ * with an offset computed once so that absolute values may still be passed to the driver.
+ * Otherwise use the jiffies that the driver exports in its descriptor.
+ */
+static inline uint64_t
+omx__now(void)
+{
+#ifdef OMX_HAVE_CLOCK_MONOTONIC_COARSE
+  if (omx__globals.coarse_clock) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return omx__globals.coarse_clock_offset
+      + (uint64_t) ts.tv_sec * omx__globals.coarse_clock_hz
+      + ts.tv_nsec / omx__globals.coarse_clock_nsec_per_jiffy;
+  }
+#endif
+  return omx__driver_desc->jiffies;
+}
+
 #define ACK_PER_SECOND 64 /* simplifies divisions too */
 #define omx__ack_delay_jiffies() ((omx__driver_desc->hz + ACK_PER_SECOND) / ACK_PER_SECOND)
 
 #define RESEND_PER_SECOND 2
 #define omx__resend_delay_jiffies() ((omx__driver_desc->hz + RESEND_PER_SECOND) / RESEND_PER_SECOND)
+/* never resend before the peer had a chance to send its delayed ack */
+#define omx__resend_delay_min_jiffies() (2 * omx__ack_delay_jiffies())
 
 /* assume 1s = 1024ms, to simplify divisions */
 
@@ -112,7 +142,7 @@ static inline __pure uint64_t
 omx__timeout_ms_to_absolute_jiffies(uint32_t ms)
 {
 	uint32_t hz = omx__driver_desc->hz;
-	uint64_t now = omx__driver_desc->jiffies;
+	uint64_t now = omx__now();
 	return (ms == OMX_TIMEOUT_INFINITE)
 		? OMX_CMD_WAIT_EVENT_TIMEOUT_INFINITE
 		: now + (ms * hz + 1023)/1024;
@@ -151,6 +181,15 @@ omx__partner_localization_shared(const struct omx__partner *partner)
   return (partner->localization == OMX__PARTNER_LOCALIZATION_LOCAL);
 }
 
+/* messages to local partners above the single-copy threshold go through a rndv too */
+static inline __pure unsigned
+omx__shared_send_rndv_threshold(void)
+{
+  if (omx__globals.shared_single_copy_threshold)
+    return omx__globals.shared_single_copy_threshold;
+  return omx__globals.shared_rndv_threshold;
+}
+
 static inline void
 omx__partner_recv_lookup(const struct omx_endpoint *ep,
 			 uint16_t peer_index, uint8_t endpoint_index,
@@ -169,7 +208,7 @@ omx__mark_partner_need_ack_delayed(struct omx_endpoint *ep,
 
   if (partner->need_ack == OMX__PARTNER_NEED_NO_ACK) {
     partner->need_ack = OMX__PARTNER_NEED_ACK_DELAYED;
-    partner->oldest_recv_time_not_acked = omx__driver_desc->jiffies;
+    partner->oldest_recv_time_not_acked = omx__now();
     list_add_tail(&partner->endpoint_partners_to_ack_elt, &ep->partners_to_ack_delayed_list);
   }
 }
@@ -213,6 +252,25 @@ omx__mark_partner_ack_sent(struct omx_endpoint *ep,
   partner->last_acked_recv_seq = partner->next_frag_recv_seq;
 }
 
+/*
+ * Delay before resending a request, doubled after each resend of this request.
+ * Selectively acked requests only get resent in case the peer dropped them
+ * in the meantime, or if all its acks got lost.
+ */
+static inline uint64_t
+omx__request_resend_delay(const union omx_request *req)
+{
+  uint64_t delay;
+
+  if (req->generic.state & OMX_REQUEST_STATE_SACKED)
+    return omx__globals.resend_delay_jiffies;
+
+  delay = req->generic.partner->resend_delay_jiffies;
+  if (req->generic.resends > 1)
+    delay <<= req->generic.resends < 16 ? req->generic.resends - 1 : 15;
+  return delay < omx__globals.resend_delay_jiffies ? delay : omx__globals.resend_delay_jiffies;
+}
+
 static inline void
 omx__mark_partner_throttling(struct omx_endpoint *ep,
 			     struct omx__partner *partner)
@@ -278,7 +336,7 @@ omx__endpoint_sendq_map_get(struct omx_endpoint * ep,
    * (even if it may not be uint16_t internally),
    * make sure it's enough for the actual offset
    */
-  BUILD_BUG_ON(1ULL << (8*sizeof(omx_sendq_map_index_t)) < OMX_SENDQ_ENTRY_NR);
+  BUILD_BUG_ON(1ULL << (8*sizeof(omx_sendq_map_index_t)) < OMX_QUEUE_ENTRY_NR_MAX);
 
   omx__debug_assert((ep->sendq_map.first_free == -1) == (ep->sendq_map.nr_free == 0));
 
@@ -347,6 +405,46 @@ omx__endpoint_sendq_map_user(const struct omx_endpoint * ep,
   return user;
 }
 
+/***************************
+ * Command submission helpers
+ */
+
+extern void
+omx__flush_submitq(struct omx_endpoint * ep);
+
+/*
+ * Post a send command to the driver, either with its own ioctl,
+ * or queued in the submit queue until the next flush.
+ * In the latter case, failures are never reported, the caller must
+ * rely on retransmission as for regular ioctl failures.
+ * Only commands queued during a single library call are batched:
+ * the queue is flushed when full, before any command that is not queued
+ * (so that packets are sent in order), before sleeping, and before
+ * returning to the application (see omx__progress_and_flush()).
+ */
+static inline int
+omx___submit_cmd(struct omx_endpoint * ep,
+		 unsigned long ioctl_cmd, uint32_t epcmd,
+		 const void * param, size_t length)
+{
+  struct omx_cmd_submit_entry * entry;
+
+  if (!ep->submitq_max)
+    return ioctl(ep->fd, ioctl_cmd, param);
+
+  omx__debug_assert(length <= sizeof(entry->cmd));
+  entry = &ep->submitq[ep->submitq_nr];
+  entry->epcmd = epcmd;
+  memcpy(&entry->cmd, param, length);
+
+  if (++ep->submitq_nr == ep->submitq_max)
+    omx__flush_submitq(ep);
+  return 0;
+}
+
+#define omx__submit_cmd(ep, type, param) \
+  omx___submit_cmd(ep, OMX_CMD_##type, OMX_EPCMD_##type, param, sizeof(*(param)))
+
 /******************************
  * Various internal prototypes
  */
@@ -407,6 +505,9 @@ omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *part
 			      const struct omx_evt_recv_msg *msg,
 			      const void *data, uint32_t xfer_length);
 
+extern void
+omx__release_medium_direct(struct omx_endpoint *ep, union omx_request *req, int detach);
+
 extern void
 omx__process_recv_rndv(struct omx_endpoint *ep, struct omx__partner *partner,
 		       union omx_request *req,
@@ -436,6 +537,15 @@ omx__process_recv_nack_lib(struct omx_endpoint *ep,
 extern omx_return_t
 omx__progress(struct omx_endpoint * ep);
 
+/* progress and submit queued commands, before returning to the application */
+static inline omx_return_t
+omx__progress_and_flush(struct omx_endpoint * ep)
+{
+  omx_return_t ret = omx__progress(ep);
+  omx__flush_submitq(ep);
+  return ret;
+}
+
 extern void
 omx__notify_user_event(struct omx_endpoint *ep);
 
@@ -448,7 +558,7 @@ extern omx_return_t
 omx__connect_myself(struct omx_endpoint *ep);
 
 extern void
-omx__post_connect_request(const struct omx_endpoint *ep,
+omx__post_connect_request(struct omx_endpoint *ep,
 			  const struct omx__partner *partner,
 			  union omx_request * req);
 
@@ -468,6 +578,11 @@ omx_return_t
 omx__connect_wait(omx_endpoint_t ep, union omx_request * req,
 		  uint32_t ms_timeout);
 
+extern omx_return_t
+omx__rail_connect(struct omx_endpoint *rail,
+		  uint64_t nic_id, uint32_t endpoint_id, uint32_t key,
+		  struct omx__partner **partnerp);
+
 /* retransmission */
 
 extern void
@@ -529,6 +644,7 @@ extern omx_return_t
 omx__get_region(struct omx_endpoint *ep,
 		const struct omx__req_segs *segs,
 		struct omx__large_region **regionp,
+		uint32_t *offsetp,
 		const void * reserver);
 
 extern omx_return_t
@@ -539,6 +655,52 @@ omx__put_region(struct omx_endpoint *ep,
 extern void
 omx__regcache_clean(void *ptr, size_t size);
 
+#ifdef OMX_LIB_MALLOC_HOOKS
+/* memory release interception (see omx_hooks.c) */
+
+extern void
+omx__hooks_invalidate(void *ptr, size_t size);
+
+extern unsigned long
+omx__hooks_seqnum(void);
+
+extern int
+omx__hooks_next_invalidation(unsigned long *seqnump,
+			     unsigned long *beginp, unsigned long *endp);
+
+extern int
+omx__hooks_active(void);
+#endif /* OMX_LIB_MALLOC_HOOKS */
+
+/* end-to-end checksum (see omx_crc32c.c) */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define OMX__CRC32C_HW 1
+#endif
+
+extern void
+omx__crc32c_init(void);
+
+extern uint32_t (*omx__crc32c)(uint32_t crc, const void *buf, size_t len);
+
+extern uint32_t
+omx__crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+#ifdef OMX__CRC32C_HW
+extern uint32_t
+omx__crc32c_hw(uint32_t crc, const void *buf, size_t len);
+#endif
+
+extern int
+omx__crc32c_hw_available(void);
+
+extern uint32_t
+omx__crc32c_copy(void *dst, const void *src, size_t len, uint32_t crc);
+
+/* packet headers only have room for 16 bits */
+#define OMX__CRC32C_FOLD16(crc) ((uint16_t) ((crc) ^ ((crc) >> 16)))
+
 /* board management */
 
 extern omx_return_t
@@ -583,6 +745,9 @@ omx__peer_addr_to_index(uint64_t board_addr, uint16_t *index);
 extern omx_return_t
 omx__peer_index_to_addr(uint16_t index, uint64_t *board_addrp);
 
+extern omx_return_t
+omx__peer_index_to_rail_addr(uint16_t index, int board_offset, uint64_t *board_addrp);
+
 /* error management */
 
 extern void
@@ -277,7 +277,7 @@ omx__cancel_common(omx_endpoint_t ep,
     if (req->generic.state & OMX_REQUEST_STATE_RECV_NEED_MATCHING) {
       /* not matched, still in the recv queue */
       uint32_t ctxid = CTXID_FROM_MATCHING(ep, req->recv.match_info);
-      omx__dequeue_request(&ep->ctxid[ctxid].recv_req_q, req);
+      omx__dequeue_recv_request(ep, ctxid, req);
       omx_free_segments(ep, &req->send.segs);
       req->generic.state &= ~OMX_REQUEST_STATE_RECV_NEED_MATCHING;
       *result = 1;
@@ -327,7 +327,7 @@ omx_cancel(omx_endpoint_t ep,
 
   OMX__ENDPOINT_LOCK(ep);
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (ret != OMX_SUCCESS)
     goto out_with_lock;
 
@@ -353,7 +353,7 @@ omx_cancel_notest(omx_endpoint_t ep,
 
   OMX__ENDPOINT_LOCK(ep);
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (ret != OMX_SUCCESS)
     goto out_with_lock;
 
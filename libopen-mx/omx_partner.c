@@ -129,7 +129,12 @@ omx__partner_reset(struct omx__partner *partner)
   partner->connect_seqnum = 0;
   partner->last_send_acknum = 0;
   partner->last_recv_acknum = 0;
+  partner->srtt_x8 = 0;
+  partner->rttvar_x4 = 0;
+  partner->resend_delay_jiffies = omx__globals.resend_delay_jiffies; /* until we get some RTT samples */
   partner->throttling_sends_nr = 0;
+  memset(partner->rail_partners, 0, sizeof(partner->rail_partners)); /* connect the rails again */
+  partner->rails_missing = 0;
 
   if (partner->need_ack != OMX__PARTNER_NEED_NO_ACK) {
     partner->need_ack = OMX__PARTNER_NEED_NO_ACK;
@@ -180,7 +185,7 @@ omx__partner_check_localization(const struct omx_endpoint * ep, struct omx__part
 
   if (partner->localization == OMX__PARTNER_LOCALIZATION_UNKNOWN) {
     partner->localization = localization;
-    partner->rndv_threshold = shared ? omx__globals.shared_rndv_threshold : omx__globals.rndv_threshold;
+    partner->rndv_threshold = shared ? omx__shared_send_rndv_threshold() : omx__globals.rndv_threshold;
     if (shared)
       omx__debug_printf(CONNECT, ep, "Using shared communication for partner %016llx ep %d\n",
 			(unsigned long long) partner->board_addr, (unsigned) partner->endpoint_index);
@@ -281,7 +286,7 @@ omx__connect_myself(struct omx_endpoint *ep)
   maybe_self = omx__globals.selfcomms;
   maybe_shared = omx__globals.sharedcomms;
   ep->myself->localization = (maybe_self || maybe_shared) ? OMX__PARTNER_LOCALIZATION_LOCAL : OMX__PARTNER_LOCALIZATION_REMOTE;
-  ep->myself->rndv_threshold = (maybe_self || maybe_shared) ? omx__globals.shared_rndv_threshold : omx__globals.rndv_threshold;
+  ep->myself->rndv_threshold = (maybe_self || maybe_shared) ? omx__shared_send_rndv_threshold() : omx__globals.rndv_threshold;
 
   omx__debug_printf(CONNECT, ep, "created myself partner %016llx ep %d peer index %d\n",
 		    (unsigned long long) ep->board_info.addr, (unsigned) ep->endpoint_index, (unsigned) peer_index);
@@ -294,7 +299,7 @@ omx__connect_myself(struct omx_endpoint *ep)
  */
 
 void
-omx__post_connect_request(const struct omx_endpoint *ep,
+omx__post_connect_request(struct omx_endpoint *ep,
 			  const struct omx__partner *partner,
 			  union omx_request * req)
 {
@@ -303,6 +308,7 @@ omx__post_connect_request(const struct omx_endpoint *ep,
 
   connect_param->target_recv_seqnum_start = partner->next_match_recv_seq;
 
+  omx__flush_submitq(ep);
   err = ioctl(ep->fd, OMX_CMD_SEND_CONNECT_REQUEST, connect_param);
   if (err < 0) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
@@ -312,7 +318,7 @@ omx__post_connect_request(const struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 }
 
 /*
@@ -328,7 +334,7 @@ omx__connect_common(omx_endpoint_t ep,
   uint8_t connect_seqnum;
   omx_return_t ret;
 
-  { /* warn once about connection deadlocks if actually connecting from different endpoints */
+  if (!ep->rail_primary) { /* warn once about connection deadlocks if actually connecting from different endpoints */
     static omx_endpoint_t last_connecting_ep = NULL;
     static int warned_about_connect_pollall = 0;
     if (last_connecting_ep && last_connecting_ep != ep
@@ -386,8 +392,6 @@ omx__connect_common(omx_endpoint_t ep,
   req->connect.session_id = ep->desc->session_id;
   req->connect.connect_seqnum = connect_seqnum;
 
-  omx__progress(ep);
-
   return OMX_SUCCESS;
 
  out:
@@ -420,6 +424,7 @@ omx_connect(omx_endpoint_t ep,
     ret = omx__error_with_ep(ep, ret, "Allocating connect request");
     goto out_with_req;
   }
+  omx__progress_and_flush(ep);
 
   omx__debug_printf(CONNECT, ep, "waiting for connect reply from partner %016llx ep %d\n",
 		    (unsigned long long) nic_id, (unsigned) endpoint_id);
@@ -497,6 +502,8 @@ omx_iconnect(omx_endpoint_t ep,
     ep->zombies++;
   }
 
+  omx__progress_and_flush(ep);
+
   OMX__ENDPOINT_UNLOCK(ep);
   return ret;
 
@@ -507,6 +514,42 @@ omx_iconnect(omx_endpoint_t ep,
   return ret;
 }
 
+/*
+ * Start connecting one of our rail endpoints to the corresponding peer rail.
+ * Called with the primary endpoint lock held, the rail is not progressed here
+ * since its events may complete the requests that the caller is processing.
+ */
+omx_return_t
+omx__rail_connect(struct omx_endpoint *rail,
+		  uint64_t nic_id, uint32_t endpoint_id, uint32_t key,
+		  struct omx__partner **partnerp)
+{
+  union omx_request * req;
+  omx_return_t ret;
+
+  req = omx__request_alloc(rail);
+  if (!req)
+    /* let the caller handle the error */
+    return OMX_NO_RESOURCES;
+
+  req->generic.type = OMX_REQUEST_TYPE_CONNECT;
+  req->generic.status.match_info = 0;
+  req->generic.status.context = NULL;
+
+  ret = omx__connect_common(rail, nic_id, endpoint_id, key, req);
+  if (ret != OMX_SUCCESS) {
+    omx__request_free(rail, req);
+    return ret;
+  }
+
+  /* nobody waits for it */
+  req->generic.state |= OMX_REQUEST_STATE_ZOMBIE;
+  rail->zombies++;
+
+  *partnerp = req->generic.partner;
+  return OMX_SUCCESS;
+}
+
 /*
  * Complete the connect request
  */
@@ -706,6 +749,7 @@ omx__process_recv_connect_request(struct omx_endpoint *ep,
   reply_param.connect_seqnum = event->connect_seqnum;
   reply_param.connect_status_code = connect_status_code;
 
+  omx__flush_submitq(ep);
   err = ioctl(ep->fd, OMX_CMD_SEND_CONNECT_REPLY, &reply_param);
   if (err < 0) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
@@ -866,9 +910,7 @@ omx__partner_cleanup(struct omx_endpoint *ep, struct omx__partner *partner, int
     /* dequeue and complete with status error */
     omx___dequeue_partner_request(req);
     if(unlikely(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)) {
-      omx__dequeue_request(&ep->anyctxid.unexp_req_q, req);
-      if (unlikely(HAS_CTXIDS(ep)))
-	omx__dequeue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+      omx__dequeue_unexp_request(ep, ctxid, req);
 #ifdef OMX_LIB_DEBUG
     } else {
       omx__dequeue_request(&ep->partial_medium_recv_req_q, req);
@@ -876,6 +918,7 @@ omx__partner_cleanup(struct omx_endpoint *ep, struct omx__partner *partner, int
     }
 
     req->generic.state &= ~OMX_REQUEST_STATE_RECV_PARTIAL;
+    omx__release_medium_direct(ep, req, 1);
     omx__recv_complete(ep, req, OMX_REMOTE_ENDPOINT_UNREACHABLE);
     count++;
   }
@@ -909,7 +952,7 @@ omx__partner_cleanup(struct omx_endpoint *ep, struct omx__partner *partner, int
     omx__debug_printf(CONNECT, ep, "Dropping unexpected recv %p\n", req);
 
     /* drop it and that's it */
-    omx___dequeue_request(req);
+    omx___dequeue_unexp_request(ep, req);
     if (req->generic.type != OMX_REQUEST_TYPE_RECV_LARGE
 	&& req->generic.status.msg_length > 0)
       /* release the single segment used for unexp buffer */
@@ -959,7 +1002,7 @@ omx_disconnect(omx_endpoint_t ep, omx_endpoint_addr_t addr)
 
   OMX__ENDPOINT_LOCK(ep);
 
-  omx__progress(ep);
+  omx__progress_and_flush(ep);
   partner = omx__partner_from_addr(&addr);
   omx__partner_cleanup(ep, partner, 2);
 
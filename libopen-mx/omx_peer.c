@@ -16,6 +16,7 @@
  * See the GNU Lesser General Public License in COPYING.LGPL for more details.
  */
 
+#include <stdlib.h>
 #include <sys/ioctl.h>
 
 #include "omx_lib.h"
@@ -306,6 +307,39 @@ omx__peer_index_to_addr(uint16_t index, uint64_t *board_addrp)
   return OMX_SUCCESS;
 }
 
+/*
+ * Find the board of the same host whose index is board_offset after this one,
+ * assuming the peers still use the default 'hostname:board' names.
+ */
+omx_return_t
+omx__peer_index_to_rail_addr(uint16_t index, int board_offset, uint64_t *board_addrp)
+{
+  char hostname[OMX_HOSTNAMELEN_MAX];
+  char *colon, *end;
+  long board;
+  size_t room;
+  omx_return_t ret;
+
+  ret = omx__driver_peer_from_index(index, NULL, hostname);
+  if (ret != OMX_SUCCESS)
+    /* let the caller handle errors */
+    return ret;
+
+  hostname[OMX_HOSTNAMELEN_MAX-1] = '\0';
+  colon = strrchr(hostname, ':');
+  if (!colon)
+    return OMX_PEER_NOT_FOUND;
+  board = strtol(colon+1, &end, 10);
+  if (end == colon+1 || *end != '\0' || board + board_offset < 0)
+    return OMX_PEER_NOT_FOUND;
+
+  room = hostname + OMX_HOSTNAMELEN_MAX - (colon+1);
+  if ((size_t) snprintf(colon+1, room, "%ld", board + board_offset) >= room)
+    return OMX_PEER_NOT_FOUND;
+
+  return omx__driver_peer_from_hostname(hostname, board_addrp, NULL);
+}
+
 /* API omx_hostname_to_nic_id */
 omx_return_t
 omx_hostname_to_nic_id(char *hostname,
@@ -220,6 +220,10 @@ omx__postpone_early_packet(struct omx_endpoint *ep, struct omx__partner * partne
 		    (unsigned) OMX__SESNUM_SHIFTED(msg->seqnum));
 
   list_add_after(&early->partner_elt, prev);
+
+  /* let the sender know soon that only the previous messages need to be resent */
+  if (omx__globals.sack)
+    omx__mark_partner_need_ack_delayed(ep, partner);
 }
 
 /*****************************************
@@ -257,9 +261,7 @@ omx__process_recv_tiny(struct omx_endpoint *ep, struct omx__partner *partner,
 #endif
 
   if (unlikely(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)) {
-    omx__enqueue_request(&ep->anyctxid.unexp_req_q, req);
-    if (unlikely(HAS_CTXIDS(ep)))
-      omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+    omx__enqueue_unexp_request(ep, ctxid, req);
   } else {
     omx__recv_complete(ep, req, OMX_SUCCESS);
   }
@@ -288,9 +290,7 @@ omx__process_recv_small(struct omx_endpoint *ep, struct omx__partner *partner,
 #endif
 
   if (unlikely(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)) {
-    omx__enqueue_request(&ep->anyctxid.unexp_req_q, req);
-    if (unlikely(HAS_CTXIDS(ep)))
-      omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+    omx__enqueue_unexp_request(ep, ctxid, req);
   } else {
     omx__recv_complete(ep, req, OMX_SUCCESS);
   }
@@ -301,12 +301,82 @@ omx__init_process_recv_medium(union omx_request *req)
 {
   req->recv.specific.medium.frags_received_mask = 0;
   req->recv.specific.medium.accumulated_length = 0;
+  req->recv.specific.medium.direct_region = NULL;
   /* initialize the state to the beginning */
   req->recv.specific.medium.scan_offset = 0;
   req->recv.specific.medium.scan_state.seg = &req->recv.segs.segs[0];
   req->recv.specific.medium.scan_state.offset = 0;
 }
 
+/*
+ * Ask the driver to copy the next fragments of a matched medium message
+ * directly into the receive buffer instead of the recvq.
+ */
+static INLINE void
+omx__attach_medium_direct(struct omx_endpoint *ep, union omx_request *req,
+			  const struct omx_evt_recv_msg *msg, uint32_t xfer_length)
+{
+  struct omx_cmd_medium_direct direct_param;
+  struct omx__large_region *region;
+  uint32_t offset;
+  omx_return_t ret;
+  int err;
+
+  ret = omx__get_region(ep, &req->recv.segs, &region, &offset, NULL);
+  if (unlikely(ret != OMX_SUCCESS))
+    /* no region available, just keep using the recvq */
+    return;
+
+  direct_param.peer_index = msg->peer_index;
+  direct_param.src_endpoint = msg->src_endpoint;
+  direct_param.detach = 0;
+  direct_param.seqnum = msg->seqnum;
+  direct_param.rdma_id = region->id;
+  direct_param.offset = offset;
+  direct_param.length = xfer_length;
+
+  err = ioctl(ep->fd, OMX_CMD_MEDIUM_DIRECT, &direct_param);
+  if (unlikely(err < 0)) {
+    omx__debug_printf(MEDIUM, ep, "failed to attach region %d for direct medium frags (%m)\n",
+		      region->id);
+    omx__put_region(ep, region, NULL);
+    return;
+  }
+
+  req->recv.specific.medium.direct_region = region;
+}
+
+/*
+ * Release the region attached for direct medium fragments.
+ * Detach it from the driver first if the message is not complete.
+ */
+void
+omx__release_medium_direct(struct omx_endpoint *ep, union omx_request *req, int detach)
+{
+  struct omx__large_region *region = req->recv.specific.medium.direct_region;
+
+  if (likely(!region))
+    return;
+
+  if (unlikely(detach)) {
+    struct omx__partner *partner = req->generic.partner;
+    struct omx_cmd_medium_direct direct_param;
+
+    direct_param.peer_index = partner->peer_index;
+    direct_param.src_endpoint = partner->endpoint_index;
+    direct_param.detach = 1;
+    direct_param.seqnum = req->recv.seqnum;
+    direct_param.rdma_id = region->id;
+    direct_param.offset = 0;
+    direct_param.length = 0;
+    /* cannot fail unless the endpoint is being closed, in which case the region goes away anyway */
+    ioctl(ep->fd, OMX_CMD_MEDIUM_DIRECT, &direct_param);
+  }
+
+  omx__put_region(ep, region, NULL);
+  req->recv.specific.medium.direct_region = NULL;
+}
+
 void
 omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *partner,
 			      union omx_request *req,
@@ -354,8 +424,10 @@ omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *part
   else
     xfer_chunk = 0;
 
-  /* take care of the data chunk */
-  if (likely(req->recv.segs.nseg == 1))
+  /* take care of the data chunk, unless the driver already placed it */
+  if (msg->specific.medium_frag.direct)
+    omx__debug_assert(req->recv.specific.medium.direct_region);
+  else if (likely(req->recv.segs.nseg == 1))
     memcpy(OMX_SEG_PTR(&req->recv.segs.single) + offset, data, xfer_chunk);
   else
     omx_partial_copy_to_segments(ep, &req->recv.segs, data, xfer_chunk,
@@ -385,9 +457,7 @@ omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *part
      * ordered to ensure in-order matching.
      */
     if (unlikely(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)) {
-      omx__enqueue_request(&ep->anyctxid.unexp_req_q, req);
-      if (unlikely(HAS_CTXIDS(ep)))
-	omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+      omx__enqueue_unexp_request(ep, ctxid, req);
 #ifdef OMX_LIB_DEBUG
     } else {
       omx__enqueue_request(&ep->partial_medium_recv_req_q, req);
@@ -396,6 +466,14 @@ omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *part
 
     req->generic.state |= OMX_REQUEST_STATE_RECV_PARTIAL;
     omx__enqueue_partner_request(&partner->partial_medium_recv_req_q, req);
+
+    /* let the driver place the next frags of an expected message in the receive buffer */
+    if (omx__globals.medium_direct
+	&& !(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)
+	&& req->recv.specific.medium.accumulated_length < msg_length
+	&& req->recv.segs.nseg == 1 && xfer_length
+	&& !omx__partner_localization_shared(partner))
+      omx__attach_medium_direct(ep, req, msg, xfer_length);
   }
 
   if (likely(req->recv.specific.medium.accumulated_length == msg_length)) {
@@ -422,6 +500,8 @@ omx__process_recv_medium_frag(struct omx_endpoint *ep, struct omx__partner *part
 #ifdef OMX_LIB_DEBUG
       omx__dequeue_request(&ep->partial_medium_recv_req_q, req);
 #endif
+      /* the driver saw all frags as well, it does not use the region anymore */
+      omx__release_medium_direct(ep, req, 0);
       omx__recv_complete(ep, req, OMX_SUCCESS);
     }
 
@@ -459,9 +539,7 @@ omx__process_recv_rndv(struct omx_endpoint *ep, struct omx__partner *partner,
   req->generic.state |= OMX_REQUEST_STATE_RECV_PARTIAL;
 
   if (unlikely(req->generic.state & OMX_REQUEST_STATE_UNEXPECTED_RECV)) {
-    omx__enqueue_request(&ep->anyctxid.unexp_req_q, req);
-    if (unlikely(HAS_CTXIDS(ep)))
-      omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+    omx__enqueue_unexp_request(ep, ctxid, req);
   } else {
     omx__submit_pull(ep, req);
   }
@@ -477,15 +555,30 @@ omx__match_recv(struct omx_endpoint *ep,
 		union omx_request **reqp)
 {
   uint32_t ctxid = CTXID_FROM_MATCHING(ep, match_info);
-  union omx_request * req;
+  union omx_request * req, * exact = NULL;
+
+  /* find the oldest posted recv with a full mask and the same match_info */
+  omx__foreach_match_request(&ep->recv_match_hash[omx__match_hash(match_info)], req)
+    if (likely(req->recv.match_info == match_info)) {
+      exact = req;
+      break;
+    }
 
-  omx__foreach_request(&ep->ctxid[ctxid].recv_req_q, req)
-    if (likely(req->recv.match_info == (req->recv.match_mask & match_info))) {
-      /* matched a posted recv */
-      omx___dequeue_request(req);
-      *reqp = req;
+  /* a wildcard recv wins if it was posted earlier */
+  omx__foreach_match_request(&ep->ctxid[ctxid].recv_wildcard_req_q, req) {
+    if (exact && req->recv.post_seqnum > exact->recv.post_seqnum)
+      break;
+    if (req->recv.match_info == (req->recv.match_mask & match_info)) {
+      exact = req;
       break;
     }
+  }
+
+  if (likely(exact)) {
+    /* matched a posted recv */
+    omx___dequeue_recv_request(exact);
+    *reqp = exact;
+  }
 }
 
 static INLINE omx_return_t
@@ -524,7 +617,7 @@ omx__try_match_next_recv(struct omx_endpoint *ep,
     omx__debug_assert(!(ep->progression_disabled & OMX_PROGRESSION_DISABLED_IN_HANDLER));
     ep->progression_disabled = OMX_PROGRESSION_DISABLED_IN_HANDLER;
 #ifdef OMX_LIB_DEBUG
-    omx_handler_jiffies_start = omx__driver_desc->jiffies;
+    omx_handler_jiffies_start = omx__now();
 #endif
     OMX__ENDPOINT_UNLOCK(ep);
 
@@ -536,7 +629,7 @@ omx__try_match_next_recv(struct omx_endpoint *ep,
     OMX__ENDPOINT_HANDLER_DONE_SIGNAL(ep);
 #ifdef OMX_LIB_DEBUG
   {
-    uint64_t now = omx__driver_desc->jiffies;
+    uint64_t now = omx__now();
     uint64_t delay = now - omx_handler_jiffies_start;
     if (delay > omx__driver_desc->hz)
       omx__verbose_printf(ep, "Unexpected handler disabled progression during %lld seconds (%lld jiffies)\n",
@@ -733,6 +826,31 @@ omx__process_partner_ordered_recv(struct omx_endpoint *ep,
   return ret;
 }
 
+/*
+ * Verify the end-to-end checksum of an incoming packet payload.
+ * It has to be done before the seqnum is accepted so that a corrupted packet
+ * is dropped and resent by the sender, the recvq slot was just written
+ * by the driver anyway.
+ */
+static INLINE int
+omx__recv_checksum_valid(const struct omx_evt_recv_msg *msg, const void *data)
+{
+  switch (msg->type) {
+  case OMX_EVT_RECV_TINY:
+    return msg->specific.tiny.checksum
+      == OMX__CRC32C_FOLD16(omx__crc32c(0, msg->specific.tiny.data, msg->specific.tiny.length));
+  case OMX_EVT_RECV_SMALL:
+    return msg->specific.small.checksum
+      == OMX__CRC32C_FOLD16(omx__crc32c(0, data, msg->specific.small.length));
+  case OMX_EVT_RECV_MEDIUM_FRAG:
+    return msg->specific.medium_frag.checksum
+      == OMX__CRC32C_FOLD16(omx__crc32c(0, data, msg->specific.medium_frag.frag_length));
+  default:
+    /* no payload */
+    return 1;
+  }
+}
+
 void
 omx__process_recv(struct omx_endpoint *ep,
 		  const struct omx_evt_recv_msg *msg, const void *data, uint32_t msg_length,
@@ -750,6 +868,16 @@ omx__process_recv(struct omx_endpoint *ep,
   if (unlikely(!partner))
     return;
 
+  if (unlikely(omx__globals.checksum)
+      && !omx__partner_localization_shared(partner)
+      && !omx__recv_checksum_valid(msg, data)) {
+    omx__verbose_printf(ep, "Dropping packet with invalid checksum (seqnum %d) from partner %016llx ep %d, waiting for resend\n",
+			(unsigned) OMX__SEQNUM(msg->seqnum),
+			(unsigned long long) partner->board_addr, (unsigned) partner->endpoint_index);
+    ep->checksum_errors++;
+    return;
+  }
+
   omx__debug_printf(RECV, ep, "got message length %ld from partner %016llx ep %d\n",
 		    (unsigned long) msg_length,
 		    (unsigned long long) partner->board_addr, (unsigned) partner->endpoint_index);
@@ -878,7 +1006,7 @@ omx__process_self_send(struct omx_endpoint *ep,
     omx__debug_assert(!(ep->progression_disabled & OMX_PROGRESSION_DISABLED_IN_HANDLER));
     ep->progression_disabled = OMX_PROGRESSION_DISABLED_IN_HANDLER;
 #ifdef OMX_LIB_DEBUG
-    omx_handler_jiffies_start = omx__driver_desc->jiffies;
+    omx_handler_jiffies_start = omx__now();
 #endif
     OMX__ENDPOINT_UNLOCK(ep);
 
@@ -890,7 +1018,7 @@ omx__process_self_send(struct omx_endpoint *ep,
     OMX__ENDPOINT_HANDLER_DONE_SIGNAL(ep);
 #ifdef OMX_LIB_DEBUG
   {
-    uint64_t now = omx__driver_desc->jiffies;
+    uint64_t now = omx__now();
     uint64_t delay = now - omx_handler_jiffies_start;
     if (delay > omx__driver_desc->hz)
       omx__verbose_printf(ep, "Unexpected handler disabled progression during %lld seconds (%lld jiffies)\n",
@@ -992,9 +1120,7 @@ omx__process_self_send(struct omx_endpoint *ep,
     omx_copy_from_segments(unexp_buffer, &sreq->send.segs, msg_length);
     rreq->recv.checksum = omx_checksum_segments(&rreq->recv.segs, msg_length);
 
-    omx__enqueue_request(&ep->anyctxid.unexp_req_q, rreq);
-    if (unlikely(HAS_CTXIDS(ep)))
-      omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, rreq);
+    omx__enqueue_unexp_request(ep, ctxid, rreq);
 
     /* self communication are always synchronous,
      * the send will be completed on matching
@@ -1101,9 +1227,7 @@ omx__complete_unexp_req_as_irecv(struct omx_endpoint *ep,
   uint32_t msg_length;
   uint32_t xfer_length;
 
-  omx___dequeue_request(req);
-  if (unlikely(HAS_CTXIDS(ep)))
-    omx___dequeue_ctxid_request(req);
+  omx___dequeue_unexp_request(ep, req);
 
   /* get the unexp buffer and store the new segments */
   unexp_buffer = OMX_SEG_PTR(&req->recv.segs.single);
@@ -1201,7 +1325,14 @@ omx__irecv_segs(struct omx_endpoint *ep, const struct omx__req_segs * reqsegs,
   union omx_request * req;
   omx_return_t ret;
 
-  if (unlikely(HAS_CTXIDS(ep))) {
+  if (likely(match_mask == OMX__MATCH_MASK_FULL)) {
+    req = omx__find_unexp_exact_request(ep, match_info);
+    if (req) {
+      /* matched an unexpected in the matching hash */
+      omx__complete_unexp_req_as_irecv(ep, req, reqsegs, context);
+      goto ok;
+    }
+  } else if (unlikely(HAS_CTXIDS(ep))) {
     omx__foreach_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req) {
       if (likely((req->generic.status.match_info & match_mask) == match_info)) {
 	/* matched an unexpected in the ctxid queue */
@@ -1234,8 +1365,8 @@ omx__irecv_segs(struct omx_endpoint *ep, const struct omx__req_segs * reqsegs,
   req->recv.match_info = match_info;
   req->recv.match_mask = match_mask;
 
-  omx__enqueue_request(&ep->ctxid[ctxid].recv_req_q, req);
-  omx__progress(ep);
+  omx__enqueue_recv_request(ep, ctxid, req);
+  omx__progress_and_flush(ep);
 
  ok:
   if (requestp) {
@@ -28,21 +28,53 @@
  * Request allocation
  */
 
-static inline void
+/*
+ * Requests are allocated from a per-endpoint cache of cache-line-aligned
+ * slots, preallocated when opening the endpoint (OMX_REQUEST_CACHE)
+ * and grown by chunks when empty. They are never given back to the
+ * memory allocator before the endpoint is closed.
+ * The cache is protected by the endpoint lock as any other request queue.
+ */
+
+#define OMX__REQUEST_SLOT_SIZE \
+  ((sizeof(union omx_request) + OMX__CACHELINE_SIZE - 1) & ~(OMX__CACHELINE_SIZE - 1))
+#define OMX__REQUEST_CACHE_GROW_NR 64
+
+extern omx_return_t
+omx__request_cache_grow(struct omx_endpoint *ep, unsigned nr);
+
+static inline omx_return_t
 omx__request_alloc_init(struct omx_endpoint *ep)
 {
 #ifdef OMX_LIB_DEBUG
   ep->req_alloc_nr = 0;
 #endif
+  ep->req_cache.free_list = NULL;
+  ep->req_cache.chunks = NULL;
+  ep->req_cache.chunks_nr = 0;
+
+  if (omx__globals.request_cache_nr)
+    return omx__request_cache_grow(ep, omx__globals.request_cache_nr);
+  return OMX_SUCCESS;
 }
 
 static inline void
 omx__request_alloc_exit(struct omx_endpoint *ep)
 {
+  void * chunk = ep->req_cache.chunks;
+
 #ifdef OMX_LIB_DEBUG
   if (ep->req_alloc_nr)
     omx__verbose_printf(ep, "%d requests were not freed on endpoint close\n", ep->req_alloc_nr);
 #endif
+
+  while (chunk) {
+    void * next = *(void **) chunk;
+    omx_free_ep(ep, chunk);
+    chunk = next;
+  }
+  ep->req_cache.chunks = NULL;
+  ep->req_cache.free_list = NULL;
 }
 
 static inline __malloc union omx_request *
@@ -50,14 +82,16 @@ omx__request_alloc(struct omx_endpoint *ep)
 {
   union omx_request * req;
 
-#ifdef OMX_LIB_DEBUG
-  req = omx_calloc_ep(ep, 1, sizeof(*req));
-#else
-  req = omx_malloc_ep(ep, sizeof(*req));
-#endif
-  if (unlikely(!req))
+  if (unlikely(!ep->req_cache.free_list)
+      && omx__request_cache_grow(ep, OMX__REQUEST_CACHE_GROW_NR) != OMX_SUCCESS)
     return NULL;
 
+  req = ep->req_cache.free_list;
+  ep->req_cache.free_list = (union omx_request *) req->generic.queue_elt.nxt;
+
+#ifdef OMX_LIB_DEBUG
+  memset(req, 0, sizeof(*req));
+#endif
   req->generic.state = 0;
   req->generic.status.code = OMX_SUCCESS;
 
@@ -70,7 +104,8 @@ omx__request_alloc(struct omx_endpoint *ep)
 static inline void
 omx__request_free(struct omx_endpoint *ep, union omx_request * req)
 {
-  omx_free_ep(ep, req);
+  req->generic.queue_elt.nxt = (struct list_head *) ep->req_cache.free_list;
+  ep->req_cache.free_list = req;
 #ifdef OMX_LIB_DEBUG
   ep->req_alloc_nr--;
 #endif
@@ -167,6 +202,105 @@ omx__dequeue_ctxid_request(struct list_head *head,
 #define omx__foreach_ctxid_request(head, req)	\
 list_for_each_entry(req, head, generic.ctxid_elt)
 
+/******************************
+ * Matching queues management
+ */
+
+/*
+ * Posted receives with a full match mask are hashed on their match_info,
+ * the others are kept in a per-ctxid ordered wildcard queue.
+ * Unexpected receives are always hashed on their match_info, in addition
+ * to the ordered unexpected queues that wildcard receives still have to walk.
+ * Hash buckets are ordered too, so the first entry with the right match_info
+ * is always the oldest one.
+ */
+
+#define OMX__MATCH_HASH_BITS 10
+#define OMX__MATCH_HASH_NR (1U << OMX__MATCH_HASH_BITS)
+#define OMX__MATCH_MASK_FULL ((uint64_t) -1)
+
+static inline __pure uint32_t
+omx__match_hash(uint64_t match_info)
+{
+  /* multiplicative hashing, the top bits are the most mixed ones */
+  return (uint32_t) ((match_info * 0x9e3779b97f4a7c15ULL) >> (64 - OMX__MATCH_HASH_BITS));
+}
+
+static inline void
+omx__enqueue_recv_request(struct omx_endpoint *ep, uint32_t ctxid,
+			  union omx_request *req)
+{
+  omx__enqueue_request(&ep->ctxid[ctxid].recv_req_q, req);
+
+  req->recv.post_seqnum = ep->next_recv_post_seqnum++;
+  if (likely(req->recv.match_mask == OMX__MATCH_MASK_FULL))
+    list_add_tail(&req->recv.match_elt, &ep->recv_match_hash[omx__match_hash(req->recv.match_info)]);
+  else
+    list_add_tail(&req->recv.match_elt, &ep->ctxid[ctxid].recv_wildcard_req_q);
+}
+
+static inline void
+omx___dequeue_recv_request(union omx_request *req)
+{
+  omx___dequeue_request(req);
+  list_del(&req->recv.match_elt);
+}
+
+static inline void
+omx__dequeue_recv_request(struct omx_endpoint *ep, uint32_t ctxid,
+			  union omx_request *req)
+{
+  omx__dequeue_request(&ep->ctxid[ctxid].recv_req_q, req);
+  list_del(&req->recv.match_elt);
+}
+
+static inline void
+omx__enqueue_unexp_request(struct omx_endpoint *ep, uint32_t ctxid,
+			   union omx_request *req)
+{
+  omx__enqueue_request(&ep->anyctxid.unexp_req_q, req);
+  if (unlikely(HAS_CTXIDS(ep)))
+    omx__enqueue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+  list_add_tail(&req->recv.match_elt,
+		&ep->unexp_match_hash[omx__match_hash(req->generic.status.match_info)]);
+}
+
+static inline void
+omx___dequeue_unexp_request(struct omx_endpoint *ep,
+			    union omx_request *req)
+{
+  omx___dequeue_request(req);
+  if (unlikely(HAS_CTXIDS(ep)))
+    omx___dequeue_ctxid_request(req);
+  list_del(&req->recv.match_elt);
+}
+
+static inline void
+omx__dequeue_unexp_request(struct omx_endpoint *ep, uint32_t ctxid,
+			   union omx_request *req)
+{
+  omx__dequeue_request(&ep->anyctxid.unexp_req_q, req);
+  if (unlikely(HAS_CTXIDS(ep)))
+    omx__dequeue_ctxid_request(&ep->ctxid[ctxid].unexp_req_q, req);
+  list_del(&req->recv.match_elt);
+}
+
+#define omx__foreach_match_request(head, req)	\
+list_for_each_entry(req, head, recv.match_elt)
+
+/* find the oldest unexpected receive with exactly this match_info */
+static inline union omx_request *
+omx__find_unexp_exact_request(const struct omx_endpoint *ep, uint64_t match_info)
+{
+  union omx_request *req;
+
+  omx__foreach_match_request(&ep->unexp_match_hash[omx__match_hash(match_info)], req)
+    if (likely(req->generic.status.match_info == match_info))
+      return req;
+
+  return NULL;
+}
+
 /********************************
  * Done request queue management
  */
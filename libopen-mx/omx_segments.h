@@ -110,6 +110,33 @@ omx_copy_from_segments(char *dst, const struct omx__req_segs *srcsegs, uint32_t
   }
 }
 
+/*
+ * copy segments into a contiguous buffer and return the CRC32C of the data,
+ * computed while it is still in the cache
+ */
+static inline uint32_t
+omx_copy_from_segments_crc32c(char *dst, const struct omx__req_segs *srcsegs, uint32_t length)
+{
+  uint32_t crc = 0;
+
+  omx__debug_assert(length <= srcsegs->total_length);
+
+  if (likely(srcsegs->nseg == 1)) {
+    crc = omx__crc32c_copy(dst, OMX_SEG_PTR(&srcsegs->single), length, crc);
+  } else {
+    struct omx_cmd_user_segment * cseg = &srcsegs->segs[0];
+    while (length) {
+      uint32_t chunk = cseg->len > length ? length : cseg->len;
+      crc = omx__crc32c_copy(dst, OMX_SEG_PTR(cseg), chunk, crc);
+      dst += chunk;
+      length -= chunk;
+      cseg++;
+    }
+  }
+
+  return crc;
+}
+
 static inline void
 omx_copy_to_segments(const struct omx__req_segs *dstsegs, const char *src, uint32_t length)
 {
@@ -284,6 +311,39 @@ omx_partial_copy_to_segments(const struct omx_endpoint *ep,
 }
 
 
+/*
+ * compute the folded CRC32C of each fragment of a segment request,
+ * for medium messages that are not copied by the library
+ */
+static inline void
+omx_crc32c_segments_frags(const struct omx__req_segs *reqsegs, uint32_t length,
+			  uint32_t frag_max, uint16_t *frag_checksums)
+{
+  const struct omx_cmd_user_segment *cseg = reqsegs->nseg == 1 ? &reqsegs->single : reqsegs->segs;
+  uint32_t cseg_offset = 0;
+
+  while (length) {
+    uint32_t frag_remaining = length > frag_max ? frag_max : length;
+    uint32_t crc = 0;
+
+    length -= frag_remaining;
+    while (frag_remaining) {
+      uint32_t chunk = cseg->len - cseg_offset;
+      if (chunk > frag_remaining)
+	chunk = frag_remaining;
+      crc = omx__crc32c(crc, OMX_SEG_PTR(cseg) + cseg_offset, chunk);
+      frag_remaining -= chunk;
+      cseg_offset += chunk;
+      if (cseg_offset == cseg->len) {
+	cseg++;
+	cseg_offset = 0;
+      }
+    }
+
+    *(frag_checksums++) = OMX__CRC32C_FOLD16(crc);
+  }
+}
+
 /*
  * compute the checksum of a segment request
  */
@@ -56,7 +56,7 @@ omx__send_complete(struct omx_endpoint *ep, union omx_request *req,
     omx_free_ep(ep, req->send.specific.small.copy);
     break;
   case OMX_REQUEST_TYPE_SEND_MEDIUMSQ:
-    omx__endpoint_sendq_map_put(ep, req->send.specific.mediumsq.frags_nr, req->send.specific.mediumsq.sendq_map_index);
+    omx__endpoint_sendq_map_put(ep, req->send.specific.mediumsq.frags_nr, req->send.specific.mediumsq.send_mediumsq_ioctl_param.sendq_index);
     break;
   default:
     break;
@@ -86,10 +86,10 @@ omx__post_isend_tiny(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   tiny_param->hdr.piggyack = ack_upto;
 
-  err = ioctl(ep->fd, OMX_CMD_SEND_TINY, tiny_param);
+  err = omx__submit_cmd(ep, SEND_TINY, tiny_param);
   if (unlikely(err < 0)) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
 				       OMX_SUCCESS,
@@ -98,7 +98,7 @@ omx__post_isend_tiny(struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 
   if (!err)
     omx__mark_partner_ack_sent(ep, partner);
@@ -153,6 +153,10 @@ omx__alloc_setup_isend_tiny(struct omx_endpoint *ep,
   if (omx__globals.debug_checksum)
     tiny_param->hdr.checksum = omx_checksum_segments(&req->send.segs, req->generic.status.msg_length);
 #endif
+  if (unlikely(omx__globals.checksum) && !tiny_param->hdr.shared)
+    tiny_param->hdr.checksum = OMX__CRC32C_FOLD16(omx_copy_from_segments_crc32c(tiny_param->data,
+										&req->send.segs, length));
+  else
     omx_copy_from_segments(tiny_param->data, &req->send.segs, length);
 
   if (unlikely(OMX__SEQNUM(partner->next_send_seq - partner->next_acked_send_seq) >= OMX__THROTTLING_OFFSET_MAX)) {
@@ -207,10 +211,10 @@ omx__post_isend_small(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   small_param->piggyack = ack_upto;
 
-  err = ioctl(ep->fd, OMX_CMD_SEND_SMALL, small_param);
+  err = omx__submit_cmd(ep, SEND_SMALL, small_param);
   if (unlikely(err < 0)) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
 				       OMX_SUCCESS,
@@ -219,7 +223,7 @@ omx__post_isend_small(struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 
   if (!err)
     omx__mark_partner_ack_sent(ep, partner);
@@ -275,13 +279,19 @@ omx__alloc_setup_isend_small(struct omx_endpoint *ep,
 #endif
 
   /*
-   * if single segment, use it for the first pio,
+   * if single segment and not batching commands, use it for the first pio,
    * else copy it in the contigous copy buffer first
+   * (a batched command is processed after the request is already done early)
    */
-  if (likely(req->send.segs.nseg == 1)) {
+  if (likely(req->send.segs.nseg == 1 && !ep->submitq_max)) {
     small_param->vaddr = (uintptr_t) OMX_SEG_PTR(&req->send.segs.single);
+    if (unlikely(omx__globals.checksum) && !small_param->shared)
+      small_param->checksum = OMX__CRC32C_FOLD16(omx__crc32c(0, OMX_SEG_PTR(&req->send.segs.single), length));
   } else {
-    omx_copy_from_segments(copy, &req->send.segs, length);
+    if (unlikely(omx__globals.checksum) && !small_param->shared)
+      small_param->checksum = OMX__CRC32C_FOLD16(omx_copy_from_segments_crc32c(copy, &req->send.segs, length));
+    else
+      omx_copy_from_segments(copy, &req->send.segs, length);
     small_param->vaddr = (uintptr_t) copy;
   }
 
@@ -298,7 +308,7 @@ omx__alloc_setup_isend_small(struct omx_endpoint *ep,
   }
 
   /* bufferize data for retransmission (if not done already) */
-  if (likely(req->send.segs.nseg == 1)) {
+  if (likely(req->send.segs.nseg == 1 && !ep->submitq_max)) {
     omx_copy_from_segments(copy, &req->send.segs, length);
     small_param->vaddr = (uintptr_t) copy;
   }
@@ -350,9 +360,10 @@ omx__post_isend_mediumva(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   medium_param->piggyack = ack_upto;
 
+  omx__flush_submitq(ep);
   err = ioctl(ep->fd, OMX_CMD_SEND_MEDIUMVA, medium_param);
   if (unlikely(err < 0)) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
@@ -362,7 +373,7 @@ omx__post_isend_mediumva(struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 
   if (!err)
     omx__mark_partner_ack_sent(ep, partner);
@@ -410,11 +421,20 @@ omx__alloc_setup_isend_mediumva(struct omx_endpoint *ep,
   medium_param->length = length;
   medium_param->nr_segments = req->send.segs.nseg;
   medium_param->segments = (uintptr_t) req->send.segs.segs;
+  medium_param->zerocopy = omx__globals.medium_zerocopy_min && length >= omx__globals.medium_zerocopy_min;
 
 #ifdef OMX_LIB_DEBUG
-  if (omx__globals.debug_checksum)
+  if (omx__globals.debug_checksum) {
+    unsigned i;
     medium_param->checksum = omx_checksum_segments(&req->send.segs, req->generic.status.msg_length);
+    for(i=0; i<OMX_MEDIUM_FRAGS_MAX; i++)
+      medium_param->frag_checksum[i] = medium_param->checksum;
+  }
 #endif
+  if (unlikely(omx__globals.checksum) && !medium_param->shared)
+    /* the data is not copied by the library, checksum the application buffer once */
+    omx_crc32c_segments_frags(&req->send.segs, length, OMX_MEDIUM_FRAG_LENGTH_MAX,
+			      medium_param->frag_checksum);
 
   if (unlikely(OMX__SEQNUM(partner->next_send_seq - partner->next_acked_send_seq) >= OMX__THROTTLING_OFFSET_MAX)) {
     /* throttling */
@@ -440,11 +460,11 @@ omx__post_isend_mediumsq(struct omx_endpoint *ep,
 			 struct omx__partner *partner,
 			 union omx_request *req)
 {
-  struct omx_cmd_send_mediumsq_frag * medium_param = &req->send.specific.mediumsq.send_mediumsq_frag_ioctl_param;
+  struct omx_cmd_send_mediumsq * medium_param = &req->send.specific.mediumsq.send_mediumsq_ioctl_param;
   omx__seqnum_t ack_upto = omx__get_partner_needed_ack(ep, partner);
   uint32_t length = req->generic.status.msg_length;
   uint32_t remaining = length;
-  omx_sendq_map_index_t * sendq_index = req->send.specific.mediumsq.sendq_map_index;
+  omx_sendq_map_index_t * sendq_index = medium_param->sendq_index;
   uint32_t frags_nr = req->send.specific.mediumsq.frags_nr;
   uint32_t frag_max = OMX_MEDIUM_FRAG_LENGTH_MAX;
   unsigned i;
@@ -453,115 +473,68 @@ omx__post_isend_mediumsq(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   medium_param->piggyack = ack_upto;
 
-  if (likely(req->send.segs.nseg == 1)) {
-    /* optimize the contigous send medium */
-    char * data = OMX_SEG_PTR(&req->send.segs.single);
-    uint32_t offset = 0;
-
-    for(i=0; i<frags_nr; i++) {
-      unsigned chunk = remaining > frag_max ? frag_max : remaining;
-      medium_param->frag_length = chunk;
-      medium_param->frag_seqnum = i;
-      medium_param->sendq_offset = sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT;
-      omx__debug_printf(MEDIUM, ep, "sending mediumsq seqnum %d length %d of total %ld\n",
-			i, chunk, (unsigned long) length);
-
-      /* copy the data in the sendq only once */
-      if (likely(!req->generic.resends))
-	memcpy(ep->sendq + (sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT), data + offset, chunk);
-
-      err = ioctl(ep->fd, OMX_CMD_SEND_MEDIUMSQ_FRAG, medium_param);
-      if (unlikely(err < 0)) {
-	/* finish copying frags if not done already */
-	if (likely(!req->generic.resends)) {
-	  unsigned j;
-	  for(j=i+1; j<frags_nr; i++) {
-	    unsigned chunk = remaining > frag_max ? frag_max : remaining;
-	    memcpy(ep->sendq + (sendq_index[j] << OMX_SENDQ_ENTRY_SHIFT), data + offset, chunk);
-	    remaining -= chunk;
-	    offset += chunk;
-	  }
-	}
-	goto err;
+  /* copy the data in the sendq only once, and checksum each frag while copying it */
+  if (likely(!req->generic.resends)) {
+    int checksum = unlikely(omx__globals.checksum) && !medium_param->shared;
+
+    if (likely(req->send.segs.nseg == 1)) {
+      /* optimize the contigous send medium */
+      char * data = OMX_SEG_PTR(&req->send.segs.single);
+
+      for(i=0; i<frags_nr; i++) {
+	unsigned chunk = remaining > frag_max ? frag_max : remaining;
+	char * sendq_data = ep->sendq + (sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT);
+	if (checksum)
+	  medium_param->frag_checksum[i] = OMX__CRC32C_FOLD16(omx__crc32c_copy(sendq_data, data, chunk, 0));
+	else
+	  memcpy(sendq_data, data, chunk);
+	remaining -= chunk;
+	data += chunk;
       }
 
-      remaining -= chunk;
-      offset += chunk;
-    }
+    } else {
+      /* initialize the state to the beginning */
+      struct omx_segscan_state state = { .seg = &req->send.segs.segs[0], .offset = 0 };
 
-  } else {
-    /* initialize the state to the beginning */
-    struct omx_segscan_state state = { .seg = &req->send.segs.segs[0], .offset = 0 };
-
-    for(i=0; i<frags_nr; i++) {
-      unsigned chunk = remaining > frag_max ? frag_max : remaining;
-      medium_param->frag_length = chunk;
-      medium_param->frag_seqnum = i;
-      medium_param->sendq_offset = sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT;
-      omx__debug_printf(MEDIUM, ep, "sending mediumsq seqnum %d length %d of total %ld\n",
-			i, chunk, (unsigned long) length);
-
-      /* copy the data in the sendq only once */
-      if (likely(!req->generic.resends))
-	omx_continue_partial_copy_from_segments(ep, ep->sendq + (sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT),
+      for(i=0; i<frags_nr; i++) {
+	unsigned chunk = remaining > frag_max ? frag_max : remaining;
+	char * sendq_data = ep->sendq + (sendq_index[i] << OMX_SENDQ_ENTRY_SHIFT);
+	omx_continue_partial_copy_from_segments(ep, sendq_data,
 						&req->send.segs, chunk,
 						&state);
-
-      err = ioctl(ep->fd, OMX_CMD_SEND_MEDIUMSQ_FRAG, medium_param);
-      if (unlikely(err < 0)) {
-	/* finish copying frags if not done already */
-	if (likely(!req->generic.resends)) {
-	  unsigned j;
-	  for(j=i+1; j<frags_nr; i++) {
-	    unsigned chunk = remaining > frag_max ? frag_max : remaining;
-	    omx_continue_partial_copy_from_segments(ep, ep->sendq + (sendq_index[j] << OMX_SENDQ_ENTRY_SHIFT),
-						    &req->send.segs, chunk,
-						    &state);
-	    remaining -= chunk;
-	  }
-	}
-	goto err;
+	if (checksum)
+	  /* the frag was just copied, it is still in the cache */
+	  medium_param->frag_checksum[i] = OMX__CRC32C_FOLD16(omx__crc32c(0, sendq_data, chunk));
+	remaining -= chunk;
       }
-
-      remaining -= chunk;
     }
   }
 
-  req->send.specific.mediumsq.frags_pending_nr = frags_nr;
+  omx__debug_printf(MEDIUM, ep, "sending mediumsq length %ld as %d frags\n",
+		    (unsigned long) length, (unsigned) frags_nr);
+
+  /* post all frags at once, the driver reports a single done event */
+  omx__flush_submitq(ep);
+  err = ioctl(ep->fd, OMX_CMD_SEND_MEDIUMSQ, medium_param);
+  if (unlikely(err < 0)) {
+    /* no frags were posted, keep the request as NEED_ACK and let retransmission occur later */
+    omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
+				       OMX_SUCCESS,
+				       "send mediumsq message");
+    ep->avail_exp_events++;
+    return;
+  }
 
- ok:
+  req->send.specific.mediumsq.frags_pending_nr = 1;
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
   req->generic.state |= OMX_REQUEST_STATE_DRIVER_MEDIUMSQ_SENDING;
 
-  /* at least one frag was posted, the ack has been sent for sure */
+  /* the frags were posted, the ack has been sent for sure */
   omx__mark_partner_ack_sent(ep, partner);
-
-  return;
-
- err:
-  /* assume some frags got lost and let retransmission take care of it later */
-  omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
-				     OMX_SUCCESS,
-				     "send mediumsq message fragment");
-
-  /* update the number of fragment that we actually submitted */
-  req->send.specific.mediumsq.frags_pending_nr = i;
-  ep->avail_exp_events += frags_nr - i;
-  if (i)
-    /*
-     * some frags were posted, mark the request as DRIVER_MEDIUM_SENDING
-     * and let retransmission wait for send done events first
-     */
-    goto ok;
-
-  /*
-   * no frags were posted, keep the request as NEED_ACK
-   * and let retransmission occur later
-   */
 }
 
 static INLINE void
@@ -569,7 +542,7 @@ omx__setup_isend_mediumsq(struct omx_endpoint *ep,
 			  struct omx__partner * partner,
 			  union omx_request *req)
 {
-  struct omx_cmd_send_mediumsq_frag * medium_param = &req->send.specific.mediumsq.send_mediumsq_frag_ioctl_param;
+  struct omx_cmd_send_mediumsq * medium_param = &req->send.specific.mediumsq.send_mediumsq_ioctl_param;
   uint64_t match_info = req->generic.status.match_info;
   uint32_t ctxid = CTXID_FROM_MATCHING(ep, match_info);
   omx__seqnum_t seqnum;
@@ -600,11 +573,10 @@ omx__alloc_setup_isend_mediumsq(struct omx_endpoint *ep,
 				struct omx__partner *partner,
 				union omx_request *req)
 {
-  struct omx_cmd_send_mediumsq_frag * medium_param = &req->send.specific.mediumsq.send_mediumsq_frag_ioctl_param;
+  struct omx_cmd_send_mediumsq * medium_param = &req->send.specific.mediumsq.send_mediumsq_ioctl_param;
   uint32_t length = req->generic.status.msg_length;
-  omx_sendq_map_index_t * sendq_index = req->send.specific.mediumsq.sendq_map_index;
+  omx_sendq_map_index_t * sendq_index = medium_param->sendq_index;
   int res = req->generic.missing_resources;
-  uint32_t frags_nr = req->send.specific.mediumsq.frags_nr;
 
   if (likely(res & OMX_REQUEST_RESOURCE_EXP_EVENT))
     goto need_exp_events;
@@ -613,9 +585,10 @@ omx__alloc_setup_isend_mediumsq(struct omx_endpoint *ep,
   omx__abort(ep, "Unexpected missing resources %x for mediumsq send request\n", res);
 
  need_exp_events:
-  if (unlikely(ep->avail_exp_events < frags_nr))
+  /* the whole message is reported by a single done event */
+  if (unlikely(ep->avail_exp_events < 1))
     return OMX_INTERNAL_MISSING_RESOURCES;
-  ep->avail_exp_events -= frags_nr;
+  ep->avail_exp_events--;
   req->generic.missing_resources &= ~OMX_REQUEST_RESOURCE_EXP_EVENT;
 
  need_sendq_map_slot:
@@ -632,11 +605,16 @@ omx__alloc_setup_isend_mediumsq(struct omx_endpoint *ep,
   medium_param->frag_pipeline = req->send.specific.mediumsq.frag_pipeline;
 #endif
   medium_param->msg_length = length;
+  medium_param->frags_nr = req->send.specific.mediumsq.frags_nr;
   medium_param->session_id = partner->true_session_id;
 
 #ifdef OMX_LIB_DEBUG
-  if (omx__globals.debug_checksum)
-    medium_param->checksum = omx_checksum_segments(&req->send.segs, req->generic.status.msg_length);
+  if (omx__globals.debug_checksum) {
+    uint16_t checksum = omx_checksum_segments(&req->send.segs, req->generic.status.msg_length);
+    unsigned i;
+    for(i=0; i<OMX_MEDIUM_FRAGS_MAX; i++)
+      medium_param->frag_checksum[i] = checksum;
+  }
 #endif
 
   if (unlikely(OMX__SEQNUM(partner->next_send_seq - partner->next_acked_send_seq) >= OMX__THROTTLING_OFFSET_MAX)) {
@@ -669,6 +647,10 @@ omx__submit_isend_medium(struct omx_endpoint *ep,
   /* the default max medium length should fit in the maximal number of frags */
   BUILD_BUG_ON(OMX__MX_MEDIUM_MSG_LENGTH_MAX > OMX_MEDIUM_FRAG_LENGTH_MAX * OMX_MEDIUM_FRAGS_MAX);
 
+  if (omx__globals.medium_zerocopy_min && length >= omx__globals.medium_zerocopy_min)
+    /* let the driver send from the application pages, the request will complete once acked */
+    use_sendq = 0;
+
   if (use_sendq) {
     int frag_max = OMX_MEDIUM_FRAG_LENGTH_MAX;
     int frags_nr;
@@ -724,9 +706,10 @@ omx__post_isend_rndv(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   rndv_param->piggyack = ack_upto;
 
+  omx__flush_submitq(ep);
   err = ioctl(ep->fd, OMX_CMD_SEND_RNDV, rndv_param);
   if (unlikely(err < 0)) {
     omx_return_t ret;
@@ -740,7 +723,7 @@ omx__post_isend_rndv(struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 
   if (!err)
     omx__mark_partner_ack_sent(ep, partner);
@@ -795,7 +778,7 @@ omx__alloc_setup_isend_large(struct omx_endpoint *ep,
   ep->large_sends_avail_nr--;
 
  need_large_region:
-  ret = omx__get_region(ep, &req->send.segs, &region, req);
+  ret = omx__get_region(ep, &req->send.segs, &region, NULL, req);
   if (unlikely(ret != OMX_SUCCESS)) {
     omx__debug_assert(ret == OMX_INTERNAL_MISSING_RESOURCES);
     return ret;
@@ -879,10 +862,10 @@ omx__post_notify(struct omx_endpoint *ep,
   omx__debug_printf(ACK, ep, "piggy acking back to partner up to %d (#%d) at jiffies %lld\n",
 		    (unsigned int) OMX__SEQNUM(ack_upto - 1),
 		    (unsigned int) OMX__SESNUM_SHIFTED(ack_upto - 1),
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
   notify_param->piggyack = ack_upto;
 
-  err = ioctl(ep->fd, OMX_CMD_SEND_NOTIFY, notify_param);
+  err = omx__submit_cmd(ep, SEND_NOTIFY, notify_param);
   if (unlikely(err < 0)) {
     omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
 				       OMX_SUCCESS,
@@ -891,7 +874,7 @@ omx__post_notify(struct omx_endpoint *ep,
   }
 
   req->generic.resends++;
-  req->generic.last_send_jiffies = omx__driver_desc->jiffies;
+  req->generic.last_send_jiffies = omx__now();
 
   if (!err)
     omx__mark_partner_ack_sent(ep, partner);
@@ -1010,7 +993,7 @@ omx__isend_req(struct omx_endpoint *ep, struct omx__partner *partner,
   }
 
   /* progress a little bit */
-  omx__progress(ep);
+  omx__progress_and_flush(ep);
 
  return OMX_SUCCESS;
 }
@@ -1124,7 +1107,7 @@ omx__issend_req(struct omx_endpoint *ep, struct omx__partner *partner,
   }
 
   /* progress a little bit */
-  omx__progress(ep);
+  omx__progress_and_flush(ep);
 }
 
 /* API omx_issend */
@@ -1336,7 +1319,7 @@ omx__release_unsent_send_resources(struct omx_endpoint *ep, union omx_request *r
 
   case OMX_REQUEST_TYPE_SEND_MEDIUMSQ:
     if (!(res & OMX_REQUEST_RESOURCE_EXP_EVENT))
-      ep->avail_exp_events += req->send.specific.mediumsq.frags_nr;
+      ep->avail_exp_events++;
 
     /* make sure we don't release garbage sendq map slots */
     if (res & OMX_REQUEST_RESOURCE_SENDQ_SLOT)
@@ -1360,7 +1343,8 @@ omx__release_unsent_send_resources(struct omx_endpoint *ep, union omx_request *r
       if (!(res & OMX_REQUEST_RESOURCE_EXP_EVENT))
 	ep->avail_exp_events++;
 
-      if (!(res & OMX_REQUEST_RESOURCE_LARGE_REGION))
+      if (!(res & OMX_REQUEST_RESOURCE_LARGE_REGION)
+	  && req->recv.specific.large.local_region)
 	omx__put_region(ep, req->recv.specific.large.local_region, NULL);
 
       /* nothing to do for OMX_REQUEST_RESOURCE_PULL_HANDLE */
@@ -1417,7 +1401,7 @@ void
 omx__process_resend_requests(struct omx_endpoint *ep)
 {
   union omx_request *req, *next;
-  uint64_t now = omx__driver_desc->jiffies;
+  uint64_t now = omx__now();
   struct list_head tmp_req_q;
 
   list_head_init(&tmp_req_q);
@@ -1425,10 +1409,14 @@ omx__process_resend_requests(struct omx_endpoint *ep)
   /* resend the first requests from the non_acked queue */
  start_resending:
   omx__foreach_request_safe(&ep->non_acked_req_q, req, next) {
-    if (now - req->generic.last_send_jiffies < omx__globals.resend_delay_jiffies)
+    if (now - req->generic.last_send_jiffies < omx__globals.resend_delay_min_jiffies)
       /* the remaining ones are more recent, no need to resend them yet */
       goto done_resending;
 
+    if (now - req->generic.last_send_jiffies < omx__request_resend_delay(req))
+      /* the resend delay of this partner is not over yet, others may be */
+      continue;
+
     /* check before dequeueing so that omx__partner_cleanup() is called with queues in a coherent state */
     if (req->generic.resends > req->generic.resends_max) {
       /* Disconnect the peer (and drop the requests) */
@@ -1462,14 +1450,13 @@ omx__process_resend_requests(struct omx_endpoint *ep)
       omx__debug_printf(SEND, ep, "reposting resend mediumsq request %p seqnum %d (#%d)\n", req,
 			(unsigned) OMX__SEQNUM(req->generic.send_seqnum),
 			(unsigned) OMX__SESNUM_SHIFTED(req->generic.send_seqnum));
-      if (ep->avail_exp_events < req->send.specific.mediumsq.frags_nr) {
-	/* not enough expected events available, stop resending for now, and try again later */
-	omx__debug_printf(SEND, ep, "stopping resending for now, only %d exp events available to resend %d mediumsq frags\n",
-			  ep->avail_exp_events, req->send.specific.mediumsq.frags_nr);
+      if (ep->avail_exp_events < 1) {
+	/* no expected event available, stop resending for now, and try again later */
+	omx__debug_printf(SEND, ep, "stopping resending for now, no exp events available to resend mediumsq\n");
 	omx__requeue_request(&ep->non_acked_req_q, req);
 	goto done_resending;
       }
-      ep->avail_exp_events -= req->send.specific.mediumsq.frags_nr;
+      ep->avail_exp_events--;
       omx__post_isend_mediumsq(ep, req->generic.partner, req);
       break;
     case OMX_REQUEST_TYPE_SEND_MEDIUMVA:
@@ -32,6 +32,70 @@ struct omx__sleeper {
  * Common sleeping routine
  */
 
+/*
+ * The completion of pulls on our rails does not wake us up,
+ * sleep on a rail where some are pending instead, with a short timeout
+ * so that our own events are not delayed much.
+ * Wakeups are also sent to these rails, see omx__wakeup().
+ */
+static omx_return_t
+omx__wait_rail(struct omx_endpoint *ep,
+	       struct omx_cmd_wait_event *wait_param,
+	       const char *caller)
+{
+  struct omx_cmd_wait_event rail_wait_param;
+  struct omx_endpoint *rail = NULL;
+  uint64_t delay = omx__driver_desc->hz / 1000; /* about 1ms */
+  unsigned i;
+  int err;
+
+  for(i=0; i<ep->rails_nr; i++)
+    if (ep->rails[i]->rail_pulls_nr) {
+      rail = ep->rails[i];
+      break;
+    }
+  omx__debug_assert(rail);
+
+  if (!delay)
+    delay = 1;
+  rail_wait_param.jiffies_expire = omx__now() + delay;
+  if (rail_wait_param.jiffies_expire > wait_param->jiffies_expire)
+    rail_wait_param.jiffies_expire = wait_param->jiffies_expire;
+  rail_wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
+  rail_wait_param.next_exp_event_index = rail->next_exp_event_index;
+  rail_wait_param.next_unexp_event_index = rail->next_unexp_event_index;
+  rail_wait_param.user_event_index = rail->desc->user_event_index;
+
+  omx__debug_printf(WAIT, ep, "%s going to sleep on rail board #%d at %lld until %lld\n",
+		    caller, (unsigned) rail->board_index,
+		    (unsigned long long) omx__now(),
+		    (unsigned long long) rail_wait_param.jiffies_expire);
+
+  /* make sure all our pending commands are submitted before sleeping */
+  omx__flush_submitq(ep);
+
+  /* release the lock while sleeping */
+  OMX__ENDPOINT_UNLOCK(ep);
+  err = ioctl(rail->fd, OMX_CMD_WAIT_EVENT, &rail_wait_param);
+  OMX__ENDPOINT_LOCK(ep);
+
+  OMX_VALGRIND_MEMORY_MAKE_READABLE(&rail_wait_param, sizeof(rail_wait_param));
+
+  if (unlikely(err < 0))
+      omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
+					 OMX_SUCCESS,
+					 "wait event in the driver");
+
+  /* report wakeups and signals to our caller, but not the short rail timeout */
+  if (rail_wait_param.status == OMX_CMD_WAIT_EVENT_STATUS_WAKEUP
+      || rail_wait_param.status == OMX_CMD_WAIT_EVENT_STATUS_INTR)
+    wait_param->status = rail_wait_param.status;
+  else
+    wait_param->status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
+
+  return OMX_SUCCESS;
+}
+
 static omx_return_t
 omx__wait(struct omx_endpoint *ep,
 	  struct omx_cmd_wait_event *wait_param,
@@ -40,20 +104,23 @@ omx__wait(struct omx_endpoint *ep,
 {
   int err;
 
-  if (omx__driver_desc->jiffies >= wait_param->jiffies_expire
+  if (omx__now() >= wait_param->jiffies_expire
       || wait_param->status == OMX_CMD_WAIT_EVENT_STATUS_TIMEOUT
       || wait_param->status == OMX_CMD_WAIT_EVENT_STATUS_WAKEUP
       || (omx__globals.waitintr && wait_param->status == OMX_CMD_WAIT_EVENT_STATUS_INTR))
     /* this is not an error in most cases, let the caller handle it if needed */
     return OMX_TIMEOUT;
 
+  if (unlikely(ep->rail_pulls_nr))
+    return omx__wait_rail(ep, wait_param, caller);
+
   if (ms_timeout == OMX_TIMEOUT_INFINITE)
     omx__debug_printf(WAIT, ep, "%s going to sleep at %lld for ever\n",
-		      caller, (unsigned long long) omx__driver_desc->jiffies);
+		      caller, (unsigned long long) omx__now());
   else
     omx__debug_printf(WAIT, ep, "%s going to sleep at %lld until %lld\n",
 		      caller,
-		      (unsigned long long) omx__driver_desc->jiffies,
+		      (unsigned long long) omx__now(),
 		      (unsigned long long) wait_param->jiffies_expire);
 
   BUILD_BUG_ON(sizeof(wait_param->next_exp_event_index) != sizeof(ep->next_exp_event_index));
@@ -64,6 +131,9 @@ omx__wait(struct omx_endpoint *ep,
   wait_param->user_event_index = ep->desc->user_event_index;
   omx__prepare_progress_wakeup(ep);
 
+  /* make sure all our pending commands are submitted before sleeping */
+  omx__flush_submitq(ep);
+
   /* release the lock while sleeping */
   OMX__ENDPOINT_UNLOCK(ep);
   err = ioctl(ep->fd, OMX_CMD_WAIT_EVENT, wait_param);
@@ -73,7 +143,7 @@ omx__wait(struct omx_endpoint *ep,
 
 #ifdef OMX_LIB_DEBUG
   {
-    uint64_t now = omx__driver_desc->jiffies;
+    uint64_t now = omx__now();
     if (ms_timeout != OMX_TIMEOUT_INFINITE && now > wait_param->jiffies_expire + 2) {
       /* tolerate 2 jiffies of timeshift */
       omx__verbose_printf(ep, "Sleep for %ld ms actually slept until jiffies %lld instead of %lld\n",
@@ -86,7 +156,7 @@ omx__wait(struct omx_endpoint *ep,
 
   omx__debug_printf(WAIT, ep, "%s woken up at %lld\n",
 		    caller,
-		    (unsigned long long) omx__driver_desc->jiffies);
+		    (unsigned long long) omx__now());
 
   if (unlikely(err < 0))
       omx__ioctl_errno_to_return_checked(OMX_NO_SYSTEM_RESOURCES,
@@ -100,6 +170,37 @@ omx__wait(struct omx_endpoint *ep,
   return OMX_SUCCESS;
 }
 
+/*
+ * Take the endpoint lock in a non-blocking routine.
+ * If another thread already holds it, it is most likely progressing
+ * the endpoint on our behalf, so let the caller report that nothing
+ * is ready yet instead of serializing behind it.
+ * Returns 0 if the lock was not taken.
+ */
+static INLINE int
+omx__test_lock(struct omx_endpoint *ep)
+{
+  if (!omx__globals.test_trylock) {
+    OMX__ENDPOINT_LOCK(ep);
+    return 1;
+  }
+
+  return OMX__ENDPOINT_TRYLOCK(ep);
+}
+
+/*
+ * Lock-free look at one of the global anyctxid queues, to check whether
+ * something may be reported before giving up when omx__test_lock() fails.
+ * The other thread may loop while holding the lock (waitspin), so we would
+ * never report completed requests otherwise.
+ * A wrong answer is harmless: the queue is checked again under the lock.
+ */
+static INLINE int
+omx__test_queue_maybe_nonempty(struct list_head *head)
+{
+  return ((volatile struct list_head *) head)->nxt != head;
+}
+
 /*********************************************
  * Test/Wait a single request and complete it
  */
@@ -145,9 +246,14 @@ omx_test(struct omx_endpoint *ep, union omx_request **requestp,
   omx_return_t ret = OMX_SUCCESS;
   uint32_t result = 0;
 
-  OMX__ENDPOINT_LOCK(ep);
+  if (unlikely(!omx__test_lock(ep))) {
+    /* only wait for the lock if the other thread completed our request */
+    if (!(((volatile union omx_request *) *requestp)->generic.state & OMX_REQUEST_STATE_DONE))
+      goto out;
+    OMX__ENDPOINT_LOCK(ep);
+  }
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (unlikely(ret != OMX_SUCCESS))
     goto out_with_lock;
 
@@ -155,6 +261,7 @@ omx_test(struct omx_endpoint *ep, union omx_request **requestp,
 
  out_with_lock:
   OMX__ENDPOINT_UNLOCK(ep);
+ out:
   *resultp = result;
   return ret;
 }
@@ -178,14 +285,14 @@ omx_wait(struct omx_endpoint *ep, union omx_request **requestp,
   if (omx__globals.waitspin) {
     /* busy spin instead of sleeping */
     while (!sleeper.need_wakeup) {
-      ret = omx__progress(ep);
+      ret = omx__progress_and_flush(ep);
       if (unlikely(ret != OMX_SUCCESS))
 	goto out_with_lock;
 
       if ((result = omx__test_common(ep, requestp, status)) != 0)
 	goto out_with_lock;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire)
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire)
 	goto out_with_lock;
 
       /* release the lock a bit */
@@ -200,7 +307,7 @@ omx_wait(struct omx_endpoint *ep, union omx_request **requestp,
   wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
 
   while (1) {
-    ret = omx__progress(ep);
+    ret = omx__progress_and_flush(ep);
     if (unlikely(ret != OMX_SUCCESS))
       goto out_with_lock;
 
@@ -310,9 +417,14 @@ omx_test_any(struct omx_endpoint *ep,
     goto out;
   }
 
-  OMX__ENDPOINT_LOCK(ep);
+  if (unlikely(!omx__test_lock(ep))) {
+    /* only wait for the lock if the other thread completed some requests */
+    if (!omx__test_queue_maybe_nonempty(&ep->anyctxid.done_req_q))
+      goto out;
+    OMX__ENDPOINT_LOCK(ep);
+  }
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (unlikely(ret != OMX_SUCCESS))
     goto out_with_lock;
 
@@ -352,14 +464,14 @@ omx_wait_any(struct omx_endpoint *ep,
   if (omx__globals.waitspin) {
     /* busy spin instead of sleeping */
     while (!sleeper.need_wakeup) {
-      ret = omx__progress(ep);
+      ret = omx__progress_and_flush(ep);
       if (unlikely(ret != OMX_SUCCESS))
 	goto out_with_lock;
 
       if ((result = omx__test_any_common(ep, match_info, match_mask, status)) != 0)
 	goto out_with_lock;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire)
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire)
 	goto out_with_lock;
 
       /* release the lock a bit */
@@ -374,7 +486,7 @@ omx_wait_any(struct omx_endpoint *ep,
   wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
 
   while (1) {
-    ret = omx__progress(ep);
+    ret = omx__progress_and_flush(ep);
     if (unlikely(ret != OMX_SUCCESS))
       goto out_with_lock;
 
@@ -420,9 +532,14 @@ omx_ipeek(struct omx_endpoint *ep, union omx_request **requestp,
   omx_return_t ret = OMX_SUCCESS;
   uint32_t result = 0;
 
-  OMX__ENDPOINT_LOCK(ep);
+  if (unlikely(!omx__test_lock(ep))) {
+    /* only wait for the lock if the other thread completed some requests */
+    if (!omx__test_queue_maybe_nonempty(&ep->anyctxid.done_req_q))
+      goto out;
+    OMX__ENDPOINT_LOCK(ep);
+  }
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (unlikely(ret != OMX_SUCCESS))
     goto out_with_lock;
 
@@ -430,6 +547,7 @@ omx_ipeek(struct omx_endpoint *ep, union omx_request **requestp,
 
  out_with_lock:
   OMX__ENDPOINT_UNLOCK(ep);
+ out:
   *resultp = result;
   return ret;
 }
@@ -452,14 +570,14 @@ omx_peek(struct omx_endpoint *ep, union omx_request **requestp,
   if (omx__globals.waitspin) {
     /* busy spin instead of sleeping */
     while (!sleeper.need_wakeup) {
-      ret = omx__progress(ep);
+      ret = omx__progress_and_flush(ep);
       if (unlikely(ret != OMX_SUCCESS))
 	goto out_with_lock;
 
       if ((result = omx__ipeek_common(ep, requestp)) != 0)
 	goto out_with_lock;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire)
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire)
 	goto out_with_lock;
 
       /* release the lock a bit */
@@ -474,7 +592,7 @@ omx_peek(struct omx_endpoint *ep, union omx_request **requestp,
   wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
 
   while (1) {
-    ret = omx__progress(ep);
+    ret = omx__progress_and_flush(ep);
     if (unlikely(ret != OMX_SUCCESS))
       goto out_with_lock;
 
@@ -511,7 +629,7 @@ omx_ibuffered(struct omx_endpoint *ep, union omx_request **requestp,
 
   OMX__ENDPOINT_LOCK(ep);
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (unlikely(ret != OMX_SUCCESS))
     goto out_with_lock;
 
@@ -568,7 +686,15 @@ omx__iprobe_common(const struct omx_endpoint *ep,
 {
   union omx_request * req;
 
-  if (likely(!HAS_CTXIDS(ep) || MATCHING_CROSS_CTXIDS(ep, match_mask))) {
+  if (likely(match_mask == OMX__MATCH_MASK_FULL)) {
+    /* exact matching, use the unexpected matching hash */
+    req = omx__find_unexp_exact_request(ep, match_info);
+    if (req) {
+      memcpy(status, &req->generic.status, sizeof(*status));
+      return 1;
+    }
+
+  } else if (likely(!HAS_CTXIDS(ep) || MATCHING_CROSS_CTXIDS(ep, match_mask))) {
     /* no ctxids, or matching across multiple ctxids, so use the anyctxid queue */
     omx__foreach_request(&ep->anyctxid.unexp_req_q, req) {
       if (likely((req->generic.status.match_info & match_mask) == match_info)) {
@@ -606,9 +732,14 @@ omx_iprobe(struct omx_endpoint *ep, uint64_t match_info, uint64_t match_mask,
     goto out;
   }
 
-  OMX__ENDPOINT_LOCK(ep);
+  if (unlikely(!omx__test_lock(ep))) {
+    /* only wait for the lock if the other thread received some unexpected messages */
+    if (!omx__test_queue_maybe_nonempty(&ep->anyctxid.unexp_req_q))
+      goto out;
+    OMX__ENDPOINT_LOCK(ep);
+  }
 
-  ret = omx__progress(ep);
+  ret = omx__progress_and_flush(ep);
   if (unlikely(ret != OMX_SUCCESS))
     goto out_with_lock;
 
@@ -648,14 +779,14 @@ omx_probe(struct omx_endpoint *ep,
   if (omx__globals.waitspin) {
     /* busy spin instead of sleeping */
     while (!sleeper.need_wakeup) {
-      ret = omx__progress(ep);
+      ret = omx__progress_and_flush(ep);
       if (unlikely(ret != OMX_SUCCESS))
 	goto out_with_lock;
 
       if ((result = omx__iprobe_common(ep, match_info, match_mask, status)) != 0)
 	goto out_with_lock;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire)
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire)
 	goto out_with_lock;
 
       /* release the lock a bit */
@@ -670,7 +801,7 @@ omx_probe(struct omx_endpoint *ep,
   wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
 
   while (1) {
-    ret = omx__progress(ep);
+    ret = omx__progress_and_flush(ep);
     if (unlikely(ret != OMX_SUCCESS))
       goto out_with_lock;
 
@@ -719,7 +850,7 @@ omx__connect_wait(omx_endpoint_t ep, union omx_request * req, uint32_t ms_timeou
       if (req->generic.state == (OMX_REQUEST_STATE_DONE|OMX_REQUEST_STATE_INTERNAL))
 	goto out;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire) {
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire) {
 	/* let the caller handle errors */
 	ret = OMX_TIMEOUT;
 	goto out;
@@ -734,14 +865,14 @@ omx__connect_wait(omx_endpoint_t ep, union omx_request * req, uint32_t ms_timeou
   if (omx__globals.waitspin) {
     /* busy spin instead of sleeping */
     while (!sleeper.need_wakeup) {
-      ret = omx__progress(ep);
+      ret = omx__progress_and_flush(ep);
       if (unlikely(ret != OMX_SUCCESS))
 	goto out;
 
       if (req->generic.state == (OMX_REQUEST_STATE_DONE|OMX_REQUEST_STATE_INTERNAL))
 	goto out;
 
-      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__driver_desc->jiffies >= jiffies_expire) {
+      if (ms_timeout != OMX_TIMEOUT_INFINITE && omx__now() >= jiffies_expire) {
 	/* let the caller handle errors */
 	ret = OMX_TIMEOUT;
 	goto out;
@@ -761,7 +892,7 @@ omx__connect_wait(omx_endpoint_t ep, union omx_request * req, uint32_t ms_timeou
   wait_param.status = OMX_CMD_WAIT_EVENT_STATUS_EVENT;
 
   while (1) {
-    ret = omx__progress(ep);
+    ret = omx__progress_and_flush(ep);
     if (unlikely(ret != OMX_SUCCESS))
       goto out;
 
@@ -796,6 +927,7 @@ omx__wakeup(struct omx_endpoint *ep, uint32_t status)
   } else if (!list_empty(&ep->sleepers)) {
     /* enter the driver to wakeup sleeper if any */
     struct omx_cmd_wakeup wakeup;
+    unsigned i;
     int err;
 
     wakeup.status = status;
@@ -804,6 +936,11 @@ omx__wakeup(struct omx_endpoint *ep, uint32_t status)
     if (unlikely(err < 0))
       omx__ioctl_errno_to_return_checked(OMX_SUCCESS,
 					 "wakeup sleepers in the driver");
+
+    /* sleepers may be waiting on our rails, see omx__wait_rail() */
+    for(i=0; i<ep->rails_nr; i++)
+      if (ep->rails[i]->rail_pulls_nr)
+	ioctl(ep->rails[i]->fd, OMX_CMD_WAKEUP, &wakeup);
   }
 
   return OMX_SUCCESS;
@@ -59,6 +59,16 @@ struct omx__sendq_map {
   } * array;
 };
 
+/* node of the regcache interval tree, one per segment of each cached region */
+struct omx__regcache_node {
+  struct omx__regcache_node *left, *right;
+  unsigned long begin, end; /* virtual address range of the segment */
+  unsigned long max_end; /* highest end in the subtree */
+  int height;
+  uint32_t iseg; /* index of the segment in the region */
+  struct omx__large_region *region;
+};
+
 struct omx__large_region_map {
   int first_free;
   int nr_free;
@@ -66,11 +76,13 @@ struct omx__large_region_map {
     int next_free;
     struct omx__large_region {
       struct list_head reg_elt; /* linked into the endpoint reg_list or reg_vect_list */
-      struct list_head reg_unused_elt; /* linked into the endpoint reg_unused_list if contigous, unused and cached */
+      struct list_head reg_unused_elt; /* linked into the endpoint reg_unused_list if unused and cached */
       int use_count;
       uint8_t id;
       uint8_t last_seqnum;
       struct omx__req_segs segs;
+      struct omx__regcache_node *nodes; /* one per segment in the endpoint regcache tree, NULL if not cached */
+      struct omx__regcache_node single_node; /* avoid allocating nodes for contigous regions */
       void * reserver; /* single object that can be assigned (used for rndv/notify), while multiple pull may be pending */
     } region;
   } * array;
@@ -111,6 +123,9 @@ typedef uint16_t omx__seqnum_t;
  */
 #define OMX__THROTTLING_OFFSET_MAX (OMX__SEQNUM_MASK/2)
 
+/* maximal number of additional boards that an endpoint may stripe large pulls across */
+#define OMX__RAILS_MAX 4
+
 enum omx__partner_localization {
   OMX__PARTNER_LOCALIZATION_LOCAL,
   OMX__PARTNER_LOCALIZATION_REMOTE,
@@ -140,10 +155,23 @@ struct omx__partner {
   /* seq num of the last connect request to this partner */
   uint8_t connect_seqnum;
 
+  /* the same peer endpoint on each rail, set once the rail connect was started */
+  struct omx__partner * rail_partners[OMX__RAILS_MAX];
+  uint8_t rails_missing; /* mask of rails where the peer has no board */
+
   /* ack seqnums of last sent and recv explicit ack */
   uint32_t last_send_acknum;
   uint32_t last_recv_acknum;
 
+  /* round-trip time estimation from acked messages, in jiffies,
+   * smoothed RTT scaled by 8 and RTT variation scaled by 4 as in TCP,
+   * both 0 until the first sample
+   */
+  uint32_t srtt_x8;
+  uint32_t rttvar_x4;
+  /* resend delay of messages sent to this partner, derived from the RTT */
+  uint32_t resend_delay_jiffies;
+
   /* list of non-acked request (queued by their partner_elt) */
   struct list_head non_acked_req_q;
   /* pending connect requests (queued by their partner_elt) */
@@ -233,6 +261,15 @@ enum omx__request_resource {
   OMX_REQUEST_RESOURCE_SENDQ_SLOT = (1<<4)
 };
 
+/* per-endpoint cache of preallocated requests */
+struct omx__request_cache {
+  /* free requests (linked by their generic.queue_elt.nxt) */
+  union omx_request * free_list;
+  /* allocated chunks of requests (linked by their first pointer) */
+  void * chunks;
+  unsigned chunks_nr;
+};
+
 #define OMX_REQUEST_SEND_MEDIUMSQ_RESOURCES (OMX_REQUEST_RESOURCE_EXP_EVENT | OMX_REQUEST_RESOURCE_SENDQ_SLOT)
 #define OMX_REQUEST_SEND_LARGE_RESOURCES (OMX_REQUEST_RESOURCE_SEND_LARGE_REGION | OMX_REQUEST_RESOURCE_LARGE_REGION)
 #define OMX_REQUEST_PULL_RESOURCES (OMX_REQUEST_RESOURCE_EXP_EVENT | OMX_REQUEST_RESOURCE_LARGE_REGION | OMX_REQUEST_RESOURCE_PULL_HANDLE)
@@ -252,16 +289,29 @@ struct omx_endpoint {
   omx_unexp_handler_t unexp_handler;
   void * unexp_handler_context;
   struct omx_endpoint_desc * desc;
+
+  /* hidden endpoints on other boards that large pulls are striped across */
+  struct omx_endpoint * rails[OMX__RAILS_MAX];
+  unsigned rails_nr;
+  unsigned rail_weights[OMX__RAILS_MAX+1]; /* link speeds, this endpoint first */
+  unsigned rail_weights_total;
+  unsigned rail_pulls_nr; /* pulls pending on our rails (on this rail if we are one), whose completion does not wake us up */
+  struct omx_endpoint * rail_primary; /* the endpoint owning this one if it is a rail */
+
   uint32_t check_status_delay_jiffies;
   uint64_t last_check_jiffies;
+  uint64_t last_timers_jiffies; /* last time the progression looked at timer-based work */
 #ifdef OMX_LIB_DEBUG
   uint64_t last_progress_jiffies;
 #endif
   void * sendq;
   const void * recvq;
   const void * exp_eventq, * unexp_eventq;
+  uint32_t sendq_entry_nr, recvq_entry_nr, exp_eventq_entry_nr, unexp_eventq_entry_nr; /* chosen by the driver at open, powers of 2 */
   omx_eventq_index_t next_exp_event_index, next_unexp_event_index;
   uint32_t avail_exp_events;
+  struct omx_cmd_submit_entry * submitq; /* send commands waiting for the next flush */
+  uint32_t submitq_nr, submitq_max;
   uint32_t req_resends_max;
   uint32_t pull_resend_timeout_jiffies;
   uint32_t zombies, zombie_max;
@@ -287,11 +337,21 @@ struct omx_endpoint {
     /* posted non-matched receive (queued by their queue_elt) */
     /* (we could queue by the ctxid_elt but we would need another recv_req_q to ensure conservation of matter) */
     struct list_head recv_req_q;
+    /* posted non-matched receive with a partial match mask (queued by their recv.match_elt) */
+    struct list_head recv_wildcard_req_q;
 
     /* done requests (queued by their ctxid_elt, only if there are multiple ctxids) */
     struct list_head done_req_q;
   } * ctxid;
 
+  /* matching hash tables, indexed by omx__match_hash(match_info) */
+  /* posted non-matched receive with a full match mask (queued by their recv.match_elt) */
+  struct list_head * recv_match_hash;
+  /* unexpected receive, may be partial (queued by their recv.match_elt) */
+  struct list_head * unexp_match_hash;
+  /* order of posted receives, to decide between exact and wildcard matches */
+  uint64_t next_recv_post_seqnum;
+
   /* non multiplexed queues */
   /* SEND req with state = NEED_RESOURCES (queued by their queue_elt) */
   struct list_head need_resources_send_req_q;
@@ -328,16 +388,27 @@ struct omx_endpoint {
   uint64_t last_partners_acking_jiffies;
   struct list_head partners_to_ack_immediate_list;
   struct list_head partners_to_ack_delayed_list;
+  /* resent messages that had to be resent, or whose previous copy got acked anyway */
+  unsigned long resends_needed, resends_spurious;
+  /* received packets dropped because of an invalid end-to-end checksum */
+  unsigned long checksum_errors;
   struct list_head throttling_partners_list;
 
   struct list_head sleepers;
 
   struct list_head reg_list; /* registered single-segment windows */
-  struct list_head reg_unused_list; /* unused registered single-segment windows, LRU in front */
-  struct list_head reg_vect_list; /* registered vectorial windows (uncached) */
+  struct list_head reg_unused_list; /* unused cached windows, LRU in front */
+  struct list_head reg_vect_list; /* registered vectorial windows */
+  struct omx__regcache_node *regcache_root; /* interval tree of the cached windows segments */
+  unsigned long regcache_hits, regcache_misses;
+#ifdef OMX_LIB_MALLOC_HOOKS
+  unsigned long regcache_hooks_seqnum; /* next malloc hooks invalidation to apply */
+#endif
   int large_sends_avail_nr; /* number of simultaneous large send that may be posted,
 			     * limited to prevent deadlocks */
 
+  struct omx__request_cache req_cache;
+
   omx_error_handler_t error_handler;
 
   struct list_head omx_endpoints_list_elt;
@@ -350,6 +421,7 @@ struct omx_endpoint {
 
 #define OMX__ENDPOINT_LOCK(ep) omx__lock(&(ep)->lock)
 #define OMX__ENDPOINT_UNLOCK(ep) omx__unlock(&(ep)->lock)
+#define OMX__ENDPOINT_TRYLOCK(ep) omx__trylock(&(ep)->lock)
 #define OMX__ENDPOINT_HANDLER_DONE_WAIT(ep) omx__cond_wait(&(ep)->in_handler_cond, &(ep)->lock)
 #define OMX__ENDPOINT_HANDLER_DONE_SIGNAL(ep) omx__cond_signal(&(ep)->in_handler_cond)
 
@@ -389,8 +461,9 @@ enum omx__request_type {
  *   NEED_REPLY: ep->large_send_req_q
  *   NEED_ACK (unlikely): ep->non_acked_req_q + partner->non_acked_req_q
  * RECV (not RECV_LARGE):
- *   UNEXPECTED_RECV: ep->unexp_req_q
- *   UNEXPECTED_RECV | RECV_PARTIAL: ep->unexp_req_q + partner->partial_medium_recv_req_q
+ *   RECV_NEED_MATCHING: ep->recv_req_q + ep->recv_match_hash or ep->recv_wildcard_req_q (by match_elt)
+ *   UNEXPECTED_RECV: ep->unexp_req_q + ep->unexp_match_hash (by match_elt)
+ *   UNEXPECTED_RECV | RECV_PARTIAL: ep->unexp_req_q + ep->unexp_match_hash + partner->partial_medium_recv_req_q
  *   RECV_PARTIAL: ep->partial_medium_recv_req_q(DBG) + partner->partial_medium_recv_req_q
  * RECV_LARGE:
  *   DRIVER_PULLING: ep->driver_pulling_req_q
@@ -438,7 +511,9 @@ enum omx__request_state {
   /* request has been completed by the application and should not be notified when done for real (including acked) */
   OMX_REQUEST_STATE_ZOMBIE = (1<<11),
   /* request is internal, should not be queued in the doneq for peek/test_any */
-  OMX_REQUEST_STATE_INTERNAL = (1<<12)
+  OMX_REQUEST_STATE_INTERNAL = (1<<12),
+  /* the peer selectively acked the request, no need to resend it until the regular ack */
+  OMX_REQUEST_STATE_SACKED = (1<<13)
 };
 
 struct omx__generic_request {
@@ -464,12 +539,6 @@ struct omx__generic_request {
   struct omx_status status;
 };
 
-#ifdef OMX_MX_WIRE_COMPAT
-#define OMX_MEDIUM_FRAGS_MAX 8
-#elif !defined OMX_MEDIUM_FRAGS_MAX /* if not enforced by configure */
-#define OMX_MEDIUM_FRAGS_MAX 32 /* 32 needed for 32kB if MTU=1500 */
-#endif
-
 typedef uint16_t omx_sendq_map_index_t;
 
 union omx_request {
@@ -487,13 +556,12 @@ union omx_request {
 	void *copy; /* buffered data attached the request */
       } small;
       struct {
-	struct omx_cmd_send_mediumsq_frag send_mediumsq_frag_ioctl_param;
+	struct omx_cmd_send_mediumsq send_mediumsq_ioctl_param; /* contains the sendq map indexes */
 	uint32_t frags_nr;
 	uint32_t frags_pending_nr;
 #ifdef OMX_MX_WIRE_COMPAT
 	unsigned frag_pipeline;
 #endif
-	omx_sendq_map_index_t sendq_map_index[OMX_MEDIUM_FRAGS_MAX];
       } mediumsq;
       struct {
 	struct omx_cmd_send_mediumva send_mediumva_ioctl_param;
@@ -511,6 +579,11 @@ union omx_request {
     struct omx__req_segs segs;
     uint64_t match_info;
     uint64_t match_mask;
+    /* queued in the matching hash or in the ctxid wildcard queue while posted,
+     * or in the unexpected matching hash while unexpected
+     */
+    struct list_head match_elt;
+    uint64_t post_seqnum; /* posting order, only valid while posted and not matched */
     uint16_t checksum; /* checksum given by sender in incoming send */
     omx__seqnum_t seqnum; /* seqnum of the incoming matched send */
     union {
@@ -519,13 +592,17 @@ union omx_request {
 	uint32_t accumulated_length; /* the actual received length, not the transfered one */
 	uint32_t scan_offset;
 	struct omx_segscan_state scan_state;
+	struct omx__large_region *direct_region; /* attached to the driver for direct fragment placement */
       } medium;
       struct {
 	struct omx_cmd_send_notify send_notify_ioctl_param;
 	struct omx__large_region * local_region;
+	uint32_t local_region_offset; /* offset of the receive buffer in local_region */
 	uint8_t pulled_rdma_id;
 	uint8_t pulled_rdma_seqnum;
 	uint16_t pulled_rdma_offset;
+	uint32_t pulls_pending; /* pulls posted on this endpoint and on its rails */
+	uint32_t primary_pull_offset; /* beginning of the part pulled on this endpoint */
       } large;
       struct {
 	union omx_request *sreq;
@@ -564,26 +641,45 @@ struct omx__globals {
   int regcache;
   int parallel_regcache;
   int waitspin;
+  int test_trylock;
   int connect_pollall;
+  unsigned rails[OMX__RAILS_MAX]; /* board indexes */
+  unsigned rails_nr;
+  unsigned rails_stripe_min;
   int zombie_max;
   int waitintr;
   int fatal_errors;
   int debug_signal_level;
   int debug_checksum;
+  int checksum;
   int check_request_alloc;
   int medium_sendq;
+  int medium_direct;
+  unsigned medium_zerocopy_min; /* 0 if disabled */
+  unsigned request_cache_nr;
+  unsigned submit_batch_max;
+  unsigned sendq_entry_nr, recvq_entry_nr, exp_eventq_entry_nr; /* 0 for the driver defaults */
+  int coarse_clock;
+  uint64_t coarse_clock_offset;
+  uint32_t coarse_clock_hz;
+  uint32_t coarse_clock_nsec_per_jiffy;
   uint32_t any_endpoint_id;
   int selfcomms;
   int sharedcomms;
   unsigned rndv_threshold;
   unsigned shared_rndv_threshold;
+  unsigned shared_single_copy_threshold;
   unsigned ack_delay_jiffies;
   unsigned resend_delay_jiffies;
+  unsigned resend_delay_min_jiffies;
+  int resend_rtt;
+  int sack;
   unsigned req_resends_max;
   unsigned not_acked_max;
   unsigned ctxid_bits;
   unsigned ctxid_shift;
   char *process_binding;
+  uint8_t endpoint_numa_placement;
   char *message_prefix;
   char *message_prefix_format;
   unsigned abort_sleeps;
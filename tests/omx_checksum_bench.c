@@ -0,0 +1,147 @@
+/*
+ * Open-MX
+ * Copyright © inria 2007-2010 (see AUTHORS file)
+ *
+ * The development of this software has been funded by Myricom, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License in COPYING.GPL for more details.
+ */
+
+/*
+ * Measure the overhead of the end-to-end checksum (OMX_CHECKSUM)
+ * compared to the copy that the library performs anyway.
+ */
+
+#include <sys/time.h>
+#include <getopt.h>
+
+#include "omx_lib.h"
+#include "omx_segments.h"
+
+#define ITER 100000
+#define MIN 32
+#define MAX (64*1024)
+
+static void
+usage(int argc, char *argv[])
+{
+  fprintf(stderr, "%s [options]\n", argv[0]);
+  fprintf(stderr, " -N <n>\tchange number of iterations [%d]\n", ITER);
+  fprintf(stderr, " -S <n>\tchange the start length [%d]\n", MIN);
+  fprintf(stderr, " -E <n>\tchange the end length [%d]\n", MAX);
+}
+
+static unsigned long long
+elapsed_ns(struct timeval *tv1, struct timeval *tv2, int iter)
+{
+  return ((tv2->tv_sec-tv1->tv_sec)*1000000ULL+(tv2->tv_usec-tv1->tv_usec))*1000ULL/iter;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct omx__req_segs segs;
+  struct timeval tv1, tv2;
+  unsigned long long copy, debug, sw, hw, copycrc;
+  volatile uint32_t crc = 0;
+  char *src, *dst;
+  int iter = ITER;
+  unsigned min = MIN;
+  unsigned max = MAX;
+  unsigned length;
+  int i;
+  int c;
+
+  while ((c = getopt(argc, argv, "N:S:E:h")) != -1)
+    switch (c) {
+    case 'N':
+      iter = atoi(optarg);
+      break;
+    case 'S':
+      min = atoi(optarg);
+      break;
+    case 'E':
+      max = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Unknown option -%c\n", c);
+    case 'h':
+      usage(argc, argv);
+      exit(-1);
+      break;
+    }
+
+  omx__crc32c_init();
+
+  /* check the implementations against the standard check value */
+  assert(omx__crc32c_sw(0, "123456789", 9) == 0xe3069283);
+#ifdef OMX__CRC32C_HW
+  if (omx__crc32c_hw_available())
+    assert(omx__crc32c_hw(0, "123456789", 9) == 0xe3069283);
+#endif
+  printf("CRC32C uses %s\n", omx__crc32c == omx__crc32c_sw ? "the table-driven fallback" : "SSE4.2");
+
+  src = malloc(max);
+  dst = malloc(max);
+  assert(src && dst);
+  for(i=0; i<max; i++)
+    src[i] = i;
+
+  printf("  length\t    copy\t   CRC16\t  CRC32C-sw\t CRC32C-hw\tcopy+CRC32C (overhead)\n");
+  for(length = min; length <= max; length *= 2) {
+    omx_cache_single_segment(&segs, src, length);
+
+    gettimeofday(&tv1, NULL);
+    for(i=0; i<iter; i++)
+      omx_copy_from_segments(dst, &segs, length);
+    gettimeofday(&tv2, NULL);
+    copy = elapsed_ns(&tv1, &tv2, iter);
+
+    /* the debug checksum is very slow, do not run it as much */
+    gettimeofday(&tv1, NULL);
+    for(i=0; i<iter/100+1; i++)
+      crc += omx_checksum_segments(&segs, length);
+    gettimeofday(&tv2, NULL);
+    debug = elapsed_ns(&tv1, &tv2, iter/100+1);
+
+    gettimeofday(&tv1, NULL);
+    for(i=0; i<iter; i++)
+      crc += omx__crc32c_sw(0, src, length);
+    gettimeofday(&tv2, NULL);
+    sw = elapsed_ns(&tv1, &tv2, iter);
+
+    hw = 0;
+#ifdef OMX__CRC32C_HW
+    if (omx__crc32c_hw_available()) {
+      gettimeofday(&tv1, NULL);
+      for(i=0; i<iter; i++)
+	crc += omx__crc32c_hw(0, src, length);
+      gettimeofday(&tv2, NULL);
+      hw = elapsed_ns(&tv1, &tv2, iter);
+    }
+#endif
+
+    gettimeofday(&tv1, NULL);
+    for(i=0; i<iter; i++)
+      crc += omx_copy_from_segments_crc32c(dst, &segs, length);
+    gettimeofday(&tv2, NULL);
+    copycrc = elapsed_ns(&tv1, &tv2, iter);
+
+    printf("% 8d\t% 6lld ns\t% 6lld ns\t% 8lld ns\t% 6lld ns\t% 6lld ns (%+lld%%)\n",
+	   length, copy, debug, sw, hw, copycrc,
+	   copy ? ((long long) copycrc - (long long) copy) * 100 / (long long) copy : 0LL);
+  }
+
+  free(src);
+  free(dst);
+  return 0;
+}
@@ -23,11 +23,13 @@
 #include "omx_lib.h"
 
 #define ITER 1000000
+#define FAKE_PEER_ADDR_BASE 0x020000000000ULL /* locally administered addresses */
 
 static void
 usage(int argc, char *argv[])
 {
   fprintf(stderr, "%s [options]\n", argv[0]);
+  fprintf(stderr, " -p <n>\tadd <n> fake peers to the driver table before benchmarking peer lookups\n");
 }
 
 int
@@ -38,11 +40,15 @@ main(int argc, char *argv[])
   struct timeval tv1,tv2;
   struct omx_cmd_bench cmd;
   unsigned long long total, delay, olddelay;
+  int fake_peers = 0;
   int i, err;
   int c;
 
-  while ((c = getopt(argc, argv, "h")) != -1)
+  while ((c = getopt(argc, argv, "p:h")) != -1)
     switch (c) {
+    case 'p':
+      fake_peers = atoi(optarg);
+      break;
     default:
       fprintf(stderr, "Unknown option -%c\n", c);
     case 'h':
@@ -164,5 +170,30 @@ main(int argc, char *argv[])
   printf("+ recv done:      +%lld ns =>\t%lld ns (%lld us for %d iter)\n", delay-olddelay, delay, total, ITER);
   olddelay = delay;
 
+  for(i=0; i<fake_peers; i++) {
+    char hostname[OMX_HOSTNAMELEN_MAX];
+    /* give them a name so that the driver does not query their hostname */
+    snprintf(hostname, sizeof(hostname), "fake-peer-%d", i);
+    ret = omx__driver_peer_add(FAKE_PEER_ADDR_BASE + i, hostname);
+    if (ret != OMX_SUCCESS) {
+      fprintf(stderr, "Failed to add fake peer #%d (%s)\n", i, omx_strerror(ret));
+      break;
+    }
+  }
+  if (fake_peers)
+    printf("added %d fake peers, use omx_init_peers -c to remove them\n", i);
+
+  cmd.hdr.type = OMX_CMD_BENCH_TYPE_PEER_LOOKUP;
+  cmd.hdr.board_addr = ep->board_info.addr;
+  gettimeofday(&tv1, NULL);
+  for(i=0; i<ITER; i++) {
+    err = ioctl(ep->fd, OMX_CMD_BENCH, &cmd);
+    assert(!err);
+  }
+  gettimeofday(&tv2, NULL);
+  total = (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec);
+  delay = total*1000ULL/ITER;
+  printf("peer lookup:      %lld ns   \t       (%lld us for %d iter)\n", delay, total, ITER);
+
   return 0;
 }
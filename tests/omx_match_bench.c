@@ -0,0 +1,184 @@
+/*
+ * Open-MX
+ * Copyright © inria 2007-2010 (see AUTHORS file)
+ *
+ * The development of this software has been funded by Myricom, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License in COPYING.GPL for more details.
+ */
+
+/*
+ * Post N receives and send N tiny messages to ourself that match them
+ * in reverse order, so that a linear matching engine would have to walk
+ * the whole posted queue for each incoming message.
+ * Report the per-message cost for increasing N.
+ */
+
+#define _SVID_SOURCE 1 /* for putenv */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <getopt.h>
+#include <assert.h>
+
+#include "open-mx.h"
+
+#define BID 0
+#define EID OMX_ANY_ENDPOINT
+#define MIN 1
+#define MAX 16384
+#define MATCH_BASE 0x1234000000000000ULL
+
+static void
+usage(int argc, char *argv[])
+{
+  fprintf(stderr, "%s [options]\n", argv[0]);
+  fprintf(stderr, " -b <n>\tchange local board id [%d]\n", BID);
+  fprintf(stderr, " -e <n>\tchange local endpoint id [%d]\n", EID);
+  fprintf(stderr, " -s\tuse shared communication instead of native networking\n");
+  fprintf(stderr, " -S\tuse self communication instead of shared or native networking\n");
+  fprintf(stderr, " -m <n>\tchange the minimal number of posted receives [%d]\n", MIN);
+  fprintf(stderr, " -M <n>\tchange the maximal number of posted receives [%d]\n", MAX);
+  fprintf(stderr, " -w\tpost receives with a wildcard match mask\n");
+}
+
+int main(int argc, char *argv[])
+{
+  omx_endpoint_t ep;
+  int board_index = BID;
+  int endpoint_index = EID;
+  omx_endpoint_addr_t addr;
+  omx_request_t *reqs;
+  omx_status_t status;
+  uint32_t result;
+  uint64_t mask = -1ULL;
+  int min = MIN, max = MAX;
+  int self = 0;
+  int shared = 0;
+  int c, i, n;
+  omx_return_t ret;
+
+  while ((c = getopt(argc, argv, "e:b:m:M:wsSh")) != -1)
+    switch (c) {
+    case 'b':
+      board_index = atoi(optarg);
+      break;
+    case 'e':
+      endpoint_index = atoi(optarg);
+      break;
+    case 'm':
+      min = atoi(optarg);
+      break;
+    case 'M':
+      max = atoi(optarg);
+      break;
+    case 'w':
+      /* ignore the lowest bit, so that the engine cannot hash the receives */
+      mask = ~1ULL;
+      break;
+    case 's':
+      shared = 1;
+      break;
+    case 'S':
+      self = 1;
+      break;
+    default:
+      fprintf(stderr, "Unknown option -%c\n", c);
+    case 'h':
+      usage(argc, argv);
+      exit(-1);
+      break;
+    }
+
+  if (min < 1 || max < min) {
+    fprintf(stderr, "Invalid range of posted receives %d-%d\n", min, max);
+    exit(-1);
+  }
+
+  if (!self && !getenv("OMX_DISABLE_SELF"))
+    putenv("OMX_DISABLE_SELF=1");
+
+  if (!shared && !getenv("OMX_DISABLE_SHARED"))
+    putenv("OMX_DISABLE_SHARED=1");
+
+  reqs = malloc(max * sizeof(*reqs));
+  if (!reqs) {
+    fprintf(stderr, "Failed to allocate request array\n");
+    goto out;
+  }
+
+  ret = omx_init();
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to initialize (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_reqs;
+  }
+
+  ret = omx_open_endpoint(board_index, endpoint_index, 0x12345678, NULL, 0, &ep);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to open endpoint (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_reqs;
+  }
+
+  ret = omx_get_endpoint_addr(ep, &addr);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to get local endpoint address (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_ep;
+  }
+
+  printf("# posted\tus/msg\n");
+
+  for(n=min; n<=max; n*=2) {
+    struct timeval tv1, tv2;
+    unsigned long long us;
+
+    for(i=0; i<n; i++) {
+      ret = omx_irecv(ep, NULL, 0, (MATCH_BASE + 2*i) & mask, mask, NULL, &reqs[i]);
+      assert(ret == OMX_SUCCESS);
+    }
+
+    gettimeofday(&tv1, NULL);
+
+    /* match the last posted receive first */
+    for(i=n-1; i>=0; i--) {
+      ret = omx_isend(ep, NULL, 0, addr, MATCH_BASE + 2*i, NULL, NULL);
+      assert(ret == OMX_SUCCESS);
+    }
+
+    for(i=n-1; i>=0; i--) {
+      ret = omx_wait(ep, &reqs[i], &status, &result, OMX_TIMEOUT_INFINITE);
+      if (ret != OMX_SUCCESS || !result || status.code != OMX_SUCCESS) {
+	fprintf(stderr, "Failed to wait for receive #%d (%s)\n",
+		i, omx_strerror(ret != OMX_SUCCESS ? ret : status.code));
+	goto out_with_ep;
+      }
+    }
+
+    gettimeofday(&tv2, NULL);
+    us = (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec);
+    printf("%d\t\t%.3f\n", n, (double) us / n);
+  }
+
+  omx_close_endpoint(ep);
+  free(reqs);
+  return 0;
+
+ out_with_ep:
+  omx_close_endpoint(ep);
+ out_with_reqs:
+  free(reqs);
+ out:
+  return -1;
+}
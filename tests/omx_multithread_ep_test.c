@@ -30,13 +30,19 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <sys/time.h>
 
 #include "open-mx.h"
 
+#define SHARED_ITER 10000
+#define SHARED_MATCH_BASE 0x5678000000000000ULL
+
 static void
 usage(int argc, char *argv[])
 {
     fprintf(stderr, "%s [options]\n", argv[0]);
+    fprintf(stderr, " -s\tmeasure the throughput of threads sharing a single endpoint\n");
+    fprintf(stderr, " -N <n>\tchange the number of messages per thread in shared mode [%d]\n", SHARED_ITER);
 }
 
 #ifdef OMX_HAVE_HWLOC
@@ -118,16 +124,115 @@ static void *threadfunc(void *_barriers)
   return 0;
 }
 
+/*
+ * Shared endpoint mode: each thread sends tiny messages to itself
+ * through a single endpoint and tests them, so that the aggregated
+ * message rate shows how the endpoint lock scales with threads.
+ */
+static omx_endpoint_t shared_ep;
+static omx_endpoint_addr_t shared_addr;
+static int shared_iter = SHARED_ITER;
+static pthread_barrier_t shared_barrier;
+
+static void *sharedfunc(void *_id)
+{
+  uint64_t match = SHARED_MATCH_BASE + (((uint64_t) (uintptr_t) _id) << 32);
+  omx_request_t sreq, rreq;
+  omx_status_t status;
+  omx_return_t ret;
+  uint32_t result;
+  int i;
+
+  pthread_barrier_wait(&shared_barrier);
+
+  for(i=0; i<shared_iter; i++) {
+    ret = omx_irecv(shared_ep, NULL, 0, match + i, -1ULL, NULL, &rreq);
+    assert(ret == OMX_SUCCESS);
+    ret = omx_isend(shared_ep, NULL, 0, shared_addr, match + i, NULL, &sreq);
+    assert(ret == OMX_SUCCESS);
+
+    do {
+      ret = omx_test(shared_ep, &sreq, &status, &result);
+      assert(ret == OMX_SUCCESS);
+    } while (!result);
+    do {
+      ret = omx_test(shared_ep, &rreq, &status, &result);
+      assert(ret == OMX_SUCCESS);
+    } while (!result);
+  }
+
+  pthread_barrier_wait(&shared_barrier);
+  return NULL;
+}
+
+static int
+shared_bench(unsigned nbthreads)
+{
+  pthread_t *th;
+  omx_return_t ret;
+  unsigned n;
+  int i;
+
+  ret = omx_open_endpoint(OMX_ANY_NIC, OMX_ANY_ENDPOINT, 0, NULL, 0, &shared_ep);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to open endpoint (%s)\n", omx_strerror(ret));
+    return -1;
+  }
+  omx_get_endpoint_addr(shared_ep, &shared_addr);
+
+  th = malloc(nbthreads*sizeof(*th));
+
+  printf("# threads\tmsg/s\n");
+
+  /* powers of two, and all threads in the end */
+  for(n=1; ; n = 2*n < nbthreads ? 2*n : nbthreads) {
+    struct timeval tv1, tv2;
+    unsigned long long us;
+
+    /* the main thread joins the barrier to time the run */
+    pthread_barrier_init(&shared_barrier, NULL, n+1);
+
+    for (i = 0; i < n; i++)
+      pthread_create (&th[i], NULL, sharedfunc, (void*) (uintptr_t) i);
+
+    pthread_barrier_wait(&shared_barrier);
+    gettimeofday(&tv1, NULL);
+    pthread_barrier_wait(&shared_barrier);
+    gettimeofday(&tv2, NULL);
+
+    for (i = 0; i < n; i++)
+      pthread_join (th[i], NULL);
+    pthread_barrier_destroy(&shared_barrier);
+
+    us = (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec);
+    printf("%u\t\t%.0f\n", n, (double) n * shared_iter * 1000000. / (us ? us : 1));
+
+    if (n == nbthreads)
+      break;
+  }
+
+  free(th);
+  omx_close_endpoint(shared_ep);
+  return 0;
+}
+
 int main (int argc, char *argv[])
 {
   pthread_t *th;
   pthread_barrier_t barrier[2];
   unsigned nbthreads = get_nbthreads();
   omx_return_t ret;
+  int shared = 0;
   int i, c;
 
-  while ((c = getopt (argc, argv, "h")) != -1)
+  while ((c = getopt (argc, argv, "sN:h")) != -1)
     switch (c) {
+    case 's':
+      shared = 1;
+      break;
+    case 'N':
+      shared_iter = atoi(optarg);
+      break;
     default:
       fprintf (stderr, "Unknown option -%c\n", c);
     case 'h':
@@ -139,6 +244,13 @@ int main (int argc, char *argv[])
   if (ret != OMX_SUCCESS)
     return -1;
 
+  if (shared) {
+    int err = shared_bench(nbthreads);
+    omx_finalize ();
+    topology_exit();
+    return err;
+  }
+
   th = malloc(nbthreads*sizeof(*th));
 
   pthread_barrier_init(&barrier[0], NULL, nbthreads);
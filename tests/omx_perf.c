@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/resource.h> /* getrusage() */
 #include <getopt.h>
 #include <assert.h>
 #include <malloc.h>	/* memalign() */
@@ -102,6 +103,8 @@ usage(int argc, char *argv[])
   fprintf(stderr, " -w\tsleep instead of busy polling\n");
   fprintf(stderr, " -y\tyield the processor between busy polling loops\n");
   fprintf(stderr, " -v\tverbose\n");
+  fprintf(stderr, " -Z <mode>\tsend mediums with copy or zerocopy and report the CPU time per byte\n");
+  fprintf(stderr, "\t(combine with -w so that busy polling does not account for most of the CPU time)\n");
   fprintf(stderr, "Sender options:\n");
   fprintf(stderr, " -a\tuse page-aligned buffers on both hosts\n");
   fprintf(stderr, " -d <hostname>\tset remote peer name and switch to sender mode\n");
@@ -155,6 +158,7 @@ int main(int argc, char *argv[])
   unsigned long long max = MAX;
   unsigned long long multiplier = MULTIPLIER;
   unsigned long long increment = INCREMENT;
+  char *medium_mode = NULL;
   int unidir = UNIDIR;
   int sync = SYNC;
   int yield = YIELD;
@@ -171,7 +175,7 @@ int main(int argc, char *argv[])
   int wait = 0;
   int pause_ms = PAUSE_MS;
 
-  while ((c = getopt(argc, argv, "e:r:d:b:S:E:M:I:N:W:P:swUYyvah")) != -1)
+  while ((c = getopt(argc, argv, "e:r:d:b:S:E:M:I:N:W:P:Z:swUYyvah")) != -1)
     switch (c) {
     case 'b':
       bid = atoi(optarg);
@@ -229,6 +233,17 @@ int main(int argc, char *argv[])
     case 'y':
       yield = 1;
       break;
+    case 'Z':
+      medium_mode = optarg;
+      if (!strcmp(medium_mode, "copy"))
+	setenv("OMX_MEDIUM_ZEROCOPY", "0", 1);
+      else if (!strcmp(medium_mode, "zerocopy"))
+	setenv("OMX_MEDIUM_ZEROCOPY", "1", 1);
+      else {
+	fprintf(stderr, "Unknown medium mode %s, should be copy or zerocopy\n", medium_mode);
+	exit(-1);
+      }
+      break;
     default:
       fprintf(stderr, "Unknown option -%c\n", c);
     case 'h':
@@ -293,6 +308,7 @@ int main(int argc, char *argv[])
     omx_endpoint_addr_t addr;
     struct param param;
     struct timeval tv1, tv2;
+    struct rusage ru1, ru2;
     unsigned long long us;
     unsigned long long length;
     int i;
@@ -381,8 +397,10 @@ int main(int argc, char *argv[])
 	if (verbose)
 	  printf("Iteration %d/%d\n", i-warmup, iter);
 
-	if (i == warmup)
+	if (i == warmup) {
 	  gettimeofday(&tv1, NULL);
+	  getrusage(RUSAGE_SELF, &ru1);
+	}
 
 	/* sending a message */
 	ret = omx_isend_or_issend(sync,
@@ -432,12 +450,22 @@ int main(int argc, char *argv[])
 	printf("Iteration %d/%d\n", i-warmup, iter);
 
       gettimeofday(&tv2, NULL);
+      getrusage(RUSAGE_SELF, &ru2);
       us = (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec);
       if (verbose)
 	printf("Total Duration: %lld us\n", us);
-      printf("length % 9lld:\t%.3f us\t%.2f MB/s\t %.2f MiB/s\n",
-	     length, ((float) us)/(2.-unidir)/iter,
-	     (2.-unidir)*iter*length/us, (2.-unidir)*iter*length/us/1.048576);
+      if (medium_mode) {
+	unsigned long long cpu_us;
+	cpu_us = (ru2.ru_utime.tv_sec-ru1.ru_utime.tv_sec)*1000000ULL+(ru2.ru_utime.tv_usec-ru1.ru_utime.tv_usec)
+	  + (ru2.ru_stime.tv_sec-ru1.ru_stime.tv_sec)*1000000ULL+(ru2.ru_stime.tv_usec-ru1.ru_stime.tv_usec);
+	printf("length % 9lld:\t%.3f us\t%.2f MB/s\t %.2f MiB/s\t%s %.3f ns/B\n",
+	       length, ((float) us)/(2.-unidir)/iter,
+	       (2.-unidir)*iter*length/us, (2.-unidir)*iter*length/us/1.048576,
+	       medium_mode, length ? 1000.*cpu_us/(2.-unidir)/iter/length : 0.);
+      } else
+	printf("length % 9lld:\t%.3f us\t%.2f MB/s\t %.2f MiB/s\n",
+	       length, ((float) us)/(2.-unidir)/iter,
+	       (2.-unidir)*iter*length/us, (2.-unidir)*iter*length/us/1.048576);
 
       free(sendbuffer);
       free(recvbuffer);
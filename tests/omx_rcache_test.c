@@ -19,6 +19,7 @@
 #define _SVID_SOURCE 1 /* for putenv */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <sys/time.h>
 
@@ -29,6 +30,7 @@
 #define ITER 10
 #define PARALLEL 4
 #define LENGTH 1048576
+#define BENCH_STRIDE 7919 /* prime, so that each round visits all buffers unless their number is a multiple of it */
 
 static int verbose = 0;
 
@@ -146,6 +148,98 @@ one_iteration(omx_endpoint_t ep, omx_endpoint_addr_t addr,
   return OMX_BAD_ERROR;
 }
 
+static omx_return_t
+transfer(omx_endpoint_t ep, omx_endpoint_addr_t addr,
+	 char *sbuffer, char *rbuffer, int length)
+{
+  omx_request_t sreq, rreq;
+  omx_status_t status;
+  omx_return_t ret;
+  uint32_t result;
+
+  ret = omx_irecv(ep, rbuffer, length, 0, 0, NULL, &rreq);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to post a recv (%s)\n",
+	    omx_strerror(ret));
+    return ret;
+  }
+
+  ret = omx_isend(ep, sbuffer, length, addr, 0x1234567887654321ULL, NULL, &sreq);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to send message length %d (%s)\n",
+	    length, omx_strerror(ret));
+    return ret;
+  }
+
+  ret = omx_wait(ep, &rreq, &status, &result, OMX_TIMEOUT_INFINITE);
+  if (ret != OMX_SUCCESS || !result) {
+    fprintf(stderr, "Failed to wait for recv completion (%s)\n",
+	    omx_strerror(ret));
+    return OMX_BAD_ERROR;
+  }
+
+  ret = omx_wait(ep, &sreq, &status, &result, OMX_TIMEOUT_INFINITE);
+  if (ret != OMX_SUCCESS || !result) {
+    fprintf(stderr, "Failed to wait for send completion (%s)\n",
+	    omx_strerror(ret));
+    return OMX_BAD_ERROR;
+  }
+
+  return OMX_SUCCESS;
+}
+
+/*
+ * Receive in many live buffers carved out of a single area
+ * so that the regcache has to look among many regions.
+ * If cover is set, a first message is received in the whole area
+ * so that the next receives may reuse its region.
+ */
+static omx_return_t
+bench(omx_endpoint_t ep, omx_endpoint_addr_t addr,
+      int length, int nbufs, int cover)
+{
+  struct timeval tv1, tv2;
+  char *area, *sbuffer;
+  omx_return_t ret = OMX_BAD_ERROR;
+  int i, j;
+
+  area = malloc((size_t) nbufs * length);
+  if (!area)
+    goto out;
+  sbuffer = malloc(length);
+  if (!sbuffer)
+    goto out_with_area;
+  memset(sbuffer, 'a', length);
+
+  if (cover) {
+    ret = transfer(ep, addr, area, area, nbufs * length);
+    if (ret != OMX_SUCCESS)
+      goto out_with_buffers;
+  }
+
+  gettimeofday(&tv1, NULL);
+  for(i=0; i<ITER; i++)
+    for(j=0; j<nbufs; j++) {
+      /* do not walk buffers in address order */
+      int index = (int) (((unsigned long long) j * BENCH_STRIDE) % nbufs);
+      ret = transfer(ep, addr, sbuffer, area + (size_t) index * length, length);
+      if (ret != OMX_SUCCESS)
+	goto out_with_buffers;
+    }
+  gettimeofday(&tv2, NULL);
+
+  printf("%d buffers of %d bytes: %.3f us per message\n", nbufs, length,
+	 (double) ((tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec)) / ITER / nbufs);
+  ret = OMX_SUCCESS;
+
+ out_with_buffers:
+  free(sbuffer);
+ out_with_area:
+  free(area);
+ out:
+  return ret;
+}
+
 static void
 usage(int argc, char *argv[])
 {
@@ -154,6 +248,9 @@ usage(int argc, char *argv[])
   fprintf(stderr, " -e <n>\tchange local endpoint id [%d]\n", EID);
   fprintf(stderr, " -l <n>\tuse length [%d]\n", LENGTH);
   fprintf(stderr, " -P <n>\tsend multiple messages in parallel [%d]\n", PARALLEL);
+  fprintf(stderr, " -N <n>\tbenchmark receiving in <n> live buffers instead\n");
+  fprintf(stderr, " -C\treceive in the whole area first so that buffers are covered by a single region\n");
+  fprintf(stderr, "\t(set OMX_VERBOSE to get the regcache hit rate when closing the endpoint)\n");
   fprintf(stderr, " -R\tdo not enable regcache\n");
   fprintf(stderr, " -s\tuse shared communication instead of native networking\n");
   fprintf(stderr, " -S\tuse self communication instead of shared or native networking\n");
@@ -180,11 +277,13 @@ int main(int argc, char *argv[])
   int self = 0;
   int shared = 0;
   int parallel = PARALLEL;
+  int nbufs = 0;
+  int cover = 0;
   int c;
   int i;
   omx_return_t ret;
 
-  while ((c = getopt(argc, argv, "e:b:l:P:RsSvh")) != -1)
+  while ((c = getopt(argc, argv, "e:b:l:P:N:CRsSvh")) != -1)
     switch (c) {
     case 'b':
       board_index = atoi(optarg);
@@ -198,6 +297,12 @@ int main(int argc, char *argv[])
     case 'P':
       parallel = atoi(optarg);
       break;
+    case 'N':
+      nbufs = atoi(optarg);
+      break;
+    case 'C':
+      cover = 1;
+      break;
     case 'R':
       rcache = 0;
       break;
@@ -273,6 +378,14 @@ int main(int argc, char *argv[])
     goto out_with_ep;
   }
 
+  if (nbufs > 0) {
+    ret = bench(ep, addr, length, nbufs, cover);
+    if (ret != OMX_SUCCESS)
+      goto out_with_ep;
+    omx_close_endpoint(ep);
+    return 0;
+  }
+
   gettimeofday(&tv1, NULL);
   for(i=0; i<ITER; i++) {
     /* send a large message */
@@ -21,12 +21,18 @@
 #include <getopt.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 
 #include "omx_lib.h"
 
 #define EP 3
 #define ITER 10000
 #define LENGTH (1024*1024*4*4)
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
 
 static inline int
 do_register(int fd, int id,
@@ -63,21 +69,54 @@ usage(int argc, char *argv[])
   fprintf(stderr, "%s [options]\n", argv[0]);
   fprintf(stderr, " -l <n>\tchange buffer length [%d]\n", LENGTH);
   fprintf(stderr, " -N <n>\tchange the number of iterations [%d]\n", ITER);
+  fprintf(stderr, " -H\talso register buffers backed by huge pages to compare\n");
+}
+
+static int
+do_bench(int fd, char *buffer1, char *buffer2, int length, int iter, const char *backing)
+{
+  struct timeval tv1, tv2;
+  int i, ret;
+
+  gettimeofday(&tv1, NULL);
+
+  for(i=0; i<iter; i++) {
+
+    ret = do_register(fd, 34, buffer1, length, buffer2, length);
+    if (ret < 0) {
+      fprintf(stderr, "Failed to register (%m)\n");
+      return -1;
+    }
+
+    ret = do_deregister(fd, 34);
+    if (ret < 0) {
+      fprintf(stderr, "Failed to deregister window (%m)\n");
+      return -1;
+    }
+  }
+
+  gettimeofday(&tv2, NULL);
+  printf("%d times register %d bytes with %s pages => %lld us\n",
+	 iter, length, backing,
+	 (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec));
+  return 0;
 }
 
 int main(int argc, char *argv[])
 {
   int fd, ret;
   struct omx_cmd_open_endpoint open_param;
-  int i;
-  struct timeval tv1, tv2;
   char *buffer1, *buffer2;
   int c;
   int length = LENGTH;
   int iter = ITER;
+  int huge = 0;
 
-  while ((c = getopt(argc, argv, "l:N:h")) != -1)
+  while ((c = getopt(argc, argv, "l:N:Hh")) != -1)
     switch (c) {
+    case 'H':
+      huge = 1;
+      break;
     case 'l':
       length = atoi(optarg);
       break;
@@ -100,6 +139,9 @@ int main(int argc, char *argv[])
 
   open_param.board_index = 0;
   open_param.endpoint_index = EP;
+  open_param.sendq_entry_nr = 0;
+  open_param.recvq_entry_nr = 0;
+  open_param.exp_eventq_entry_nr = 0;
   ret = ioctl(fd, OMX_CMD_OPEN_ENDPOINT, &open_param);
   if (ret < 0) {
     perror("attach endpoint");
@@ -136,28 +178,30 @@ int main(int argc, char *argv[])
     goto out_with_fd;
   }
 
-  gettimeofday(&tv1, NULL);
+  ret = do_bench(fd, buffer1, buffer2, length, iter, "regular");
+  if (ret < 0)
+    goto out_with_fd;
 
-  for(i=0; i<iter; i++) {
+  if (huge) {
+    /* round up to entire huge pages */
+    size_t hlength = (length + HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+    char *hbuffer1, *hbuffer2;
 
-    ret = do_register(fd, 34, buffer1, length, buffer2, length);
-    if (ret < 0) {
-      fprintf(stderr, "Failed to register (%m)\n");
+    hbuffer1 = mmap(NULL, hlength, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    hbuffer2 = mmap(NULL, hlength, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (hbuffer1 == MAP_FAILED || hbuffer2 == MAP_FAILED) {
+      fprintf(stderr, "Failed to allocate huge page buffers (%m), check /proc/sys/vm/nr_hugepages\n");
       goto out_with_fd;
     }
 
-    ret = do_deregister(fd, 34);
-    if (ret < 0) {
-      fprintf(stderr, "Failed to deregister window (%m)\n");
+    ret = do_bench(fd, hbuffer1, hbuffer2, length, iter, "huge");
+
+    munmap(hbuffer2, hlength);
+    munmap(hbuffer1, hlength);
+    if (ret < 0)
       goto out_with_fd;
-    }
   }
 
-  gettimeofday(&tv2, NULL);
-  printf("%d times register %d bytes => %lld us\n",
-	 iter, length,
-	 (tv2.tv_sec-tv1.tv_sec)*1000000ULL+(tv2.tv_usec-tv1.tv_usec));
-
   free(buffer2);
   free(buffer1);
 
@@ -0,0 +1,404 @@
+/*
+ * Open-MX
+ * Copyright © inria 2007-2010 (see AUTHORS file)
+ *
+ * The development of this software has been funded by Myricom, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License in COPYING.GPL for more details.
+ */
+
+/*
+ * Check that OMX_RAILS stripes large message pulls across boards.
+ *
+ * Meant to run on two veth pairs attached to Open-MX, one side of each
+ * pair per process: the receiver opens board -b with rail -r, the sender
+ * (a forked process, since OMX_RAILS is per process) opens board -B with
+ * rail -R. Both primary boards and both rail boards must exchange pull
+ * requests and replies.
+ * Exits with 77 (skipped) if these boards do not exist.
+ */
+
+#define _SVID_SOURCE 1 /* for putenv */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "open-mx.h"
+
+#define BID 0
+#define RAIL 1
+#define PEER_BID 2
+#define PEER_RAIL 3
+#define EID 3
+#define PEER_EID 4
+#define ITER 10
+#define LENGTH (4*1024*1024)
+#define KEY 0x12345678
+#define MATCH 0x1234567887654321ULL
+
+#define SEND_PULL_REQ_LABEL "Send Pull Request"
+#define SEND_PULL_REPLY_LABEL "Send Pull Reply"
+
+static int verbose = 0;
+static uint32_t counter_max;
+
+static int
+find_counter(const char *label)
+{
+  char buffer[128];
+  uint32_t i;
+
+  for(i=0; i<counter_max; i++) {
+    uint8_t index = i;
+    if (omx_get_info(NULL, OMX_INFO_COUNTER_LABEL, &index, sizeof(index),
+		     buffer, sizeof(buffer)) != OMX_SUCCESS)
+      continue;
+    if (!strcmp(buffer, label))
+      return i;
+  }
+
+  return -1;
+}
+
+static int
+read_counter(int board, int index, uint32_t *valuep)
+{
+  uint32_t values[counter_max];
+  uint8_t board_index = board;
+  omx_return_t ret;
+
+  ret = omx_get_info(NULL, OMX_INFO_COUNTER_VALUES, &board_index, sizeof(board_index),
+		     values, sizeof(values));
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to read board #%d counters (%s)\n",
+	    board, omx_strerror(ret));
+    return -1;
+  }
+
+  *valuep = values[index];
+  return 0;
+}
+
+static int
+init_with_rail(int rail)
+{
+  static char rails_env[32];
+  omx_return_t ret;
+
+  snprintf(rails_env, sizeof(rails_env), "OMX_RAILS=%d", rail);
+  putenv(rails_env);
+  /* shared communication would bypass the boards */
+  putenv("OMX_DISABLE_SHARED=1");
+
+  ret = omx_init();
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to initialize (%s)\n",
+	    omx_strerror(ret));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+sender(int pipefd, int board, int rail, int peer_board, int length)
+{
+  omx_endpoint_t ep;
+  omx_endpoint_addr_t addr;
+  omx_request_t req;
+  omx_status_t status;
+  omx_return_t ret;
+  uint64_t peer_nic_id;
+  uint32_t result;
+  char *buffer;
+  char c;
+  int i;
+
+  if (init_with_rail(rail) < 0)
+    goto out;
+
+  buffer = malloc(length);
+  if (!buffer)
+    goto out;
+  for(i=0; i<length; i++)
+    buffer[i] = i%26+'a';
+
+  ret = omx_open_endpoint(board, PEER_EID, KEY, NULL, 0, &ep);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to open sender endpoint (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_buffer;
+  }
+
+  ret = omx_board_number_to_nic_id(peer_board, &peer_nic_id);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to find board %d nic id (%s)\n",
+	    peer_board, omx_strerror(ret));
+    goto out_with_ep;
+  }
+
+  /* wait for the receiver endpoint to be open */
+  if (read(pipefd, &c, 1) != 1)
+    goto out_with_ep;
+
+  ret = omx_connect(ep, peer_nic_id, EID, KEY, OMX_TIMEOUT_INFINITE, &addr);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to connect to the receiver (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_ep;
+  }
+
+  for(i=0; i<ITER; i++) {
+    ret = omx_isend(ep, buffer, length, addr, MATCH, NULL, &req);
+    if (ret != OMX_SUCCESS) {
+      fprintf(stderr, "Failed to send message length %d (%s)\n",
+	      length, omx_strerror(ret));
+      goto out_with_ep;
+    }
+
+    ret = omx_wait(ep, &req, &status, &result, OMX_TIMEOUT_INFINITE);
+    if (ret != OMX_SUCCESS || !result || status.code != OMX_SUCCESS) {
+      fprintf(stderr, "Failed to complete send (%s)\n",
+	      omx_strerror(ret != OMX_SUCCESS ? ret : status.code));
+      goto out_with_ep;
+    }
+  }
+
+  omx_close_endpoint(ep);
+  free(buffer);
+  return 0;
+
+ out_with_ep:
+  omx_close_endpoint(ep);
+ out_with_buffer:
+  free(buffer);
+ out:
+  return -1;
+}
+
+static int
+receiver(int pipefd, int board, int length)
+{
+  omx_endpoint_t ep;
+  omx_request_t req;
+  omx_status_t status;
+  omx_return_t ret;
+  uint32_t result;
+  char *buffer;
+  int i, j;
+
+  buffer = malloc(length);
+  if (!buffer)
+    goto out;
+
+  ret = omx_open_endpoint(board, EID, KEY, NULL, 0, &ep);
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to open receiver endpoint (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_buffer;
+  }
+
+  /* let the sender connect */
+  if (write(pipefd, "", 1) != 1)
+    goto out_with_ep;
+
+  for(i=0; i<ITER; i++) {
+    memset(buffer, 0, length);
+
+    ret = omx_irecv(ep, buffer, length, 0, 0, NULL, &req);
+    if (ret != OMX_SUCCESS) {
+      fprintf(stderr, "Failed to post a recv (%s)\n",
+	      omx_strerror(ret));
+      goto out_with_ep;
+    }
+
+    ret = omx_wait(ep, &req, &status, &result, OMX_TIMEOUT_INFINITE);
+    if (ret != OMX_SUCCESS || !result || status.code != OMX_SUCCESS) {
+      fprintf(stderr, "Failed to complete recv (%s)\n",
+	      omx_strerror(ret != OMX_SUCCESS ? ret : status.code));
+      goto out_with_ep;
+    }
+
+    if (status.xfer_length != (uint32_t) length) {
+      fprintf(stderr, "Received %ld bytes instead of %d\n",
+	      (unsigned long) status.xfer_length, length);
+      goto out_with_ep;
+    }
+
+    for(j=0; j<length; j++)
+      if (buffer[j] != j%26+'a') {
+	fprintf(stderr, "buffer invalid at offset %d, got '%c' instead of '%c'\n",
+		j, buffer[j], j%26+'a');
+	goto out_with_ep;
+      }
+
+    if (verbose)
+      printf("Received message #%d of %d bytes\n", i, length);
+  }
+
+  omx_close_endpoint(ep);
+  free(buffer);
+  return 0;
+
+ out_with_ep:
+  omx_close_endpoint(ep);
+ out_with_buffer:
+  free(buffer);
+ out:
+  return -1;
+}
+
+static void
+usage(int argc, char *argv[])
+{
+  fprintf(stderr, "%s [options]\n", argv[0]);
+  fprintf(stderr, " -b <n>\tchange the receiver board id [%d]\n", BID);
+  fprintf(stderr, " -r <n>\tchange the receiver rail board id [%d]\n", RAIL);
+  fprintf(stderr, " -B <n>\tchange the sender board id [%d]\n", PEER_BID);
+  fprintf(stderr, " -R <n>\tchange the sender rail board id [%d]\n", PEER_RAIL);
+  fprintf(stderr, " -l <n>\tchange the message length [%d]\n", LENGTH);
+  fprintf(stderr, " -v\tenable verbose messages\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int boards[4] = { BID, RAIL, PEER_BID, PEER_RAIL };
+  const char *board_names[4] = { "receiver", "receiver rail", "sender", "sender rail" };
+  uint32_t before[4][2], after[4][2];
+  int counters[2];
+  int length = LENGTH;
+  int pipefds[2];
+  pid_t pid;
+  int status;
+  int c;
+  int i, j;
+  int err = 0;
+  omx_return_t ret;
+
+  while ((c = getopt(argc, argv, "b:r:B:R:l:vh")) != -1)
+    switch (c) {
+    case 'b':
+      boards[0] = atoi(optarg);
+      break;
+    case 'r':
+      boards[1] = atoi(optarg);
+      break;
+    case 'B':
+      boards[2] = atoi(optarg);
+      break;
+    case 'R':
+      boards[3] = atoi(optarg);
+      break;
+    case 'l':
+      length = atoi(optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      fprintf(stderr, "Unknown option -%c\n", c);
+    case 'h':
+      usage(argc, argv);
+      exit(-1);
+      break;
+    }
+
+  if (pipe(pipefds) < 0) {
+    perror("pipe");
+    return -1;
+  }
+
+  /* OMX_RAILS is read by omx_init(), fork before it */
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (!pid) {
+    close(pipefds[1]);
+    exit(sender(pipefds[0], boards[2], boards[3], boards[0], length) < 0 ? 1 : 0);
+  }
+  close(pipefds[0]);
+
+  if (init_with_rail(boards[1]) < 0)
+    goto out_with_child;
+
+  for(i=0; i<4; i++) {
+    uint64_t nic_id;
+    if (omx_board_number_to_nic_id(boards[i], &nic_id) != OMX_SUCCESS) {
+      fprintf(stderr, "No %s board #%d, skipping\n", board_names[i], boards[i]);
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      return 77;
+    }
+  }
+
+  ret = omx_get_info(NULL, OMX_INFO_COUNTER_MAX, NULL, 0,
+		     &counter_max, sizeof(counter_max));
+  if (ret != OMX_SUCCESS) {
+    fprintf(stderr, "Failed to get the number of counters (%s)\n",
+	    omx_strerror(ret));
+    goto out_with_child;
+  }
+  counters[0] = find_counter(SEND_PULL_REQ_LABEL);
+  counters[1] = find_counter(SEND_PULL_REPLY_LABEL);
+  if (counters[0] < 0 || counters[1] < 0) {
+    fprintf(stderr, "Failed to find the pull counters\n");
+    goto out_with_child;
+  }
+
+  for(i=0; i<4; i++)
+    for(j=0; j<2; j++)
+      if (read_counter(boards[i], counters[j], &before[i][j]) < 0)
+	goto out_with_child;
+
+  if (receiver(pipefds[1], boards[0], length) < 0)
+    goto out_with_child;
+
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+    fprintf(stderr, "Sender failed\n");
+    goto out;
+  }
+
+  for(i=0; i<4; i++)
+    for(j=0; j<2; j++)
+      if (read_counter(boards[i], counters[j], &after[i][j]) < 0)
+	goto out;
+
+  /* the receiver boards pull, the sender boards reply */
+  for(i=0; i<4; i++) {
+    int puller = i < 2;
+    uint32_t delta = after[i][puller ? 0 : 1] - before[i][puller ? 0 : 1];
+
+    printf("%s board #%d: %ld %s\n", board_names[i], boards[i],
+	   (unsigned long) delta, puller ? SEND_PULL_REQ_LABEL : SEND_PULL_REPLY_LABEL);
+    if (!delta) {
+      fprintf(stderr, "No pull went through the %s board #%d\n", board_names[i], boards[i]);
+      err = -1;
+    }
+  }
+
+  omx_finalize();
+  return err;
+
+ out_with_child:
+  close(pipefds[1]);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+ out:
+  return -1;
+}
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
 
@@ -34,17 +35,38 @@ usage(int argc, char *argv[])
   fprintf(stderr, " -c\tclear counters\n");
   fprintf(stderr, " -q\tonly display non-null counters [default]\n");
   fprintf(stderr, " -v\talso display null counters\n");
+  fprintf(stderr, " -i <n>\tdisplay counter rates per second over <n> seconds\n");
+}
+
+static int
+read_counters(uint32_t board_index, int clear, uint32_t *counters)
+{
+  struct omx_cmd_get_counters get_counters;
+  int err;
+
+  get_counters.board_index = board_index;
+  get_counters.clear = clear;
+  get_counters.buffer_addr = (uintptr_t) counters;
+  get_counters.buffer_length = OMX_COUNTER_INDEX_MAX * sizeof(*counters);
+  err = ioctl(omx__globals.control_fd, OMX_CMD_GET_COUNTERS, &get_counters);
+  if (err < 0) {
+    if (clear && errno == EPERM)
+      perror("Clearing counters");
+    return -1;
+  }
+  OMX_VALGRIND_MEMORY_MAKE_READABLE(counters, OMX_COUNTER_INDEX_MAX * sizeof(*counters));
+  return 0;
 }
 
 static void
-do_one_board(uint32_t board_index, int strict, int clear, int verbose)
+do_one_board(uint32_t board_index, int strict, int clear, int verbose, int interval)
 {
   struct omx_board_info board_info;
   char board_addr_str[OMX_BOARD_ADDR_STRLEN];
   uint32_t counters[OMX_COUNTER_INDEX_MAX];
-  struct omx_cmd_get_counters get_counters;
+  uint32_t old_counters[OMX_COUNTER_INDEX_MAX];
   omx_return_t ret;
-  int i, err;
+  int i;
 
   /* get the board id */
   ret = omx__get_board_info(NULL, board_index, &board_info);
@@ -54,17 +76,16 @@ do_one_board(uint32_t board_index, int strict, int clear, int verbose)
     return;
   }
   omx__board_addr_sprintf(board_addr_str, board_info.addr);
-  get_counters.board_index = board_index;
-  get_counters.clear = clear;
-  get_counters.buffer_addr = (uintptr_t) counters;
-  get_counters.buffer_length = sizeof(counters);
-  err = ioctl(omx__globals.control_fd, OMX_CMD_GET_COUNTERS, &get_counters);
-  if (err < 0) {
-    if (clear && errno == EPERM)
-      perror("Clearing counters");
-    return;
+
+  if (interval) {
+    /* sample twice and only report the difference */
+    if (read_counters(board_index, 0, old_counters) < 0)
+      return;
+    sleep(interval);
   }
-  OMX_VALGRIND_MEMORY_MAKE_READABLE(counters, sizeof(counters));
+
+  if (read_counters(board_index, clear, counters) < 0)
+    return;
 
   if (board_index == OMX_SHARED_FAKE_IFACE_INDEX)
     printf("%s (addr %s)\n",
@@ -74,9 +95,16 @@ do_one_board(uint32_t board_index, int strict, int clear, int verbose)
 	   board_info.hostname, board_index, board_info.ifacename, board_addr_str);
   printf("=======================================================\n");
 
-  for(i=0; i<OMX_COUNTER_INDEX_MAX; i++)
-    if (counters[i] || verbose)
-      printf("%03d: % 9ld %s\n", i, (unsigned long) counters[i], omx_strcounter(i));
+  for(i=0; i<OMX_COUNTER_INDEX_MAX; i++) {
+    if (interval) {
+      uint32_t diff = counters[i] - old_counters[i];
+      if (diff || verbose)
+	printf("%03d: % 9ld/s %s\n", i, (unsigned long) (diff / interval), omx_strcounter(i));
+    } else {
+      if (counters[i] || verbose)
+	printf("%03d: % 9ld %s\n", i, (unsigned long) counters[i], omx_strcounter(i));
+    }
+  }
 
   printf("\n");
 }
@@ -87,9 +115,10 @@ int main(int argc, char *argv[])
   omx_return_t ret;
   int clear = 0;
   int verbose = 0;
+  int interval = 0;
   int c;
 
-  while ((c = getopt(argc, argv, "b:ascqvh")) != -1)
+  while ((c = getopt(argc, argv, "b:ascqvi:h")) != -1)
     switch (c) {
     case 'b':
       board_index = atoi(optarg);
@@ -109,6 +138,9 @@ int main(int argc, char *argv[])
     case 'v':
       verbose = 1;
       break;
+    case 'i':
+      interval = atoi(optarg);
+      break;
     default:
       fprintf(stderr, "Unknown option -%c\n", c);
     case 'h':
@@ -125,11 +157,11 @@ int main(int argc, char *argv[])
   }
 
   if (board_index == OMX_ANY_NIC) {
-    do_one_board(OMX_SHARED_FAKE_IFACE_INDEX, 1, clear, verbose);
+    do_one_board(OMX_SHARED_FAKE_IFACE_INDEX, 1, clear, verbose, interval);
     for(board_index=0; board_index<omx__driver_desc->board_max; board_index++)
-      do_one_board(board_index, 0, clear, verbose);
+      do_one_board(board_index, 0, clear, verbose, interval);
   } else {
-    do_one_board(board_index, 1, clear, verbose);
+    do_one_board(board_index, 1, clear, verbose, interval);
   }
 
   return 0;